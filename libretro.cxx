@@ -14,12 +14,14 @@
 #include <libretro.h>
 #include <streams/file_stream.h>
 #include "libretro_core_options.h"
+#include "libretro_ext.h"
 
 #include "Console.hxx"
 #include "Cart.hxx"
 #include "Props.hxx"
 #include "MD5.hxx"
 #include "Sound.hxx"
+#include "AudioEventQueue.hxx"
 #include "SerialPort.hxx"
 #include "TIA.hxx"
 #include "Switches.hxx"
@@ -284,9 +286,25 @@ static const int32_t stelladaptor_analog_sense_table
 static int32_t stelladaptor_analog_sensitivity = 0x10000;
 static int32_t stelladaptor_analog_center      = 0;
 
-/* Low pass audio filter */
-static bool low_pass_enabled       = false;
-static int32_t low_pass_range      = 0;
+/* Audio timing: generate the samples inline at each TIA register write,
+ * locked to the CPU clock, instead of replaying the frame's writes over
+ * a fixed number of samples when it ends */
+static bool audio_inline = false;
+
+/* High-resolution ARM music: CDF, BUS and DPC+ carts render what their
+ * music fetchers play on the TIA's sample clock, and Sound plays that
+ * instead of the AUDV writes the game copies it into (see
+ * Sound::setMusicSource()). Needs the cart on the emulation thread, so
+ * not with threaded audio. */
+static bool arm_music_wanted = false;  /* core option */
+static bool arm_music        = false;  /* in use for the loaded game */
+
+/* Low pass audio filter. check_variables() sets it on the emulation
+ * thread while the audio callback may be filtering on its own (see
+ * below), so the switch and the range share one word, stored and read
+ * whole with AEQ_STORE_RELEASE()/AEQ_LOAD_ACQUIRE(). */
+#define LOW_PASS_ENABLED   0x80000000u  /* above the range, 0 - 0x10000 */
+static uint32_t low_pass_setting   = 0;
 static int32_t low_pass_left_prev  = 0;
 static int32_t low_pass_right_prev = 0;
 
@@ -306,8 +324,12 @@ static int32_t dc_block_x_prev_l = 0;
 static int32_t dc_block_y_prev_l = 0;
 static int32_t dc_block_x_prev_r = 0;
 static int32_t dc_block_y_prev_r = 0;
-/* R in 16.16 fixed point: 20 Hz cutoff at the 31.4 kHz TIA sample rate. */
-#define DC_BLOCK_R 65274
+/* R in 16.16 fixed point: 20 Hz cutoff at the 31.4 kHz TIA sample rate,
+ * and at the rates the resampler below can output (R = 1 - 2*pi*20/fs). */
+#define DC_BLOCK_R       65274
+#define DC_BLOCK_R_44100 65349
+#define DC_BLOCK_R_48000 65364
+static int32_t dc_block_r = DC_BLOCK_R;
 
 static retro_log_printf_t log_cb;
 static retro_video_refresh_t video_cb;
@@ -631,29 +653,74 @@ static void dc_block_reset(void)
    dc_block_x_prev_r = dc_block_y_prev_r = 0;
 }
 
-/* On vectorisation:
- * A one-pole high-pass is a feedback recurrence --
+/************************************
+ * Output filters
+ ************************************/
+
+/* The DC blocker and the optional low-pass filter run in one pass over
+ * the output, each sample going through both before it is stored.
+ *
+ * On vectorisation:
+ * Both are one-pole feedback recurrences --
  *   y[n] = x[n] - x[n-1] + R*y[n-1]
  * -- so y[n] depends on y[n-1] and the loop cannot be vectorised along
  * the sample axis (SSE2/NEON parallelise independent lanes, not a serial
- * dependency chain). The only independent axis is the two channels, but
- * for the TIA they are identical (mono duplicated into L and R), so a
- * 2-lane SIMD step would compute the same value twice for no gain over
- * the scalar path -- and the load/store shuffle per sample would very
- * likely be slower than the handful of scalar integer ops here. There is
- * therefore no useful SSE2/NEON form of this filter; the scalar loop is
- * the right implementation. (A block-parallel scan reformulation exists in
- * theory but is far more complex and pointless at ~525 samples/frame.)
- * The filter is off the hot path regardless: it runs once over the ~525
- * samples of a frame, dwarfed by TIA emulation. */
-static void apply_dc_block_filter(int16_t *buf, int frames)
+ * dependency chain). The only independent axis is the two channels, and
+ * unless the cartridge is STEREO they are identical, so the mono form
+ * filters one channel and stores it to both instead. There is therefore
+ * no useful SSE2/NEON form of this pass; the scalar loop is the right
+ * implementation. (A block-parallel scan reformulation exists in theory
+ * but is far more complex and pointless at ~525 samples/frame.) */
+static void filter_audio_mono(int16_t *buf, uint32_t frames)
+{
+   int32_t x_prev   = dc_block_x_prev_l, y_prev = dc_block_y_prev_l;
+   int32_t low_pass = low_pass_left_prev;
+   uint32_t setting = AEQ_LOAD_ACQUIRE(&low_pass_setting);
+   int32_t factor_a = (int32_t)(setting & ~LOW_PASS_ENABLED);
+   int32_t factor_b = 0x10000 - factor_a;
+   bool filter      = (setting & LOW_PASS_ENABLED) != 0;
+   uint32_t i;
+
+   for (i = 0; i < frames; i++)
+   {
+      int32_t x = buf[2*i];
+      /* R*y_prev in 64-bit to avoid the ~31-bit product overflowing. */
+      int32_t y = (int32_t)(x - x_prev +
+                   (((int64_t)dc_block_r * y_prev) >> 16));
+
+      /* Clamp to int16 range before the low-pass filter. */
+      if (y >  32767) y =  32767; else if (y < -32768) y = -32768;
+      x_prev = x; y_prev = y;
+
+      if (filter)
+      {
+         low_pass = ((low_pass * factor_a) + (y * factor_b)) >> 16;
+         y        = low_pass;
+      }
+
+      /* Converted to stereo by duplicating the channel */
+      buf[2*i]     = (int16_t)y;
+      buf[2*i + 1] = (int16_t)y;
+   }
+
+   /* The right channel's blocker state is kept equal to the left's, as
+    * filtering it separately would leave it */
+   dc_block_x_prev_l = dc_block_x_prev_r = x_prev;
+   dc_block_y_prev_l = dc_block_y_prev_r = y_prev;
+   low_pass_left_prev = low_pass;
+}
+
+static void filter_audio_stereo(int16_t *buf, uint32_t frames)
 {
    int32_t xl_prev = dc_block_x_prev_l, yl_prev = dc_block_y_prev_l;
    int32_t xr_prev = dc_block_x_prev_r, yr_prev = dc_block_y_prev_r;
-   int i;
-
-   if (frames <= 0)
-      return;
+   int32_t low_pass_left  = low_pass_left_prev;
+   int32_t low_pass_right = low_pass_right_prev;
+   uint32_t setting       = AEQ_LOAD_ACQUIRE(&low_pass_setting);
+   int32_t factor_a       = (int32_t)(setting & ~LOW_PASS_ENABLED);
+   int32_t factor_b       = 0x10000 - factor_a;
+   bool filter            = (setting & LOW_PASS_ENABLED) != 0;
+   uint32_t i;
 
    for (i = 0; i < frames; i++)
    {
@@ -661,96 +728,402 @@ static void apply_dc_block_filter(int16_t *buf, int frames)
       int32_t xr = buf[2*i + 1];
       /* R*y_prev in 64-bit to avoid the ~31-bit product overflowing. */
       int32_t yl = (int32_t)(xl - xl_prev +
-                    (((int64_t)DC_BLOCK_R * yl_prev) >> 16));
+                    (((int64_t)dc_block_r * yl_prev) >> 16));
       int32_t yr = (int32_t)(xr - xr_prev +
-                    (((int64_t)DC_BLOCK_R * yr_prev) >> 16));
+                    (((int64_t)dc_block_r * yr_prev) >> 16));
 
-      /* Clamp to int16 range before storing. */
+      /* Clamp to int16 range before the low-pass filter. */
       if (yl >  32767) yl =  32767; else if (yl < -32768) yl = -32768;
       if (yr >  32767) yr =  32767; else if (yr < -32768) yr = -32768;
+      xl_prev = xl; yl_prev = yl;
+      xr_prev = xr; yr_prev = yr;
+
+      if (filter)
+      {
+         low_pass_left  = ((low_pass_left  * factor_a) + (yl * factor_b)) >> 16;
+         low_pass_right = ((low_pass_right * factor_a) + (yr * factor_b)) >> 16;
+         yl = low_pass_left;
+         yr = low_pass_right;
+      }
 
       buf[2*i]     = (int16_t)yl;
       buf[2*i + 1] = (int16_t)yr;
-
-      xl_prev = xl; yl_prev = yl;
-      xr_prev = xr; yr_prev = yr;
    }
 
    dc_block_x_prev_l = xl_prev; dc_block_y_prev_l = yl_prev;
    dc_block_x_prev_r = xr_prev; dc_block_y_prev_r = yr_prev;
+   low_pass_left_prev  = low_pass_left;
+   low_pass_right_prev = low_pass_right;
 }
 
+/* Selected when a game is loaded, by whether its cartridge is STEREO */
+static void (*filter_audio)(int16_t *buf, uint32_t frames) = filter_audio_mono;
+
 /************************************
- * Low pass audio filter
+ * Band-limited resampler
  ************************************/
 
-static void apply_low_pass_filter_mono(int16_t *buf, int length)
+/* Optional conversion of the 31400 Hz TIA stream to 44.1/48 kHz in the
+ * core, so the frontend doesn't have to run a generic resampler on top.
+ *
+ * The TIA output is piecewise constant, so rather than filtering every
+ * input sample, each change of level is added to the output as a
+ * band-limited step (BLEP): the derivative of a windowed-sinc step, i.e.
+ * a windowed-sinc impulse scaled by the size of the change, goes into a
+ * delta buffer, and the output is the running sum of that buffer. The
+ * cost is per level change, not per sample, and silence or a held level
+ * costs nothing but the running sum.
+ *
+ * The kernel is 16 taps, cut off at 0.45 of the output rate (Blackman
+ * window), in 64 sub-sample phases. Because it is expressed in output
+ * samples it is the same for every output rate, so it is precomputed
+ * here in fixed point, each phase summing to exactly 1 << 14; a level
+ * change therefore settles to exactly the new level and the running sum
+ * never drifts. All arithmetic is integer, so the output is bit-identical
+ * on every platform. Output lags input by 8 output samples.
+ *
+ * On SIMD: the 16-tap add per level change is a plain loop the compiler
+ * vectorises where it helps, and level changes are rare next to output
+ * samples (a few hundred per frame at most), so there is no hot loop
+ * worth hand-written SSE2/NEON. */
+#define BLEP_TAPS        16
+#define BLEP_PHASES      64
+#define BLEP_UNIT_SHIFT  14
+/* 1024 TIA samples (the most a fragment holds) at 48 kHz are 1566 output
+ * samples */
+#define BLEP_MAX_OUT     1600
+
+static const int16_t blep_kernel[BLEP_PHASES][BLEP_TAPS] = {
+   {     9,   -55,   180,  -422,   780, -1186,  1513, 14746,  1513, -1186,   780,  -422,   180,   -55,     9,     0 },
+   {     9,   -55,   177,  -410,   746, -1099,  1283, 14741,  1747, -1272,   814,  -433,   182,   -55,     9,     0 },
+   {     9,   -54,   173,  -397,   711, -1013,  1058, 14725,  1987, -1357,   847,  -443,   184,   -55,     9,     0 },
+   {     9,   -53,   170,  -385,   675,  -926,   839, 14701,  2231, -1442,   878,  -453,   186,   -55,     9,     0 },
+   {     8,   -53,   166,  -371,   638,  -840,   626, 14666,  2480, -1525,   909,  -462,   188,   -55,     9,     0 },
+   {     8,   -52,   162,  -357,   601,  -753,   418, 14622,  2733, -1608,   938,  -471,   189,   -55,     9,     0 },
+   {     8,   -51,   158,  -343,   564,  -668,   217, 14567,  2990, -1689,   966,  -478,   190,   -55,     8,     0 },
+   {     8,   -50,   153,  -329,   526,  -583,    21, 14503,  3251, -1768,   993,  -485,   190,   -54,     8,     0 },
+   {     8,   -49,   148,  -314,   488,  -498,  -168, 14428,  3515, -1846,  1018,  -491,   190,   -53,     8,     0 },
+   {     8,   -48,   144,  -298,   450,  -415,  -351, 14341,  3783, -1922,  1042,  -496,   190,   -52,     8,     0 },
+   {     7,   -46,   139,  -283,   412,  -333,  -527, 14250,  4053, -1996,  1063,  -500,   189,   -51,     7,     0 },
+   {     7,   -45,   133,  -267,   374,  -251,  -697, 14145,  4326, -2067,  1084,  -503,   188,   -50,     7,     0 },
+   {     7,   -44,   128,  -252,   336,  -172,  -861, 14036,  4602, -2136,  1102,  -505,   186,   -49,     6,     0 },
+   {     7,   -42,   123,  -236,   298,   -93, -1017, 13913,  4879, -2203,  1118,  -506,   184,   -47,     6,     0 },
+   {     6,   -41,   117,  -220,   261,   -17, -1167, 13783,  5159, -2266,  1133,  -505,   181,   -45,     5,     0 },
+   {     6,   -39,   111,  -204,   224,    58, -1310, 13643,  5440, -2326,  1145,  -504,   178,   -43,     5,     0 },
+   {     6,   -38,   106,  -188,   187,   131, -1446, 13495,  5722, -2382,  1156,  -502,   174,   -41,     4,     0 },
+   {     5,   -36,   100,  -172,   150,   202, -1575, 13340,  6005, -2436,  1164,  -498,   170,   -39,     4,     0 },
+   {     5,   -35,    94,  -156,   115,   272, -1697, 13176,  6288, -2485,  1170,  -494,   165,   -37,     3,     0 },
+   {     5,   -33,    88,  -140,    79,   339, -1812, 13004,  6572, -2531,  1173,  -488,   160,   -34,     2,     0 },
+   {     5,   -31,    82,  -124,    45,   403, -1920, 12823,  6856, -2572,  1174,  -481,   154,   -31,     1,     0 },
+   {     4,   -30,    77,  -108,    11,   466, -2021, 12634,  7140, -2609,  1173,  -473,   148,   -28,     0,     0 },
+   {     4,   -28,    71,   -93,   -22,   526, -2115, 12439,  7423, -2642,  1169,  -463,   141,   -25,    -1,     0 },
+   {     4,   -27,    65,   -78,   -54,   584, -2202, 12237,  7704, -2670,  1163,  -452,   133,   -21,    -2,     0 },
+   {     4,   -25,    59,   -63,   -86,   639, -2283, 12027,  7985, -2693,  1154,  -440,   126,   -18,    -3,     1 },
+   {     3,   -23,    54,   -48,  -116,   691, -2356, 11811,  8264, -2711,  1142,  -427,   117,   -14,    -4,     1 },
+   {     3,   -22,    48,   -34,  -145,   741, -2423, 11591,  8540, -2724,  1128,  -413,   108,   -10,    -5,     1 },
+   {     3,   -20,    43,   -20,  -174,   789, -2483, 11360,  8815, -2731,  1111,  -397,    99,    -6,    -6,     1 },
+   {     3,   -19,    37,    -6,  -201,   833, -2536, 11128,  9087, -2734,  1091,  -380,    89,    -2,    -7,     1 },
+   {     2,   -17,    32,     7,  -228,   875, -2583, 10891,  9356, -2730,  1068,  -362,    79,     2,    -9,     1 },
+   {     2,   -16,    27,    20,  -253,   914, -2623, 10647,  9621, -2721,  1043,  -343,    68,     7,   -10,     1 },
+   {     2,   -14,    22,    33,  -277,   951, -2657, 10393,  9883, -2705,  1015,  -322,    57,    12,   -11,     2 },
+   {     2,   -13,    17,    45,  -300,   984, -2684, 10141, 10141, -2684,   984,  -300,    45,    17,   -13,     2 },
+   {     2,   -11,    12,    57,  -322,  1015, -2705,  9883, 10393, -2657,   951,  -277,    33,    22,   -14,     2 },
+   {     1,   -10,     7,    68,  -343,  1043, -2721,  9621, 10647, -2623,   914,  -253,    20,    27,   -16,     2 },
+   {     1,    -9,     2,    79,  -362,  1068, -2730,  9356, 10891, -2583,   875,  -228,     7,    32,   -17,     2 },
+   {     1,    -7,    -2,    89,  -380,  1091, -2734,  9087, 11128, -2536,   833,  -201,    -6,    37,   -19,     3 },
+   {     1,    -6,    -6,    99,  -397,  1111, -2731,  8815, 11360, -2483,   789,  -174,   -20,    43,   -20,     3 },
+   {     1,    -5,   -10,   108,  -413,  1128, -2724,  8540, 11591, -2423,   741,  -145,   -34,    48,   -22,     3 },
+   {     1,    -4,   -14,   117,  -427,  1142, -2711,  8264, 11811, -2356,   691,  -116,   -48,    54,   -23,     3 },
+   {     1,    -3,   -18,   126,  -440,  1154, -2693,  7985, 12027, -2283,   639,   -86,   -63,    59,   -25,     4 },
+   {     0,    -2,   -21,   133,  -452,  1163, -2670,  7704, 12237, -2202,   584,   -54,   -78,    65,   -27,     4 },
+   {     0,    -1,   -25,   141,  -463,  1169, -2642,  7423, 12439, -2115,   526,   -22,   -93,    71,   -28,     4 },
+   {     0,     0,   -28,   148,  -473,  1173, -2609,  7140, 12634, -2021,   466,    11,  -108,    77,   -30,     4 },
+   {     0,     1,   -31,   154,  -481,  1174, -2572,  6856, 12823, -1920,   403,    45,  -124,    82,   -31,     5 },
+   {     0,     2,   -34,   160,  -488,  1173, -2531,  6572, 13004, -1812,   339,    79,  -140,    88,   -33,     5 },
+   {     0,     3,   -37,   165,  -494,  1170, -2485,  6288, 13176, -1697,   272,   115,  -156,    94,   -35,     5 },
+   {     0,     4,   -39,   170,  -498,  1164, -2436,  6005, 13340, -1575,   202,   150,  -172,   100,   -36,     5 },
+   {     0,     4,   -41,   174,  -502,  1156, -2382,  5722, 13495, -1446,   131,   187,  -188,   106,   -38,     6 },
+   {     0,     5,   -43,   178,  -504,  1145, -2326,  5440, 13643, -1310,    58,   224,  -204,   111,   -39,     6 },
+   {     0,     5,   -45,   181,  -505,  1133, -2266,  5159, 13783, -1167,   -17,   261,  -220,   117,   -41,     6 },
+   {     0,     6,   -47,   184,  -506,  1118, -2203,  4879, 13913, -1017,   -93,   298,  -236,   123,   -42,     7 },
+   {     0,     6,   -49,   186,  -505,  1102, -2136,  4602, 14036,  -861,  -172,   336,  -252,   128,   -44,     7 },
+   {     0,     7,   -50,   188,  -503,  1084, -2067,  4326, 14145,  -697,  -251,   374,  -267,   133,   -45,     7 },
+   {     0,     7,   -51,   189,  -500,  1063, -1996,  4053, 14250,  -527,  -333,   412,  -283,   139,   -46,     7 },
+   {     0,     8,   -52,   190,  -496,  1042, -1922,  3783, 14341,  -351,  -415,   450,  -298,   144,   -48,     8 },
+   {     0,     8,   -53,   190,  -491,  1018, -1846,  3515, 14428,  -168,  -498,   488,  -314,   148,   -49,     8 },
+   {     0,     8,   -54,   190,  -485,   993, -1768,  3251, 14503,    21,  -583,   526,  -329,   153,   -50,     8 },
+   {     0,     8,   -55,   190,  -478,   966, -1689,  2990, 14567,   217,  -668,   564,  -343,   158,   -51,     8 },
+   {     0,     9,   -55,   189,  -471,   938, -1608,  2733, 14622,   418,  -753,   601,  -357,   162,   -52,     8 },
+   {     0,     9,   -55,   188,  -462,   909, -1525,  2480, 14666,   626,  -840,   638,  -371,   166,   -53,     8 },
+   {     0,     9,   -55,   186,  -453,   878, -1442,  2231, 14701,   839,  -926,   675,  -385,   170,   -53,     9 },
+   {     0,     9,   -55,   184,  -443,   847, -1357,  1987, 14725,  1058, -1013,   711,  -397,   173,   -54,     9 },
+   {     0,     9,   -55,   182,  -433,   814, -1272,  1747, 14741,  1283, -1099,   746,  -410,   177,   -55,     9 },
+};
+
+static unsigned blep_rate = 0;      /* output rate, 0 when disabled */
+static uint32_t blep_in_step  = 0;  /* input sample period, in time units */
+static uint32_t blep_out_step = 0;  /* output sample period, in time units */
+static uint32_t blep_pos      = 0;  /* time of the next input sample,
+                                       relative to blep_buf[.][0] */
+static int32_t blep_last[2];        /* last input level per channel */
+static int32_t blep_integ[2];       /* running sum, level << 14 */
+static int32_t blep_buf[2][BLEP_MAX_OUT + BLEP_TAPS];
+static int16_t resampleBuffer[2 * BLEP_MAX_OUT];
+
+static void blep_reset(void)
 {
-   int samples      = length;
-   int16_t *out     = buf;
+   blep_pos = 0;
+   blep_last[0] = blep_last[1] = 0;
+   blep_integ[0] = blep_integ[1] = 0;
+   memset(blep_buf, 0, sizeof(blep_buf));
+}
 
-   /* Restore previous sample */
-   int32_t low_pass = low_pass_left_prev;
+/* Select the output rate (0 to disable) and reset the resampler */
+static void blep_init(unsigned rate)
+{
+   unsigned a = 31400, b = rate;
 
-   /* Single-pole low-pass filter (6 dB/octave) */
-   int32_t factor_a = low_pass_range;
-   int32_t factor_b = 0x10000 - factor_a;
+   blep_rate = rate;
+   if (rate)
+   {
+      /* Time unit: 1/gcd(31400, rate) of a second */
+      while (b)
+      {
+         unsigned t = a % b;
+         a = b;
+         b = t;
+      }
+      blep_in_step  = rate / a;
+      blep_out_step = 31400 / a;
+   }
+
+   dc_block_r = rate == 48000 ? DC_BLOCK_R_48000 :
+                rate == 44100 ? DC_BLOCK_R_44100 : DC_BLOCK_R;
+   blep_reset();
+}
+
+/* Resample 'samples' stereo TIA samples into 'out', which must hold
+ * BLEP_MAX_OUT stereo samples. Returns the number of samples written. */
+static uint32_t blep_resample(const int16_t *in, uint32_t samples,
+      int16_t *out)
+{
+   uint32_t count, i, m;
+   int c;
 
-   do
+   for (i = 0; i < samples; i++, in += 2, blep_pos += blep_in_step)
    {
-      /* Apply low-pass filter */
-      low_pass = (low_pass * factor_a) + (*out * factor_b);
+      uint32_t slot  = blep_pos / blep_out_step;
+      uint32_t phase = (blep_pos % blep_out_step) * BLEP_PHASES /
+                       blep_out_step;
+
+      for (c = 0; c < 2; c++)
+      {
+         int32_t delta = in[c] - blep_last[c];
+         int32_t *buf;
+         int j;
 
-      /* 16.16 fixed point */
-      low_pass >>= 16;
+         if (!delta)
+            continue;
 
-      /* Update sound buffer
-       * > Converted to stereo by duplicating
-       *   the left/right channels */
-      *out++   = (int16_t)low_pass;
-      *out++   = (int16_t)low_pass;
+         buf = blep_buf[c] + slot;
+         for (j = 0; j < BLEP_TAPS; j++)
+            buf[j] += delta * blep_kernel[phase][j];
+         blep_last[c] = in[c];
+      }
    }
-   while (--samples);
 
-   /* Save last sample for next frame */
-   low_pass_left_prev = low_pass;
+   /* Every slot before the next input sample's is complete */
+   count = blep_pos / blep_out_step;
+   for (m = 0; m < count; m++)
+   {
+      for (c = 0; c < 2; c++)
+      {
+         int32_t sample;
+
+         blep_integ[c] += blep_buf[c][m];
+         sample = (blep_integ[c] + (1 << (BLEP_UNIT_SHIFT - 1))) >>
+                  BLEP_UNIT_SHIFT;
+         *out++ = (int16_t)(sample > 32767 ? 32767 :
+                            sample < -32768 ? -32768 : sample);
+      }
+   }
+
+   /* Move the kernels still in progress to the front */
+   for (c = 0; c < 2; c++)
+   {
+      memmove(blep_buf[c], blep_buf[c] + count,
+            BLEP_TAPS * sizeof(int32_t));
+      memset(blep_buf[c] + BLEP_TAPS, 0, count * sizeof(int32_t));
+   }
+   blep_pos -= count * blep_out_step;
+
+   return count;
 }
 
-static void apply_low_pass_filter_stereo(int16_t *buf, int length)
+/* Resample and filter 'samples' stereo TIA samples in 'buffer'. Answers
+ * the buffer holding the result and updates the sample count to match. */
+static const int16_t *post_process_audio(int16_t *buffer, uint32_t *samples)
 {
-   int samples            = length;
-   int16_t *out           = buf;
+   if (blep_rate)
+   {
+      *samples = blep_resample(buffer, *samples, resampleBuffer);
+      buffer   = resampleBuffer;
+   }
 
-   /* Restore previous samples */
-   int32_t low_pass_left  = low_pass_left_prev;
-   int32_t low_pass_right = low_pass_right_prev;
+   /* Remove the TIA's unipolar DC offset before output. Always on: the
+    * offset is never wanted, and the ~20 Hz cutoff leaves game audio
+    * (>=100 Hz) untouched. The low-pass filter follows in the same pass,
+    * if enabled. */
+   filter_audio(buffer, *samples);
 
-   /* Single-pole low-pass filter (6 dB/octave) */
-   int32_t factor_a       = low_pass_range;
-   int32_t factor_b       = 0x10000 - factor_a;
+   return buffer;
+}
+
+/* Audio of the last frame stella2014_render_audio() ran that didn't fit
+ * in the caller's buffer, handed out first by the next call */
+static int16_t render_carry[2 * BLEP_MAX_OUT];
+static size_t render_carry_frames = 0;
+
+/************************************
+ * Audio callback mode
+ ************************************/
 
-   do
+/* With RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK the frontend pulls the audio
+ * from its own thread, at its own pace. The emulation then only publishes
+ * the sound register writes, with their cycles, to audio_events (see
+ * Sound::setEventQueue()), plus the cycle every frame ends at. The
+ * callback replays them into a TIASound of its own, one sample per 38
+ * cycles as with cycle-exact audio timing, and runs the samples through
+ * the resampler and filters, whose state then belongs to it. */
+#define ASYNC_CHUNK    512           /* most TIA samples per callback     */
+#define ASYNC_STARVED  64            /* samples to fill in when starved   */
+#define ASYNC_MAX_LAG  (4 * 19912)   /* cycles playback may lag or lead   */
+
+static bool audio_callback_wanted = false;  /* core option */
+static bool audio_async           = false;  /* callback registered */
+static AudioEventQueue audio_events;
+static TIASound async_sound;
+static uint64_t async_cycle = 0;           /* cycle playback has reached */
+static uint64_t async_latest = 0;          /* cycle the emulation is at  */
+static int16_t asyncBuffer[2 * ASYNC_CHUNK];
+
+static void RETRO_CALLCONV audio_async_callback(void)
+{
+   const AudioEventQueue::Event *event = audio_events.back();
+   uint32_t samples = 0;
+   int i;
+
+   if (event)
+      async_latest = event->cycle;
+
+   /* Fallen too far behind (audio was paused, or the emulation runs
+    * faster than real time): apply the oldest events without playing
+    * them rather than add latency */
+   while (async_latest > async_cycle + ASYNC_MAX_LAG &&
+         (event = audio_events.front()))
+   {
+      if (event->type == AudioEventQueue::Sync)
+      {
+         for (i = 0; i < 6; i++)
+            async_sound.set(0x15 + i, event->regs[i]);
+         async_cycle = event->cycle;
+      }
+      else
+      {
+         if (event->type == AudioEventQueue::Write)
+            async_sound.set(event->addr, event->value);
+         if (event->cycle > async_cycle)
+            async_cycle = event->cycle;
+      }
+      audio_events.pop();
+   }
+
+   while (samples < ASYNC_CHUNK && (event = audio_events.front()))
    {
-      /* Apply low-pass filter */
-      low_pass_left  = (low_pass_left  * factor_a) + (*out       * factor_b);
-      low_pass_right = (low_pass_right * factor_a) + (*(out + 1) * factor_b);
+      if (event->type == AudioEventQueue::Sync)
+      {
+         for (i = 0; i < 6; i++)
+            async_sound.set(0x15 + i, event->regs[i]);
+         async_cycle = event->cycle;
+         audio_events.pop();
+         continue;
+      }
+
+      if (event->cycle > async_cycle)
+      {
+         uint64_t n = (event->cycle - async_cycle) / 38;
+         if (n > ASYNC_CHUNK - samples)
+            n = ASYNC_CHUNK - samples;
+         async_sound.process(asyncBuffer + 2 * samples, (uint32_t)n);
+         samples     += (uint32_t)n;
+         async_cycle += n * 38;
+
+         /* Out of room before the event: it stays for the next call */
+         if (event->cycle - async_cycle >= 38)
+            break;
+      }
 
-      /* 16.16 fixed point */
-      low_pass_left  >>= 16;
-      low_pass_right >>= 16;
+      if (event->type == AudioEventQueue::Write)
+         async_sound.set(event->addr, event->value);
+      audio_events.pop();
+   }
 
-      /* Update sound buffer */
-      *out++ = (int16_t)low_pass_left;
-      *out++ = (int16_t)low_pass_right;
+   /* The emulation is late: carry on with the current registers instead
+    * of leaving a gap. The clock counts these samples too, so the writes
+    * that were late are applied without playing the time they missed,
+    * and playback keeps its latency; it runs ahead of the emulation by
+    * no more than it may fall behind. */
+   if (!samples)
+   {
+      samples = ASYNC_STARVED;
+      async_sound.process(asyncBuffer, samples);
+      async_cycle += ASYNC_STARVED * 38;
+      if (async_cycle > async_latest + ASYNC_MAX_LAG)
+         async_cycle = async_latest + ASYNC_MAX_LAG;
    }
-   while (--samples);
 
-   /* Save last samples for next frame */
-   low_pass_left_prev  = low_pass_left;
-   low_pass_right_prev = low_pass_right;
+   {
+      const int16_t *audio = post_process_audio(asyncBuffer, &samples);
+      audio_batch_cb(audio, samples);
+   }
+}
+
+static void RETRO_CALLCONV audio_async_set_state(bool enabled)
+{
+   (void)enabled;
 }
 
-static void (*apply_low_pass_filter)(int16_t *buf, int length) = apply_low_pass_filter_mono;
+/* Register the audio callback if the core option asks for it, and
+ * point the sound device at the event queue if that worked. The
+ * frontend doesn't call the callback before this returns. */
+static void audio_async_init(void)
+{
+   audio_async = false;
+
+#ifdef AUDIO_EVENT_QUEUE_THREADED
+   if (audio_callback_wanted)
+   {
+      struct retro_audio_callback callback;
+
+      callback.callback  = audio_async_callback;
+      callback.set_state = audio_async_set_state;
+
+      audio_events.clear();
+      async_sound.reset();
+      async_sound.outputFrequency(31400);
+      async_sound.channels(2,
+            console->properties().get(Cartridge_Sound) == "STEREO");
+      async_sound.volume(settings->getInt("volume"));
+      async_cycle = 0;
+      async_latest = 0;
+
+      audio_async = environ_cb(RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK,
+            &callback);
+   }
+#endif
+
+   osystem.sound().setEventQueue(audio_async ? &audio_events : 0);
+}
 
 /************************************
  * Auxiliary functions
@@ -1084,6 +1457,8 @@ static void check_variables(bool first_run)
 {
    struct retro_variable var            = {0};
    enum frame_blend_method blend_method = FRAME_BLEND_NONE;
+   uint32_t low_pass;
+   int32_t low_pass_range;
    int last_paddle_sensitivity;
    int stelladaptor_sensitivity;
    int stelladaptor_center;
@@ -1100,6 +1475,53 @@ static void check_variables(bool first_run)
       if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
          if (strcmp(var.value, "24bit") == 0)
             framePixelBytes = 4;
+
+      /* The output rate is part of the AV info, so it is also only
+       * read on first run */
+      var.key   = "stella2014_audio_resampler";
+      var.value = NULL;
+
+      blep_init(0);
+
+      if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      {
+         if (strcmp(var.value, "44100") == 0)
+            blep_init(44100);
+         else if (strcmp(var.value, "48000") == 0)
+            blep_init(48000);
+      }
+
+      /* Switching the audio timing mid-game would drop or repeat part
+       * of a frame, so it is also only read on first run */
+      var.key   = "stella2014_audio_timing";
+      var.value = NULL;
+
+      audio_inline = false;
+
+      if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+         if (strcmp(var.value, "cycle") == 0)
+            audio_inline = true;
+
+      osystem.sound().setInline(audio_inline);
+
+      /* Whether to ask the frontend to pull audio from its own thread */
+      var.key   = "stella2014_audio_callback";
+      var.value = NULL;
+
+      audio_callback_wanted = false;
+
+      if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+         if (strcmp(var.value, "enabled") == 0)
+            audio_callback_wanted = true;
+
+      var.key   = "stella2014_arm_music";
+      var.value = NULL;
+
+      arm_music_wanted = false;
+
+      if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+         if (strcmp(var.value, "enabled") == 0)
+            arm_music_wanted = true;
    }
 
    /* Read interframe blending option */
@@ -1126,11 +1548,11 @@ static void check_variables(bool first_run)
    var.key   = "stella2014_low_pass_filter";
    var.value = NULL;
 
-   low_pass_enabled = false;
+   low_pass = 0;
 
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
       if (strcmp(var.value, "enabled") == 0)
-         low_pass_enabled = true;
+         low_pass = LOW_PASS_ENABLED;
 
    var.key   = "stella2014_low_pass_range";
    var.value = NULL;
@@ -1140,6 +1562,9 @@ static void check_variables(bool first_run)
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
       low_pass_range = (strtol(var.value, NULL, 10) * 0x10000) / 100;
 
+   AEQ_STORE_RELEASE(&low_pass_setting,
+         low_pass | ((uint32_t)low_pass_range & ~LOW_PASS_ENABLED));
+
    /* Read paddle digital sensitivity option */
    var.key   = "stella2014_paddle_digital_sensitivity";
    var.value = NULL;
@@ -1290,7 +1715,7 @@ void retro_get_system_av_info(struct retro_system_av_info *info)
     * emulation, which is pure integer. Computed from the exact rational. */
    info->timing.fps            = (double)console->getFramerateNum() /
                                  (double)console->getFramerateDen();
-   info->timing.sample_rate    = 31400;
+   info->timing.sample_rate    = blep_rate ? blep_rate : 31400;
    info->geometry.base_width   = 160 * 2;
    info->geometry.base_height  = videoHeight;
    info->geometry.max_width    = 320;
@@ -1388,6 +1813,18 @@ void retro_set_controller_port_device(unsigned port, unsigned device)
  * savestate round-trip (the filters keep state across frames). */
 #define AF_TRAILER_MAGIC  0x41463256u /* 'AF2V'                              */
 #define AF_TRAILER_SIZE   28u         /* magic + lp(2) + dc(4), all u32      */
+/* With the resampler enabled, its state goes right before that trailer,
+ * so the trailer stays at the end and states load either way (the
+ * resampler then restarts from silence). */
+#define RS_BLOCK_MAGIC    0x31425352u /* 'RSB1'                              */
+#define RS_BLOCK_SIZE     (20u + 8u + 8u * BLEP_TAPS)
+                          /* magic + rate + pos + last(2) + integ(2)
+                           * + buf(2 x BLEP_TAPS), all u32               */
+/* With high-resolution ARM music, the music Sound plays goes before
+ * both, padded to a fixed size; a state without it restarts the music
+ * at the next AMPLITUDE fetch. */
+#define MS_BLOCK_MAGIC    0x31534D41u /* 'AMS1'                              */
+#define MS_BLOCK_SIZE     1072u       /* magic + length + Sound::saveMusic() */
 
 static void write_u32(uint8_t *p, uint32_t v)
 {
@@ -1403,65 +1840,149 @@ static uint32_t read_u32(const uint8_t *p)
          ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
 }
 
-size_t retro_serialize_size(void) 
+/* Size of what serialize_audio_filters() appends */
+static size_t audio_trailer_size(void)
 {
-   Serializer state;
-   if(!stateManager.saveState(state))
-      return 0;
-   return state.get().size() + AF_TRAILER_SIZE;
+   return (arm_music ? MS_BLOCK_SIZE : 0) +
+      (blep_rate ? RS_BLOCK_SIZE + AF_TRAILER_SIZE : AF_TRAILER_SIZE);
 }
 
-bool retro_serialize(void *data, size_t size)
+/* Write the ARM music block at 'block' (MS_BLOCK_SIZE bytes) */
+static void serialize_music(uint8_t *block)
 {
-    Serializer state;
-    if(!stateManager.saveState(state))
-        return false;
-    std::string s = state.get();
-    if(size < s.size() + AF_TRAILER_SIZE)
-        return false;
-    memcpy(data, s.data(), s.size());
-
-    uint8_t *trailer = (uint8_t*)data + s.size();
-    write_u32(trailer +  0, AF_TRAILER_MAGIC);
-    write_u32(trailer +  4, (uint32_t)low_pass_left_prev);
-    write_u32(trailer +  8, (uint32_t)low_pass_right_prev);
-    write_u32(trailer + 12, (uint32_t)dc_block_x_prev_l);
-    write_u32(trailer + 16, (uint32_t)dc_block_y_prev_l);
-    write_u32(trailer + 20, (uint32_t)dc_block_x_prev_r);
-    write_u32(trailer + 24, (uint32_t)dc_block_y_prev_r);
-    return true;
+   Serializer state(block + 8, MS_BLOCK_SIZE - 8);
+
+   memset(block, 0, MS_BLOCK_SIZE);
+   if (!osystem.sound().saveMusic(state) || state.failed())
+   {
+      memset(block, 0, MS_BLOCK_SIZE);
+      return;
+   }
+
+   write_u32(block + 0, MS_BLOCK_MAGIC);
+   write_u32(block + 4, state.size());
 }
 
-bool retro_unserialize(const void *data, size_t size)
+/* Restore the ARM music from the block before the resampler block, or
+ * restart it if there is none */
+static void unserialize_music(const uint8_t *data, size_t size)
 {
-   /* Stella's Serializer arms iostream exceptions on any read error, and
-    * the entire Console::load() chain reads attacker-controllable fields
-    * (including string lengths passed to string::resize) with no internal
-    * bounds checks. A corrupt or truncated savestate -- as a frontend may
-    * hand us during netplay, rewind, or from a tampered file -- therefore
-    * throws std::ios_failure (or std::bad_alloc / std::length_error) that
-    * would otherwise escape across the C libretro ABI and abort the whole
-    * process. This function is the firewall: any failure means "reject the
-    * state", reported as a false return, never a crash. */
-   try
+   size_t at = MS_BLOCK_SIZE + AF_TRAILER_SIZE + (blep_rate ? RS_BLOCK_SIZE : 0);
+   const uint8_t *block;
+
+   if (!arm_music)
+      return;
+
+   if (size >= at)
    {
-      std::string s((const char*)data, size);
-      Serializer state;
-      state.set(s);
-      if(!stateManager.loadState(state))
-         return false;
+      block = data + size - at;
+      if (read_u32(block) == MS_BLOCK_MAGIC &&
+            read_u32(block + 4) <= MS_BLOCK_SIZE - 8)
+      {
+         Serializer state(block + 8, read_u32(block + 4));
+         if (osystem.sound().loadMusic(state) && !state.failed())
+            return;
+      }
    }
-   catch(...)
+
+   osystem.sound().setMusicSource(&console->cartridge());
+}
+
+/* Append the resampler block, if enabled, and the audio-filter trailer
+ * at 'trailer' (audio_trailer_size() bytes) */
+static void serialize_audio_filters(uint8_t *trailer)
+{
+   if (arm_music)
    {
-      return false;
+      serialize_music(trailer);
+      trailer += MS_BLOCK_SIZE;
+   }
+
+   /* In audio callback mode the resampler and filters run on the audio
+    * thread: store them as just reset rather than racing it */
+   if (audio_async)
+   {
+      memset(trailer, 0, audio_trailer_size());
+      if (blep_rate)
+      {
+         write_u32(trailer + 0, RS_BLOCK_MAGIC);
+         write_u32(trailer + 4, blep_rate);
+         trailer += RS_BLOCK_SIZE;
+      }
+      write_u32(trailer, AF_TRAILER_MAGIC);
+      return;
+   }
+
+   if (blep_rate)
+   {
+      int c, i;
+
+      write_u32(trailer +  0, RS_BLOCK_MAGIC);
+      write_u32(trailer +  4, blep_rate);
+      write_u32(trailer +  8, blep_pos);
+      write_u32(trailer + 12, (uint32_t)blep_last[0]);
+      write_u32(trailer + 16, (uint32_t)blep_last[1]);
+      write_u32(trailer + 20, (uint32_t)blep_integ[0]);
+      write_u32(trailer + 24, (uint32_t)blep_integ[1]);
+      for (c = 0; c < 2; c++)
+         for (i = 0; i < BLEP_TAPS; i++)
+            write_u32(trailer + 28 + 4 * (c * BLEP_TAPS + i),
+                  (uint32_t)blep_buf[c][i]);
+      trailer += RS_BLOCK_SIZE;
    }
 
-   /* Restore the audio-filter state that lives outside the Console. Try
-    * the extended trailer first, then the legacy low-pass-only trailer,
-    * then fall back to deterministic defaults for older states. */
+   write_u32(trailer +  0, AF_TRAILER_MAGIC);
+   write_u32(trailer +  4, (uint32_t)low_pass_left_prev);
+   write_u32(trailer +  8, (uint32_t)low_pass_right_prev);
+   write_u32(trailer + 12, (uint32_t)dc_block_x_prev_l);
+   write_u32(trailer + 16, (uint32_t)dc_block_y_prev_l);
+   write_u32(trailer + 20, (uint32_t)dc_block_x_prev_r);
+   write_u32(trailer + 24, (uint32_t)dc_block_y_prev_r);
+}
+
+/* Restore the resampler from the block before the audio-filter trailer,
+ * if there is one for the current output rate */
+static void unserialize_resampler(const uint8_t *data, size_t size)
+{
+   const uint8_t *block;
+   int c, i;
+
+   blep_reset();
+   if (!blep_rate || size < RS_BLOCK_SIZE + AF_TRAILER_SIZE)
+      return;
+
+   block = data + size - AF_TRAILER_SIZE - RS_BLOCK_SIZE;
+   if (read_u32(block) != RS_BLOCK_MAGIC || read_u32(block + 4) != blep_rate ||
+         read_u32(block + 8) >= blep_out_step)
+      return;
+
+   blep_pos      = read_u32(block + 8);
+   blep_last[0]  = (int32_t)read_u32(block + 12);
+   blep_last[1]  = (int32_t)read_u32(block + 16);
+   blep_integ[0] = (int32_t)read_u32(block + 20);
+   blep_integ[1] = (int32_t)read_u32(block + 24);
+   for (c = 0; c < 2; c++)
+      for (i = 0; i < BLEP_TAPS; i++)
+         blep_buf[c][i] = (int32_t)read_u32(block + 28 +
+               4 * (c * BLEP_TAPS + i));
+}
+
+/* Restore the audio-filter state that lives outside the Console from the
+ * end of a state blob. Try the extended trailer first, then the legacy
+ * low-pass-only trailer, then fall back to deterministic defaults for
+ * older states. */
+static void unserialize_audio_filters(const uint8_t *data, size_t size)
+{
+   /* Rendered from the state being replaced */
+   render_carry_frames = 0;
+
+   /* Owned by the audio thread in audio callback mode, see above */
+   if (audio_async)
+      return;
+
    if(size >= AF_TRAILER_SIZE)
    {
-      const uint8_t *trailer = (const uint8_t*)data + size - AF_TRAILER_SIZE;
+      const uint8_t *trailer = data + size - AF_TRAILER_SIZE;
       if(read_u32(trailer) == AF_TRAILER_MAGIC)
       {
          low_pass_left_prev  = (int32_t)read_u32(trailer +  4);
@@ -1470,91 +1991,488 @@ bool retro_unserialize(const void *data, size_t size)
          dc_block_y_prev_l   = (int32_t)read_u32(trailer + 16);
          dc_block_x_prev_r   = (int32_t)read_u32(trailer + 20);
          dc_block_y_prev_r   = (int32_t)read_u32(trailer + 24);
-         return true;
+         unserialize_resampler(data, size);
+         unserialize_music(data, size);
+         return;
       }
    }
    if(size >= LPF_TRAILER_SIZE)
    {
-      const uint8_t *trailer = (const uint8_t*)data + size - LPF_TRAILER_SIZE;
+      const uint8_t *trailer = data + size - LPF_TRAILER_SIZE;
       if(read_u32(trailer) == LPF_TRAILER_MAGIC)
       {
          low_pass_left_prev  = (int32_t)read_u32(trailer + 4);
          low_pass_right_prev = (int32_t)read_u32(trailer + 8);
          dc_block_reset();
-         return true;
+         blep_reset();
+         unserialize_music(data, 0);
+         return;
       }
    }
    /* State predates the trailer: reset to a deterministic default */
+   unserialize_music(data, 0);
    low_pass_left_prev  = 0;
    low_pass_right_prev = 0;
    dc_block_reset();
-   return true;
+   blep_reset();
 }
 
-void retro_cheat_reset(void)
-{}
+/* Frontends ask for this before every rewind and run-ahead save, so it
+ * doesn't save a state to measure one: StateManager caches the size per
+ * cart */
+size_t retro_serialize_size(void) 
+{
+   uint32_t size = stateManager.stateSize();
+   if(!size)
+      return 0;
+   return size + audio_trailer_size();
+}
 
-void retro_cheat_set(unsigned index, bool enabled, const char *code)
+/* Room a state blob of a 'size' byte buffer may take, leaving space for
+ * the audio trailer. Blobs are written straight into the frontend's
+ * buffer and read straight from it (see Serializer's span mode), so no
+ * state operation allocates or copies. */
+static uint32_t state_span(size_t size)
 {
-   (void)index;
-   (void)enabled;
-   (void)code;
+   size_t trailer = audio_trailer_size();
+
+   if (size < trailer)
+      return 0;
+   size -= trailer;
+   return size > 0xffffffffu ? 0xffffffffu : (uint32_t)size;
 }
 
-bool retro_load_game(const struct retro_game_info *info)
+/* What the frontend saves or loads the state for, if it says */
+static enum retro_savestate_context savestate_context(void)
 {
-   enum retro_pixel_format fmt;
+   enum retro_savestate_context context;
 
-   /* MovieCart (MVC) images are streamed from disk and can be many MB in
-    * size; they are identified by a 'M','V','C',0 signature at the start of
-    * the file. Detect this up front so the normal upper size limit (which
-    * targets ordinary bankswitched ROMs) doesn't reject them. */
-   bool isMVC = info && info->data && info->size >= 4 &&
-                ((const uint8_t*)info->data)[0] == 'M' &&
-                ((const uint8_t*)info->data)[1] == 'V' &&
-                ((const uint8_t*)info->data)[2] == 'C' &&
-                ((const uint8_t*)info->data)[3] == 0;
+   if (!environ_cb(RETRO_ENVIRONMENT_GET_SAVESTATE_CONTEXT, &context))
+      return RETRO_SAVESTATE_CONTEXT_NORMAL;
+   return context;
+}
 
-   /* Reject empty images and anything larger than the largest supported
-    * cartridge. The historical limit was 96K, which predates the CDF/CDFJ
-    * ARM mappers: CDF images run to 128K/256K and CDFJ+ up to 512K. The
-    * ROM data is handed straight to Cartridge::create (each cart copies
-    * out the portion it needs), so the cap is only a sanity gate, not a
-    * buffer bound. Also reject anything below the smallest real cartridge
-    * (2K): the size-based detectors index near the end of the image
-    * (image[size-8] etc.), so a too-small image would read out of bounds. */
-   if (!info || info->size < 2*1024 || (!isMVC && info->size > 512*1024))
-      return false;
+/* Whether the state being saved may leave the process (or be kept), and
+ * so is worth checksumming; run-ahead and rollback states never do */
+static bool savestate_checksums(enum retro_savestate_context context)
+{
+   return context != RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE &&
+          context != RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_BINARY &&
+          context != RETRO_SAVESTATE_CONTEXT_ROLLBACK_NETPLAY;
+}
 
-   /* Release any state from a previous load (repeat retro_load_game
-    * calls without an intervening retro_unload_game, or a retry after
-    * a failed load); prevents leaking the previous Settings/Console
-    * and keeps the ownership invariants below simple. */
-   retro_unload_game();
+bool retro_serialize(void *data, size_t size)
+{
+    enum retro_savestate_context context = savestate_context();
 
-   // Set color depth
-   check_variables(true);
+    Serializer state((uint8_t*)data, state_span(size));
+    if(!stateManager.saveState(state, savestate_checksums(context)))
+        return false;
 
-   if (framePixelBytes == 4)
-   {
-      fmt = RETRO_PIXEL_FORMAT_XRGB8888;
-      if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt))
-      {
-         if (log_cb)
-            log_cb(RETRO_LOG_INFO, "[Stella]: XRGB8888 is not supported - trying RGB565...\n");
+    /* Run-ahead loads this state back after running frames it throws
+     * away, and those must not stay in the rewind ring */
+    if(context == RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE)
+        stateManager.markRewind();
 
-         /* Fallback to RETRO_PIXEL_FORMAT_RGB565 */
-         framePixelBytes = 2;
-      }
-   }
+    serialize_audio_filters((uint8_t*)data + state.size());
+    return true;
+}
 
-   if (framePixelBytes == 2)
+bool retro_unserialize(const void *data, size_t size)
+{
+   /* The Serializer bounds-checks every read of the span, but the
+    * Console::load() chain still reads attacker-controllable fields with
+    * no checks of its own, and some of it (carts, incremental states)
+    * throws on inconsistent data. A corrupt or truncated savestate -- as
+    * a frontend may hand us during netplay, rewind, or from a tampered
+    * file -- must not let that escape across the C libretro ABI and abort
+    * the whole process. This function is the firewall: any failure means
+    * "reject the state", reported as a false return, never a crash. */
+   try
    {
-      fmt = RETRO_PIXEL_FORMAT_RGB565;
-      if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt))
-      {
-         if (log_cb)
-            log_cb(RETRO_LOG_INFO, "[Stella]: RGB565 is not supported.\n");
+      Serializer state((const uint8_t*)data,
+            size > 0xffffffffu ? 0xffffffffu : (uint32_t)size);
+      if(!stateManager.loadState(state))
+         return false;
+   }
+   catch(...)
+   {
+      return false;
+   }
+
+   /* Back from run-ahead: forget the frames it ran (see retro_serialize) */
+   if(savestate_context() == RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE)
+      stateManager.forgetAfterMark();
+
+   unserialize_audio_filters((const uint8_t*)data, size);
+   return true;
+}
+
+size_t stella2014_profile_dump(void *data, size_t size, unsigned format)
+{
+#ifdef STELLA_PROFILE
+   Profiler::Format f;
+
+   if (!console)
+      return 0;
+
+   switch (format)
+   {
+      case STELLA2014_PROFILE_INSTRUCTIONS_CSV:
+         f = Profiler::InstructionCSV;
+         break;
+      case STELLA2014_PROFILE_FRAMES_CSV:
+         f = Profiler::FrameCSV;
+         break;
+      case STELLA2014_PROFILE_BINARY:
+         f = Profiler::Binary;
+         break;
+      default:
+         return 0;
+   }
+
+   return console->system().profiler().dump((uint8_t*)data,
+         size > 0xffffffffu ? 0xffffffffu : (uint32_t)size, f);
+#else
+   (void)data;
+   (void)size;
+   (void)format;
+   return 0;
+#endif
+}
+
+void stella2014_profile_reset(void)
+{
+#ifdef STELLA_PROFILE
+   if (console)
+      console->system().profiler().reset();
+#endif
+}
+
+/* Incremental states (see libretro_ext.h): the large RAM-like arrays only
+ * carry the pages that changed since the previous incremental save/load,
+ * which keeps run-ahead from copying 32K of mostly idle CDF/BUS RAM per
+ * frame. The audio-filter trailer is appended exactly as for full states. */
+size_t stella2014_serialize_delta(void *data, size_t size)
+{
+   if (!console)
+      return 0;
+
+   /* A state that doesn't fit is never seen by the caller, so
+    * saveStateDelta() doesn't diff against it */
+   Serializer state((uint8_t*)data, state_span(size));
+   if(!stateManager.saveStateDelta(state))
+      return 0;
+
+   serialize_audio_filters((uint8_t*)data + state.size());
+   return state.size() + audio_trailer_size();
+}
+
+bool stella2014_unserialize_delta(const void *data, size_t size)
+{
+   if (!console)
+      return false;
+
+   /* Same firewall as retro_unserialize() */
+   try
+   {
+      Serializer state((const uint8_t*)data,
+            size > 0xffffffffu ? 0xffffffffu : (uint32_t)size);
+      if(!stateManager.loadStateDelta(state))
+         return false;
+   }
+   catch(...)
+   {
+      return false;
+   }
+
+   unserialize_audio_filters((const uint8_t*)data, size);
+   return true;
+}
+
+/* In-core rewind (see libretro_ext.h): StateManager records a state at
+ * the end of every retro_run(). Only the Stella state is recorded; the
+ * audio filters carry on, as across a frame. */
+bool stella2014_rewind_setup(unsigned depth, size_t size)
+{
+   try
+   {
+      stateManager.setRewind(depth,
+            size > 0xffffffffu ? 0xffffffffu : (uint32_t)size);
+   }
+   catch(...)
+   {
+      stateManager.setRewind(0, 0);
+      return false;
+   }
+   return true;
+}
+
+unsigned stella2014_rewind(unsigned frames)
+{
+   unsigned n;
+
+   if (!console)
+      return 0;
+
+   n = stateManager.rewind(frames);
+   if (n)
+   {
+      /* Rendered from the state being replaced */
+      render_carry_frames = 0;
+      if (arm_music)
+         osystem.sound().setMusicSource(&console->cartridge());
+   }
+   return n;
+}
+
+/* Sectioned states (see libretro_ext.h): needs no game loaded */
+const void *stella2014_state_section(const void *data, size_t size,
+      const char *name, size_t *length, unsigned *version)
+{
+   uint32_t len = 0, ver = 0;
+   const uint8_t *section;
+
+   if (!data || !name)
+      return NULL;
+
+   section = StateManager::findSection((const uint8_t*)data,
+         size > 0xffffffffu ? 0xffffffffu : (uint32_t)size, name, len, ver);
+   if (section)
+   {
+      if (length)
+         *length = len;
+      if (version)
+         *version = ver;
+   }
+   return section;
+}
+
+/* State files (see libretro_ext.h): what retro_serialize() saves, through
+ * Serializer's file modes, which compress and inflate them */
+bool stella2014_save_state_file(const char *path, int level)
+{
+   size_t size = retro_serialize_size();
+   uint8_t *data;
+   bool saved = false;
+
+   if (!console || !path || !size)
+      return false;
+   if (level < 0)
+      level = 1;
+
+   data = new uint8_t[size]();
+   try
+   {
+      if (retro_serialize(data, size))
+      {
+         Serializer out(path, level);
+         out.putByteArray(data, (uint32_t)size);
+         saved = out.close();
+      }
+   }
+   catch(...)
+   {
+      saved = false;
+   }
+   delete[] data;
+   return saved;
+}
+
+bool stella2014_load_state_file(const char *path)
+{
+   uint8_t *data = NULL;
+   bool loaded = false;
+
+   if (!console || !path)
+      return false;
+
+   try
+   {
+      Serializer in(path, true);
+      if (in.isValid())
+      {
+         uint32_t size = in.size();
+         data = new uint8_t[size ? size : 1];
+         in.getByteArray(data, size);
+         loaded = retro_unserialize(data, size);
+      }
+   }
+   catch(...)
+   {
+      loaded = false;
+   }
+   delete[] data;
+   return loaded;
+}
+
+/* Snapshots (see libretro_ext.h): the Stella state only, like the rewind
+ * ring records, for quick in-process save and restore. */
+size_t stella2014_snapshot_size(void)
+{
+   if (!console)
+      return 0;
+   return stateManager.snapshotSize();
+}
+
+bool stella2014_snapshot(void *data, size_t size)
+{
+   if (!console || !data)
+      return false;
+
+   try
+   {
+      Serializer state((uint8_t*)data,
+            size > 0xffffffffu ? 0xffffffffu : (uint32_t)size);
+      return stateManager.saveSnapshot(state);
+   }
+   catch(...)
+   {
+      return false;
+   }
+}
+
+bool stella2014_restore(const void *data, size_t size)
+{
+   if (!console || !data)
+      return false;
+
+   try
+   {
+      Serializer state((const uint8_t*)data,
+            size > 0xffffffffu ? 0xffffffffu : (uint32_t)size);
+      if (!stateManager.loadSnapshot(state))
+         return false;
+   }
+   catch(...)
+   {
+      return false;
+   }
+
+   /* Rendered from the state being replaced */
+   render_carry_frames = 0;
+   if (arm_music)
+      osystem.sound().setMusicSource(&console->cartridge());
+   return true;
+}
+
+/* Rollback (see libretro_ext.h): snapshots kept by StateManager, in a
+ * ring allocated up front, and restored by frame number. */
+bool stella2014_rollback_setup(unsigned slots)
+{
+   try
+   {
+      stateManager.setRollback(slots);
+   }
+   catch(...)
+   {
+      stateManager.setRollback(0);
+      return false;
+   }
+   return true;
+}
+
+bool stella2014_rollback_save(unsigned frame)
+{
+   if (!console)
+      return false;
+
+   try
+   {
+      return stateManager.saveRollback(frame);
+   }
+   catch(...)
+   {
+      return false;
+   }
+}
+
+bool stella2014_rollback_load(unsigned frame)
+{
+   if (!console)
+      return false;
+
+   try
+   {
+      if (!stateManager.loadRollback(frame))
+         return false;
+   }
+   catch(...)
+   {
+      return false;
+   }
+
+   /* Rendered from the state being replaced */
+   render_carry_frames = 0;
+   if (arm_music)
+      osystem.sound().setMusicSource(&console->cartridge());
+   return true;
+}
+
+void retro_cheat_reset(void)
+{}
+
+void retro_cheat_set(unsigned index, bool enabled, const char *code)
+{
+   (void)index;
+   (void)enabled;
+   (void)code;
+}
+
+bool retro_load_game(const struct retro_game_info *info)
+{
+   enum retro_pixel_format fmt;
+
+   /* MovieCart (MVC) images are streamed from disk and can be many MB in
+    * size; they are identified by a 'M','V','C',0 signature at the start of
+    * the file. Detect this up front so the normal upper size limit (which
+    * targets ordinary bankswitched ROMs) doesn't reject them. */
+   bool isMVC = info && info->data && info->size >= 4 &&
+                ((const uint8_t*)info->data)[0] == 'M' &&
+                ((const uint8_t*)info->data)[1] == 'V' &&
+                ((const uint8_t*)info->data)[2] == 'C' &&
+                ((const uint8_t*)info->data)[3] == 0;
+
+   /* Reject empty images and anything larger than the largest supported
+    * cartridge. The historical limit was 96K, which predates the CDF/CDFJ
+    * ARM mappers: CDF images run to 128K/256K and CDFJ+ up to 512K. The
+    * ROM data is handed straight to Cartridge::create (each cart copies
+    * out the portion it needs), so the cap is only a sanity gate, not a
+    * buffer bound. Also reject anything below the smallest real cartridge
+    * (2K): the size-based detectors index near the end of the image
+    * (image[size-8] etc.), so a too-small image would read out of bounds. */
+   if (!info || info->size < 2*1024 || (!isMVC && info->size > 512*1024))
+      return false;
+
+   /* Release any state from a previous load (repeat retro_load_game
+    * calls without an intervening retro_unload_game, or a retry after
+    * a failed load); prevents leaking the previous Settings/Console
+    * and keeps the ownership invariants below simple. */
+   retro_unload_game();
+
+   // Set color depth
+   check_variables(true);
+
+   if (framePixelBytes == 4)
+   {
+      fmt = RETRO_PIXEL_FORMAT_XRGB8888;
+      if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt))
+      {
+         if (log_cb)
+            log_cb(RETRO_LOG_INFO, "[Stella]: XRGB8888 is not supported - trying RGB565...\n");
+
+         /* Fallback to RETRO_PIXEL_FORMAT_RGB565 */
+         framePixelBytes = 2;
+      }
+   }
+
+   if (framePixelBytes == 2)
+   {
+      fmt = RETRO_PIXEL_FORMAT_RGB565;
+      if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt))
+      {
+         if (log_cb)
+            log_cb(RETRO_LOG_INFO, "[Stella]: RGB565 is not supported.\n");
          return false;
       }
    }
@@ -1595,14 +2513,25 @@ bool retro_load_game(const struct retro_game_info *info)
    console->initializeVideo();
    console->initializeAudio();
 
-   // Reset the DC-blocker so cold-start audio output is reproducible
+   // Reset the DC-blocker and resampler so cold-start audio output is
+   // reproducible
    dc_block_reset();
+   blep_reset();
+   render_carry_frames = 0;
+
+   // Incremental states never carry over from a previous game
+   stateManager.reset();
+
+   audio_async_init();
+
+   arm_music = arm_music_wanted && !audio_async;
+   osystem.sound().setMusicSource(arm_music ? &console->cartridge() : 0);
 
    // Check number of audio channels
    if (console->properties().get(Cartridge_Sound) == "STEREO")
-      apply_low_pass_filter = apply_low_pass_filter_stereo;
+      filter_audio = filter_audio_stereo;
    else
-      apply_low_pass_filter = apply_low_pass_filter_mono;
+      filter_audio = filter_audio_mono;
 
    // Init paddle controls
    init_paddles();
@@ -1641,6 +2570,11 @@ bool retro_load_game_special(unsigned game_type, const struct retro_game_info *i
 
 void retro_unload_game(void) 
 {
+   osystem.sound().setEventQueue(0);
+   audio_async = false;
+   osystem.sound().setMusicSource(0);
+   arm_music = false;
+
    if (console)
    {
       /* Console owns System, and System owns every attached Device
@@ -1723,7 +2657,7 @@ void retro_deinit(void)
    MouseButtonValue0          = Event::MouseButtonLeftValue;
    MouseAxisValue1            = Event::MouseAxisYValue;
    MouseButtonValue1          = Event::MouseButtonRightValue;
-   low_pass_enabled           = false;
+   low_pass_setting           = 0;
    low_pass_left_prev         = 0;
    low_pass_right_prev        = 0;
    currentPalette32           = NULL;
@@ -1754,35 +2688,27 @@ void retro_reset(void)
    console->system().reset();
 }
 
-void retro_run(void)
+/* sampleBuffer holds 2048 int16 = 1024 stereo samples; worst case is
+ * 31400*342/15600 = 688 samples (auto-framerate at 342 scanlines) */
+static int16_t sampleBuffer[2048];
+
+/* Number of samples in this frame: sampleRate/fps as exact integers,
+ * 31400 * den / num (e.g. NTSC 31400*25/1498 = 524, PAL 31400*25/1248 = 629).
+ * Recomputed every frame: the TIA auto-framerate can retune num/den at
+ * any frame boundary. */
+static uint32_t samples_per_frame(void)
 {
-   static int16_t sampleBuffer[2048];
-   //Number of samples in this frame: sampleRate/fps as exact integers,
-   //31400 * den / num (e.g. NTSC 31400*25/1498 = 524, PAL 31400*25/1248 = 629).
-   //Recomputed every frame: the TIA auto-framerate can retune num/den at
-   //any frame boundary, and the previous once-only 'static' froze the
-   //value computed on the very first retro_run() forever.
-   uint32_t tiaSamplesPerFrame =
+   uint32_t samples =
          (31400u * console->getFramerateDen()) /
          (console->getFramerateNum() ? console->getFramerateNum() : 1498u);
-   //sampleBuffer holds 2048 int16 = 1024 stereo samples; worst case is
-   //31400*342/15600 = 688 samples (auto-framerate at 342 scanlines)
-   if (tiaSamplesPerFrame > 1024)
-      tiaSamplesPerFrame = 1024;
-
-   //CORE OPTIONS
-   bool updated = false;
-   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated)
-      check_variables(false);
-
-   //INPUT
-   update_input();
+   return samples > 1024 ? 1024 : samples;
+}
 
-   //EMULATE
+/* Copy the frame the TIA just finished into frameBuffer */
+static void render_video(void)
+{
    TIA& tia = console->tia();
-   tia.update();
 
-   //VIDEO
    //Get the frame info from stella
    videoWidth = tia.width();
    videoHeight = tia.height();
@@ -1797,18 +2723,296 @@ void retro_run(void)
       blend_frames_16(tia.currentFrameBuffer(), videoWidth, videoHeight);
    else
       blend_frames_32(tia.currentFrameBuffer(), videoWidth, videoHeight);
+}
+
+/* Generate, resample and filter the audio of the frame the TIA just
+ * finished. Takes the number of TIA samples and answers the buffer and
+ * the number of output samples in it. With cycle-exact audio timing the
+ * samples were generated while the frame ran, and their number follows
+ * from the frame's length in cycles instead. */
+static const int16_t *render_audio(uint32_t *samples)
+{
+   int16_t *buffer = sampleBuffer;
 
+   {
+#ifdef STELLA_PROFILE
+      Profiler::Scope profile(console->system().profiler(), Profiler::Sound);
+#endif
+      if (audio_inline)
+         *samples = osystem.sound().finishFragment(
+               console->system().cycles(), buffer);
+      else
+         osystem.sound().processFragment(sampleBuffer, *samples);
+
+      return post_process_audio(buffer, samples);
+   }
+}
+
+/* With cycle-exact audio timing, a frame too long for one fragment (see
+ * Sound::finishFragment()) leaves the rest of its samples to this, which
+ * answers the next part as render_audio() does, or NULL once there is
+ * none left. */
+static const int16_t *render_audio_next(uint32_t *samples)
+{
+   int16_t *buffer;
+
+   if (!audio_inline)
+      return NULL;
+
+   {
+#ifdef STELLA_PROFILE
+      Profiler::Scope profile(console->system().profiler(), Profiler::Sound);
+#endif
+      *samples = osystem.sound().finishFragment(
+            console->system().cycles(), buffer);
+      return *samples ? post_process_audio(buffer, samples) : NULL;
+   }
+}
+
+void retro_run(void)
+{
+   uint32_t tiaSamplesPerFrame = samples_per_frame();
+   const int16_t *audio;
+
+   //CORE OPTIONS
+   bool updated = false;
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated)
+      check_variables(false);
+
+   //INPUT
+   update_input();
+
+   //EMULATE
+   console->tia().update();
+
+   //VIDEO
+   render_video();
    video_cb(frameBuffer, videoWidth, videoHeight, videoWidth * framePixelBytes);
 
-   osystem.sound().processFragment(sampleBuffer, tiaSamplesPerFrame);
+   //AUDIO
+   if (audio_async)
+      osystem.sound().markTime(console->system().cycles());
+   else
+   {
+      audio = render_audio(&tiaSamplesPerFrame);
+      audio_batch_cb(audio, tiaSamplesPerFrame);
+      while ((audio = render_audio_next(&tiaSamplesPerFrame)))
+         audio_batch_cb(audio, tiaSamplesPerFrame);
+   }
 
-   /* Remove the TIA's unipolar DC offset before output. Always on: the
-    * offset is never wanted, and the ~20 Hz cutoff leaves game audio
-    * (>=100 Hz) untouched. */
-   apply_dc_block_filter(sampleBuffer, tiaSamplesPerFrame);
+#ifdef STELLA_PROFILE
+   console->system().profiler().endFrame();
+#endif
+
+   //REWIND
+   stateManager.update();
+}
+
+/* Input for the frame stella2014_run_frames() is currently starting */
+static const struct stella2014_input_frame *batch_input = NULL;
+
+/* TIA samples of the frame stella2014_run_frames() is running, which
+ * may span several calls */
+static uint32_t batch_samples = 0;
+
+static void batch_input_poll(void)
+{
+}
+
+static int16_t batch_input_state(unsigned port, unsigned device,
+      unsigned index, unsigned id)
+{
+   if (!batch_input || port >= 4)
+      return 0;
+
+   if (device == RETRO_DEVICE_JOYPAD)
+   {
+      if (id == RETRO_DEVICE_ID_JOYPAD_MASK)
+         return batch_input->joypad[port];
+      return (batch_input->joypad[port] >> id) & 1;
+   }
+   if (device == RETRO_DEVICE_ANALOG &&
+         index == RETRO_DEVICE_INDEX_ANALOG_LEFT)
+      return id == RETRO_DEVICE_ID_ANALOG_X ?
+            batch_input->analog_x[port] : batch_input->analog_y[port];
+   return 0;
+}
+
+bool stella2014_run_frames(struct stella2014_run *run)
+{
+   retro_input_poll_t poll_cb;
+   retro_input_state_t state_cb;
+   bool video = false;
+
+   /* Without a cycle target the frame count is what ends the run, and
+    * it also sizes the input buffer */
+   if (!console || !run || (!run->frames && !run->until_cycle) ||
+         (!run->frames && run->input))
+      return false;
+
+   TIA& tia = console->tia();
+
+   run->frames_run    = 0;
+   run->audio_frames  = 0;
+   run->audio_dropped = 0;
+   run->partial       = false;
+
+   /* The CPU stops at a timer expiry as at the cycle target */
+   if (run->flags & STELLA2014_RUN_UNTIL_TIMER)
+      console->riot().setTimerEvents(true);
+
+   /* Serve update_input() from the caller's buffer, if there is one */
+   poll_cb  = input_poll_cb;
+   state_cb = input_state_cb;
+   if (run->input)
+   {
+      input_poll_cb  = batch_input_poll;
+      input_state_cb = batch_input_state;
+   }
+
+   while (!run->frames || run->frames_run < run->frames)
+   {
+      uint64_t cycle = run->until_cycle ? run->until_cycle : ~(uint64_t)0;
+      const int16_t *audio;
+      uint32_t samples;
+
+      if (console->system().cycles() >= cycle)
+         break;
 
-   if (low_pass_enabled)
-      apply_low_pass_filter(sampleBuffer, tiaSamplesPerFrame);
+      /* Input and the frame's sample count are latched when a frame
+       * starts, as in retro_run() */
+      if (!tia.partialFrame())
+      {
+         if (run->input)
+            batch_input = &run->input[run->frames_run];
+         update_input();
+         batch_samples = samples_per_frame();
+      }
+
+      if (!tia.updatePartial(cycle,
+               (run->flags & STELLA2014_RUN_UNTIL_SCANLINE) ?
+               run->until_scanline : ~0u))
+      {
+         run->partial = true;
+         break;
+      }
+
+      samples = batch_samples;
+      if (audio_async)
+      {
+         osystem.sound().markTime(console->system().cycles());
+         audio = NULL;
+      }
+      else
+         audio = render_audio(&samples);
+      while (audio)
+      {
+         if (samples && (run->flags & STELLA2014_RUN_AUDIO))
+            audio_batch_cb(audio, samples);
+         if (samples && run->audio)
+         {
+            size_t n = run->audio_capacity - run->audio_frames;
+            if (n > samples)
+               n = samples;
+            memcpy(run->audio + 2 * run->audio_frames, audio,
+                  n * 2 * sizeof(int16_t));
+            run->audio_frames  += n;
+            run->audio_dropped += samples - n;
+         }
+         audio = render_audio_next(&samples);
+      }
+      if (run->flags & STELLA2014_RUN_VIDEO)
+      {
+         render_video();
+         video = true;
+      }
+#ifdef STELLA_PROFILE
+      console->system().profiler().endFrame();
+#endif
+      /* REWIND, as at the end of retro_run() */
+      stateManager.update();
+      run->frames_run++;
+
+      /* The caller gets to make room before more audio is lost */
+      if (run->audio_dropped)
+         break;
+   }
+
+   input_poll_cb  = poll_cb;
+   input_state_cb = state_cb;
+   batch_input    = NULL;
+   if (run->flags & STELLA2014_RUN_UNTIL_TIMER)
+      console->riot().setTimerEvents(false);
+
+   if (video)
+      video_cb(frameBuffer, videoWidth, videoHeight,
+            videoWidth * framePixelBytes);
+
+   run->cycle    = console->system().cycles();
+   run->scanline = tia.scanlines();
+   return true;
+}
+
+static size_t take_render_carry(int16_t *data, size_t frames)
+{
+   size_t n = render_carry_frames < frames ? render_carry_frames : frames;
+
+   memcpy(data, render_carry, n * 2 * sizeof(int16_t));
+   render_carry_frames -= n;
+   memmove(render_carry, render_carry + 2 * n,
+         render_carry_frames * 2 * sizeof(int16_t));
+   return n;
+}
+
+size_t stella2014_render_audio(int16_t *data, size_t frames)
+{
+   retro_input_poll_t poll_cb;
+   retro_input_state_t state_cb;
+   size_t written;
+
+   if (!console || !data || audio_async)
+      return 0;
+
+   TIA& tia = console->tia();
+
+   /* Nothing is pressed while rendering */
+   poll_cb        = input_poll_cb;
+   state_cb       = input_state_cb;
+   input_poll_cb  = batch_input_poll;
+   input_state_cb = batch_input_state;
+   batch_input    = NULL;
+   tia.enableAudioOnly(true);
+
+   written = take_render_carry(data, frames);
+   while (written < frames)
+   {
+      const int16_t *audio;
+      uint32_t samples;
+
+      /* The rest of a frame too long for one fragment comes first */
+      audio = render_audio_next(&samples);
+      if (!audio)
+      {
+         if (!tia.partialFrame())
+         {
+            update_input();
+            batch_samples = samples_per_frame();
+         }
+         tia.update();
+
+         samples = batch_samples;
+         audio   = render_audio(&samples);
+#ifdef STELLA_PROFILE
+         console->system().profiler().endFrame();
+#endif
+      }
+      memcpy(render_carry, audio, samples * 2 * sizeof(int16_t));
+      render_carry_frames = samples;
+      written += take_render_carry(data + 2 * written, frames - written);
+   }
 
-   audio_batch_cb(sampleBuffer, tiaSamplesPerFrame);
+   tia.enableAudioOnly(false);
+   input_poll_cb  = poll_cb;
+   input_state_cb = state_cb;
+   return written;
 }
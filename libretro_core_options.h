@@ -125,6 +125,51 @@ struct retro_core_option_definition option_defs_us[] = {
       },
       "60"
    },
+   {
+      "stella2014_audio_resampler",
+      "Audio Output Rate (Restart)",
+      "Outputs audio at the selected rate instead of the TIA's native 31400 Hz, using an alias-free band-limited resampler in the core, so that the frontend does not need to resample it.",
+      {
+         { "disabled", "31400 Hz (native)" },
+         { "44100",    "44100 Hz" },
+         { "48000",    "48000 Hz" },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
+   {
+      "stella2014_audio_timing",
+      "Audio Timing (Restart)",
+      "'Per Frame' queues sound register writes and replays them over a fixed number of samples when each frame ends. 'Cycle-Exact' generates the samples as the writes happen, locked to the CPU clock, so frames that run long or short give correspondingly more or fewer samples.",
+      {
+         { "frame", "Per Frame" },
+         { "cycle", "Cycle-Exact" },
+         { NULL, NULL },
+      },
+      "frame"
+   },
+   {
+      "stella2014_audio_callback",
+      "Threaded Audio (Restart)",
+      "Lets the frontend pull audio from its own audio thread when it needs it, instead of taking one block per emulated frame. The emulation only passes on the sound register writes, and the samples are generated on the audio thread, so audio buffering no longer depends on video frame pacing. Has no effect if the frontend does not support it.",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
+   {
+      "stella2014_arm_music",
+      "High-Resolution ARM Cart Music (Restart)",
+      "CDF, BUS and DPC+ games play their music by copying what the cartridge's music fetchers give into a TIA volume register, usually once per scanline, and not at all while the screen is blanked. When enabled, the fetchers are sampled at the TIA's own sample rate instead, for cleaner music with fewer gaps. Not available with threaded audio.",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
    {
       "stella2014_paddle_digital_sensitivity",
       "Gamepad: Paddle Sensitivity (Digital)",
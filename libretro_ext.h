@@ -0,0 +1,351 @@
+#ifndef LIBRETRO_EXT_H__
+#define LIBRETRO_EXT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <libretro.h>
+
+/*
+ * Core-specific extensions to the libretro API.
+ *
+ * These entry points are exported alongside the retro_* symbols so that
+ * tools, batch drivers and test harnesses can reach functionality the
+ * generic libretro interface has no room for. They are looked up with
+ * dlsym()/GetProcAddress() and are only valid between retro_load_game()
+ * and retro_unload_game().
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ ********************************
+ * Incremental savestates
+ ********************************
+ *
+ * An incremental state holds the small register blocks of every device
+ * in full, but the large RAM-like arrays (RIOT RAM, cart RAM, ARM RAM)
+ * only as the 64-byte pages that changed since the previous incremental
+ * save or load. The first incremental state after loading a game is
+ * self-contained.
+ *
+ * An incremental state can only be loaded while the core still holds
+ * the snapshot it was diffed against, or the state itself -- which is
+ * exactly the run-ahead pattern: save, run ahead, load the same state
+ * back. Anything else is rejected. Full states are unaffected and can
+ * be mixed freely with incremental ones.
+ */
+
+/* Writes an incremental state to 'data'. Returns the number of bytes
+ * written, or 0 on failure (including a buffer that is too small). A
+ * buffer of retro_serialize_size() + retro_serialize_size() / 256 + 64
+ * bytes is always large enough. */
+RETRO_API size_t stella2014_serialize_delta(void *data, size_t size);
+
+/* Loads an incremental state written by stella2014_serialize_delta().
+ * Returns false if the state is malformed or was not diffed against
+ * the snapshot the core currently holds. */
+RETRO_API bool stella2014_unserialize_delta(const void *data, size_t size);
+
+/*
+ ********************************
+ * In-core rewind
+ ********************************
+ *
+ * Once set up, the core records its state at the end of every frame
+ * retro_run() or stella2014_run_frames() finishes into a ring of fixed
+ * size, so a frontend on a small-RAM target can rewind without keeping
+ * full states. Only the newest state is kept whole; each older one is
+ * kept as the XOR of it and the one after it, run-length coded, which
+ * for most games is a few hundred bytes per frame. The oldest frames are
+ * dropped when the ring is full.
+ * Recording starts over when a game is loaded. Frames run ahead are not
+ * kept: loading a state saved for run-ahead in the same instance (the
+ * frontend answering RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE)
+ * forgets the frames recorded since it was saved.
+ */
+
+/* Sets rewind up to keep at most 'depth' frames in 'size' bytes, and
+ * forgets the frames recorded so far. A depth or size of 0 turns it off
+ * and frees its memory. The setting is kept across games. Returns false
+ * if the memory can't be had, which also turns it off. */
+RETRO_API bool stella2014_rewind_setup(unsigned depth, size_t size);
+
+/* Goes back 'frames' frames, or as far as the ring reaches, forgetting
+ * the frames in between. Returns the number of frames gone back. */
+RETRO_API unsigned stella2014_rewind(unsigned frames);
+
+/*
+ ********************************
+ * Sectioned states
+ ********************************
+ *
+ * A state from retro_serialize() starts with a table of sections, one
+ * per part of the console (the system itself, the CPU "M6502", the RIOT
+ * "M6532", the "TIA" with its sound, the cart, named for its type, the
+ * two controllers and the "Switches"), giving the offset, length,
+ * version and Adler-32 checksum of each. A tool can read one part, say
+ * the RIOT's RAM, from a state in memory or mapped from a file, without
+ * parsing or checking the rest. The layout is described in
+ * stella/src/emucore/StateManager.cxx.
+ *
+ * Each section holds what that part has always saved, starting with its
+ * name as a 32-bit length and the characters; in the M6532 section the
+ * 128 bytes of RAM follow right after. Numbers are in the byte order of
+ * the machine that saved the state. States saved for run-ahead or
+ * rollback (see RETRO_ENVIRONMENT_GET_SAVESTATE_CONTEXT) and incremental
+ * states have no checksums. States saved before sections were introduced
+ * still load, and so do those older than the 64-bit cycle counts (their
+ * header reads "03090100state"): their 32-bit counts are converted as
+ * they are read.
+ */
+
+/* Finds the section of the part with the given name in a state, checking
+ * its checksum, and answers its start, length and version; or NULL if
+ * there is no such section, or it is damaged. Of two parts with the same
+ * name, the first is found. Needs no game loaded. */
+RETRO_API const void *stella2014_state_section(const void *data, size_t size,
+      const char *name, size_t *length, unsigned *version);
+
+/*
+ ********************************
+ * State files
+ ********************************
+ *
+ * Saves and loads the state retro_serialize() would, as a file. When the
+ * core is built with HAVE_ZLIB=1 (off by default, as it links the
+ * system's libz), the file can be gzip-compressed: a few kilobytes of
+ * state typically shrink to a few hundred bytes. Compressed and
+ * uncompressed files both load.
+ */
+
+/* Writes the current state to 'path', compressed at the given zlib
+ * level: 1 is fastest, 9 smallest, and a negative level picks the
+ * fastest. At level 0, or without HAVE_ZLIB, the file holds exactly what
+ * retro_serialize() saves. The state is written to 'path' with ".tmp"
+ * appended, which then replaces the file, so an old file is only lost
+ * to a complete new one. Returns false if no game is loaded or the file
+ * couldn't be written, leaving any old file as it was. */
+RETRO_API bool stella2014_save_state_file(const char *path, int level);
+
+/* Loads a state written by stella2014_save_state_file(), or a file
+ * holding what retro_serialize() saves. Returns false as
+ * retro_unserialize() does, or if the file couldn't be read (including
+ * a compressed one, without HAVE_ZLIB). */
+RETRO_API bool stella2014_load_state_file(const char *path);
+
+/*
+ ********************************
+ * Snapshots
+ ********************************
+ *
+ * A snapshot holds the same emulated state as retro_serialize(), but the
+ * CPU, RIOT and TIA are copied as whole structs instead of field by
+ * field, which makes saving and restoring it several times cheaper. It
+ * is laid out as in memory, so it is only good for restoring in the same
+ * process while the same game is loaded; retro_serialize() remains the
+ * format for anything kept. The rewind ring records snapshots. As with
+ * rewinding, the audio filters and resampler carry on across a restore.
+ */
+
+/* Returns the size a snapshot takes now, or 0 if no game is loaded. Like
+ * retro_serialize_size(), it varies a little with the sound pending. */
+RETRO_API size_t stella2014_snapshot_size(void);
+
+/* Saves a snapshot into 'data'. Returns false if it doesn't fit. */
+RETRO_API bool stella2014_snapshot(void *data, size_t size);
+
+/* Restores a snapshot stella2014_snapshot() saved. Returns false, with
+ * the state possibly half restored, if it is not one of the game loaded. */
+RETRO_API bool stella2014_restore(const void *data, size_t size);
+
+/*
+ ********************************
+ * Rollback
+ ********************************
+ *
+ * For netplay rollback, the core can keep the snapshots of the latest
+ * frames itself and restore one by its frame number, instead of the
+ * frontend serializing every frame. The snapshots go to a ring of slots
+ * allocated up front, one slot per frame: frame numbers are the
+ * frontend's own, and each picks slot 'frame % slots'. Saving and
+ * restoring allocate nothing and parse no state tags, and a cart's
+ * pages are only mapped again when the snapshot is in another bank.
+ * The ring is emptied when a game is loaded.
+ */
+
+/* Sets the ring up with 'slots' slots, forgetting any frames saved, and
+ * allocates them if a game is loaded (otherwise at the first save). 0
+ * slots turns it off and frees its memory. The setting is kept across
+ * games. Returns false if the memory can't be had, which also turns it
+ * off. */
+RETRO_API bool stella2014_rollback_setup(unsigned slots);
+
+/* Saves a snapshot of the current state as the given frame, replacing
+ * the frame saved 'slots' frames before. Returns false if no game is
+ * loaded or the ring is off. */
+RETRO_API bool stella2014_rollback_save(unsigned frame);
+
+/* Restores the snapshot of the given frame and forgets the frames saved
+ * after it. Returns false if the ring doesn't hold that frame. */
+RETRO_API bool stella2014_rollback_load(unsigned frame);
+
+/*
+ ********************************
+ * Batch execution
+ ********************************
+ *
+ * stella2014_run_frames() advances the emulation by many frames in one
+ * call, for drivers (training harnesses, test farms) that would
+ * otherwise pay for a retro_run() and its callbacks on every frame.
+ * Each frame behaves exactly like retro_run(): input is latched when
+ * the frame starts, and audio is generated and filtered the same way,
+ * so a batch leaves the core in the same state as the equivalent
+ * sequence of retro_run() calls, and in-core rewind records every frame
+ * it finishes. Only the callbacks differ.
+ *
+ * The core keeps its console in process-wide state, so one loaded copy
+ * of it runs one console. Drivers running many consoles side by side
+ * need a process, or a separately loaded copy of the core, per console;
+ * there is no multi-console batch, and batching frames is what
+ * amortizes the per-frame costs (audio synthesis included) within each.
+ *
+ * A run ends when 'frames' frames are finished, or earlier when the
+ * system cycle count reaches 'until_cycle', the beam reaches
+ * 'until_scanline' (with STELLA2014_RUN_UNTIL_SCANLINE) or, with
+ * STELLA2014_RUN_UNTIL_TIMER, the RIOT timer expires. Those may stop it
+ * mid-frame; the next stella2014_run_frames() or retro_run() carries on
+ * with that frame. It also ends after a frame whose audio didn't all
+ * fit in 'audio'.
+ * A scanline target stops at the first time that scanline is reached
+ * after the call starts, which may be in a later frame. The CPU stops
+ * between instructions, so it can run past a target by the rest of an
+ * instruction, or by the rest of a scanline when halted on WSYNC.
+ */
+
+/* RetroPad state of all four ports for one frame */
+struct stella2014_input_frame
+{
+   int16_t joypad[4];   /* RETRO_DEVICE_ID_JOYPAD_* button bitmasks */
+   int16_t analog_x[4]; /* left analog stick, as from input_state_cb */
+   int16_t analog_y[4];
+};
+
+/* Call video_cb once, with the last finished frame */
+#define STELLA2014_RUN_VIDEO 1
+/* Call audio_batch_cb with the audio of every finished frame */
+#define STELLA2014_RUN_AUDIO 2
+/* Stop when the RIOT interval timer expires (the cycle at which TIMINT
+ * first reports it), as a cycle target at that cycle would: at the
+ * expiry pending when the run starts, or else at that of the game's
+ * next write to the timer. A game idling in a timer polling loop can so
+ * be run up to the end of its wait without stepping through it. */
+#define STELLA2014_RUN_UNTIL_TIMER 4
+/* Stop when the beam reaches 'until_scanline' */
+#define STELLA2014_RUN_UNTIL_SCANLINE 8
+
+struct stella2014_run
+{
+   /* In: number of frames to finish; 0 for no limit (needs until_cycle) */
+   unsigned frames;
+   /* In: system cycle to stop at, 0 for none */
+   uint64_t until_cycle;
+   /* In: scanline to stop at, with STELLA2014_RUN_UNTIL_SCANLINE */
+   unsigned until_scanline;
+   /* In: STELLA2014_RUN_* flags */
+   unsigned flags;
+   /* In: 'frames' entries, entry i being latched when the i-th frame of
+    * the run starts (unused if an earlier call already started it), or
+    * NULL to poll input_state_cb per frame as retro_run() does */
+   const struct stella2014_input_frame *input;
+   /* In: optional buffer receiving the interleaved stereo audio of all
+    * finished frames, at the rate retro_get_system_av_info() reports,
+    * and its capacity in stereo frames. With the audio callback
+    * registered (RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK) all audio goes
+    * through that instead, and neither this nor STELLA2014_RUN_AUDIO
+    * gets any. */
+   int16_t *audio;
+   size_t audio_capacity;
+
+   /* Out: frames finished, and stereo frames written to 'audio' */
+   unsigned frames_run;
+   size_t audio_frames;
+   /* Out: stereo frames of the last frame that didn't fit in 'audio',
+    * which are lost; the run ends after that frame */
+   size_t audio_dropped;
+   /* Out: true if the run stopped inside a frame */
+   bool partial;
+   /* Out: system cycle count and scanline of the current frame */
+   uint64_t cycle;
+   unsigned scanline;
+};
+
+/* Runs the emulation as described by 'run' and fills in its outputs.
+ * Returns false if no game is loaded, nothing bounds the run, or an
+ * input buffer is given without a frame count. */
+RETRO_API bool stella2014_run_frames(struct stella2014_run *run);
+
+/*
+ ********************************
+ * Audio-only rendering
+ ********************************
+ *
+ * stella2014_render_audio() runs the loaded game for its sound alone,
+ * for turning music ROMs into audio files many times faster than
+ * realtime. The CPU, the cartridge (coprocessor included) and the TIA
+ * run exactly as in retro_run(), with no input pressed, but the TIA
+ * draws nothing and no video is made, so the audio is the same as
+ * retro_run() would give. It goes through the same resampler, filters
+ * and audio timing options, at the rate retro_get_system_av_info()
+ * reports. The frame buffer is stale afterwards, until the next
+ * retro_run() draws a new frame.
+ *
+ * A frame whose audio didn't all fit is finished anyway, and the rest
+ * of its audio is returned first by the next call; loading a state or
+ * a game discards it.
+ */
+
+/* Runs as many frames as it takes to fill 'data' with exactly 'frames'
+ * interleaved stereo frames, and returns that number. Returns 0 if no
+ * game is loaded, or if the audio callback is registered
+ * (RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK), which then gets all audio. */
+RETRO_API size_t stella2014_render_audio(int16_t *data, size_t frames);
+
+/*
+ ********************************
+ * Execution profiler
+ ********************************
+ *
+ * Only collected by cores built with PROFILE=1 (STELLA_PROFILE); other
+ * builds keep no profiling state at all and stella2014_profile_dump()
+ * always returns 0.
+ *
+ * Per 6502 instruction, the cycles it took (stalls included) and its
+ * execution count are accumulated by cartridge bank and address. Per
+ * frame, the host time spent in TIA rendering, the Thumbulator and
+ * sound generation is recorded for the most recent 4096 frames.
+ */
+
+/* One line per executed (bank, address): bank,pc,instructions,cycles */
+#define STELLA2014_PROFILE_INSTRUCTIONS_CSV 0
+/* One line per frame: frame,cycles,tia_ns,thumb_ns,sound_ns */
+#define STELLA2014_PROFILE_FRAMES_CSV       1
+/* Both tables as flat little-endian records; see Profiler.hxx */
+#define STELLA2014_PROFILE_BINARY           2
+
+/* Writes the profile in the given format to 'data' if it fits in 'size'
+ * bytes and returns its full size, so a call with a NULL buffer sizes
+ * it. Returns 0 if the core was built without the profiler. */
+RETRO_API size_t stella2014_profile_dump(void *data, size_t size,
+      unsigned format);
+
+/* Discards everything the profiler has collected. */
+RETRO_API void stella2014_profile_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,158 @@
+//============================================================================
+//
+//   SSSS    tt          lll  lll
+//  SS  SS   tt           ll   ll
+//  SS     tttttt  eeee   ll   ll   aaaa
+//   SSSS    tt   ee  ee  ll   ll      aa
+//      SS   tt   eeeeee  ll   ll   aaaaa  --  "An Atari 2600 VCS Emulator"
+//  SS  SS   tt   ee      ll   ll  aa  aa
+//   SSSS     ttt  eeeee llll llll  aaaaa
+//
+// Copyright (c) 1995-2014 by Bradford W. Mott, Stephen Anthony
+// and the Stella Team
+//
+// See the file "License.txt" for information on usage and redistribution of
+// this file, and for a DISCLAIMER OF ALL WARRANTIES.
+//============================================================================
+
+#ifndef AUDIO_EVENT_QUEUE_HXX
+#define AUDIO_EVENT_QUEUE_HXX
+
+#include "bspf.hxx"
+
+/**
+  Acquire/release access to the queue indices.  Only compilers that offer
+  them get AUDIO_EVENT_QUEUE_THREADED; elsewhere the queue still works on
+  a single thread, but must not be shared between two.
+*/
+#if defined(__clang__) || \
+    (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)))
+  #define AUDIO_EVENT_QUEUE_THREADED
+  #define AEQ_LOAD_ACQUIRE(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+  #define AEQ_STORE_RELEASE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+  // x86 keeps loads and stores in order; only the compiler must not
+  // move them across the index accesses
+  #include <intrin.h>
+  #define AUDIO_EVENT_QUEUE_THREADED
+  #define AEQ_LOAD_ACQUIRE(p)     aeqLoadAcquire(p)
+  #define AEQ_STORE_RELEASE(p, v) aeqStoreRelease(p, v)
+  static inline uint32_t aeqLoadAcquire(const volatile uint32_t* p)
+  {
+    uint32_t v = *p;
+    _ReadWriteBarrier();
+    return v;
+  }
+  static inline void aeqStoreRelease(volatile uint32_t* p, uint32_t v)
+  {
+    _ReadWriteBarrier();
+    *p = v;
+  }
+#else
+  #define AEQ_LOAD_ACQUIRE(p)     (*(p))
+  #define AEQ_STORE_RELEASE(p, v) (*(p) = (v))
+#endif
+
+/**
+  A lock-free single-producer, single-consumer queue of timestamped TIA
+  sound events, which lets the sound registers be written on the
+  emulation thread and the samples be generated on another (the
+  frontend's audio thread, see RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK).
+
+  The producer only ever writes the tail index and the consumer only the
+  head index, each publishing its slots with a release store that the
+  other side reads with an acquire load.  Neither side ever blocks or
+  allocates: push() fails when the queue is full, and it is up to the
+  producer to resynchronize the consumer once there is room again (see
+  the Sync event).
+*/
+class AudioEventQueue
+{
+  public:
+    enum Type {
+      Write,  // a sound register write at 'cycle'
+      Time,   // emulation has reached 'cycle' (sent once per frame)
+      Sync    // all six registers, with the clock restarting at 'cycle'
+    };
+
+    struct Event
+    {
+      uint64_t cycle;
+      uint8_t type;
+      uint8_t addr;       // Write: register address (0x15 - 0x1a)
+      uint8_t value;      // Write: value written
+      uint8_t regs[6];    // Sync: AUDC0, AUDC1, AUDF0, AUDF1, AUDV0, AUDV1
+    };
+
+    // Number of events the queue holds (a power of two), enough for
+    // several frames of the busiest sound register traffic
+    enum { kCapacity = 8192 };
+
+  public:
+    AudioEventQueue() : myHead(0), myTail(0) { }
+
+    /**
+      Empty the queue.  Neither side may be using it at the time.
+    */
+    void clear() { myHead = myTail = 0; }
+
+    /**
+      Producer: append an event.
+
+      @return  False if the queue is full and the event was dropped
+    */
+    bool push(const Event& event)
+    {
+      uint32_t tail = myTail;
+      if(tail - AEQ_LOAD_ACQUIRE(&myHead) == kCapacity)
+        return false;
+
+      myEvents[tail & (kCapacity - 1)] = event;
+      AEQ_STORE_RELEASE(&myTail, tail + 1);
+      return true;
+    }
+
+    /**
+      Consumer: the oldest event, if there is one.  It stays in the queue
+      until pop() is called.
+
+      @return  The event, or 0 if the queue is empty
+    */
+    const Event* front() const
+    {
+      uint32_t head = myHead;
+      if(head == AEQ_LOAD_ACQUIRE(&myTail))
+        return 0;
+
+      return &myEvents[head & (kCapacity - 1)];
+    }
+
+    /**
+      Consumer: the newest event, if there is one.  Its slot can't be
+      reused before the consumer pops it, so reading it is safe.
+
+      @return  The event, or 0 if the queue is empty
+    */
+    const Event* back() const
+    {
+      uint32_t tail = AEQ_LOAD_ACQUIRE(&myTail);
+      if(myHead == tail)
+        return 0;
+
+      return &myEvents[(tail - 1) & (kCapacity - 1)];
+    }
+
+    /**
+      Consumer: remove the event front() answered.
+    */
+    void pop() { AEQ_STORE_RELEASE(&myHead, myHead + 1); }
+
+  private:
+    Event myEvents[kCapacity];
+
+    // Free-running indices; each is only written by one side
+    volatile uint32_t myHead;
+    volatile uint32_t myTail;
+};
+
+#endif
@@ -25,6 +25,8 @@
 #include "System.hxx"
 #include "OSystem.hxx"
 #include "Console.hxx"
+#include "Cart.hxx"
+#include "AudioEventQueue.hxx"
 #include "Sound.hxx"
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -32,12 +34,24 @@ Sound::Sound(OSystem* osystem)
   : myIsEnabled(false),
     myIsInitializedFlag(false),
     myLastRegisterSetCycle(0),
+    myCycleOrigin(0),
     myNumChannels(0),
     myIsMuted(true),
-    myVolume(100)
+    myVolume(100),
+    myInlineFlag(false),
+    myInlineCycle(0),
+    myInlineSamples(0),
+    myEventQueue(0),
+    myEventsLost(true),
+    myMusicCart(0),
+    myMusicFirst(0),
+    myMusicCount(0),
+    myMusicSpan(0)
 {
   myIsInitializedFlag = true;
   myOSystem           = osystem;
+  myMusicOn[0] = myMusicOn[1] = false;
+  myMusicQueued[0] = myMusicQueued[1] = false;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -81,9 +95,13 @@ void Sound::close()
   if(myIsInitializedFlag)
   {
     myIsEnabled = false;
-    myLastRegisterSetCycle = 0;
+    myLastRegisterSetCycle = myCycleOrigin;
     myTIASound.reset();
     myRegWriteQueue.clear();
+    myInlineCycle = myCycleOrigin;
+    myInlineSamples = 0;
+    myMusicOn[0] = myMusicOn[1] = false;
+    myMusicQueued[0] = myMusicQueued[1] = false;
   }
 }
 
@@ -99,9 +117,14 @@ void Sound::reset()
 {
   if(myIsInitializedFlag)
   {
-    myLastRegisterSetCycle = 0;
+    myLastRegisterSetCycle = myCycleOrigin;
     myTIASound.reset();
     myRegWriteQueue.clear();
+    myInlineCycle = myCycleOrigin;
+    myInlineSamples = 0;
+    myMusicOn[0] = myMusicOn[1] = false;
+    myMusicQueued[0] = myMusicQueued[1] = false;
+    resync(myCycleOrigin);
     mute(myIsMuted);
   }
 }
@@ -134,9 +157,9 @@ void Sound::adjustVolume(int8_t direction)
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void Sound::adjustCycleCounter(int32_t amount)
+void Sound::setCycleOrigin(uint64_t cycle)
 {
-  myLastRegisterSetCycle += amount;
+  myCycleOrigin = cycle;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -147,17 +170,149 @@ void Sound::setChannels(uint32_t channels)
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void Sound::set(uint16_t addr, uint8_t value, int32_t cycle)
+void Sound::setInline(bool state)
 {
+  flushQueue();
+  myInlineFlag = state;
+  myInlineCycle = myCycleOrigin;
+  myInlineSamples = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Sound::setEventQueue(AudioEventQueue* queue)
+{
+  flushQueue();
+  myEventQueue = queue;
+  myInlineSamples = 0;
+  resync(myCycleOrigin);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Sound::markTime(uint64_t cycle)
+{
+  if(myEventQueue)
+    publish(AudioEventQueue::Time, cycle, 0, 0);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Sound::setMusicSource(Cartridge* cart)
+{
+  if(myMusicCart)
+    myMusicCart->setMusicStream(0);
+
+  myMusicCart = cart;
+  myMusicStream.restart(myCycleOrigin);
+  myMusicOn[0] = myMusicOn[1] = false;
+  myMusicQueued[0] = myMusicQueued[1] = false;
+
+  if(myMusicCart)
+    myMusicCart->setMusicStream(&myMusicStream);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Sound::resync(uint64_t cycle)
+{
+  myEventsLost = true;
+  if(myEventQueue)
+    publish(AudioEventQueue::Time, cycle, 0, 0);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Sound::publish(uint8_t type, uint64_t cycle, uint16_t addr, uint8_t value)
+{
+  AudioEventQueue::Event event;
+  event.cycle = cycle;
+  event.addr = (uint8_t)addr;
+  event.value = value;
+
+  if(myEventsLost)
+  {
+    // The registers already hold any write being published, so the
+    // Sync event covers it
+    event.type = AudioEventQueue::Sync;
+    for(uint16_t i = 0; i < 6; ++i)
+      event.regs[i] = myTIASound.get(0x15 + i);
+    if(!myEventQueue->push(event))
+      return;
+    myEventsLost = false;
+    if(type == AudioEventQueue::Write)
+      return;
+  }
+
+  event.type = type;
+  if(!myEventQueue->push(event))
+    myEventsLost = true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Sound::set(uint16_t addr, uint8_t value, uint64_t cycle)
+{
+  if(myEventQueue)
+  {
+    // The samples are generated by the consumer of the queue; only the
+    // registers are kept here, for savestates
+    myTIASound.set(addr, value);
+    publish(AudioEventQueue::Write, cycle, addr, value);
+    return;
+  }
+
+  // ARM music: an AUDV write storing an AMPLITUDE fetch hands the
+  // channel to the music stream, and any other ends that
+  if(myMusicCart && (addr == 0x19 || addr == 0x1a))
+  {
+    uint32_t channel = addr - 0x19;
+    bool music = myMusicStream.fetchWrite(value, cycle);
+
+    // Only the write that hands the channel over is queued
+    if(!myInlineFlag)
+    {
+      if(music && myMusicQueued[channel])
+        return;
+      myMusicQueued[channel] = music;
+    }
+    if(music)
+      addr |= kMusicWrite;
+  }
+
+  if(myInlineFlag)
+  {
+    // Bring the output up to this cycle, then change the register.  If
+    // the fragment filled up before reaching it, the write waits in the
+    // queue until finishFragment() has handed out the samples before it.
+    advanceTo(cycle);
+    if(myRegWriteQueue.size() == 0 && cycle < myInlineCycle + 38)
+    {
+      applyWrite(addr, value);
+      return;
+    }
+  }
+
   // Record how many CPU cycles have passed since the last register write.
   // All queue timing is integer CPU cycles: the TIA emits exactly one
   // audio sample every 38 CPU cycles (2 samples per 76-cycle scanline,
   // per real hardware / MiSTer RTL), so no seconds conversion is needed
-  // and the arithmetic is exact and deterministic.
-  int32_t delta = cycle - myLastRegisterSetCycle;
+  // and the arithmetic is exact and deterministic.  Inline, the first
+  // write waiting counts from the sample clock instead.
+  uint64_t since = (myInlineFlag && myRegWriteQueue.size() == 0) ?
+      myInlineCycle : myLastRegisterSetCycle;
+  int64_t delta = (int64_t)(cycle - since);
   if(delta < 0)
     delta = 0;
 
+  // If the queue is full (only a frame far longer than normal, writing
+  // sound registers all the time, gets here), apply the oldest write now,
+  // as processFragment() does with writes it has no room for, and fold
+  // its delay into the next one so the rest of the queue keeps its
+  // timing.  Either way the result only depends on the emulated timeline.
+  if(myRegWriteQueue.full())
+  {
+    RegWrite& oldest = myRegWriteQueue.front();
+    uint32_t deltaCycles = oldest.deltaCycles;
+    applyWrite(oldest.addr, oldest.value);
+    myRegWriteQueue.dequeue();
+    myRegWriteQueue.front().deltaCycles += deltaCycles;
+  }
+
   RegWrite info;
   info.addr = addr;
   info.value = value;
@@ -189,11 +344,22 @@ void Sound::processFragment(int16_t* stream, uint32_t length)
     {
       RegWrite& info = myRegWriteQueue.front();
       removedCycles += info.deltaCycles;
-      myTIASound.set(info.addr, info.value);
+      applyWrite(info.addr, info.value);
       myRegWriteQueue.dequeue();
     }
   }
 
+  // The music rendered since the last fragment is spread over this one
+  if(myMusicCart)
+  {
+    myMusicCart->renderMusic();
+    myMusicCount = myMusicStream.size();
+    if(myMusicCount > length)
+      myMusicCount = length;
+    myMusicFirst = myMusicStream.first() + myMusicStream.size() - myMusicCount;
+    myMusicSpan = length;
+  }
+
   uint64_t positionCycles = 0;   // elapsed time within this fragment
 
   while(positionCycles < streamLengthCycles)
@@ -204,14 +370,14 @@ void Sound::processFragment(int16_t* stream, uint32_t length)
     {
       // There are no more pending TIA sound register updates so we'll
       // use the current settings to finish filling the sound fragment
-      myTIASound.process(stream + (positionSamples * channels),
-          length - positionSamples);
+      generate(stream + (positionSamples * channels),
+          length - positionSamples, positionSamples);
 
       // Since we had to fill the fragment we'll reset the cycle counter
-      // to zero.  NOTE: This isn't 100% correct, however, it'll do for
-      // now.  We should really remember the overrun and remove it from
-      // the delta of the next write.
-      myLastRegisterSetCycle = 0;
+      // to the start of the frame.  NOTE: This isn't 100% correct, however,
+      // it'll do for now.  We should really remember the overrun and remove
+      // it from the delta of the next write.
+      myLastRegisterSetCycle = myCycleOrigin;
       break;
     }
     else
@@ -235,12 +401,12 @@ void Sound::processFragment(int16_t* stream, uint32_t length)
           // crossed: floor((pos+delta)/38) - floor(pos/38).
           uint32_t nextSamples = (uint32_t)
               ((positionCycles + info.deltaCycles) / CYCLES_PER_SAMPLE);
-          myTIASound.process(stream + (positionSamples * channels),
-              nextSamples - positionSamples);
+          generate(stream + (positionSamples * channels),
+              nextSamples - positionSamples, positionSamples);
 
           positionCycles += info.deltaCycles;
         }
-        myTIASound.set(info.addr, info.value);
+        applyWrite(info.addr, info.value);
         myRegWriteQueue.dequeue();
       }
       else
@@ -248,13 +414,137 @@ void Sound::processFragment(int16_t* stream, uint32_t length)
         // The next register update occurs in the next fragment so finish
         // this fragment with the current TIA settings and reduce the register
         // update delay by the corresponding amount of time
-        myTIASound.process(stream + (positionSamples * channels),
-            length - positionSamples);
+        generate(stream + (positionSamples * channels),
+            length - positionSamples, positionSamples);
         info.deltaCycles -= (uint32_t)remainingCycles;
         break;
       }
     }
   }
+
+  if(myMusicCart)
+    myMusicStream.discard(myMusicFirst + myMusicCount);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint32_t Sound::finishFragment(uint64_t cycle, int16_t*& stream)
+{
+  advanceTo(cycle);
+
+  uint32_t length = myInlineSamples;
+  myInlineSamples = 0;
+  stream = myInlineBuffer;
+  return length;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Sound::advanceTo(uint64_t cycle)
+{
+  // One sample every 38 CPU cycles, as in processFragment(); the clock
+  // only moves in whole samples so the remainder carries over
+  const uint32_t CYCLES_PER_SAMPLE = 38;
+
+  // The music levels follow the same clock, one per sample
+  if(myMusicCart)
+    myMusicCart->renderMusic();
+
+  for(;;)
+  {
+    // Apply the waiting writes the clock has reached, as set() does;
+    // the front one counts from the clock, the others from the one
+    // before them
+    while(myRegWriteQueue.size() > 0 &&
+          myRegWriteQueue.front().deltaCycles < CYCLES_PER_SAMPLE)
+    {
+      RegWrite& info = myRegWriteQueue.front();
+      uint32_t deltaCycles = info.deltaCycles;
+      applyWrite(info.addr, info.value);
+      myRegWriteQueue.dequeue();
+      if(myRegWriteQueue.size() > 0)
+        myRegWriteQueue.front().deltaCycles += deltaCycles;
+    }
+
+    // Run up to the next waiting write, or the given cycle, for as long
+    // as the fragment has room; the rest waits for the next call
+    uint64_t target = cycle;
+    if(myRegWriteQueue.size() > 0 &&
+       myInlineCycle + myRegWriteQueue.front().deltaCycles < target)
+      target = myInlineCycle + myRegWriteQueue.front().deltaCycles;
+    if(target <= myInlineCycle)
+      break;
+
+    uint64_t samples = (target - myInlineCycle) / CYCLES_PER_SAMPLE;
+    uint32_t room = kInlineSamples - myInlineSamples;
+    if(samples > room)
+      samples = room;
+    if(samples == 0)
+      break;
+
+    if(myMusicCart)
+    {
+      myMusicFirst = myMusicStream.index(myInlineCycle);
+      myMusicCount = myMusicSpan = 1;
+    }
+
+    generate(myInlineBuffer + 2 * myInlineSamples, (uint32_t)samples, 0);
+    myInlineSamples += (uint32_t)samples;
+    myInlineCycle += samples * CYCLES_PER_SAMPLE;
+    if(myRegWriteQueue.size() > 0)
+      myRegWriteQueue.front().deltaCycles -=
+          (uint32_t)(samples * CYCLES_PER_SAMPLE);
+  }
+
+  if(myMusicCart)
+    myMusicStream.discard(myMusicStream.index(myInlineCycle));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Sound::flushQueue()
+{
+  while(myRegWriteQueue.size() > 0)
+  {
+    RegWrite& info = myRegWriteQueue.front();
+    applyWrite(info.addr, info.value);
+    myRegWriteQueue.dequeue();
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Sound::applyWrite(uint16_t addr, uint8_t value)
+{
+  if(addr & kMusicWrite)
+  {
+    addr &= ~kMusicWrite;
+    myMusicOn[addr - 0x19] = true;
+  }
+  else if(addr == 0x19 || addr == 0x1a)
+    myMusicOn[addr - 0x19] = false;
+
+  myTIASound.set(addr, value);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Sound::generate(int16_t* stream, uint32_t samples, uint32_t position)
+{
+  if(!myMusicCart || !(myMusicOn[0] || myMusicOn[1]))
+  {
+    myTIASound.process(stream, samples);
+    return;
+  }
+
+  // The channels playing the music get the level of every sample, as
+  // if the 6502 wrote it to AUDV every 38 cycles
+  for(uint32_t i = 0; i < samples; ++i, ++position)
+  {
+    uint8_t level = myMusicStream.level(myMusicFirst +
+        (uint64_t)position * myMusicCount / myMusicSpan);
+
+    if(myMusicOn[0])
+      myTIASound.set(0x19, level);
+    if(myMusicOn[1])
+      myTIASound.set(0x1a, level);
+    myTIASound.process(stream + 2 * i, 1);
+  }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -269,7 +559,8 @@ bool Sound::save(Serializer& out) const
    if(!myTIASound.save(out))
       return false;
 
-   out.putInt(myLastRegisterSetCycle);
+   out.putLong(myLastRegisterSetCycle);
+   out.putLong(myCycleOrigin);
 
    // Pending register writes that have been queued but not yet
    // consumed by processFragment(); dropping them on load loses
@@ -284,6 +575,13 @@ bool Sound::save(Serializer& out) const
       out.putInt(r.deltaCycles);
    }
 
+   // Inline generation: the cycle clock and the samples of a fragment
+   // that isn't finished yet (only when saved in the middle of a frame)
+   out.putBool(myInlineFlag);
+   out.putLong(myInlineCycle);
+   out.putInt(myInlineSamples);
+   out.putShortArray((const uint16_t*)myInlineBuffer, 2 * myInlineSamples);
+
    return true;
 }
 
@@ -296,10 +594,19 @@ bool Sound::load(Serializer& in)
    if(!myTIASound.load(in))
       return false;
 
-   myLastRegisterSetCycle = (int32_t) in.getInt();
+   // Nothing is kept until the counts are checked: a state refused
+   // halfway leaves an empty queue and inline fragment, not bad counts
+   uint64_t lastRegisterSetCycle = in.getCycles();
+   uint64_t cycleOrigin = in.legacy() ? Serializer::kLegacyCycleBase :
+                                        in.getLong();
 
    myRegWriteQueue.clear();
+   myInlineSamples = 0;
+   myMusicOn[0] = myMusicOn[1] = false;
+   myMusicQueued[0] = myMusicQueued[1] = false;
    uint32_t n = (uint32_t) in.getInt();
+   if(n > RegWriteQueue::kCapacity)
+      return false;
    for(uint32_t i = 0; i < n; ++i)
    {
       RegWrite r;
@@ -309,89 +616,87 @@ bool Sound::load(Serializer& in)
       myRegWriteQueue.enqueue(r);
    }
 
-   return true;
-}
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-Sound::RegWriteQueue::RegWriteQueue(uint32_t capacity)
-  : myCapacity(capacity),
-    myBuffer(0),
-    mySize(0),
-    myHead(0),
-    myTail(0)
-{
-  myBuffer = new RegWrite[myCapacity];
-}
+   // A legacy state has no inline generation, as if saved without it
+   bool inlineState = !in.legacy() && in.getBool();
+   uint64_t inlineCycle = in.legacy() ? 0 : in.getLong();
+   uint32_t inlineSamples = in.legacy() ? 0 : (uint32_t) in.getInt();
+   if(inlineSamples > kInlineSamples)
+   {
+      myRegWriteQueue.clear();
+      return false;
+   }
+   in.getShortArray((uint16_t*)myInlineBuffer, 2 * inlineSamples);
+
+   myLastRegisterSetCycle = lastRegisterSetCycle;
+   myCycleOrigin = cycleOrigin;
+   myInlineCycle = inlineCycle;
+   myInlineSamples = inlineSamples;
+
+   // A state saved in the other mode carries no usable inline clock, or
+   // queued writes timed for the other; carry on from the start of its
+   // frame
+   if(myInlineFlag && !inlineState)
+      setInline(true);
+   else if(!myInlineFlag)
+   {
+      if(inlineState)
+         flushQueue();
+      myInlineSamples = 0;
+   }
 
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-Sound::RegWriteQueue::~RegWriteQueue()
-{
-  delete[] myBuffer;
-}
+   // The timeline jumped: resynchronize the event queue's consumer
+   if(myEventQueue)
+   {
+      flushQueue();
+      resync(myCycleOrigin);
+   }
 
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void Sound::RegWriteQueue::clear()
-{
-  myHead = myTail = mySize = 0;
+   return true;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void Sound::RegWriteQueue::dequeue()
+bool Sound::saveMusic(Serializer& out) const
 {
-  if(mySize > 0)
-  {
-    myHead = (myHead + 1) % myCapacity;
-    --mySize;
-  }
-}
+   out.putBool(myMusicOn[0]);
+   out.putBool(myMusicOn[1]);
+   out.putBool(myMusicQueued[0]);
+   out.putBool(myMusicQueued[1]);
+   myMusicStream.save(out);
 
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-uint64_t Sound::RegWriteQueue::durationCycles()
-{
-  uint64_t duration = 0;
-  for(uint32_t i = 0; i < mySize; ++i)
-  {
-    duration += myBuffer[(myHead + i) % myCapacity].deltaCycles;
-  }
-  return duration;
+   return true;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void Sound::RegWriteQueue::enqueue(const RegWrite& info)
+bool Sound::loadMusic(Serializer& in)
 {
-  // If an attempt is made to enqueue more than the queue can hold then
-  // we'll enlarge the queue's capacity.
-  if(mySize == myCapacity)
-    grow();
-
-  myBuffer[myTail] = info;
-  myTail = (myTail + 1) % myCapacity;
-  ++mySize;
-}
+   myMusicOn[0] = in.getBool();
+   myMusicOn[1] = in.getBool();
+   myMusicQueued[0] = in.getBool();
+   myMusicQueued[1] = in.getBool();
 
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-Sound::RegWrite& Sound::RegWriteQueue::front()
-{
-  return myBuffer[myHead];
+   if(!myMusicStream.load(in))
+   {
+      myMusicOn[0] = myMusicOn[1] = false;
+      myMusicQueued[0] = myMusicQueued[1] = false;
+      return false;
+   }
+   return true;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-uint32_t Sound::RegWriteQueue::size() const
+Sound::RegWriteQueue::RegWriteQueue()
+  : mySize(0),
+    myHead(0)
 {
-  return mySize;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void Sound::RegWriteQueue::grow()
+uint64_t Sound::RegWriteQueue::durationCycles() const
 {
-  RegWrite* buffer = new RegWrite[myCapacity * 2];
+  uint64_t duration = 0;
   for(uint32_t i = 0; i < mySize; ++i)
   {
-    buffer[i] = myBuffer[(myHead + i) % myCapacity];
+    duration += peek(i).deltaCycles;
   }
-  myHead = 0;
-  myTail = mySize;
-  myCapacity = myCapacity * 2;
-  delete[] myBuffer;
-  myBuffer = buffer;
+  return duration;
 }
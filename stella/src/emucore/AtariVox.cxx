@@ -111,7 +111,7 @@ void AtariVox::write(DigitalPin pin, bool value)
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void AtariVox::clockDataIn(bool value)
 {
-  uint32_t cycle = mySystem.cycles();
+  uint64_t cycle = mySystem.cycles();
 
   if(value && (myShiftCount == 0))
     return;
@@ -153,16 +153,6 @@ void AtariVox::clockDataIn(bool value)
   myLastDataWriteCycle = cycle;
 }
 
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void AtariVox::systemCyclesReset()
-{
-  myLastDataWriteCycle -= mySystem.cycles();
-
-  // The EEPROM keeps track of cycle counts, and needs to know when the
-  // cycles are reset
-  myEEPROM->systemCyclesReset();
-}
-
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 string AtariVox::about() const
 {
@@ -84,13 +84,6 @@ class AtariVox : public Controller
     */
     void update() { }
 
-    /**
-      Notification method invoked by the system right before the
-      system resets its cycle counter to zero.  It may be necessary 
-      to override this method for devices that remember cycle counts.
-    */
-    void systemCyclesReset();
-
     string about() const;
 
   private:
@@ -119,7 +112,7 @@ class AtariVox : public Controller
     // The real SpeakJet chip reads data at 19200 bits/sec. Alex's
     // driver code sends data at 62 CPU cycles per bit, which is
     // "close enough".
-    uint32_t myLastDataWriteCycle;
+    uint64_t myLastDataWriteCycle;
 
     // Holds information concerning serial port usage
     string myAboutString;
@@ -20,6 +20,7 @@
 #include <cstring>
 
 #include "bspf.hxx"
+#include "System.hxx"
 #include "Cart.hxx"
 #include "Cart0840.hxx"
 #include "Cart2K.hxx"
@@ -324,7 +325,8 @@ Cartridge::Cartridge(const Settings& settings)
     myStartBank(0),
     myBankChanged(true),
     myCodeAccessBase(NULL),
-    myBankLocked(false)
+    myBankLocked(false),
+    myMusicStream(0)
 {
 }
 
@@ -335,6 +337,27 @@ Cartridge::~Cartridge()
     delete[] myCodeAccessBase;
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Cartridge::renderMusicNow()
+{
+  MusicStream& music = *myMusicStream;
+  uint64_t cycle = mySystem->cycles();
+  uint64_t next = music.nextCycle();
+
+  // The timeline jumped (reset, state load), or nothing rendered for
+  // longer than the stream holds: start over from here
+  if(cycle + MusicStream::kCyclesPerLevel < next ||
+     (cycle > next && cycle - next >
+        (uint64_t)MusicStream::kCapacity * MusicStream::kCyclesPerLevel))
+    music.restart(cycle);
+
+  while(music.nextCycle() <= cycle)
+  {
+    uint64_t at = music.nextCycle();
+    music.push(music.holding(at) ? music.lastFetch() : musicLevel(at));
+  }
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 bool Cartridge::save(ofstream& out)
 {
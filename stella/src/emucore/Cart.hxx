@@ -30,6 +30,7 @@ class Properties;
 #include "Array.hxx"
 #include "Device.hxx"
 #include "Settings.hxx"
+#include "MusicStream.hxx"
 
 struct RamArea {
   uint16_t start;  uint16_t size;  uint16_t roffset;  uint16_t woffset;
@@ -213,7 +214,43 @@ class Cartridge : public Device
     */
     virtual void setRomName(const string& name) { }
 
+    /**
+      Carts whose music fetchers the 6502 reads through an AMPLITUDE
+      register (CDF, BUS, DPC+) render the levels they give into the
+      given stream, one every 38 cycles, for Sound to play in place of
+      the AUDV writes that copy them (see Sound::setMusicSource()).
+      Every other cart ignores it.
+
+      @param stream  The stream to render into, or 0 to stop rendering
+    */
+    void setMusicStream(MusicStream* stream) { myMusicStream = stream; }
+
+    /**
+      Render the music stream up to the current cycle.  The music carts
+      call this before anything changes what their fetchers give.
+    */
+    void renderMusic() { if(myMusicStream) renderMusicNow(); }
+
   protected:
+    /**
+      The level the music fetchers give the AMPLITUDE register at the
+      given cycle (not before their last update), without changing any
+      state.  Only the music carts have one.
+
+      @param cycle  The system cycle
+      @return  The value an AMPLITUDE fetch at that cycle would read
+    */
+    virtual uint8_t musicLevel(uint64_t cycle) const { (void)cycle; return 0; }
+
+    /**
+      Record an AMPLITUDE fetch in the music stream, if there is one.
+
+      @param value  The value the fetch read
+      @param cycle  The system cycle of the fetch
+    */
+    void noteMusicFetch(uint8_t value, uint64_t cycle)
+      { if(myMusicStream) myMusicStream->fetched(value, cycle); }
+
     /**
       Add the given area to the RamArea list for this cart.
 
@@ -241,6 +278,9 @@ class Cartridge : public Device
     void createCodeAccessBase(uint32_t size);
 
   private:
+    // Render the music stream up to the current cycle
+    void renderMusicNow();
+
     /**
       Get an image pointer and size for a ROM that is part of a larger,
       multi-ROM image.
@@ -483,6 +523,9 @@ class Cartridge : public Device
     // by the debugger, when disassembling/dumping ROM.
     bool myBankLocked;
 
+    // The stream the music fetchers render into, if any
+    MusicStream* myMusicStream;
+
     // Contains info about this cartridge in string format
     static string myAboutString;
 
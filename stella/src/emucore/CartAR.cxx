@@ -79,16 +79,6 @@ void CartridgeAR::reset()
   bankConfiguration(0);
 }
 
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void CartridgeAR::systemCyclesReset()
-{
-  // Get the current system cycle
-  uint32_t cycles = mySystem->cycles();
-
-  // Adjust cycle values
-  myPowerRomCycle -= cycles;
-}
-
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void CartridgeAR::install(System& system)
 {
@@ -457,7 +447,7 @@ bool CartridgeAR::save(Serializer& out) const
    out.putBool(myPower);
 
    // Indicates when the power was last turned on
-   out.putInt(myPowerRomCycle);
+   out.putLong(myPowerRomCycle);
 
    // Data hold register used for writing
    out.putByte(myDataHoldRegister);
@@ -500,7 +490,7 @@ bool CartridgeAR::load(Serializer& in)
    myPower = in.getBool();
 
    // Indicates when the power was last turned on
-   myPowerRomCycle = (int32_t) in.getInt();
+   myPowerRomCycle = in.getCycles();
 
    // Data hold register used for writing
    myDataHoldRegister = in.getByte();
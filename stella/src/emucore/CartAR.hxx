@@ -63,13 +63,6 @@ class CartridgeAR : public Cartridge
     */
     void reset();
 
-    /**
-      Notification method invoked by the system right before the
-      system resets its cycle counter to zero.  It may be necessary
-      to override this method for devices that remember cycle counts.
-    */
-    void systemCyclesReset();
-
     /**
       Install cartridge in the specified system.  Invoked by the system
       when the cartridge is attached to it.
@@ -194,7 +187,7 @@ class CartridgeAR : public Cartridge
     bool myPower;
 
     // Indicates when the power was last turned on
-    int32_t myPowerRomCycle;
+    uint64_t myPowerRomCycle;
 
     // Data hold register used for writing
     uint8_t myDataHoldRegister;
@@ -79,6 +79,9 @@ void CartridgeARM::setArmTimingForFormat(const string& format)
 void CartridgeARM::runArm(uint32_t cycles, bool irqDrivenAudio)
 {
 #ifdef THUMB_SUPPORT
+#ifdef STELLA_PROFILE
+  Profiler::Scope profile(mySystem->profiler(), Profiler::Thumbulator);
+#endif
   if(myThumbEmulator != 0)
     thumb_run_cycles(myThumbEmulator, cycles, irqDrivenAudio ? 1 : 0);
 #else
@@ -80,6 +80,7 @@ CartridgeBUS::CartridgeBUS(const uint8_t* image, uint32_t size,
   setupVersion();
 
   myDriverImage = myRAM;
+  myRAMPages.attach(myRAM, sizeof(myRAM));
 
   {
     uint32_t cBase, cStart, cStack;
@@ -104,6 +105,7 @@ CartridgeBUS::CartridgeBUS(const uint8_t* image, uint32_t size,
                   cStart, cStack, cBase);
     thumb_set_callback(myThumbEmulator, THUMB_CONFIG_BUS, this,
                        bus_thumb_callback);
+    myThumbEmulator->ram_written = myRAMPages.writeFlags();
 #else
     (void)cBase; (void)cStart; (void)cStack;  /* only used with THUMB_SUPPORT */
 #endif
@@ -133,8 +135,8 @@ void CartridgeBUS::reset()
     for(i = start; i < (int)sizeof(myRAM); ++i)
       myRAM[i] = 0;
 
-  myAudioCycles = 0;
-  myARMCycles = 0;
+  myAudioCycles = mySystem->cycles();
+  myARMCycles = mySystem->cycles();
   myFractionalClocksFrac = 0;
 
   setInitialState();
@@ -150,6 +152,7 @@ void CartridgeBUS::setInitialState()
     memcpy(myDriverImage, myImage, 3 * 1024);
   else
     memcpy(myDriverImage, myImage, 2 * 1024);
+  myRAMPages.writtenAll();
 
   for(i = 0; i < 3; ++i)
     myMusicWaveformSize[i] = 27;
@@ -244,6 +247,9 @@ uint32_t CartridgeBUS::thumbCallback(uint8_t function, uint32_t value1,
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void CartridgeBUS::callFunction(uint8_t value)
 {
+  /* The ARM code may retune the music fetchers */
+  renderMusic();
+
 #ifdef THUMB_SUPPORT
   switch(value)
   {
@@ -273,6 +279,7 @@ void CartridgeBUS::updateMusicModeDataFetchers()
   uint32_t whole;
   int x;
 
+  renderMusic();
   myAudioCycles = mySystem->cycles();
 
   scaled = (uint64_t)num * cycles + myFractionalClocksFrac;
@@ -284,6 +291,49 @@ void CartridgeBUS::updateMusicModeDataFetchers()
       myMusicCounters[x] += myMusicFrequencies[x] * whole;
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint8_t CartridgeBUS::musicLevel(uint64_t cycle) const
+{
+  /* The counters as updateMusicModeDataFetchers() would leave them at
+     'cycle', left as they are */
+  uint64_t cycles = cycle > myAudioCycles ? cycle - myAudioCycles : 0;
+  uint32_t num = (myClockRate == 715909u) ? 12000u : 10000u;
+  uint32_t whole = (uint32_t)
+      (((uint64_t)num * cycles + myFractionalClocksFrac) / myClockRate);
+  uint32_t counters[3];
+  int x;
+
+  for(x = 0; x <= 2; ++x)
+    counters[x] = myMusicCounters[x] + myMusicFrequencies[x] * whole;
+
+  return amplitude(counters);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint8_t CartridgeBUS::amplitude(const uint32_t* counters) const
+{
+  /* Only BUS3 plays digital samples */
+  if(myBUSSubtype == BUSSubtype_BUS3 && DIGITAL_AUDIO_ON(myMode))
+  {
+    uint32_t sampleaddress = getSample() + (counters[0] >> 21);
+    uint8_t value;
+
+    if(sampleaddress < 0x8000)
+      value = myImage[sampleaddress];
+    else if(sampleaddress >= 0x40000000 && sampleaddress < 0x40002000)
+      value = myRAM[sampleaddress - 0x40000000];
+    else
+      value = 0;
+    if((counters[0] & (1 << 20)) == 0)
+      value >>= 4;
+    return value & 0x0f;
+  }
+
+  return myDisplayImage[getWaveform(0) + (counters[0] >> myMusicWaveformSize[0])]
+       + myDisplayImage[getWaveform(1) + (counters[1] >> myMusicWaveformSize[1])]
+       + myDisplayImage[getWaveform(2) + (counters[2] >> myMusicWaveformSize[2])];
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 uint8_t CartridgeBUS::busOverdrive(uint16_t address)
 {
@@ -324,6 +374,8 @@ void CartridgeBUS::setDatastreamPointer(uint8_t index, uint32_t value)
   myRAM[address + 1] = (value >> 8) & 0xff;
   myRAM[address + 2] = (value >> 16) & 0xff;
   myRAM[address + 3] = (value >> 24) & 0xff;
+  myRAMPages.written(address);
+  myRAMPages.written(address + 3);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -342,6 +394,8 @@ void CartridgeBUS::setDatastreamIncrement(uint8_t index, uint32_t value)
   myRAM[address + 1] = (value >> 8) & 0xff;
   myRAM[address + 2] = (value >> 16) & 0xff;
   myRAM[address + 3] = (value >> 24) & 0xff;
+  myRAMPages.written(address);
+  myRAMPages.written(address + 3);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -360,6 +414,8 @@ void CartridgeBUS::setAddressMap(uint8_t index, uint32_t value)
   myRAM[address + 1] = (value >> 8) & 0xff;
   myRAM[address + 2] = (value >> 16) & 0xff;
   myRAM[address + 3] = (value >> 24) & 0xff;
+  myRAMPages.written(address);
+  myRAMPages.written(address + 3);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -375,7 +431,7 @@ uint32_t CartridgeBUS::getWaveform(uint8_t index) const
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-uint32_t CartridgeBUS::getSample()
+uint32_t CartridgeBUS::getSample() const
 {
   uint16_t address = myWaveformBase;
   return  myRAM[address + 0]        + (myRAM[address + 1] << 8)
@@ -467,12 +523,9 @@ uint8_t CartridgeBUS::peek(uint16_t address)
       {
         if(index == 0x08)  /* AMPLITUDE */
         {
-          uint32_t i;
           updateMusicModeDataFetchers();
-          i = myDisplayImage[getWaveform(0) + (myMusicCounters[0] >> myMusicWaveformSize[0])]
-            + myDisplayImage[getWaveform(1) + (myMusicCounters[1] >> myMusicWaveformSize[1])]
-            + myDisplayImage[getWaveform(2) + (myMusicCounters[2] >> myMusicWaveformSize[2])];
-          result = (uint8_t)i;
+          result = amplitude(myMusicCounters);
+          noteMusicFetch(result, mySystem->cycles());
         }
       }
       return result;
@@ -483,27 +536,8 @@ uint8_t CartridgeBUS::peek(uint16_t address)
       if(address == 0xFEE)  /* AMPLITUDE */
       {
         updateMusicModeDataFetchers();
-        if(DIGITAL_AUDIO_ON(myMode))
-        {
-          uint32_t sampleaddress = getSample() + (myMusicCounters[0] >> 21);
-          if(sampleaddress < 0x8000)
-            peekvalue = myImage[sampleaddress];
-          else if(sampleaddress >= 0x40000000 && sampleaddress < 0x40002000)
-            peekvalue = myRAM[sampleaddress - 0x40000000];
-          else
-            peekvalue = 0;
-          if((myMusicCounters[0] & (1 << 20)) == 0)
-            peekvalue >>= 4;
-          peekvalue &= 0x0f;
-        }
-        else
-        {
-          uint32_t i =
-              myDisplayImage[getWaveform(0) + (myMusicCounters[0] >> myMusicWaveformSize[0])]
-            + myDisplayImage[getWaveform(1) + (myMusicCounters[1] >> myMusicWaveformSize[1])]
-            + myDisplayImage[getWaveform(2) + (myMusicCounters[2] >> myMusicWaveformSize[2])];
-          peekvalue = (uint8_t)i;
-        }
+        peekvalue = amplitude(myMusicCounters);
+        noteMusicFetch(peekvalue, mySystem->cycles());
       }
       else if(address == 0xFEF)  /* DSREAD */
         peekvalue = readFromDatastream(COMMSTREAM);
@@ -571,6 +605,7 @@ bool CartridgeBUS::poke(uint16_t address, uint8_t value)
     {
       pointer = getDatastreamPointer(index);
       myDisplayImage[pointer >> 20] = value;
+      myRAMPages.written((myDisplayImage - myRAM) + (pointer >> 20));
       pointer += 0x100000;
       setDatastreamPointer(index, pointer);
     }
@@ -613,6 +648,7 @@ bool CartridgeBUS::poke(uint16_t address, uint8_t value)
       case 0xFF0:  /* DSWRITE */
         pointer = getDatastreamPointer(COMMSTREAM);
         myDisplayImage[pointer >> 20] = value;
+        myRAMPages.written((myDisplayImage - myRAM) + (pointer >> 20));
         pointer += 0x100000;
         setDatastreamPointer(COMMSTREAM, pointer);
         break;
@@ -623,7 +659,7 @@ bool CartridgeBUS::poke(uint16_t address, uint8_t value)
         pointer |= (value << 20);
         setDatastreamPointer(COMMSTREAM, pointer);
         break;
-      case 0xFF2: myMode = value; break;      /* SETMODE */
+      case 0xFF2: renderMusic(); myMode = value; break;  /* SETMODE */
       case 0xFF3: callFunction(value); break; /* CALLFN */
       default: break;
     }
@@ -652,6 +688,7 @@ bool CartridgeBUS::poke(uint16_t address, uint8_t value)
       {
         pointer = getDatastreamPointer(index);
         myDisplayImage[pointer >> 20] = value;
+        myRAMPages.written((myDisplayImage - myRAM) + (pointer >> 20));
         pointer += 0x100000;
         setDatastreamPointer(index, pointer);
       }
@@ -724,17 +761,44 @@ void CartridgeBUS::setupVersion()
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 bool CartridgeBUS::save(Serializer& out) const
+{
+  return saveCart(out, false);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CartridgeBUS::load(Serializer& in)
+{
+  return loadCart(in, false);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CartridgeBUS::snapshot(Serializer& out) const
+{
+  return saveCart(out, true);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CartridgeBUS::restore(Serializer& in)
+{
+  return loadCart(in, true);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CartridgeBUS::saveCart(Serializer& out, bool snapshot) const
 {
   try
   {
     out.putShort(myBankOffset);
-    out.putByteArray(myRAM, sizeof(myRAM));
+    if(snapshot)
+      myRAMPages.snapshot(out);
+    else
+      out.putByteArray(myRAM, sizeof(myRAM));
     out.putShort(myBusOverdriveAddress);
     out.putShort(mySTYZeroPageAddress);
     out.putShort(myJMPoperandAddress);
-    out.putInt(myAudioCycles);
+    out.putLong(myAudioCycles);
     out.putInt(myFractionalClocksFrac);
-    out.putInt(myARMCycles);
+    out.putLong(myARMCycles);
     out.putIntArray(myMusicCounters, 3);
     out.putIntArray(myMusicFrequencies, 3);
     out.putByteArray(myMusicWaveformSize, 3);
@@ -750,18 +814,25 @@ bool CartridgeBUS::save(Serializer& out) const
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-bool CartridgeBUS::load(Serializer& in)
+bool CartridgeBUS::loadCart(Serializer& in, bool snapshot)
 {
+  const uint16_t bankOffset = myBankOffset;
   try
   {
     myBankOffset = in.getShort();
-    in.getByteArray(myRAM, sizeof(myRAM));
+    if(snapshot)
+      myRAMPages.restore(in);
+    else
+    {
+      myRAMPages.writtenAll();
+      in.getByteArray(myRAM, sizeof(myRAM));
+    }
     myBusOverdriveAddress = in.getShort();
     mySTYZeroPageAddress = in.getShort();
     myJMPoperandAddress = in.getShort();
-    myAudioCycles = in.getInt();
+    myAudioCycles = in.getCycles();
     myFractionalClocksFrac = in.getInt();
-    myARMCycles = in.getInt();
+    myARMCycles = in.getCycles();
     in.getIntArray(myMusicCounters, 3);
     in.getIntArray(myMusicFrequencies, 3);
     in.getByteArray(myMusicWaveformSize, 3);
@@ -774,6 +845,16 @@ bool CartridgeBUS::load(Serializer& in)
     return false;
   }
 
-  bank(myBankOffset >> 12);
+  // A legacy state kept these against a counter that was reset every
+  // frame without them, so they can be ahead of the System's
+  if(in.legacy())
+  {
+    myAudioCycles = MIN(myAudioCycles, mySystem->cycles());
+    myARMCycles = MIN(myARMCycles, mySystem->cycles());
+  }
+
+  // The pages already map the bank, unless it changed
+  if(myBankOffset != bankOffset)
+    bank(myBankOffset >> 12);
   return true;
 }
@@ -10,6 +10,7 @@ class System;
 
 #include "bspf.hxx"
 #include "CartARM.hxx"
+#include "PagedRAM.hxx"
 
 class CartridgeBUS : public CartridgeARM
 {
@@ -35,6 +36,8 @@ class CartridgeBUS : public CartridgeARM
     const uint8_t* getImage(int& size) const;
     bool save(Serializer& out) const;
     bool load(Serializer& in);
+    bool snapshot(Serializer& out) const;
+    bool restore(Serializer& in);
     string name() const { return "CartridgeBUS"; }
     uint32_t thumbCallback(uint8_t function, uint32_t value1, uint32_t value2);
 
@@ -42,9 +45,17 @@ class CartridgeBUS : public CartridgeARM
     uint8_t peek(uint16_t address);
     bool poke(uint16_t address, uint8_t value);
 
+  protected:
+    uint8_t musicLevel(uint64_t cycle) const;
+
   private:
+    // save() and load(), or with the RAM by pages, snapshot() and restore()
+    bool saveCart(Serializer& out, bool snapshot) const;
+    bool loadCart(Serializer& in, bool snapshot);
+
     void setInitialState();
     void updateMusicModeDataFetchers();
+    uint8_t amplitude(const uint32_t* counters) const;
     void callFunction(uint8_t value);
     uint8_t busOverdrive(uint16_t address);
     uint32_t getDatastreamPointer(uint8_t index) const;
@@ -54,7 +65,7 @@ class CartridgeBUS : public CartridgeARM
     uint32_t getAddressMap(uint8_t index) const;
     void setAddressMap(uint8_t index, uint32_t value);
     uint32_t getWaveform(uint8_t index) const;
-    uint32_t getSample();
+    uint32_t getSample() const;
     uint32_t getWaveformSize(uint8_t index) const;
     uint8_t readFromDatastream(uint8_t index);
     uint32_t scanBUSDriver(uint32_t searchValue);
@@ -67,13 +78,14 @@ class CartridgeBUS : public CartridgeARM
     uint8_t* myDisplayImage;
     uint8_t* myDriverImage;
     uint8_t myRAM[8 * 1024];
+    PagedRAM myRAMPages;
     uint16_t myBankOffset;
     uint16_t myCurrentBank;
     uint16_t myBusOverdriveAddress;
     uint16_t mySTYZeroPageAddress;
     uint16_t myJMPoperandAddress;
-    uint32_t myAudioCycles;
-    uint32_t myARMCycles;
+    uint64_t myAudioCycles;
+    uint64_t myARMCycles;
     uint16_t myDatastreamBase;
     uint16_t myDatastreamIncrementBase;
     uint16_t myDatastreamMapBase;
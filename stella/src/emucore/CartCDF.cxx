@@ -85,6 +85,7 @@ CartridgeCDF::CartridgeCDF(const uint8_t* image, uint32_t size,
   myProgramImage = myImage + (isCDFJplus() ? 2 * 1024 : 4 * 1024);
   myDriverImage  = myRAM;
   myDisplayImage = myRAM + 2 * 1024;
+  myRAMPages.attach(myRAM, sizeof(myRAM));
 
   {
     uint32_t cBase, cStart, cStack;
@@ -112,6 +113,7 @@ CartridgeCDF::CartridgeCDF(const uint8_t* image, uint32_t size,
                   ? THUMB_CONFIG_CDF : THUMB_CONFIG_CDF1;
       thumb_set_callback(myThumbEmulator, cfg, this, cdf_thumb_callback);
     }
+    myThumbEmulator->ram_written = myRAMPages.writeFlags();
 #else
     (void)cBase; (void)cStart; (void)cStack;  /* only used with THUMB_SUPPORT */
 #endif
@@ -140,8 +142,8 @@ void CartridgeCDF::reset()
     for(i = 2 * 1024; i < (int)sizeof(myRAM); ++i)
       myRAM[i] = 0;
 
-  myAudioCycles = 0;
-  myARMCycles = 0;
+  myAudioCycles = mySystem->cycles();
+  myARMCycles = mySystem->cycles();
   myFractionalClocksFrac = 0;
 
   setInitialState();
@@ -155,6 +157,7 @@ void CartridgeCDF::setInitialState()
 
   /* Copy the 2K ARM driver into the driver region of RAM. */
   memcpy(myDriverImage, myImage, 2 * 1024);
+  myRAMPages.writtenAll();
 
   for(i = 0; i < 3; ++i)
     myMusicWaveformSize[i] = 27;
@@ -255,6 +258,9 @@ uint32_t CartridgeCDF::thumbCallback(uint8_t function, uint32_t value1,
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void CartridgeCDF::callFunction(uint8_t value)
 {
+  /* The ARM code may retune the music fetchers */
+  renderMusic();
+
 #ifdef THUMB_SUPPORT
   switch(value)
   {
@@ -292,6 +298,7 @@ void CartridgeCDF::updateMusicModeDataFetchers()
   uint32_t whole;
   int x;
 
+  renderMusic();
   myAudioCycles = mySystem->cycles();
 
   scaled = (uint64_t)num * cycles + myFractionalClocksFrac;
@@ -303,6 +310,50 @@ void CartridgeCDF::updateMusicModeDataFetchers()
       myMusicCounters[x] += myMusicFrequencies[x] * whole;
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint8_t CartridgeCDF::musicLevel(uint64_t cycle) const
+{
+  /* The counters as updateMusicModeDataFetchers() would leave them at
+     'cycle', left as they are */
+  uint64_t cycles = cycle > myAudioCycles ? cycle - myAudioCycles : 0;
+  uint32_t num = (myClockRate == 715909u) ? 12000u : 10000u;
+  uint32_t whole = (uint32_t)
+      (((uint64_t)num * cycles + myFractionalClocksFrac) / myClockRate);
+  uint32_t counters[3];
+  int x;
+
+  for(x = 0; x <= 2; ++x)
+    counters[x] = myMusicCounters[x] + myMusicFrequencies[x] * whole;
+
+  return amplitude(counters);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint8_t CartridgeCDF::amplitude(const uint32_t* counters) const
+{
+  if(DIGITAL_AUDIO_ON(myMode))
+  {
+    uint32_t sampleaddress = getSample()
+        + (counters[0] >> (isCDFJplus() ? 13 : 21));
+    uint8_t value;
+
+    if(sampleaddress < 0x00080000)
+      value = myImage[sampleaddress];
+    else if(sampleaddress >= 0x40000000 && sampleaddress < 0x40008000)
+      value = myRAM[sampleaddress - 0x40000000];
+    else
+      value = 0;
+
+    if((counters[0] & (1 << (isCDFJplus() ? 12 : 20))) == 0)
+      value >>= 4;
+    return value & 0x0f;
+  }
+
+  return myDisplayImage[getWaveform(0) + (counters[0] >> myMusicWaveformSize[0])]
+       + myDisplayImage[getWaveform(1) + (counters[1] >> myMusicWaveformSize[1])]
+       + myDisplayImage[getWaveform(2) + (counters[2] >> myMusicWaveformSize[2])];
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 uint32_t CartridgeCDF::getDatastreamPointer(uint8_t index) const
 {
@@ -321,6 +372,8 @@ void CartridgeCDF::setDatastreamPointer(uint8_t index, uint32_t value)
   myRAM[address + 1] = (value >> 8) & 0xff;
   myRAM[address + 2] = (value >> 16) & 0xff;
   myRAM[address + 3] = (value >> 24) & 0xff;
+  myRAMPages.written(address);
+  myRAMPages.written(address + 3);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -352,7 +405,7 @@ uint32_t CartridgeCDF::getWaveform(uint8_t index) const
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-uint32_t CartridgeCDF::getSample()
+uint32_t CartridgeCDF::getSample() const
 {
   uint16_t address = myWaveformBase;
   return  myRAM[address + 0]        +
@@ -457,29 +510,8 @@ uint8_t CartridgeCDF::peek(uint16_t address)
       if(peekvalue == myAmplitudeStream)
       {
         updateMusicModeDataFetchers();
-
-        if(DIGITAL_AUDIO_ON(myMode))
-        {
-          uint32_t sampleaddress = getSample()
-              + (myMusicCounters[0] >> (isCDFJplus() ? 13 : 21));
-
-          if(sampleaddress < 0x00080000)
-            peekvalue = myImage[sampleaddress];
-          else if(sampleaddress >= 0x40000000 && sampleaddress < 0x40008000)
-            peekvalue = myRAM[sampleaddress - 0x40000000];
-          else
-            peekvalue = 0;
-
-          if((myMusicCounters[0] & (1 << (isCDFJplus() ? 12 : 20))) == 0)
-            peekvalue >>= 4;
-          peekvalue &= 0x0f;
-        }
-        else
-        {
-          peekvalue = myDisplayImage[getWaveform(0) + (myMusicCounters[0] >> myMusicWaveformSize[0])]
-                    + myDisplayImage[getWaveform(1) + (myMusicCounters[1] >> myMusicWaveformSize[1])]
-                    + myDisplayImage[getWaveform(2) + (myMusicCounters[2] >> myMusicWaveformSize[2])];
-        }
+        peekvalue = amplitude(myMusicCounters);
+        noteMusicFetch(peekvalue, mySystem->cycles());
         return peekvalue;
       }
       else
@@ -527,11 +559,13 @@ bool CartridgeCDF::poke(uint16_t address, uint8_t value)
       if(isCDFJplus())
       {
         myDisplayImage[pointer >> 16] = value;
+        myRAMPages.written((myDisplayImage - myRAM) + (pointer >> 16));
         pointer += 0x00010000;
       }
       else
       {
         myDisplayImage[pointer >> 20] = value;
+        myRAMPages.written((myDisplayImage - myRAM) + (pointer >> 20));
         pointer += 0x00100000;
       }
       setDatastreamPointer(COMMSTREAM, pointer);
@@ -554,6 +588,7 @@ bool CartridgeCDF::poke(uint16_t address, uint8_t value)
       break;
 
     case 0x0FF2:  /* SETMODE */
+      renderMusic();
       myMode = value;
       break;
 
@@ -680,6 +715,30 @@ uint32_t CartridgeCDF::romSize() const
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 bool CartridgeCDF::save(Serializer& out) const
+{
+  return saveCart(out, false);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CartridgeCDF::load(Serializer& in)
+{
+  return loadCart(in, false);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CartridgeCDF::snapshot(Serializer& out) const
+{
+  return saveCart(out, true);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CartridgeCDF::restore(Serializer& in)
+{
+  return loadCart(in, true);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CartridgeCDF::saveCart(Serializer& out, bool snapshot) const
 {
   try
   {
@@ -688,13 +747,16 @@ bool CartridgeCDF::save(Serializer& out) const
     out.putByte(myFastJumpActive);
     out.putShort(myLDAXYimmediateOperandAddress);
     out.putShort(myJMPoperandAddress);
-    out.putByteArray(myRAM, sizeof(myRAM));
+    if(snapshot)
+      myRAMPages.snapshot(out);
+    else
+      out.putByteArray(myRAM, sizeof(myRAM));
     out.putIntArray(myMusicCounters, 3);
     out.putIntArray(myMusicFrequencies, 3);
     out.putByteArray(myMusicWaveformSize, 3);
-    out.putInt(myAudioCycles);
+    out.putLong(myAudioCycles);
     out.putInt(myFractionalClocksFrac);
-    out.putInt(myARMCycles);
+    out.putLong(myARMCycles);
     CartridgeARM::saveArmState(out);
   }
   catch(...)
@@ -705,8 +767,9 @@ bool CartridgeCDF::save(Serializer& out) const
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-bool CartridgeCDF::load(Serializer& in)
+bool CartridgeCDF::loadCart(Serializer& in, bool snapshot)
 {
+  const uint16_t bankOffset = myBankOffset;
   try
   {
     myBankOffset = in.getShort();
@@ -714,13 +777,19 @@ bool CartridgeCDF::load(Serializer& in)
     myFastJumpActive = in.getByte();
     myLDAXYimmediateOperandAddress = in.getShort();
     myJMPoperandAddress = in.getShort();
-    in.getByteArray(myRAM, sizeof(myRAM));
+    if(snapshot)
+      myRAMPages.restore(in);
+    else
+    {
+      myRAMPages.writtenAll();
+      in.getByteArray(myRAM, sizeof(myRAM));
+    }
     in.getIntArray(myMusicCounters, 3);
     in.getIntArray(myMusicFrequencies, 3);
     in.getByteArray(myMusicWaveformSize, 3);
-    myAudioCycles = in.getInt();
+    myAudioCycles = in.getCycles();
     myFractionalClocksFrac = in.getInt();
-    myARMCycles = in.getInt();
+    myARMCycles = in.getCycles();
     CartridgeARM::loadArmState(in);
   }
   catch(...)
@@ -728,6 +797,16 @@ bool CartridgeCDF::load(Serializer& in)
     return false;
   }
 
-  bank(myCurrentBank);
+  // A legacy state kept these against a counter that was reset every
+  // frame without them, so they can be ahead of the System's
+  if(in.legacy())
+  {
+    myAudioCycles = MIN(myAudioCycles, mySystem->cycles());
+    myARMCycles = MIN(myARMCycles, mySystem->cycles());
+  }
+
+  // The pages already map the bank, unless it changed
+  if(myBankOffset != bankOffset)
+    bank(myBankOffset >> 12);
   return true;
 }
@@ -11,6 +11,7 @@ class System;
 
 #include "bspf.hxx"
 #include "CartARM.hxx"
+#include "PagedRAM.hxx"
 
 class CartridgeCDF : public CartridgeARM
 {
@@ -36,6 +37,8 @@ class CartridgeCDF : public CartridgeARM
     const uint8_t* getImage(int& size) const;
     bool save(Serializer& out) const;
     bool load(Serializer& in);
+    bool snapshot(Serializer& out) const;
+    bool restore(Serializer& in);
     string name() const { return "CartridgeCDF"; }
     uint32_t thumbCallback(uint8_t function, uint32_t value1, uint32_t value2);
 
@@ -43,15 +46,23 @@ class CartridgeCDF : public CartridgeARM
     uint8_t peek(uint16_t address);
     bool poke(uint16_t address, uint8_t value);
 
+  protected:
+    uint8_t musicLevel(uint64_t cycle) const;
+
   private:
+    // save() and load(), or with the RAM by pages, snapshot() and restore()
+    bool saveCart(Serializer& out, bool snapshot) const;
+    bool loadCart(Serializer& in, bool snapshot);
+
     void setInitialState();
     void updateMusicModeDataFetchers();
+    uint8_t amplitude(const uint32_t* counters) const;
     void callFunction(uint8_t value);
     uint32_t getDatastreamPointer(uint8_t index) const;
     void setDatastreamPointer(uint8_t index, uint32_t value);
     uint32_t getDatastreamIncrement(uint8_t index) const;
     uint32_t getWaveform(uint8_t index) const;
-    uint32_t getSample();
+    uint32_t getSample() const;
     uint32_t getWaveformSize(uint8_t index) const;
     uint8_t readFromDatastream(uint8_t index);
     uint32_t scanCDFDriver(uint32_t searchValue);
@@ -67,10 +78,11 @@ class CartridgeCDF : public CartridgeARM
     uint8_t* myDisplayImage;
     uint8_t* myDriverImage;
     uint8_t myRAM[32 * 1024];
+    PagedRAM myRAMPages;
     uint16_t myBankOffset;
     uint16_t myCurrentBank;
-    uint32_t myAudioCycles;
-    uint32_t myARMCycles;
+    uint64_t myAudioCycles;
+    uint64_t myARMCycles;
     uint32_t myMusicCounters[3];
     uint32_t myMusicFrequencies[3];
     uint8_t  myMusicWaveformSize[3];
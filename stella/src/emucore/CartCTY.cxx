@@ -78,13 +78,6 @@ void CartridgeCTY::reset()
   bank(myStartBank);
 }
 
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void CartridgeCTY::systemCyclesReset()
-{
-  // Adjust the cycle counter so that it reflects the new value
-  mySystemCycles -= mySystem->cycles();
-}
-
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void CartridgeCTY::install(System& system)
 {
@@ -311,7 +304,7 @@ bool CartridgeCTY::save(Serializer& out) const
    out.putShort(myCounter);
    out.putBool(myLDAimmediate);
    out.putInt(myRandomNumber);
-   out.putInt(mySystemCycles);
+   out.putLong(mySystemCycles);
    out.putInt(myFractionalClocks);
 
    return true;
@@ -331,7 +324,7 @@ bool CartridgeCTY::load(Serializer& in)
    myCounter = in.getShort();
    myLDAimmediate = in.getBool();
    myRandomNumber = in.getInt();
-   mySystemCycles = (int32_t)in.getInt();
+   mySystemCycles = in.getCycles();
    myFractionalClocks = in.getInt();
 
    return true;
@@ -404,7 +397,7 @@ uint8_t CartridgeCTY::ramReadWrite()
         wipeAllScores();
         break;
     }
-    // keep 0 reserved as the "idle" sentinel across the cycle-counter wrap
+    // Keep 0 reserved as the "idle" sentinel, even for unknown operations
     if(myRamAccessTimeout == 0)
       myRamAccessTimeout = 1;
     // Bit 6 is 1, busy
@@ -412,9 +405,8 @@ uint8_t CartridgeCTY::ramReadWrite()
   }
   else
   {
-    // Have we reached the timeout value yet? Signed difference so the
-    // comparison is correct even across the 32-bit cycle-counter wrap.
-    if((int32_t)((uint32_t)mySystem->cycles() - (uint32_t)myRamAccessTimeout) >= 0)
+    // Have we reached the timeout value yet?
+    if(mySystem->cycles() >= myRamAccessTimeout)
     {
       myRamAccessTimeout = 0;  // Turn off timer
       myRAM[0] = 0;            // Successful operation
@@ -489,7 +481,7 @@ void CartridgeCTY::wipeAllScores()
 inline void CartridgeCTY::updateMusicModeDataFetchers()
 {
   // Calculate the number of cycles since the last update
-  int32_t cycles = mySystem->cycles() - mySystemCycles;
+  int32_t cycles = (int32_t)(mySystem->cycles() - mySystemCycles);
   mySystemCycles = mySystem->cycles();
 
   // Calculate the number of DPC OSC clocks since the last update
@@ -132,13 +132,6 @@ class CartridgeCTY : public Cartridge
     */
     void reset();
 
-    /**
-      Notification method invoked by the system right before the
-      system resets its cycle counter to zero.  It may be necessary
-      to override this method for devices that remember cycle counts.
-    */
-    void systemCyclesReset();
-
     /**
       Install cartridge in the specified system.  Invoked by the system
       when the cartridge is attached to it.
@@ -293,7 +286,7 @@ class CartridgeCTY : public Cartridge
     string myEEPROMFile;
 
     // System cycle count when the last update to music data fetchers occurred
-    int32_t mySystemCycles;
+    uint64_t mySystemCycles;
 
     // Fractional DPC music OSC clocks unused during the last update,
     // as an integer remainder in units of 1/myDpcClockDen of an OSC clock
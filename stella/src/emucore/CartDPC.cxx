@@ -72,16 +72,6 @@ void CartridgeDPC::reset()
   bank(myStartBank);
 }
 
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void CartridgeDPC::systemCyclesReset()
-{
-  // Get the current system cycle
-  uint32_t cycles = mySystem->cycles();
-
-  // Adjust the cycle counter so that it reflects the new value
-  mySystemCycles -= cycles;
-}
-
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void CartridgeDPC::install(System& system)
 {
@@ -120,7 +110,7 @@ inline void CartridgeDPC::clockRandomNumberGenerator()
 inline void CartridgeDPC::updateMusicModeDataFetchers()
 {
   // Calculate the number of cycles since the last update
-  int32_t cycles = mySystem->cycles() - mySystemCycles;
+  int32_t cycles = (int32_t)(mySystem->cycles() - mySystemCycles);
   mySystemCycles = mySystem->cycles();
 
   // Calculate the number of DPC OSC clocks since the last update
@@ -506,7 +496,7 @@ bool CartridgeDPC::save(Serializer& out) const
    // The random number generator register
    out.putByte(myRandomNumber);
 
-   out.putInt(mySystemCycles);
+   out.putLong(mySystemCycles);
    out.putInt(myFractionalClocks);
 
    return true;
@@ -541,7 +531,7 @@ bool CartridgeDPC::load(Serializer& in)
    myRandomNumber = in.getByte();
 
    // Get system cycles and fractional clocks
-   mySystemCycles = (int32_t)in.getInt();
+   mySystemCycles = in.getCycles();
    myFractionalClocks = in.getInt();
 
    // Now, go to the current bank
@@ -62,13 +62,6 @@ class CartridgeDPC : public Cartridge
     */
     void reset();
 
-    /**
-      Notification method invoked by the system right before the
-      system resets its cycle counter to zero.  It may be necessary
-      to override this method for devices that remember cycle counts.
-    */
-    void systemCyclesReset();
-
     /**
       Install cartridge in the specified system.  Invoked by the system
       when the cartridge is attached to it.
@@ -198,7 +191,7 @@ class CartridgeDPC : public Cartridge
     uint8_t myRandomNumber;
 
     // System cycle count when the last update to music data fetchers occurred
-    int32_t mySystemCycles;
+    uint64_t mySystemCycles;
 
     // Fractional DPC music OSC clocks unused during the last update,
     // as an integer remainder in units of 1/myDpcClockDen of an OSC clock
@@ -47,6 +47,7 @@ CartridgeDPCPlus::CartridgeDPCPlus(const uint8_t* image, uint32_t size,
 
   // Pointer to the display RAM
   myDisplayImage = myDPCRAM + 0xC00;
+  myRAMPages.attach(myDPCRAM, sizeof(myDPCRAM));
 
   // Pointer to the Frequency RAM
   myFrequencyImage = myDisplayImage + 0x1000;
@@ -65,6 +66,7 @@ CartridgeDPCPlus::CartridgeDPCPlus(const uint8_t* image, uint32_t size,
              (uint16_t*)(myProgramImage-0xC00),
              (uint16_t*)myDPCRAM,
              settings.getBool("thumb.trapfatal"));
+  myThumbEmulator->ram_written = myRAMPages.writeFlags();
 #endif
   setInitialState();
 
@@ -103,6 +105,7 @@ void CartridgeDPCPlus::setInitialState()
 
   // Copy initial DPC display data and Frequency table state to Harmony RAM
   memcpy(myDisplayImage, myProgramImage + 0x6000, 0x1400);
+  myRAMPages.writtenAll();
 
   // Initialize the DPC data fetcher registers
   for(int i = 0; i < 8; ++i)
@@ -116,16 +119,6 @@ void CartridgeDPCPlus::setInitialState()
   myRandomNumber = 0x2B435044; // "DPC+"
 }
 
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void CartridgeDPCPlus::systemCyclesReset()
-{
-  // Get the current system cycle
-  uint32_t cycles = mySystem->cycles();
-
-  // Adjust the cycle counter so that it reflects the new value
-  mySystemCycles -= cycles;
-}
-
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void CartridgeDPCPlus::install(System& system)
 {
@@ -163,7 +156,8 @@ inline void CartridgeDPCPlus::priorClockRandomNumberGenerator()
 inline void CartridgeDPCPlus::updateMusicModeDataFetchers()
 {
   // Calculate the number of cycles since the last update
-  int32_t cycles = mySystem->cycles() - mySystemCycles;
+  int32_t cycles = (int32_t)(mySystem->cycles() - mySystemCycles);
+  renderMusic();
   mySystemCycles = mySystem->cycles();
 
   // Calculate the number of DPC OSC clocks since the last update
@@ -193,9 +187,40 @@ inline void CartridgeDPCPlus::updateMusicModeDataFetchers()
   }
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint8_t CartridgeDPCPlus::musicLevel(uint64_t cycle) const
+{
+  // The counters as updateMusicModeDataFetchers() would leave them at
+  // 'cycle' (one step, however many OSC clocks passed), left as they are
+  uint64_t cycles = cycle > mySystemCycles ? cycle - mySystemCycles : 0;
+  uint64_t acc = cycles * myDpcClockNum + myFractionalClocks;
+  uint32_t step = acc >= myDpcClockDen ? 1 : 0;
+  uint32_t counters[3];
+
+  for(int x = 0; x <= 2; ++x)
+    counters[x] = myMusicCounters[x] + myMusicFrequencies[x] * step;
+
+  return amplitude(counters);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+inline uint8_t CartridgeDPCPlus::amplitude(const uint32_t* counters) const
+{
+  // using myDisplayImage[] instead of myProgramImage[] because waveforms
+  // can be modified during runtime.
+  uint32_t i = myDisplayImage[(myMusicWaveforms[0] << 5) + (counters[0] >> 27)] +
+               myDisplayImage[(myMusicWaveforms[1] << 5) + (counters[1] >> 27)] +
+               myDisplayImage[(myMusicWaveforms[2] << 5) + (counters[2] >> 27)];
+
+  return (uint8_t)i;
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 inline void CartridgeDPCPlus::callFunction(uint8_t value)
 {
+  // The copies below may rewrite the waveforms
+  renderMusic();
+
   // myParameter
   uint16_t ROMdata = (myParameter[1] << 8) + myParameter[0];
   switch (value)
@@ -205,20 +230,31 @@ inline void CartridgeDPCPlus::callFunction(uint8_t value)
       break;
     case 1: // Copy ROM to fetcher
       for(int i = 0; i < myParameter[3]; ++i)
+      {
         myDisplayImage[myCounters[myParameter[2] & 0x7]+i] = myProgramImage[ROMdata+i];
+        myRAMPages.written(0xC00 + myCounters[myParameter[2] & 0x7] + i);
+      }
       myParameterPointer = 0;
       break;
     case 2: // Copy value to fetcher
       for(int i = 0; i < myParameter[3]; ++i)
+      {
         myDisplayImage[myCounters[myParameter[2]]+i] = myParameter[0];
+        myRAMPages.written(0xC00 + myCounters[myParameter[2]] + i);
+      }
       myParameterPointer = 0;
       break;
 #ifdef THUMB_SUPPORT
     case 254:
     case 255:
+    {
+#ifdef STELLA_PROFILE
+      Profiler::Scope profile(mySystem->profiler(), Profiler::Thumbulator);
+#endif
       // Call user written ARM code (most likely be C compiled for ARM)
       thumb_run(myThumbEmulator);
       break;
+    }
 #endif
     // reserved
   }
@@ -290,13 +326,8 @@ uint8_t CartridgeDPCPlus::peek(uint16_t address)
             // Update the music data fetchers (counter & flag)
             updateMusicModeDataFetchers();
 
-            // using myDisplayImage[] instead of myProgramImage[] because waveforms
-            // can be modified during runtime.
-            uint32_t i = myDisplayImage[(myMusicWaveforms[0] << 5) + (myMusicCounters[0] >> 27)] +
-                       myDisplayImage[(myMusicWaveforms[1] << 5) + (myMusicCounters[1] >> 27)] +
-                       myDisplayImage[(myMusicWaveforms[2] << 5) + (myMusicCounters[2] >> 27)];
-
-            result = (uint8_t)i;
+            result = amplitude(myMusicCounters);
+            noteMusicFetch(result, mySystem->cycles());
             break;
           }
 
@@ -474,6 +505,7 @@ bool CartridgeDPCPlus::poke(uint16_t address, uint8_t value)
           case 0x05:  // WAVEFORM0
           case 0x06:  // WAVEFORM1
           case 0x07:  // WAVEFORM2
+            renderMusic();
             myMusicWaveforms[index - 5] =  value & 0x7f;
             break;
         }
@@ -484,6 +516,7 @@ bool CartridgeDPCPlus::poke(uint16_t address, uint8_t value)
       {
         myCounters[index] = (myCounters[index] - 0x1) & 0x0fff;
         myDisplayImage[myCounters[index]] = value;
+        myRAMPages.written(0xC00 + myCounters[index]);
         break;
       }
 
@@ -527,6 +560,7 @@ bool CartridgeDPCPlus::poke(uint16_t address, uint8_t value)
           case 0x06:  // NOTE1
           case 0x07:  // NOTE2
           {
+            renderMusic();
             myMusicFrequencies[index-5] = myFrequencyImage[(value<<2)] +
             (myFrequencyImage[(value<<2)+1]<<8) +
             (myFrequencyImage[(value<<2)+2]<<16) +
@@ -543,6 +577,7 @@ bool CartridgeDPCPlus::poke(uint16_t address, uint8_t value)
       case 0x0a:
       {
         myDisplayImage[myCounters[index]] = value;
+        myRAMPages.written(0xC00 + myCounters[index]);
         myCounters[index] = (myCounters[index] + 0x1) & 0x0fff;
         break;
       }
@@ -653,6 +688,30 @@ const uint8_t* CartridgeDPCPlus::getImage(int& size) const
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 bool CartridgeDPCPlus::save(Serializer& out) const
+{
+   return saveCart(out, false);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CartridgeDPCPlus::load(Serializer& in)
+{
+   return loadCart(in, false);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CartridgeDPCPlus::snapshot(Serializer& out) const
+{
+   return saveCart(out, true);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CartridgeDPCPlus::restore(Serializer& in)
+{
+   return loadCart(in, true);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CartridgeDPCPlus::saveCart(Serializer& out, bool snapshot) const
 {
    out.putString(name());
 
@@ -660,7 +719,10 @@ bool CartridgeDPCPlus::save(Serializer& out) const
    out.putShort(myCurrentBank);
 
    // Harmony RAM
-   out.putByteArray(myDPCRAM, 8192);
+   if(snapshot)
+      myRAMPages.snapshot(out);
+   else
+      out.putByteArray(myDPCRAM, 8192);
 
    // The top registers for the data fetchers
    out.putByteArray(myTops, 8);
@@ -696,23 +758,30 @@ bool CartridgeDPCPlus::save(Serializer& out) const
    // The random number generator register
    out.putInt(myRandomNumber);
 
-   out.putInt(mySystemCycles);
+   out.putLong(mySystemCycles);
    out.putInt(myFractionalClocks);
 
    return true;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-bool CartridgeDPCPlus::load(Serializer& in)
+bool CartridgeDPCPlus::loadCart(Serializer& in, bool snapshot)
 {
    if(in.getString() != name())
       return false;
 
    // Indicates which bank is currently active
+   const uint16_t currentBank = myCurrentBank;
    myCurrentBank = in.getShort();
 
    // Harmony RAM
-   in.getByteArray(myDPCRAM, 8192);
+   if(snapshot)
+      myRAMPages.restore(in);
+   else
+   {
+      myRAMPages.writtenAll();
+      in.getByteArray(myDPCRAM, 8192);
+   }
 
    // The top registers for the data fetchers
    in.getByteArray(myTops, 8);
@@ -749,11 +818,13 @@ bool CartridgeDPCPlus::load(Serializer& in)
    myRandomNumber = in.getInt();
 
    // Get system cycles and fractional clocks
-   mySystemCycles = (int32_t)in.getInt();
+   mySystemCycles = in.getCycles();
    myFractionalClocks = in.getInt();
 
-   // Now, go to the current bank
-   bank(myCurrentBank);
+   // Now, go to the current bank, which the pages already map unless
+   // it changed
+   if(myCurrentBank != currentBank)
+      bank(myCurrentBank);
 
    return true;
 }
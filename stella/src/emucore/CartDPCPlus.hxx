@@ -27,6 +27,7 @@ struct Thumbulator;
 
 #include "bspf.hxx"
 #include "Cart.hxx"
+#include "PagedRAM.hxx"
 
 /**
   Cartridge class used for DPC+, derived from Pitfall II.  There are six 4K
@@ -65,13 +66,6 @@ class CartridgeDPCPlus : public Cartridge
     */
     void reset();
 
-    /**
-      Notification method invoked by the system right before the
-      system resets its cycle counter to zero.  It may be necessary
-      to override this method for devices that remember cycle counts.
-    */
-    void systemCyclesReset();
-
     /**
       Install cartridge in the specified system.  Invoked by the system
       when the cartridge is attached to it.
@@ -130,6 +124,13 @@ class CartridgeDPCPlus : public Cartridge
     */
     bool load(Serializer& in);
 
+    /**
+      Save/load the same state as save() and load(), with the RAM by
+      pages (see PagedRAM.hxx), for snapshots.
+    */
+    bool snapshot(Serializer& out) const;
+    bool restore(Serializer& in);
+
     /**
       Get a descriptor for the device name (used in error checking).
 
@@ -154,12 +155,24 @@ class CartridgeDPCPlus : public Cartridge
     */
     bool poke(uint16_t address, uint8_t value);
 
+  protected:
+    /**
+      The level an AMPLITUDE fetch at the given cycle would read
+    */
+    uint8_t musicLevel(uint64_t cycle) const;
+
   private:
     /** 
       Sets the initial state of the DPC pointers and RAM
     */
     void setInitialState();
 
+    /**
+      save() and load(), or snapshot() and restore()
+    */
+    bool saveCart(Serializer& out, bool snapshot) const;
+    bool loadCart(Serializer& in, bool snapshot);
+
     /** 
       Clocks the random number generator to move it to its next state
     */
@@ -176,6 +189,11 @@ class CartridgeDPCPlus : public Cartridge
     */
     void updateMusicModeDataFetchers();
 
+    /**
+      The AMPLITUDE the music fetchers give with the given counters
+    */
+    uint8_t amplitude(const uint32_t* counters) const;
+
     /** 
       Call Special Functions
     */
@@ -192,8 +210,9 @@ class CartridgeDPCPlus : public Cartridge
     // Pointer to the 4K display ROM image of the cartridge
     uint8_t* myDisplayImage;
 
-    // The DPC 8k RAM image
+    // The DPC 8k RAM image, and the versions of its pages
     uint8_t myDPCRAM[8192];
+    PagedRAM myRAMPages;
 
 #ifdef THUMB_SUPPORT
     // Pointer to the Thumb ARM emulator object
@@ -246,7 +265,7 @@ class CartridgeDPCPlus : public Cartridge
     uint32_t myRandomNumber;
 
     // System cycle count when the last update to music data fetchers occurred
-    int32_t mySystemCycles;
+    uint64_t mySystemCycles;
 
     // Fractional DPC music OSC clocks unused during the last update,
     // as an integer remainder in units of 1/myDpcClockDen of an OSC clock
@@ -388,6 +388,9 @@ bool CartridgeEnhanced::save(Serializer& out) const
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 bool CartridgeEnhanced::load(Serializer& in)
 {
+  // The segments whose bank changed (any past the 32nd count as changed)
+  uint32_t changed = 0;
+
   try
   {
     if(in.getString() != name())
@@ -395,7 +398,12 @@ bool CartridgeEnhanced::load(Serializer& in)
 
     uint16_t segs = (uint16_t)in.getInt();
     for(uint16_t i = 0; i < segs && i < myBankSegs; ++i)
-      myCurrentSegOffset[i] = in.getInt();
+    {
+      uint32_t off = in.getInt();
+      if(i < 32 && off != myCurrentSegOffset[i])
+        changed |= 1u << i;
+      myCurrentSegOffset[i] = off;
+    }
     if(myRamSize > 0)
       in.getByteArray(myRAM, myRamSize);
   }
@@ -404,9 +412,12 @@ bool CartridgeEnhanced::load(Serializer& in)
     return false;
   }
 
-  // Re-map every segment from the restored offsets
+  // Re-map the segments whose bank changed; the pages already map the rest
   for(uint16_t seg = 0; seg < myBankSegs; ++seg)
   {
+    if(seg < 32 && !(changed & (1u << seg)))
+      continue;
+
     uint32_t off = myCurrentSegOffset[seg];
     uint16_t b;
     if(off >= mySize)
@@ -392,9 +392,8 @@ uint8_t CartridgeFA2::ramReadWrite()
   }
   else
   {
-    // Have we reached the timeout value yet? Signed difference so the
-    // comparison is correct even across the 32-bit cycle-counter wrap.
-    if((int32_t)((uint32_t)mySystem->cycles() - (uint32_t)myRamAccessTimeout) >= 0)
+    // Have we reached the timeout value yet?
+    if(mySystem->cycles() >= myRamAccessTimeout)
     {
       myRamAccessTimeout = 0;  // Turn off timer
       myRAM[255] = 0;          // Successful operation
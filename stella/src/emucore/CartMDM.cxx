@@ -108,6 +108,8 @@ bool CartridgeMDM::save(Serializer& out) const
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 bool CartridgeMDM::load(Serializer& in)
 {
+  // Let the banks of the state be mapped, even if banking is disabled now
+  myBankingDisabled = false;
   CartridgeEnhanced::load(in);
   myBankingDisabled = in.getBool();
   return true;
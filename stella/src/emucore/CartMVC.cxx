@@ -19,6 +19,7 @@
 #include "Serializable.hxx"
 #include "System.hxx"
 #include <cstring>
+#include <functional>
 #include "CartMVC.hxx"
 
 /**
@@ -46,6 +47,16 @@ namespace {
   const int BACK_SECONDS = 10;
 
   const int TITLE_CYCLES = 1000000;
+
+  // A pointer in a compact state, as an offset from 'base' (or 'none')
+  const uint32_t NO_POINTER = 0xffffffff;
+
+  uint32_t pointerOffset(const uint8_t* p, const uint8_t* base) {
+    return p ? static_cast<uint32_t>(p - base) : NO_POINTER;
+  }
+  uint8_t* pointerAt(uint32_t offset, uint8_t* base) {
+    return offset != NO_POINTER ? base + offset : 0;
+  }
 } // namespace
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -55,11 +66,14 @@ namespace {
 class StreamReader
 {
   public:
-    StreamReader() : myAudio(0), myGraph(0), myGraphOverride(0), myTimecode(0), myColor(0), myColorBK(0), myVisibleLines(192), myVSyncLines(3), myBlankLines(37), myOverscanLines(30), myEmbeddedFrame(0), myFile(0), myFileSize(0) { memset(myBuffer1, 0, sizeof(myBuffer1)); memset(myBuffer2, 0, sizeof(myBuffer2)); }
+    StreamReader() : myAudio(0), myGraph(0), myGraphOverride(0), myGraphOverrideBase(0), myTimecode(0), myColor(0), myColorBK(0), myCurrent(true), myVisibleLines(192), myVSyncLines(3), myBlankLines(37), myOverscanLines(30), myEmbeddedFrame(0), myFile(0), myFileSize(0) { clearBuffers(); }
 
     ~StreamReader() { delete myFile; }
 
     bool open(const string& path) {
+      // The file may not be the one the buffers were read from
+      clearBuffers();
+
       delete myFile;
       myFile = new Serializer(path, true);
       if(!myFile->isValid())
@@ -81,29 +95,16 @@ class StreamReader
     void blankPartialLines(bool index) {
       const int colorSize = myVisibleLines * 5;
       if(index)
-      {
-        // top line
-        myColor[0] = 0;
-        myColor[1] = 0;
-        myColor[2] = 0;
-        myColor[3] = 0;
-        myColor[4] = 0;
-      }
+        blank(myCurrent, myColor, 5);                  // top line
       else
-      {
-        // bottom line
-        myColor[colorSize - 5] = 0;
-        myColor[colorSize - 4] = 0;
-        myColor[colorSize - 3] = 0;
-        myColor[colorSize - 2] = 0;
-        myColor[colorSize - 1] = 0;
-      }
+        blank(myCurrent, myColor + colorSize - 5, 5);  // bottom line
 
-      myColorBK[0] = 0;
+      blank(myCurrent, myColorBK, 1);
     }
 
     void swapField(bool index, bool odd) {
-      uint8_t* offset = index ? myBuffer1 : myBuffer2;
+      uint8_t* offset = buffer(index);
+      myCurrent = index;
 
       class FrameFormat
       {
@@ -176,10 +177,9 @@ class StreamReader
         if(offset + CartridgeMVC::MVC_FIELD_SIZE <= myFileSize)
         {
           myFile->setPosition(offset);
-          if(index)
-            myFile->getByteArray(myBuffer1, CartridgeMVC::MVC_FIELD_SIZE);
-          else
-            myFile->getByteArray(myBuffer2, CartridgeMVC::MVC_FIELD_SIZE);
+          myFile->getByteArray(buffer(index), CartridgeMVC::MVC_FIELD_SIZE);
+          myField[index] = fnum;
+          myBlanks[index] = 0;
 
           return true;
         }
@@ -194,7 +194,16 @@ class StreamReader
       return myGraphOverride ? *myGraphOverride++ : *myGraph++;
     }
 
-    void overrideGraph(const uint8_t* p) { myGraphOverride = p; }
+    void overrideGraph(const uint8_t* p, uint32_t read = 0) {
+      myGraphOverrideBase = p;
+      myGraphOverride = p ? p + read : 0;
+    }
+
+    // The table overrideGraph() last set (if any), and how far it's read
+    const uint8_t* graphOverride() const { return myGraphOverrideBase; }
+    uint32_t graphOverrideRead() const {
+      return static_cast<uint32_t>(myGraphOverride - myGraphOverrideBase);
+    }
 
     uint8_t readAudio() { return *myAudio++; }
 
@@ -251,11 +260,143 @@ class StreamReader
       return true;
     }
 
+    /**
+      Compact state: instead of the buffers, the field each holds and the
+      bytes blanked in it since, from which restore() reads them back from
+      the stream; and the read pointers (except for the graph override,
+      which MovieCart saves).  Fails if a buffer was blanked more often
+      than that records.
+    */
+    bool snapshot(Serializer& out) const {
+      const uint8_t* base = buffer(myCurrent);
+      try
+      {
+        for(int i = 0; i < 2; ++i)
+        {
+          if(myBlanks[i] > MAX_BLANKS)
+            return false;
+          out.putInt(myField[i]);
+          out.putByte(myBlanks[i]);
+          out.putShortArray(myBlankOffset[i], MAX_BLANKS);
+          out.putShortArray(myBlankLength[i], MAX_BLANKS);
+        }
+        out.putBool(myCurrent);
+        out.putInt(pointerOffset(myAudio, base));
+        out.putInt(pointerOffset(myGraph, base));
+        out.putInt(pointerOffset(myTimecode, base));
+        out.putInt(pointerOffset(myColor, base));
+        out.putInt(pointerOffset(myColorBK, base));
+
+        out.putByte(myVisibleLines);
+        out.putByte(myVSyncLines);
+        out.putByte(myBlankLines);
+        out.putByte(myOverscanLines);
+        out.putByte(myEmbeddedFrame);
+      }
+      catch(...)
+      {
+        return false;
+      }
+      return true;
+    }
+
+    bool restore(Serializer& in) {
+      try
+      {
+        for(int i = 0; i < 2; ++i)
+        {
+          int32_t field = in.getInt();
+          uint8_t blanks = in.getByte();
+          uint16_t offset[MAX_BLANKS], length[MAX_BLANKS];
+          in.getShortArray(offset, MAX_BLANKS);
+          in.getShortArray(length, MAX_BLANKS);
+          if(blanks > MAX_BLANKS)
+            return false;
+
+          // A buffer already holding the field, blanked the same, is kept
+          if(field == myField[i] && blanks == myBlanks[i] &&
+             memcmp(offset, myBlankOffset[i], blanks * sizeof(uint16_t)) == 0 &&
+             memcmp(length, myBlankLength[i], blanks * sizeof(uint16_t)) == 0)
+            continue;
+
+          if(field == NO_FIELD)
+          {
+            memset(buffer(i), 0, CartridgeMVC::MVC_FIELD_SIZE);
+            myField[i] = NO_FIELD;
+            myBlanks[i] = 0;
+          }
+          else if(!readField(field, i))
+            return false;
+          for(uint8_t b = 0; b < blanks; ++b)
+          {
+            if(offset[b] + length[b] > CartridgeMVC::MVC_FIELD_SIZE)
+              return false;
+            blank(i, buffer(i) + offset[b], length[b]);
+          }
+        }
+        myCurrent = in.getBool();
+        uint8_t* base = buffer(myCurrent);
+        myAudio    = pointerAt(in.getInt(), base);
+        myGraph    = pointerAt(in.getInt(), base);
+        myTimecode = pointerAt(in.getInt(), base);
+        myColor    = pointerAt(in.getInt(), base);
+        myColorBK  = pointerAt(in.getInt(), base);
+
+        myVisibleLines = in.getByte();
+        myVSyncLines = in.getByte();
+        myBlankLines = in.getByte();
+        myOverscanLines = in.getByte();
+        myEmbeddedFrame = in.getByte();
+      }
+      catch(...)
+      {
+        return false;
+      }
+      return true;
+    }
+
+  private:
+    static const int32_t NO_FIELD = -1;
+    static const uint8_t MAX_BLANKS = 8;
+
+    uint8_t* buffer(bool index) { return index ? myBuffer1 : myBuffer2; }
+    const uint8_t* buffer(bool index) const {
+      return index ? myBuffer1 : myBuffer2;
+    }
+
+    void clearBuffers() {
+      memset(myBuffer1, 0, sizeof(myBuffer1));
+      memset(myBuffer2, 0, sizeof(myBuffer2));
+      myField[0] = myField[1] = NO_FIELD;
+      myBlanks[0] = myBlanks[1] = 0;
+    }
+
+    // Zeroes 'size' bytes at 'p' in the given buffer, noting them for
+    // snapshot()
+    void blank(bool index, uint8_t* p, uint16_t size) {
+      memset(p, 0, size);
+
+      const uint16_t offset = static_cast<uint16_t>(p - buffer(index));
+      uint8_t& n = myBlanks[index];
+      for(uint8_t b = 0; b < n && b < MAX_BLANKS; ++b)
+        if(myBlankOffset[index][b] == offset &&
+           myBlankLength[index][b] == size)
+          return;
+      if(n < MAX_BLANKS)
+      {
+        myBlankOffset[index][n] = offset;
+        myBlankLength[index][n] = size;
+      }
+      if(n <= MAX_BLANKS)
+        ++n;
+    }
+
   private:
     const uint8_t* myAudio;
 
     const uint8_t* myGraph;
     const uint8_t* myGraphOverride;
+    const uint8_t* myGraphOverrideBase;
 
     const uint8_t* myTimecode;
     uint8_t* myColor;
@@ -264,6 +405,14 @@ class StreamReader
     uint8_t myBuffer1[CartridgeMVC::MVC_FIELD_SIZE];
     uint8_t myBuffer2[CartridgeMVC::MVC_FIELD_SIZE];
 
+    // The field each buffer holds (index true is myBuffer1), and where it
+    // was blanked since it was read; the buffer swapField() last set up
+    int32_t myField[2];
+    uint16_t myBlankOffset[2][MAX_BLANKS];
+    uint16_t myBlankLength[2][MAX_BLANKS];
+    uint8_t myBlanks[2];
+    bool myCurrent;
+
     uint8_t myVisibleLines;
     uint8_t myVSyncLines;
     uint8_t myBlankLines;
@@ -792,6 +941,18 @@ static const uint8_t levelBarsOddData[] = {
   0, 0, 0, 0, 0,
 };
 
+// The tables a graph override can read, as compact states record them
+static const struct { const uint8_t* table; size_t size; } graphOverrides[] = {
+  { brightLabelOdd,    sizeof(brightLabelOdd)    },
+  { brightLabelEven,   sizeof(brightLabelEven)   },
+  { volumeLabelOdd,    sizeof(volumeLabelOdd)    },
+  { volumeLabelEven,   sizeof(volumeLabelEven)   },
+  { levelBarsOddData,  sizeof(levelBarsOddData)  },
+  { levelBarsEvenData, sizeof(levelBarsEvenData) }
+};
+static const uint8_t NUM_GRAPH_OVERRIDES =
+  sizeof(graphOverrides) / sizeof(graphOverrides[0]);
+
 ////////////////////////////////////////////////////////////////////////////////
 class MovieCart
 {
@@ -801,8 +962,12 @@ class MovieCart
     bool init(const string& path);
     bool process(uint16_t address);
 
-    bool save(Serializer& out) const;
-    bool load(Serializer& in);
+    /**
+      A compact state refers to the fields in the stream instead of
+      holding the field buffers, and reads them back from it on load.
+    */
+    bool save(Serializer& out, bool compact = false) const;
+    bool load(Serializer& in, bool compact = false);
 
     uint8_t readROM(uint16_t address) const {
       return myROM[address & 1023];
@@ -1528,7 +1693,7 @@ bool MovieCart::process(uint16_t address)
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-bool MovieCart::save(Serializer& out) const
+bool MovieCart::save(Serializer& out, bool compact) const
 {
   try
   {
@@ -1560,7 +1725,11 @@ bool MovieCart::save(Serializer& out) const
     out.putByte(myDrawLevelBars);
     out.putByte(myDrawTimeCode);
 
-    if(!myStream.save(out)) return false;
+    if(compact)
+    {
+      if(!myStream.snapshot(out)) return false;
+    }
+    else if(!myStream.save(out)) return false;
     if(!myInputs.save(out)) return false;
     if(!myLastInputs.save(out)) return false;
 
@@ -1573,6 +1742,37 @@ bool MovieCart::save(Serializer& out) const
     // FIXME - determine whether we need to load/save this
     // const uint8_t* myVolumeScale{scales[DEFAULT_LEVEL]};
     out.putByte(myFirstAudioVal);
+
+    // Compact states are taken mid-field, and so need what the stream
+    // is drawing with too
+    if(compact)
+    {
+      uint8_t scale = 0;
+      while(scale < MAX_LEVEL && scales[scale] != myVolumeScale)
+        ++scale;
+      out.putByte(myMute);
+      out.putByte(scale);
+
+      const uint8_t* base = myStream.graphOverride();
+      uint8_t table = NUM_GRAPH_OVERRIDES;
+      uint32_t offset = 0;
+      std::less<const uint8_t*> before;
+      for(uint8_t i = 0; base && i < NUM_GRAPH_OVERRIDES; ++i)
+      {
+        const uint8_t* t = graphOverrides[i].table;
+        if(!before(base, t) && before(base, t + graphOverrides[i].size))
+        {
+          table = i;
+          offset = static_cast<uint32_t>(base - t);
+          break;
+        }
+      }
+      if(base && table == NUM_GRAPH_OVERRIDES)
+        return false;
+      out.putByte(table);
+      out.putInt(offset);
+      out.putInt(base ? myStream.graphOverrideRead() : 0);
+    }
   }
   catch(...)
   {
@@ -1582,7 +1782,7 @@ bool MovieCart::save(Serializer& out) const
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-bool MovieCart::load(Serializer& in)
+bool MovieCart::load(Serializer& in, bool compact)
 {
   try
   {
@@ -1614,7 +1814,11 @@ bool MovieCart::load(Serializer& in)
     myDrawLevelBars = in.getByte();
     myDrawTimeCode = in.getByte();
 
-    if(!myStream.load(in)) return false;
+    if(compact)
+    {
+      if(!myStream.restore(in)) return false;
+    }
+    else if(!myStream.load(in)) return false;
     if(!myInputs.load(in)) return false;
     if(!myLastInputs.load(in)) return false;
 
@@ -1627,6 +1831,26 @@ bool MovieCart::load(Serializer& in)
     // FIXME - determine whether we need to load/save this
     // const uint8_t* myVolumeScale{scales[DEFAULT_LEVEL]};
     myFirstAudioVal = in.getByte();
+
+    if(compact)
+    {
+      myMute = in.getByte();
+      const uint8_t scale = in.getByte();
+      if(scale >= MAX_LEVEL)
+        return false;
+      myVolumeScale = scales[scale];
+
+      const uint8_t table = in.getByte();
+      const uint32_t offset = in.getInt();
+      const uint32_t read = in.getInt();
+      if(table > NUM_GRAPH_OVERRIDES ||
+         (table < NUM_GRAPH_OVERRIDES && offset >= graphOverrides[table].size))
+        return false;
+      if(table == NUM_GRAPH_OVERRIDES)
+        myStream.overrideGraph(0);
+      else
+        myStream.overrideGraph(graphOverrides[table].table + offset, read);
+    }
   }
   catch(...)
   {
@@ -1715,3 +1939,15 @@ bool CartridgeMVC::load(Serializer& in)
 {
   return myMovie->load(in);
 }
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CartridgeMVC::snapshot(Serializer& out) const
+{
+  return myMovie->save(out, true);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool CartridgeMVC::restore(Serializer& in)
+{
+  return myMovie->load(in, true);
+}
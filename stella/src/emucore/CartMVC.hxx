@@ -130,6 +130,18 @@ class CartridgeMVC : public Cartridge
     */
     bool load(Serializer& in);
 
+    /**
+      Save/load a compact state for snapshots (see
+      Serializable::snapshot()): it records which fields of the stream
+      the two field buffers hold, rather than their 8K, and restore()
+      reads them back from the stream file.
+
+      @param out  The Serializer object to use
+      @return  False on any errors, else true
+    */
+    bool snapshot(Serializer& out) const;
+    bool restore(Serializer& in);
+
   private:
     // Not used by MovieCart (content is streamed from disk), but kept so the
     // base-class getImage() contract has something to return.
@@ -66,6 +66,8 @@ bool CartridgeTVBoy::save(Serializer& out) const
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 bool CartridgeTVBoy::load(Serializer& in)
 {
+  // Let the banks of the state be mapped, even if banking is disabled now
+  myBankingDisabled = false;
   CartridgeEnhanced::load(in);
   myBankingDisabled = in.getBool();
   return true;
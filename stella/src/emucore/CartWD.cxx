@@ -63,7 +63,7 @@ CartridgeWD::~CartridgeWD()
 void CartridgeWD::reset()
 {
   CartridgeEnhanced::reset();
-  myCyclesAtBankswitchInit = 0;
+  myCyclesAtBankswitchInit = mySystem->cycles();
   myPendingBank = 0xF0;
   bank(0);
 }
@@ -140,7 +140,7 @@ bool CartridgeWD::save(Serializer& out) const
 {
   CartridgeEnhanced::save(out);
   out.putShort(myCurrentBank);
-  out.putInt(myCyclesAtBankswitchInit);
+  out.putLong(myCyclesAtBankswitchInit);
   out.putShort(myPendingBank);
   return true;
 }
@@ -148,9 +148,19 @@ bool CartridgeWD::save(Serializer& out) const
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 bool CartridgeWD::load(Serializer& in)
 {
+  // Re-mapping a changed segment arranges all four for its bank, so
+  // arrange them for the bank the state is in afterwards
+  const uint16_t currentBank = myCurrentBank;
   CartridgeEnhanced::load(in);
   myCurrentBank = in.getShort();
-  myCyclesAtBankswitchInit = in.getInt();
+  myCyclesAtBankswitchInit = in.getCycles();
+  // A legacy state kept it against a counter that was reset every frame
+  // without it, so it can be ahead of the System's
+  if(in.legacy())
+    myCyclesAtBankswitchInit =
+        MIN(myCyclesAtBankswitchInit, mySystem->cycles());
   myPendingBank = in.getShort();
+  if(myCurrentBank != currentBank)
+    bank(myCurrentBank);
   return true;
 }
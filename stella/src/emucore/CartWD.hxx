@@ -64,7 +64,7 @@ class CartridgeWD : public CartridgeEnhanced
 
   private:
     // Cycle at which a (pending) bankswitch was initiated
-    uint32_t myCyclesAtBankswitchInit;
+    uint64_t myCyclesAtBankswitchInit;
 
     // The bank to switch to once the pending delay elapses
     uint16_t myPendingBank;
@@ -58,7 +58,7 @@ void CompuMate::enableKeyHandling(bool enable)
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void CompuMate::update()
 {
-  uint32_t cycle = mySystem.cycles();
+  uint64_t cycle = mySystem.cycles();
 
   // Only perform update once for both ports in the same cycle
   if(myCycleAtLastUpdate != cycle)
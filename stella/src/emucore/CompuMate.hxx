@@ -149,7 +149,7 @@ class CompuMate
 
     // System cycle at which the update() method is called
     // Multiple calls at the same cycle should be ignored
-    uint32_t myCycleAtLastUpdate;
+    uint64_t myCycleAtLastUpdate;
 };
 
 #endif
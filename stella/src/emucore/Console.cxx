@@ -108,6 +108,9 @@ Console::Console(OSystem* osystem, Cartridge* cart, const Properties& props)
   mySystem->attach(myRiot);
   mySystem->attach(myTIA);
   mySystem->attach(myCart);
+#ifdef STELLA_PROFILE
+  mySystem->profiler().setCartridge(myCart);
+#endif
 
   // Auto-detect NTSC/PAL mode if it's requested
   string autodetected = "";
@@ -226,6 +229,39 @@ bool Console::load(Serializer& in)
   return true;  // success
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint32_t Console::numberOfStateParts() const
+{
+  return mySystem->numberOfParts() + 3;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Serializable& Console::statePart(uint32_t i) const
+{
+  uint32_t n = mySystem->numberOfParts();
+  if(i < n)
+    return mySystem->part(i);
+  else if(i < n + 2)
+    return *myControllers[i - n];
+  return *mySwitches;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool Console::snapshot(Serializer& out) const
+{
+  return mySystem->snapshot(out) &&
+         myControllers[0]->snapshot(out) && myControllers[1]->snapshot(out) &&
+         mySwitches->snapshot(out);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool Console::restore(Serializer& in)
+{
+  return mySystem->restore(in) &&
+         myControllers[0]->restore(in) && myControllers[1]->restore(in) &&
+         mySwitches->restore(in);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Console::toggleFormat(int direction)
 {
@@ -158,6 +158,21 @@ class Console : public Serializable
     */
     bool load(Serializer& in);
 
+    /**
+      The parts whose states save() saves after the system's own (see
+      System::saveOwnState()), one after another: the system's parts,
+      the two controllers and the switches.
+    */
+    uint32_t numberOfStateParts() const;
+    Serializable& statePart(uint32_t i) const;
+
+    /**
+      Saves the current state of this console class as a snapshot (see
+      System::snapshot()), and loads one back.
+    */
+    bool snapshot(Serializer& out) const;
+    bool restore(Serializer& in);
+
     /**
       Get a descriptor for this console class (used in error checking).
 
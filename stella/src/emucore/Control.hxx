@@ -171,13 +171,6 @@ class Controller : public Serializable
     */
     virtual void update() = 0;
 
-    /**
-      Notification method invoked by the system right before the
-      system resets its cycle counter to zero.  It may be necessary 
-      to override this method for controllers that remember cycle counts.
-    */
-    virtual void systemCyclesReset() { };
-
     /**
       Determines how this controller will treat values received from the
       X/Y axis and left/right buttons of the mouse.  Since not all controllers
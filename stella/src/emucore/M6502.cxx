@@ -24,28 +24,28 @@
   #define DISASM_DATA  0
   #define DISASM_ROW   0
   #define DISASM_NONE  0
+#include <cstring>
+
 #include "Settings.hxx"
 
 #include "M6502.hxx"
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 M6502::M6502(uint32_t systemCyclesPerProcessorCycle, const Settings& settings)
-  : myExecutionStatus(0),
-    mySystem(0),
+  : mySystem(0),
     mySettings(settings),
     mySystemCyclesPerProcessorCycle(systemCyclesPerProcessorCycle),
     myLastAccessWasRead(true),
     myTotalInstructionCount(0),
-    myNumberOfDistinctAccesses(0),
-    myLastAddress(0),
-    myLastPeekAddress(0),
-    myLastPokeAddress(0),
-    myLastSrcAddressS(-1),
-    myLastSrcAddressA(-1),
-    myLastSrcAddressX(-1),
-    myLastSrcAddressY(-1),
-    myDataAddressForPoke(0)
+    myExecuteLimit(~(uint64_t)0),
+    myEventCycle(~(uint64_t)0),
+    myCycleLimit(~(uint64_t)0),
+    myBoundedRun(false)
 {
+  // Zero the state, padding and all, so snapshots never copy garbage
+  memset(static_cast<M6502State*>(this), 0, sizeof(M6502State));
+  myLastSrcAddressS = myLastSrcAddressA =
+    myLastSrcAddressX = myLastSrcAddressY = -1;
 
   // Compute the System Cycle table
   for(uint32_t t = 0; t < 256; ++t)
@@ -141,18 +141,52 @@ inline void M6502::poke(uint16_t address, uint8_t value)
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 bool M6502::execute(uint32_t number)
+{
+  myExecuteLimit = myCycleLimit = ~(uint64_t)0;
+  return run<false>(number);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool M6502::execute(uint32_t number, uint64_t cycleLimit)
+{
+  // A device may move the limit to an event while this runs
+  myExecuteLimit = cycleLimit;
+  myCycleLimit = MIN(cycleLimit, myEventCycle);
+
+  myBoundedRun = true;
+  bool result = run<true>(number);
+  myBoundedRun = false;
+
+  return result;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+template<bool bounded>
+bool M6502::run(uint32_t number)
 {
   // Clear all of the execution status bits except for the fatal error bit
   myExecutionStatus &= FatalErrorBit;
 
+  // The limit is read again only when setEventCycle() changes it (and
+  // sets EventBit, which ends the inner loop)
+  uint64_t cycleLimit = myCycleLimit;
+
   // Loop until execution is stopped or a fatal error occurs
   for(;;)
   {
-    for(; !myExecutionStatus && (number != 0); --number)
+    for(; !myExecutionStatus && (number != 0) &&
+          (!bounded || mySystem->cycles() < cycleLimit); --number)
     {
       uint16_t operandAddress = 0, intermediateAddress = 0;
       uint8_t operand = 0;
 
+#ifdef STELLA_PROFILE
+      // Key the instruction by where its opcode is fetched from
+      Profiler& profiler = mySystem->profiler();
+      uint16_t profileBank = profiler.bank(), profilePC = PC;
+      uint64_t profileCycles = mySystem->cycles();
+#endif
+
       // Reset the peek/poke address pointers
       myLastPeekAddress = myLastPokeAddress = myDataAddressForPoke = 0;
 
@@ -170,6 +204,18 @@ bool M6502::execute(uint32_t number)
           myExecutionStatus |= FatalErrorBit;
       }
       myTotalInstructionCount++;
+
+#ifdef STELLA_PROFILE
+      profiler.instruction(profileBank, profilePC,
+          (uint32_t)(mySystem->cycles() - profileCycles));
+#endif
+    }
+
+    // See if an event moved the cycle limit
+    if(myExecutionStatus & EventBit)
+    {
+      myExecutionStatus &= ~EventBit;
+      cycleLimit = myCycleLimit;
     }
 
     // See if we need to handle an interrupt
@@ -200,6 +246,13 @@ bool M6502::execute(uint32_t number)
       // Yes, so answer that everything finished fine
       return true;
     }
+
+    // See if we've reached the cycle limit
+    if(bounded && mySystem->cycles() >= cycleLimit)
+    {
+      // Yes, so answer that everything finished fine
+      return true;
+    }
   }
 }
 
@@ -314,6 +367,20 @@ bool M6502::load(Serializer& in)
   return true;
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool M6502::snapshot(Serializer& out) const
+{
+  out.putBlock(static_cast<const M6502State&>(*this));
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool M6502::restore(Serializer& in)
+{
+  in.getBlock(static_cast<M6502State&>(*this));
+  return true;
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 uint32_t M6502::ourInstructionCycleTable[256] = {
 //  0  1  2  3  4  5  6  7  8  9  a  b  c  d  e  f
@@ -34,6 +34,53 @@ class Settings;
 
 typedef Common::Array<Expression*> ExpressionList;
 
+/**
+  The state of the 6502 that save() saves, kept in one trivially copyable
+  struct so that snapshot() and restore() can copy it whole.
+*/
+struct M6502State
+{
+  uint8_t A;    // Accumulator
+  uint8_t X;    // X index register
+  uint8_t Y;    // Y index register
+  uint8_t SP;   // Stack Pointer
+  uint8_t IR;   // Instruction register
+  uint16_t PC;  // Program Counter
+
+  bool N;     // N flag for processor status register
+  bool V;     // V flag for processor status register
+  bool B;     // B flag for processor status register
+  bool D;     // D flag for processor status register
+  bool I;     // I flag for processor status register
+  bool notZ;  // Z flag complement for processor status register
+  bool C;     // C flag for processor status register
+
+  /// Conditions to handle, such as stopping execution and interrupts
+  /// (see the bits in M6502)
+  uint8_t myExecutionStatus;
+
+  /// Indicates the numer of distinct memory accesses
+  uint32_t myNumberOfDistinctAccesses;
+
+  /// Indicates the last address which was accessed
+  uint16_t myLastAddress;
+
+  /// Indicates the last address which was accessed specifically
+  /// by a peek or poke command
+  uint16_t myLastPeekAddress, myLastPokeAddress;
+
+  /// Indicates the last address used to access data by a peek command
+  /// for the CPU registers (S/A/X/Y)
+  int32_t myLastSrcAddressS, myLastSrcAddressA,
+        myLastSrcAddressX, myLastSrcAddressY;
+
+  /// Indicates the data address used by the last command that performed
+  /// a poke (currently, the last address used by STx)
+  /// If an address wasn't used (ie, as in immediate mode), the address
+  /// is set to zero
+  uint16_t myDataAddressForPoke;
+};
+
 /**
   The 6502 is an 8-bit microprocessor that has a 64K addressing space.
   This class provides a high compatibility 6502 microprocessor emulator.
@@ -47,7 +94,7 @@ typedef Common::Array<Expression*> ExpressionList;
   @author  Bradford W. Mott
   @version $Id: M6502.hxx 2838 2014-01-17 23:34:03Z stephena $
 */
-class M6502 : public Serializable
+class M6502 : public Serializable, private M6502State
 {
   public:
     /**
@@ -93,13 +140,28 @@ class M6502 : public Serializable
     /**
       Execute instructions until the specified number of instructions
       is executed, someone stops execution, or an error occurs.  Answers
-      true iff execution stops normally.
+      true iff execution stops normally.  Events (see setEventCycle())
+      don't stop it.
 
       @param number Indicates the number of instructions to execute
       @return true iff execution stops normally
     */
     bool execute(uint32_t number);
 
+    /**
+      Execute instructions until the specified number of instructions
+      is executed, the system cycle count reaches the given limit or
+      the event cycle, someone stops execution, or an error occurs.  The
+      instruction that crosses the limit is completed, so execution can
+      stop a few cycles past it.  Answers true iff execution stops
+      normally.
+
+      @param number     Indicates the number of instructions to execute
+      @param cycleLimit The system cycle at which to stop
+      @return true iff execution stops normally
+    */
+    bool execute(uint32_t number, uint64_t cycleLimit);
+
     /**
       Tell the processor to stop executing instructions.  Invoking this 
       method while the processor is executing instructions will stop 
@@ -107,6 +169,32 @@ class M6502 : public Serializable
     */
     void stop() { myExecutionStatus |= StopExecutionBit; }
 
+    /**
+      Schedule an event: execute() with a cycle limit stops at the given
+      system cycle as well as at its own limit, in the call in progress
+      and the ones after it, for a device that has to stop execution then
+      (see M6532::setTimerEvents()).  A new event replaces the previous
+      one, and ~0 cancels it.  Execution without a limit, as for
+      TIA::update(), goes on past events.
+
+      @param cycle The system cycle of the event
+    */
+    void setEventCycle(uint64_t cycle)
+    {
+      myEventCycle = cycle;
+      myCycleLimit = MIN(myExecuteLimit, cycle);
+      if(myBoundedRun)
+        myExecutionStatus |= EventBit;
+    }
+
+    /**
+      Get the cycle at which the execute() call in progress (or the last
+      one) stops: the lower of its limit and the event cycle.
+
+      @return The system cycle
+    */
+    uint64_t cycleLimit() const { return myCycleLimit; }
+
     /**
       Get the 16-bit value of the Program Counter register.
 
@@ -186,6 +274,12 @@ class M6502 : public Serializable
     */
     bool load(Serializer& in);
 
+    /**
+      Saves/loads the state as one block (see Serializable::snapshot()).
+    */
+    bool snapshot(Serializer& out) const;
+    bool restore(Serializer& in);
+
     /**
       Get a null terminated string which is the processor's name (i.e. "M6532")
 
@@ -256,22 +350,14 @@ class M6502 : public Serializable
     */
     void interruptHandler();
 
-  private:
-    uint8_t A;    // Accumulator
-    uint8_t X;    // X index register
-    uint8_t Y;    // Y index register
-    uint8_t SP;   // Stack Pointer
-    uint8_t IR;   // Instruction register
-    uint16_t PC;  // Program Counter
-
-    bool N;     // N flag for processor status register
-    bool V;     // V flag for processor status register
-    bool B;     // B flag for processor status register
-    bool D;     // D flag for processor status register
-    bool I;     // I flag for processor status register
-    bool notZ;  // Z flag complement for processor status register
-    bool C;     // C flag for processor status register
+    /**
+      The instruction loop of both execute() calls.  Only a bounded run
+      compares the cycle count with the limit after every instruction,
+      so the loop of a whole frame has no such compare.
+    */
+    template<bool bounded> bool run(uint32_t number);
 
+  private:
     /** 
       Bit fields used to indicate that certain conditions need to be 
       handled such as stopping execution, fatal errors, maskable interrupts 
@@ -282,10 +368,10 @@ class M6502 : public Serializable
       StopExecutionBit = 0x01,
       FatalErrorBit = 0x02,
       MaskableInterruptBit = 0x04,
-      NonmaskableInterruptBit = 0x08
+      NonmaskableInterruptBit = 0x08,
+      EventBit = 0x10
     };
-    uint8_t myExecutionStatus;
-  
+
     /// Pointer to the system the processor is installed in or the null pointer
     System* mySystem;
 
@@ -304,26 +390,15 @@ class M6502 : public Serializable
     /// The total number of instructions executed so far
     int myTotalInstructionCount;
 
-    /// Indicates the numer of distinct memory accesses
-    uint32_t myNumberOfDistinctAccesses;
-
-    /// Indicates the last address which was accessed
-    uint16_t myLastAddress;
-
-    /// Indicates the last address which was accessed specifically
-    /// by a peek or poke command
-    uint16_t myLastPeekAddress, myLastPokeAddress;
-
-    /// Indicates the last address used to access data by a peek command
-    /// for the CPU registers (S/A/X/Y)
-    int32_t myLastSrcAddressS, myLastSrcAddressA,
-          myLastSrcAddressX, myLastSrcAddressY;
+    /// The cycle limit passed to execute(), the event cycle, and the
+    /// lower of the two, at which execution stops
+    uint64_t myExecuteLimit;
+    uint64_t myEventCycle;
+    uint64_t myCycleLimit;
 
-    /// Indicates the data address used by the last command that performed
-    /// a poke (currently, the last address used by STx)
-    /// If an address wasn't used (ie, as in immediate mode), the address
-    /// is set to zero
-    uint16_t myDataAddressForPoke;
+    /// Whether an execute() with a cycle limit is in progress, which
+    /// setEventCycle() then has to stop to pick up the new limit
+    bool myBoundedRun;
 
   private:
     /**
@@ -17,7 +17,10 @@
 // $Id: M6532.cxx 2838 2014-01-17 23:34:03Z stephena $
 //============================================================================
 
+#include <cstring>
+
 #include "Console.hxx"
+#include "M6502.hxx"
 #include "Settings.hxx"
 #include "Switches.hxx"
 #include "System.hxx"
@@ -27,8 +30,11 @@
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 M6532::M6532(const Console& console, const Settings& settings)
   : myConsole(console),
-    mySettings(settings)
+    mySettings(settings),
+    myTimerEvents(false)
 {
+  // Zero the state, padding and all, so snapshots never copy garbage
+  memset(static_cast<M6532State*>(this), 0, sizeof(M6532State));
 }
  
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -50,7 +56,7 @@ void M6532::reset()
   // loop or hang (notably Solaris and H.E.R.O.)
   myTimer = (0xff - (mySystem->randGenerator().next() % 0xfe)) << 10;
   myIntervalShift = 10;
-  myCyclesWhenTimerSet = 0;
+  myCyclesWhenTimerSet = mySystem->cycles();
 
   // Zero the I/O registers
   myDDRA = myDDRB = myOutA = myOutB = 0x00;
@@ -66,18 +72,6 @@ void M6532::reset()
   myEdgeDetectPositive = false;
 }
 
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void M6532::systemCyclesReset()
-{
-  // System cycles are being reset to zero so we need to adjust
-  // the cycle count we remembered when the timer was last set
-  myCyclesWhenTimerSet -= mySystem->cycles();
-
-  // We should also inform any 'smart' controllers as well
-  myConsole.controller(Controller::Left).systemCyclesReset();
-  myConsole.controller(Controller::Right).systemCyclesReset();
-}
-
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void M6532::update()
 {
@@ -289,6 +283,9 @@ void M6532::setTimerRegister(uint8_t value, uint8_t interval)
   // Interrupt timer flag is cleared (and invalid) when writing to the timer
   myInterruptFlag &= ~TimerBit;
   myTimerFlagValid = false;
+
+  if(myTimerEvents)
+    mySystem->m6502().setEventCycle(timerExpiryCycle());
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -335,7 +332,7 @@ bool M6532::save(Serializer& out) const
 
     out.putInt(myTimer);
     out.putInt(myIntervalShift);
-    out.putInt(myCyclesWhenTimerSet);
+    out.putLong(myCyclesWhenTimerSet);
 
     out.putByte(myDDRA);
     out.putByte(myDDRB);
@@ -362,7 +359,7 @@ bool M6532::load(Serializer& in)
 
     myTimer = in.getInt();
     myIntervalShift = in.getInt();
-    myCyclesWhenTimerSet = in.getInt();
+    myCyclesWhenTimerSet = in.getCycles();
 
     myDDRA = in.getByte();
     myDDRB = in.getByte();
@@ -378,6 +375,39 @@ bool M6532::load(Serializer& in)
   return true;
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool M6532::snapshot(Serializer& out) const
+{
+  out.putBlock(static_cast<const M6532State&>(*this));
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool M6532::restore(Serializer& in)
+{
+  in.getBlock(static_cast<M6532State&>(*this));
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint64_t M6532::timerExpiryCycle() const
+{
+  // The timer reads as expired once more than myTimer clocks have
+  // passed since it was set
+  if(timerClocks() < 0)
+    return mySystem->cycles();
+
+  return myCyclesWhenTimerSet + myTimer + 1;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void M6532::setTimerEvents(bool enable)
+{
+  myTimerEvents = enable;
+  mySystem->m6502().setEventCycle(enable && timerClocks() >= 0 ?
+      timerExpiryCycle() : ~(uint64_t)0);
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 uint8_t M6532::intim() const
 {
@@ -424,7 +454,8 @@ int32_t M6532::intimClocks() const
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 M6532::M6532(const M6532& c)
   : myConsole(c.myConsole),
-    mySettings(c.mySettings)
+    mySettings(c.mySettings),
+    myTimerEvents(false)
 {
 }
 
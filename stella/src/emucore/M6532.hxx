@@ -28,6 +28,51 @@ class Settings;
 #include "Device.hxx"
 #include "System.hxx"
 
+/**
+  The state of the 6532 that save() saves, kept in one trivially copyable
+  struct so that snapshot() and restore() can copy it whole.
+*/
+struct M6532State
+{
+  // An amazing 128 bytes of RAM
+  uint8_t myRAM[128];
+
+  // Current value of the timer
+  uint32_t myTimer;
+
+  // Log base 2 of the number of cycles in a timer interval
+  uint32_t myIntervalShift;
+
+  // Indicates the number of cycles when the timer was last set
+  uint64_t myCyclesWhenTimerSet;
+
+  // Data Direction Register for Port A
+  uint8_t myDDRA;
+
+  // Data Direction Register for Port B
+  uint8_t myDDRB;
+
+  // Last value written to Port A
+  uint8_t myOutA;
+
+  // Last value written to Port B
+  uint8_t myOutB;
+
+  // Interrupt Flag Register
+  uint8_t myInterruptFlag;
+
+  // Whether the timer flag (as currently set) can be used
+  // If it isn't valid, it will be updated as required
+  bool myTimerFlagValid;
+
+  // Used to determine whether an active transition on PA7 has occurred
+  // True is positive edge-detect, false is negative edge-detect
+  bool myEdgeDetectPositive;
+
+  // Last value written to the timer registers
+  uint8_t myOutTimer[4];
+};
+
 /**
   This class models the M6532 RAM-I/O-Timer (aka RIOT) chip in the 2600
   console.  Note that since the M6507 CPU doesn't contain an interrupt line,
@@ -39,7 +84,7 @@ class Settings;
   @author  Bradford W. Mott and Stephen Anthony
   @version $Id: M6532.hxx 2838 2014-01-17 23:34:03Z stephena $
 */
-class M6532 : public Device
+class M6532 : public Device, private M6532State
 {
   public:
     /**
@@ -67,13 +112,6 @@ class M6532 : public Device
     */
     void reset();
 
-    /**
-      Notification method invoked by the system right before the
-      system resets its cycle counter to zero.  It may be necessary
-      to override this method for devices that remember cycle counts.
-    */
-    void systemCyclesReset();
-
     /**
       Update the entire digital and analog pin state of ports A and B.
     */
@@ -114,6 +152,12 @@ class M6532 : public Device
     */
     bool load(Serializer& in);
 
+    /**
+      Saves/loads the state as one block (see Serializable::snapshot()).
+    */
+    bool snapshot(Serializer& out) const;
+    bool restore(Serializer& in);
+
     /**
       Get a descriptor for the device name (used in error checking).
 
@@ -139,9 +183,35 @@ class M6532 : public Device
     */
     bool poke(uint16_t address, uint8_t value);
 
+    /**
+      Get the system cycle at which the interval timer expires (the
+      first cycle at which TIMINT reports the timer flag and INTIM
+      switches to the divide-by-1 rate).  The timer is evaluated in
+      closed form, so apart from the INTIM count nothing in the RIOT
+      changes before then; callers can schedule work, or skip an idle
+      INTIM polling loop, up to this cycle.
+
+      @return The expiry cycle, or the current cycle if already expired
+    */
+    uint64_t timerExpiryCycle() const;
+
+    /**
+      Schedule timer expiries as M6502 events (see
+      M6502::setEventCycle()), so that execution stops when the timer
+      expires: the expiry pending when turned on, if any, and after
+      that the expiry of each write to the timer.  Turning it off
+      cancels the event.
+
+      @param enable  Whether to schedule expiries
+    */
+    void setTimerEvents(bool enable);
+
   private:
+    // Closed-form timer evaluation: the number of clocks left until the
+    // timer reaches zero, in 32-bit two's complement as on the real chip
     int32_t timerClocks() const
-      { return myTimer - (mySystem->cycles() - myCyclesWhenTimerSet); }
+      { return (int32_t)(myTimer -
+          (uint32_t)(mySystem->cycles() - myCyclesWhenTimerSet)); }
 
     void setTimerRegister(uint8_t data, uint8_t interval);
     void setPinState(bool shcha);
@@ -167,43 +237,8 @@ class M6532 : public Device
     // Reference to the settings
     const Settings& mySettings;
 
-    // An amazing 128 bytes of RAM
-    uint8_t myRAM[128];
-
-    // Current value of the timer
-    uint32_t myTimer;
-
-    // Log base 2 of the number of cycles in a timer interval
-    uint32_t myIntervalShift;
-
-    // Indicates the number of cycles when the timer was last set
-    int32_t myCyclesWhenTimerSet;
-
-    // Data Direction Register for Port A
-    uint8_t myDDRA;
-
-    // Data Direction Register for Port B
-    uint8_t myDDRB;
-
-    // Last value written to Port A
-    uint8_t myOutA;
-
-    // Last value written to Port B
-    uint8_t myOutB;
-
-    // Interrupt Flag Register
-    uint8_t myInterruptFlag;
-
-    // Whether the timer flag (as currently set) can be used
-    // If it isn't valid, it will be updated as required
-    bool myTimerFlagValid;
-
-    // Used to determine whether an active transition on PA7 has occurred
-    // True is positive edge-detect, false is negative edge-detect
-    bool myEdgeDetectPositive;
-
-    // Last value written to the timer registers
-    uint8_t myOutTimer[4];
+    // Whether timer expiries are scheduled (see setTimerEvents())
+    bool myTimerEvents;
 
   private:
     // Copy constructor isn't supported by this class so make it private
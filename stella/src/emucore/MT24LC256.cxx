@@ -133,17 +133,6 @@ void MT24LC256::update()
   }
 }
 
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void MT24LC256::systemCyclesReset()
-{
-  // System cycles are being reset to zero so we need to adjust
-  // the cycle counts we remembered
-  uint32_t cycles = mySystem.cycles();
-  myCyclesWhenSDASet -= cycles;
-  myCyclesWhenSCLSet -= cycles;
-  myCyclesWhenTimerSet -= cycles;
-}
-
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void MT24LC256::jpee_init()
 {
@@ -349,8 +338,8 @@ bool MT24LC256::jpee_timercheck(int mode)
   {
     if(myTimerActive)
     {
-      uint32_t elapsed = mySystem.cycles() - myCyclesWhenTimerSet;
-      myTimerActive = elapsed < (uint32_t)(5000000.0 / 838.0);
+      uint64_t elapsed = mySystem.cycles() - myCyclesWhenTimerSet;
+      myTimerActive = elapsed < (uint64_t)(5000000.0 / 838.0);
     }
     return myTimerActive;
   }
@@ -57,13 +57,6 @@ class MT24LC256
     void writeSDA(bool state);
     void writeSCL(bool state);
 
-    /**
-      Notification method invoked by the system right before the
-      system resets its cycle counter to zero.  It may be necessary 
-      to override this method for devices that remember cycle counts.
-    */
-    void systemCyclesReset();
-
   private:
     // I2C access code provided by Supercat
     void jpee_init();
@@ -89,10 +82,10 @@ class MT24LC256
     bool myTimerActive;
 
     // Indicates when the timer was set
-    uint32_t myCyclesWhenTimerSet;
+    uint64_t myCyclesWhenTimerSet;
 
     // Indicates when the SDA and SCL pins were set/written
-    uint32_t myCyclesWhenSDASet, myCyclesWhenSCLSet;
+    uint64_t myCyclesWhenSDASet, myCyclesWhenSCLSet;
 
     // The file containing the EEPROM data
     string myDataFile;
@@ -0,0 +1,204 @@
+//============================================================================
+//
+//   SSSS    tt          lll  lll
+//  SS  SS   tt           ll   ll
+//  SS     tttttt  eeee   ll   ll   aaaa
+//   SSSS    tt   ee  ee  ll   ll      aa
+//      SS   tt   eeeeee  ll   ll   aaaaa  --  "An Atari 2600 VCS Emulator"
+//  SS  SS   tt   ee      ll   ll  aa  aa
+//   SSSS     ttt  eeeee llll llll  aaaaa
+//
+// Copyright (c) 1995-2014 by Bradford W. Mott, Stephen Anthony
+// and the Stella Team
+//
+// See the file "License.txt" for information on usage and redistribution of
+// this file, and for a DISCLAIMER OF ALL WARRANTIES.
+//============================================================================
+
+#ifndef MUSIC_STREAM_HXX
+#define MUSIC_STREAM_HXX
+
+#include "bspf.hxx"
+#include "Serializer.hxx"
+
+/**
+  The levels an ARM cart's music fetchers (CDF, BUS, DPC+) give their
+  AMPLITUDE register, rendered on the TIA's sample clock (one every 38
+  CPU cycles) by Cartridge::renderMusic(), and played by Sound in place
+  of the AUDV writes the 6502 copies them into (see Sound::setMusicSource).
+
+  Level i belongs to cycle origin + 38 * i.  The stream keeps the last
+  kCapacity levels; whoever plays them discards the ones it is done with.
+  It also remembers the last AMPLITUDE fetch, so Sound can tell the
+  writes that merely store it from the game's own.
+*/
+class MusicStream
+{
+  public:
+    enum {
+      kCyclesPerLevel = 38,   // the TIA's sample clock
+      kCapacity       = 2048, // levels kept (a power of two), three frames
+      kWriteWindow    = 16,   // most cycles from a fetch to its AUDV write
+      kHoldCycles     = 32768, // without fetches the last one holds after
+      kSaveLevels     = 1024  // most levels save() keeps
+    };
+
+  public:
+    MusicStream() { restart(0); }
+
+    /**
+      Drop all levels and fetches, and render from the given cycle on.
+    */
+    void restart(uint64_t cycle)
+    {
+      myOrigin = cycle;
+      myFirst = myNext = 0;
+      myFetchCycle = 0;
+      myFetchValue = 0;
+      myFetched = false;
+    }
+
+    /**
+      The cycle of the next level to render.
+    */
+    uint64_t nextCycle() const { return myOrigin + myNext * kCyclesPerLevel; }
+
+    /**
+      Append the level of nextCycle(), dropping the oldest if full.
+    */
+    void push(uint8_t level)
+    {
+      myLevels[myNext & (kCapacity - 1)] = level;
+      if(++myNext - myFirst > kCapacity)
+        myFirst = myNext - kCapacity;
+    }
+
+    /**
+      Index of the level the given cycle falls in.
+    */
+    uint64_t index(uint64_t cycle) const
+    {
+      return cycle > myOrigin ? (cycle - myOrigin) / kCyclesPerLevel : 0;
+    }
+
+    /**
+      Index of the oldest level kept, and the number kept.
+    */
+    uint64_t first() const { return myFirst; }
+    uint32_t size() const { return (uint32_t)(myNext - myFirst); }
+
+    /**
+      The level with the given index; indices outside the levels kept
+      answer the nearest one (or the last fetch if there are none).
+    */
+    uint8_t level(uint64_t i) const
+    {
+      if(myNext == myFirst)
+        return myFetchValue;
+      if(i < myFirst)
+        i = myFirst;
+      else if(i >= myNext)
+        i = myNext - 1;
+      return myLevels[i & (kCapacity - 1)];
+    }
+
+    /**
+      Drop the levels before the given index.
+    */
+    void discard(uint64_t i)
+    {
+      if(i > myNext)
+        i = myNext;
+      if(i > myFirst)
+        myFirst = i;
+    }
+
+    /**
+      Record an AMPLITUDE fetch of 'value' at 'cycle'.
+    */
+    void fetched(uint8_t value, uint64_t cycle)
+    {
+      myFetchValue = value;
+      myFetchCycle = cycle;
+      myFetched = true;
+    }
+
+    /**
+      Answers whether a sound register write of 'value' at 'cycle' stores
+      the last AMPLITUDE fetch.
+    */
+    bool fetchWrite(uint8_t value, uint64_t cycle) const
+    {
+      return myFetched && value == myFetchValue &&
+             cycle - myFetchCycle <= kWriteWindow;
+    }
+
+    /**
+      Answers whether the fetches stopped long enough before 'cycle' that
+      the last one holds, as it would in an AUDV register nobody writes.
+    */
+    bool holding(uint64_t cycle) const
+    {
+      return !myFetched || cycle - myFetchCycle > kHoldCycles;
+    }
+
+    uint8_t lastFetch() const { return myFetchValue; }
+
+    /**
+      Save the stream, with at most the newest kSaveLevels levels.
+    */
+    void save(Serializer& out) const
+    {
+      uint32_t n = size();
+      if(n > (uint32_t)kSaveLevels)
+        n = kSaveLevels;
+      out.putLong(myOrigin);
+      out.putLong(myNext);
+      out.putLong(myFetchCycle);
+      out.putByte(myFetchValue);
+      out.putBool(myFetched);
+      out.putInt(n);
+      for(uint64_t i = myNext - n; i < myNext; ++i)
+        out.putByte(myLevels[i & (kCapacity - 1)]);
+    }
+
+    /**
+      Load a stream save() saved.
+
+      @return  False if the data is not a stream
+    */
+    bool load(Serializer& in)
+    {
+      myOrigin = in.getLong();
+      myNext = in.getLong();
+      myFetchCycle = in.getLong();
+      myFetchValue = in.getByte();
+      myFetched = in.getBool();
+      uint32_t n = in.getInt();
+      if(n > kSaveLevels || n > myNext)
+      {
+        restart(0);
+        return false;
+      }
+      myFirst = myNext - n;
+      for(uint64_t i = myFirst; i < myNext; ++i)
+        myLevels[i & (kCapacity - 1)] = in.getByte();
+      return true;
+    }
+
+  private:
+    uint8_t myLevels[kCapacity];
+
+    // Cycle of level 0, and the indices of the oldest level kept and of
+    // the next one to render
+    uint64_t myOrigin;
+    uint64_t myFirst;
+    uint64_t myNext;
+
+    // The last AMPLITUDE fetch
+    uint64_t myFetchCycle;
+    uint8_t myFetchValue;
+    bool myFetched;
+};
+
+#endif
@@ -0,0 +1,93 @@
+//============================================================================
+//
+//   SSSS    tt          lll  lll
+//  SS  SS   tt           ll   ll
+//  SS     tttttt  eeee   ll   ll   aaaa
+//   SSSS    tt   ee  ee  ll   ll      aa
+//      SS   tt   eeeeee  ll   ll   aaaaa  --  "An Atari 2600 VCS Emulator"
+//  SS  SS   tt   ee      ll   ll  aa  aa
+//   SSSS     ttt  eeeee llll llll  aaaaa
+//
+// Copyright (c) 1995-2014 by Bradford W. Mott, Stephen Anthony
+// and the Stella Team
+//
+// See the file "License.txt" for information on usage and redistribution of
+// this file, and for a DISCLAIMER OF ALL WARRANTIES.
+//============================================================================
+
+#include <cstring>
+
+#include "PagedRAM.hxx"
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+PagedRAM::PagedRAM()
+  : myRAM(NULL),
+    mySize(0),
+    myPages(0),
+    myLastVersion(0)
+{
+  memset(myVersion, 0, sizeof(myVersion));
+  writtenAll();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void PagedRAM::attach(uint8_t* ram, uint32_t size)
+{
+  myRAM = ram;
+  mySize = MIN(size, (uint32_t)(kMaxPages * kPageSize));
+  myPages = (mySize + kPageSize - 1) / kPageSize;
+  writtenAll();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void PagedRAM::writtenAll()
+{
+  memset(myWritten, 1, sizeof(myWritten));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void PagedRAM::snapshot(Serializer& out) const
+{
+  for(uint32_t page = 0; page < myPages; ++page)
+  {
+    if(myWritten[page])
+    {
+      myVersion[page] = ++myLastVersion;
+      myWritten[page] = 0;
+    }
+  }
+  out.putIntArray(myVersion, myPages);
+  out.putByteArray(myRAM, mySize);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void PagedRAM::restore(Serializer& in)
+{
+  uint32_t version[kMaxPages];
+
+  try
+  {
+    in.getIntArray(version, myPages);
+    for(uint32_t page = 0; page < myPages; ++page)
+    {
+      uint32_t length = MIN((uint32_t)kPageSize, mySize - page * kPageSize);
+      if(version[page] == myVersion[page] && !myWritten[page])
+        in.skip(length);
+      else
+      {
+        in.getByteArray(myRAM + page * kPageSize, length);
+        myVersion[page] = version[page];
+        myWritten[page] = 0;
+      }
+    }
+  }
+  catch(...)
+  {
+    writtenAll();
+    throw;
+  }
+
+  // A page read short holds zeros, not what its version says
+  if(in.failed())
+    writtenAll();
+}
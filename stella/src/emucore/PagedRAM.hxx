@@ -0,0 +1,106 @@
+//============================================================================
+//
+//   SSSS    tt          lll  lll
+//  SS  SS   tt           ll   ll
+//  SS     tttttt  eeee   ll   ll   aaaa
+//   SSSS    tt   ee  ee  ll   ll      aa
+//      SS   tt   eeeeee  ll   ll   aaaaa  --  "An Atari 2600 VCS Emulator"
+//  SS  SS   tt   ee      ll   ll  aa  aa
+//   SSSS     ttt  eeeee llll llll  aaaaa
+//
+// Copyright (c) 1995-2014 by Bradford W. Mott, Stephen Anthony
+// and the Stella Team
+//
+// See the file "License.txt" for information on usage and redistribution of
+// this file, and for a DISCLAIMER OF ALL WARRANTIES.
+//============================================================================
+
+#ifndef PAGED_RAM_HXX
+#define PAGED_RAM_HXX
+
+#include "bspf.hxx"
+#include "Serializer.hxx"
+
+/**
+  Version numbers for the pages of a cart's RAM (the ARM RAM of the
+  DPC+, CDF and BUS carts), so that restoring a snapshot only copies the
+  pages that differ from it.
+
+  Everything that writes the RAM flags the page it wrote: the cart
+  through written(), the Thumbulator through the flags writeFlags()
+  answers.  A snapshot gives each flagged page a new version, never used
+  before, and records every page's version with the RAM.  Restoring it,
+  a page that has its version and wasn't written since already holds
+  what the snapshot does, and is skipped.  A game touching a few hundred
+  bytes of a 32K RAM between frames so costs a few pages to rewind or
+  run ahead over.
+
+  Snapshots never leave the process, so the versions need only be
+  unique within it; states (save() and load()) keep the RAM as is, and
+  loading one flags every page.
+*/
+class PagedRAM
+{
+  public:
+    enum {
+      kPageShift = 8,
+      kPageSize  = 1 << kPageShift,
+      kMaxPages  = 32 * 1024 / kPageSize
+    };
+
+    PagedRAM();
+
+  public:
+    /**
+      Tracks the given RAM, of at most 32K, flagging every page.
+    */
+    void attach(uint8_t* ram, uint32_t size);
+
+    /**
+      Flags the page holding the byte at 'offset' in the RAM as written.
+      Offsets past its end are ignored.
+    */
+    void written(uint32_t offset)
+    {
+      if(offset < mySize)
+        myWritten[offset >> kPageShift] = 1;
+    }
+
+    /**
+      Flags every page as written, after changing the whole RAM.
+    */
+    void writtenAll();
+
+    /**
+      The write flags, one byte per page, for the Thumbulator to set.
+    */
+    uint8_t* writeFlags() { return myWritten; }
+
+    /**
+      Saves the RAM and its page versions to a snapshot, giving the pages
+      written since the last one new versions.
+    */
+    void snapshot(Serializer& out) const;
+
+    /**
+      Restores what snapshot() saved, copying only the pages that differ.
+    */
+    void restore(Serializer& in);
+
+  private:
+    uint8_t* myRAM;
+    uint32_t mySize;
+    uint32_t myPages;
+
+    // The version of each page, the last version handed out, and the
+    // pages written since their version was given
+    mutable uint32_t myVersion[kMaxPages];
+    mutable uint32_t myLastVersion;
+    mutable uint8_t myWritten[kMaxPages];
+
+    // Copy constructor and assignment operator not supported
+    PagedRAM(const PagedRAM&);
+    PagedRAM& operator = (const PagedRAM&);
+};
+
+#endif
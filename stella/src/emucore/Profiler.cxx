@@ -0,0 +1,216 @@
+//============================================================================
+//
+//   SSSS    tt          lll  lll
+//  SS  SS   tt           ll   ll
+//  SS     tttttt  eeee   ll   ll   aaaa
+//   SSSS    tt   ee  ee  ll   ll      aa
+//      SS   tt   eeeeee  ll   ll   aaaaa  --  "An Atari 2600 VCS Emulator"
+//  SS  SS   tt   ee      ll   ll  aa  aa
+//   SSSS     ttt  eeeee llll llll  aaaaa
+//
+// Copyright (c) 1995-2014 by Bradford W. Mott, Stephen Anthony
+// and the Stella Team
+//
+// See the file "License.txt" for information on usage and redistribution of
+// this file, and for a DISCLAIMER OF ALL WARRANTIES.
+//============================================================================
+
+#ifdef STELLA_PROFILE
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <time.h>
+#endif
+
+#include "Cart.hxx"
+#include "Profiler.hxx"
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Profiler::Profiler()
+  : myCart(0),
+    myFrameCount(0),
+    myFrameCycles(0)
+{
+  for(uint32_t i = 0; i < kMaxBanks; ++i)
+    myBanks[i] = 0;
+
+  myFrames = new Frame[kFrameHistory];
+  for(uint32_t i = 0; i < NumSections; ++i)
+    myFrameTime[i] = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Profiler::~Profiler()
+{
+  for(uint32_t i = 0; i < kMaxBanks; ++i)
+    delete[] myBanks[i];
+
+  delete[] myFrames;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint16_t Profiler::bank() const
+{
+  return myCart ? myCart->bank() : 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Profiler::Entry* Profiler::allocateBank()
+{
+  Entry* table = new Entry[kAddresses];
+  memset(table, 0, kAddresses * sizeof(Entry));
+  return table;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Profiler::endFrame()
+{
+  Frame& f = myFrames[myFrameCount % kFrameHistory];
+  f.number = myFrameCount++;
+  f.cycles = myFrameCycles;
+  for(uint32_t i = 0; i < NumSections; ++i)
+  {
+    f.time[i] = myFrameTime[i];
+    myFrameTime[i] = 0;
+  }
+  myFrameCycles = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Profiler::reset()
+{
+  for(uint32_t i = 0; i < kMaxBanks; ++i)
+  {
+    delete[] myBanks[i];
+    myBanks[i] = 0;
+  }
+
+  myFrameCount = 0;
+  myFrameCycles = 0;
+  for(uint32_t i = 0; i < NumSections; ++i)
+    myFrameTime[i] = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint64_t Profiler::now()
+{
+#ifdef _WIN32
+  LARGE_INTEGER count, frequency;
+  QueryPerformanceCounter(&count);
+  QueryPerformanceFrequency(&frequency);
+  return (uint64_t)((double)count.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+namespace {
+  void putLE(string& out, uint64_t value, uint32_t bytes)
+  {
+    for(uint32_t i = 0; i < bytes; ++i)
+      out += (char)((value >> (8 * i)) & 0xff);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Profiler::build(string& out, Format format) const
+{
+  char line[160];
+
+  uint64_t first = myFrameCount > kFrameHistory ?
+                   myFrameCount - kFrameHistory : 0;
+
+  if(format == FrameCSV)
+  {
+    out += "frame,cycles,tia_ns,thumb_ns,sound_ns\n";
+    for(uint64_t n = first; n < myFrameCount; ++n)
+    {
+      const Frame& f = myFrames[n % kFrameHistory];
+      snprintf(line, sizeof(line), "%llu,%llu,%llu,%llu,%llu\n",
+               (unsigned long long)f.number, (unsigned long long)f.cycles,
+               (unsigned long long)f.time[TIAUpdate],
+               (unsigned long long)f.time[Thumbulator],
+               (unsigned long long)f.time[Sound]);
+      out += line;
+    }
+    return;
+  }
+
+  uint32_t records = 0;
+  for(uint32_t b = 0; b < kMaxBanks; ++b)
+    if(myBanks[b])
+      for(uint32_t pc = 0; pc < kAddresses; ++pc)
+        if(myBanks[b][pc].instructions)
+          records++;
+
+  if(format == InstructionCSV)
+    out += "bank,pc,instructions,cycles\n";
+  else
+  {
+    out += "S14P";
+    putLE(out, 1, 4);
+    putLE(out, records, 4);
+    putLE(out, (uint32_t)(myFrameCount - first), 4);
+  }
+
+  for(uint32_t b = 0; b < kMaxBanks; ++b)
+  {
+    if(!myBanks[b])
+      continue;
+
+    for(uint32_t pc = 0; pc < kAddresses; ++pc)
+    {
+      const Entry& e = myBanks[b][pc];
+      if(!e.instructions)
+        continue;
+
+      if(format == InstructionCSV)
+      {
+        snprintf(line, sizeof(line), "%u,%04X,%llu,%llu\n", b, pc,
+                 (unsigned long long)e.instructions,
+                 (unsigned long long)e.cycles);
+        out += line;
+      }
+      else
+      {
+        putLE(out, b, 2);
+        putLE(out, pc, 2);
+        putLE(out, 0, 4);
+        putLE(out, e.instructions, 8);
+        putLE(out, e.cycles, 8);
+      }
+    }
+  }
+
+  if(format == Binary)
+  {
+    for(uint64_t n = first; n < myFrameCount; ++n)
+    {
+      const Frame& f = myFrames[n % kFrameHistory];
+      putLE(out, f.number, 8);
+      putLE(out, f.cycles, 8);
+      for(uint32_t i = 0; i < NumSections; ++i)
+        putLE(out, f.time[i], 8);
+    }
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint32_t Profiler::dump(uint8_t* buffer, uint32_t size, Format format) const
+{
+  string out;
+  build(out, format);
+
+  if(buffer && out.size() <= size)
+    memcpy(buffer, out.data(), out.size());
+
+  return (uint32_t)out.size();
+}
+
+#endif  // STELLA_PROFILE
@@ -0,0 +1,221 @@
+//============================================================================
+//
+//   SSSS    tt          lll  lll
+//  SS  SS   tt           ll   ll
+//  SS     tttttt  eeee   ll   ll   aaaa
+//   SSSS    tt   ee  ee  ll   ll      aa
+//      SS   tt   eeeeee  ll   ll   aaaaa  --  "An Atari 2600 VCS Emulator"
+//  SS  SS   tt   ee      ll   ll  aa  aa
+//   SSSS     ttt  eeeee llll llll  aaaaa
+//
+// Copyright (c) 1995-2014 by Bradford W. Mott, Stephen Anthony
+// and the Stella Team
+//
+// See the file "License.txt" for information on usage and redistribution of
+// this file, and for a DISCLAIMER OF ALL WARRANTIES.
+//============================================================================
+
+#ifndef PROFILER_HXX
+#define PROFILER_HXX
+
+class Cartridge;
+
+#include "bspf.hxx"
+
+/**
+  Opt-in execution profiler.
+
+  The profiler only exists when the core is compiled with STELLA_PROFILE
+  defined (make PROFILE=1).  Otherwise this header declares nothing and
+  the hooks in M6502, TIA, the ARM carts and the frontend compile away,
+  so a normal build pays nothing for it.
+
+  Two kinds of data are collected:
+
+    - for every 6502 instruction, its cycle count (including any WSYNC
+      or other stalls it caused) and an instruction count, keyed by the
+      cartridge bank it was fetched from and its 13-bit address,
+
+    - for every frame, the host time spent in TIA frame rendering, in
+      the Thumbulator and in sound generation, and the number of 6502
+      cycles executed.
+
+  The results can be dumped as CSV or as a flat little-endian binary
+  (see dump() for the layouts).
+*/
+#ifdef STELLA_PROFILE
+
+class Profiler
+{
+  public:
+    // Timed sections of a frame
+    enum Section {
+      TIAUpdate,
+      Thumbulator,
+      Sound,
+      NumSections
+    };
+
+    // Output formats understood by dump()
+    enum Format {
+      InstructionCSV,
+      FrameCSV,
+      Binary
+    };
+
+    /**
+      Times the enclosing scope into the given section.
+    */
+    class Scope
+    {
+      public:
+        Scope(Profiler& profiler, Section section)
+          : myProfiler(profiler), mySection(section), myStart(now()) { }
+        ~Scope() { myProfiler.addTime(mySection, now() - myStart); }
+
+      private:
+        Profiler& myProfiler;
+        Section mySection;
+        uint64_t myStart;
+    };
+
+  public:
+    Profiler();
+    ~Profiler();
+
+  public:
+    /**
+      Set the cartridge whose current bank is used to key instructions.
+
+      @param cart  The cartridge, or the null pointer to key everything
+                   to bank 0
+    */
+    void setCartridge(const Cartridge* cart) { myCart = cart; }
+
+    /**
+      Answers the bank instructions are currently being fetched from.
+    */
+    uint16_t bank() const;
+
+    /**
+      Record one executed instruction.
+
+      @param bank    The bank the opcode was fetched from
+      @param pc      The address of the opcode
+      @param cycles  The number of system cycles the instruction took
+    */
+    void instruction(uint16_t bank, uint16_t pc, uint32_t cycles)
+    {
+      Entry& e = entry(bank, pc);
+      e.cycles += cycles;
+      e.instructions++;
+      myFrameCycles += cycles;
+    }
+
+    /**
+      Add host time to a section of the current frame.
+
+      @param section  The section the time was spent in
+      @param ns       The time in nanoseconds
+    */
+    void addTime(Section section, uint64_t ns) { myFrameTime[section] += ns; }
+
+    /**
+      Close the current frame and start accumulating the next one.
+    */
+    void endFrame();
+
+    /**
+      Discard everything collected so far.
+    */
+    void reset();
+
+    /**
+      Dump the collected data.  Nothing is written unless the whole dump
+      fits into the buffer.
+
+      InstructionCSV has a header line and one line per (bank, address)
+      that was executed: bank,pc,instructions,cycles.  FrameCSV has a
+      header line and one line per frame in the history (oldest first):
+      frame,cycles,tia_ns,thumb_ns,sound_ns.
+
+      Binary is little-endian: the magic "S14P", a 32-bit version (1),
+      the 32-bit instruction record count and the 32-bit frame record
+      count, followed by the 24-byte instruction records (16-bit bank,
+      16-bit pc, 32 reserved bits, 64-bit instructions and cycles) and
+      the 40-byte frame records (64-bit frame, cycles, tia_ns, thumb_ns
+      and sound_ns).
+
+      @param buffer  The buffer to write to (may be the null pointer)
+      @param size    The size of the buffer
+      @param format  The output format
+      @return The size of the full dump in bytes
+    */
+    uint32_t dump(uint8_t* buffer, uint32_t size, Format format) const;
+
+    /**
+      Answers a monotonic host time stamp in nanoseconds.
+    */
+    static uint64_t now();
+
+  private:
+    struct Entry
+    {
+      uint64_t cycles;
+      uint64_t instructions;
+    };
+
+    struct Frame
+    {
+      uint64_t number;
+      uint64_t cycles;
+      uint64_t time[NumSections];
+    };
+
+    Entry& entry(uint16_t bank, uint16_t pc)
+    {
+      Entry*& table = myBanks[bank & (kMaxBanks - 1)];
+      if(table == 0)
+        table = allocateBank();
+      return table[pc & (kAddresses - 1)];
+    }
+
+    Entry* allocateBank();
+
+    void build(string& out, Format format) const;
+
+  private:
+    // Banks beyond this are folded onto lower ones
+    static const uint32_t kMaxBanks = 256;
+
+    // The 6507 only decodes 13 address lines
+    static const uint32_t kAddresses = 8192;
+
+    // Number of most recent frames kept
+    static const uint32_t kFrameHistory = 4096;
+
+    // Cartridge providing the current bank, if any
+    const Cartridge* myCart;
+
+    // Per-address counters for each bank, allocated on first use
+    Entry* myBanks[kMaxBanks];
+
+    // Ring of the most recent frames
+    Frame* myFrames;
+    uint64_t myFrameCount;
+
+    // Accumulators for the frame in progress
+    uint64_t myFrameCycles;
+    uint64_t myFrameTime[NumSections];
+
+  private:
+    // Copy constructor isn't supported by this class so make it private
+    Profiler(const Profiler&);
+
+    // Assignment operator isn't supported by this class so make it private
+    Profiler& operator = (const Profiler&);
+};
+
+#endif  // STELLA_PROFILE
+
+#endif
@@ -0,0 +1,290 @@
+//============================================================================
+//
+//   SSSS    tt          lll  lll
+//  SS  SS   tt           ll   ll
+//  SS     tttttt  eeee   ll   ll   aaaa
+//   SSSS    tt   ee  ee  ll   ll      aa
+//      SS   tt   eeeeee  ll   ll   aaaaa  --  "An Atari 2600 VCS Emulator"
+//  SS  SS   tt   ee      ll   ll  aa  aa
+//   SSSS     ttt  eeeee llll llll  aaaaa
+//
+// Copyright (c) 1995-2014 by Bradford W. Mott, Stephen Anthony
+// and the Stella Team
+//
+// See the file "License.txt" for information on usage and redistribution of
+// this file, and for a DISCLAIMER OF ALL WARRANTIES.
+//============================================================================
+
+#include <cstring>
+
+#include "RewindBuffer.hxx"
+
+// A run of unchanged bytes shorter than this is cheaper as literals
+#define MIN_ZERO_RUN 4
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+RewindBuffer::RewindBuffer()
+  : myEntries(NULL),
+    myDepth(0),
+    myOldest(0),
+    myCount(0),
+    myArena(NULL),
+    myArenaSize(0),
+    myWrite(0),
+    myNewest(NULL),
+    myNewestSize(0),
+    myNewestCapacity(0),
+    myNext(NULL),
+    myNextCapacity(0),
+    myScratch(NULL),
+    myScratchCapacity(0)
+{
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+RewindBuffer::~RewindBuffer()
+{
+  setup(0, 0);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void RewindBuffer::setup(uint32_t depth, uint32_t size)
+{
+  delete[] myEntries;  myEntries = NULL;
+  delete[] myArena;    myArena = NULL;
+  myDepth = myArenaSize = 0;
+
+  if(depth == 0 || size == 0)
+  {
+    delete[] myNewest;   myNewest = NULL;   myNewestCapacity = 0;
+    delete[] myNext;     myNext = NULL;     myNextCapacity = 0;
+    delete[] myScratch;  myScratch = NULL;  myScratchCapacity = 0;
+  }
+  else
+  {
+    myEntries = new Entry[depth];
+    myArena = new uint8_t[size];
+    myDepth = depth;
+    myArenaSize = size;
+  }
+  clear();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void RewindBuffer::clear()
+{
+  myOldest = myCount = 0;
+  myWrite = 0;
+  myNewestSize = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint32_t RewindBuffer::used() const
+{
+  uint32_t bytes = 0;
+  for(uint32_t i = 0; i < myCount; ++i)
+    bytes += myEntries[(myOldest + i) % myDepth].length;
+
+  return bytes;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint8_t* RewindBuffer::next(uint32_t size)
+{
+  reserve(myNext, myNextCapacity, size);
+  return myNext;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void RewindBuffer::push(uint32_t size)
+{
+  if(!enabled())
+    return;
+
+  if(myNewestSize > 0)
+  {
+    reserve(myScratch, myScratchCapacity, encodeBound(myNewestSize));
+    uint32_t length = encode(myNewest, myNewestSize, myNext, size, myScratch);
+
+    if(length > myArenaSize)
+    {
+      // Can't be kept, and the states before it can't be reached
+      // without it
+      myOldest = myCount = 0;
+      myWrite = 0;
+    }
+    else
+    {
+      uint32_t offset = allocate(length);
+      memcpy(myArena + offset, myScratch, length);
+
+      Entry& e = myEntries[(myOldest + myCount) % myDepth];
+      e.offset = offset;
+      e.length = length;
+      e.size   = myNewestSize;
+      ++myCount;
+      myWrite = offset + length;
+    }
+  }
+
+  // The state just saved becomes the newest, without a copy
+  uint8_t* buffer = myNewest;
+  uint32_t capacity = myNewestCapacity;
+  myNewest = myNext;
+  myNewestCapacity = myNextCapacity;
+  myNewestSize = size;
+  myNext = buffer;
+  myNextCapacity = capacity;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool RewindBuffer::pop()
+{
+  if(myCount == 0)
+    return false;
+
+  const Entry& e = myEntries[(myOldest + myCount - 1) % myDepth];
+  const uint8_t* in = myArena + e.offset;
+  const uint8_t* end = in + e.length;
+
+  // The older state is the newest one, padded with zeros or cut short
+  // to its size, XORed with the changes
+  if(e.size > myNewestSize)
+  {
+    reserve(myNewest, myNewestCapacity, e.size);
+    memset(myNewest + myNewestSize, 0, e.size - myNewestSize);
+  }
+  myNewestSize = e.size;
+
+  uint32_t i = 0;
+  while(in + 4 <= end)
+  {
+    uint32_t zeros = in[0] | (in[1] << 8);
+    uint32_t changed = in[2] | (in[3] << 8);
+    in += 4;
+
+    i += zeros;
+    if(i + changed > myNewestSize || in + changed > end)
+      break;
+    for(uint32_t k = 0; k < changed; ++k)
+      myNewest[i + k] ^= in[k];
+    i += changed;
+    in += changed;
+  }
+
+  myWrite = e.offset;
+  --myCount;
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void RewindBuffer::reserve(uint8_t*& buffer, uint32_t& capacity, uint32_t size)
+{
+  if(size <= capacity)
+    return;
+
+  // Leave room for the sound data a state may gain (see
+  // Sound::pendingStateSize()) before growing again
+  uint32_t grown = size + size / 4;
+  uint8_t* bigger = new uint8_t[grown];
+  if(buffer)
+    memcpy(bigger, buffer, capacity);
+  delete[] buffer;
+  buffer = bigger;
+  capacity = grown;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint32_t RewindBuffer::allocate(uint32_t size)
+{
+  uint32_t offset = myWrite;
+
+  if(myCount == 0)
+    offset = 0;
+  else if(offset + size > myArenaSize)
+  {
+    // No room before the end: the states there are the oldest, and the
+    // ring starts over at the beginning
+    while(myCount > 0 && myEntries[myOldest].offset >= offset)
+      dropOldest();
+    offset = 0;
+  }
+
+  // Drop the oldest states the new one overlaps, or that are one too many
+  while(myCount > 0)
+  {
+    const Entry& e = myEntries[myOldest];
+    if(myCount < myDepth &&
+       (e.offset >= offset + size || e.offset + e.length <= offset))
+      break;
+    dropOldest();
+  }
+
+  return offset;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void RewindBuffer::dropOldest()
+{
+  myOldest = (myOldest + 1) % myDepth;
+  --myCount;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+static inline void putRun(uint8_t* out, uint32_t zeros, uint32_t changed)
+{
+  out[0] = zeros & 0xff;
+  out[1] = zeros >> 8;
+  out[2] = changed & 0xff;
+  out[3] = changed >> 8;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint32_t RewindBuffer::encode(const uint8_t* older, uint32_t olderSize,
+                              const uint8_t* newer, uint32_t newerSize,
+                              uint8_t* out)
+{
+  // Beyond the newer state, the older one is XORed with zeros
+  uint32_t common = MIN(olderSize, newerSize);
+  uint8_t* o = out;
+  uint32_t i = 0;
+
+#define CHANGE(j) (older[j] ^ ((j) < common ? newer[j] : 0))
+
+  while(i < olderSize)
+  {
+    // Unchanged bytes, a word at a time where both states have them
+    uint32_t start = i;
+    uint32_t limit = MIN(olderSize, start + 0xffff);
+    while(i + 8 <= MIN(limit, common) && memcmp(older + i, newer + i, 8) == 0)
+      i += 8;
+    while(i < limit && CHANGE(i) == 0)
+      ++i;
+    uint32_t zeros = i - start;
+
+    // Changed bytes, up to the next run of unchanged ones worth coding
+    uint8_t* run = o;
+    o += 4;
+    start = i;
+    limit = MIN(olderSize, start + 0xffff);
+    while(i < limit)
+    {
+      uint8_t x = CHANGE(i);
+      if(x == 0 && i + MIN_ZERO_RUN <= olderSize)
+      {
+        uint32_t k = 1;
+        while(k < MIN_ZERO_RUN && CHANGE(i + k) == 0)
+          ++k;
+        if(k == MIN_ZERO_RUN)
+          break;
+      }
+      *o++ = x;
+      ++i;
+    }
+    putRun(run, zeros, i - start);
+  }
+
+#undef CHANGE
+
+  return o - out;
+}
@@ -0,0 +1,144 @@
+//============================================================================
+//
+//   SSSS    tt          lll  lll
+//  SS  SS   tt           ll   ll
+//  SS     tttttt  eeee   ll   ll   aaaa
+//   SSSS    tt   ee  ee  ll   ll      aa
+//      SS   tt   eeeeee  ll   ll   aaaaa  --  "An Atari 2600 VCS Emulator"
+//  SS  SS   tt   ee      ll   ll  aa  aa
+//   SSSS     ttt  eeeee llll llll  aaaaa
+//
+// Copyright (c) 1995-2014 by Bradford W. Mott, Stephen Anthony
+// and the Stella Team
+//
+// See the file "License.txt" for information on usage and redistribution of
+// this file, and for a DISCLAIMER OF ALL WARRANTIES.
+//============================================================================
+
+#ifndef REWIND_BUFFER_HXX
+#define REWIND_BUFFER_HXX
+
+#include "bspf.hxx"
+
+/**
+  A ring of recent states for rewinding (see StateManager::update()).
+
+  Only the newest state is kept in full.  Each older one is kept as the
+  XOR of it and the state after it, run-length coded: consecutive frames
+  differ in a few hundred bytes, so most of that is runs of zeros.  The
+  coded states live in an arena of fixed size, and the oldest ones are
+  dropped when it, or the configured depth, is full.
+
+  A coded state is a sequence of tokens, each a 16-bit count of bytes
+  that didn't change, a 16-bit count of bytes that did, and the XOR of
+  those.  A state shorter than the one after it is XORed with a prefix
+  of it; a longer one, with that padded with zeros.
+*/
+class RewindBuffer
+{
+  public:
+    RewindBuffer();
+    ~RewindBuffer();
+
+  public:
+    /**
+      Sets the ring up to hold at most 'depth' states, besides the
+      newest, in 'size' bytes of coded states, and forgets all states.
+      A depth or size of 0 turns it off and frees all memory.
+    */
+    void setup(uint32_t depth, uint32_t size);
+
+    /**
+      Answers whether setup() turned the ring on.
+    */
+    bool enabled() const { return myDepth != 0; }
+
+    /**
+      Forgets all states.
+    */
+    void clear();
+
+    /**
+      The buffer to save the next state to, of at least 'size' bytes.
+      It stays valid until the next call to anything but push().
+    */
+    uint8_t* next(uint32_t size);
+
+    /**
+      Makes the 'size' bytes saved to next() the newest state, coding the
+      previous one against it.
+    */
+    void push(uint32_t size);
+
+    /**
+      Drops the newest state, making the one before it the newest.
+
+      @return  False if there is no state before it
+    */
+    bool pop();
+
+    /**
+      The newest state, and its size (0 if there is none).
+    */
+    const uint8_t* newest() const { return myNewest; }
+    uint32_t newestSize() const { return myNewestSize; }
+
+    /**
+      The number of states kept before the newest, and the bytes of the
+      arena they take.
+    */
+    uint32_t count() const { return myCount; }
+    uint32_t used() const;
+
+  private:
+    // Grows a state buffer to hold at least 'size' bytes
+    static void reserve(uint8_t*& buffer, uint32_t& capacity, uint32_t size);
+
+    // Codes 'older' against 'newer' to 'out', answering the bytes written
+    static uint32_t encode(const uint8_t* older, uint32_t olderSize,
+                           const uint8_t* newer, uint32_t newerSize,
+                           uint8_t* out);
+
+    // Most bytes encode() writes for a state of 'size' bytes
+    static uint32_t encodeBound(uint32_t size)
+    { return size + 4 * (size / 0xffff + 3); }
+
+    // Finds room for 'size' bytes in the arena, dropping the oldest
+    // states in the way, and answers where it is
+    uint32_t allocate(uint32_t size);
+    void dropOldest();
+
+  private:
+    struct Entry
+    {
+      uint32_t offset;    // where in the arena the coded state is
+      uint32_t length;    // its length there
+      uint32_t size;      // the size of the state
+    };
+
+    // At most myDepth coded states, oldest first from myOldest
+    Entry* myEntries;
+    uint32_t myDepth;
+    uint32_t myOldest;
+    uint32_t myCount;
+
+    // The coded states, and where the next one goes
+    uint8_t* myArena;
+    uint32_t myArenaSize;
+    uint32_t myWrite;
+
+    // The newest state, the one being saved, and the coding scratch
+    uint8_t* myNewest;
+    uint32_t myNewestSize;
+    uint32_t myNewestCapacity;
+    uint8_t* myNext;
+    uint32_t myNextCapacity;
+    uint8_t* myScratch;
+    uint32_t myScratchCapacity;
+
+    // Copy constructor and assignment operator not supported
+    RewindBuffer(const RewindBuffer&);
+    RewindBuffer& operator = (const RewindBuffer&);
+};
+
+#endif
@@ -0,0 +1,121 @@
+//============================================================================
+//
+//   SSSS    tt          lll  lll
+//  SS  SS   tt           ll   ll
+//  SS     tttttt  eeee   ll   ll   aaaa
+//   SSSS    tt   ee  ee  ll   ll      aa
+//      SS   tt   eeeeee  ll   ll   aaaaa  --  "An Atari 2600 VCS Emulator"
+//  SS  SS   tt   ee      ll   ll  aa  aa
+//   SSSS     ttt  eeeee llll llll  aaaaa
+//
+// Copyright (c) 1995-2014 by Bradford W. Mott, Stephen Anthony
+// and the Stella Team
+//
+// See the file "License.txt" for information on usage and redistribution of
+// this file, and for a DISCLAIMER OF ALL WARRANTIES.
+//============================================================================
+
+#include <cstring>
+
+#include "RollbackBuffer.hxx"
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+RollbackBuffer::RollbackBuffer()
+  : myEntries(NULL),
+    mySlots(0),
+    myArena(NULL),
+    myCapacity(0)
+{
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+RollbackBuffer::~RollbackBuffer()
+{
+  setup(0);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void RollbackBuffer::setup(uint32_t slots)
+{
+  delete[] myEntries;  myEntries = NULL;
+  delete[] myArena;    myArena = NULL;
+  mySlots = myCapacity = 0;
+
+  if(slots > 0)
+  {
+    myEntries = new Entry[slots];
+    mySlots = slots;
+  }
+  clear();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void RollbackBuffer::clear()
+{
+  for(uint32_t i = 0; i < mySlots; ++i)
+    myEntries[i].frame = myEntries[i].size = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void RollbackBuffer::reserve(uint32_t size)
+{
+  if(!enabled() || size <= myCapacity)
+    return;
+
+  // Leave room for the sound data a snapshot may gain before growing
+  // again, and keep the frames saved so far
+  uint32_t grown = size + size / 4;
+  uint8_t* bigger = new uint8_t[(size_t)grown * mySlots];
+  for(uint32_t i = 0; i < mySlots; ++i)
+    if(myEntries[i].size > 0)
+      memcpy(bigger + (size_t)i * grown, myArena + (size_t)i * myCapacity,
+             myEntries[i].size);
+  delete[] myArena;
+  myArena = bigger;
+  myCapacity = grown;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint8_t* RollbackBuffer::next(uint32_t frame, uint32_t size)
+{
+  reserve(size);
+
+  uint32_t slot = frame % mySlots;
+  myEntries[slot].size = 0;
+  return myArena + (size_t)slot * myCapacity;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void RollbackBuffer::push(uint32_t frame, uint32_t size)
+{
+  if(!enabled())
+    return;
+
+  Entry& e = myEntries[frame % mySlots];
+  e.frame = frame;
+  e.size  = size;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+const uint8_t* RollbackBuffer::find(uint32_t frame, uint32_t& size) const
+{
+  if(!enabled())
+    return NULL;
+
+  uint32_t slot = frame % mySlots;
+  const Entry& e = myEntries[slot];
+  if(e.size == 0 || e.frame != frame)
+    return NULL;
+
+  size = e.size;
+  return myArena + (size_t)slot * myCapacity;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void RollbackBuffer::forgetAfter(uint32_t frame)
+{
+  // Frame numbers wrap around, so 'after' is within half their range
+  for(uint32_t i = 0; i < mySlots; ++i)
+    if(myEntries[i].size > 0 && (int32_t)(myEntries[i].frame - frame) > 0)
+      myEntries[i].size = 0;
+}
@@ -0,0 +1,107 @@
+//============================================================================
+//
+//   SSSS    tt          lll  lll
+//  SS  SS   tt           ll   ll
+//  SS     tttttt  eeee   ll   ll   aaaa
+//   SSSS    tt   ee  ee  ll   ll      aa
+//      SS   tt   eeeeee  ll   ll   aaaaa  --  "An Atari 2600 VCS Emulator"
+//  SS  SS   tt   ee      ll   ll  aa  aa
+//   SSSS     ttt  eeeee llll llll  aaaaa
+//
+// Copyright (c) 1995-2014 by Bradford W. Mott, Stephen Anthony
+// and the Stella Team
+//
+// See the file "License.txt" for information on usage and redistribution of
+// this file, and for a DISCLAIMER OF ALL WARRANTIES.
+//============================================================================
+
+#ifndef ROLLBACK_BUFFER_HXX
+#define ROLLBACK_BUFFER_HXX
+
+#include "bspf.hxx"
+
+/**
+  A ring of snapshots for netplay rollback (see
+  StateManager::saveRollback()).
+
+  Each of a fixed number of slots holds the snapshot of one frame, which
+  the frame number, modulo the number of slots, picks: finding a frame
+  is one lookup, and saving one overwrites the frame as many slots back.
+  The slots are one block, allocated up front with room to spare for the
+  sound data a snapshot may gain (see Sound::pendingStateSize()); only
+  a snapshot larger than that grows them.
+*/
+class RollbackBuffer
+{
+  public:
+    RollbackBuffer();
+    ~RollbackBuffer();
+
+  public:
+    /**
+      Sets the ring up with the given number of slots, and forgets all
+      frames.  0 slots turns it off and frees all memory.
+    */
+    void setup(uint32_t slots);
+
+    /**
+      Answers whether setup() turned the ring on.
+    */
+    bool enabled() const { return mySlots != 0; }
+
+    /**
+      Forgets all frames, keeping the memory.
+    */
+    void clear();
+
+    /**
+      Makes every slot hold at least 'size' bytes, with room to spare.
+    */
+    void reserve(uint32_t size);
+
+    /**
+      The slot to save the snapshot of 'frame' to, forgetting the frame
+      it held.  It has room for at least 'size' bytes, and capacity()
+      bytes in all.
+    */
+    uint8_t* next(uint32_t frame, uint32_t size);
+    uint32_t capacity() const { return myCapacity; }
+
+    /**
+      Records that the 'size' bytes saved to next() are the snapshot of
+      'frame' (or, for 0 bytes, that it couldn't be saved).
+    */
+    void push(uint32_t frame, uint32_t size);
+
+    /**
+      The snapshot of the given frame and its size, or 0 if the ring
+      doesn't hold it.
+    */
+    const uint8_t* find(uint32_t frame, uint32_t& size) const;
+
+    /**
+      Forgets the frames after the given one, which a rollback to it
+      replaces.
+    */
+    void forgetAfter(uint32_t frame);
+
+  private:
+    struct Entry
+    {
+      uint32_t frame;     // the frame the slot holds
+      uint32_t size;      // its snapshot's size (0 if it holds none)
+    };
+
+    Entry* myEntries;
+    uint32_t mySlots;
+
+    // The slots, back to back, and the size of each
+    uint8_t* myArena;
+    uint32_t myCapacity;
+
+    // Copy constructor and assignment operator not supported
+    RollbackBuffer(const RollbackBuffer&);
+    RollbackBuffer& operator = (const RollbackBuffer&);
+};
+
+#endif
@@ -81,11 +81,3 @@ void SaveKey::write(DigitalPin pin, bool value)
       break;
   } 
 }
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void SaveKey::systemCyclesReset()
-{
-  // The EEPROM keeps track of cycle counts, and needs to know when the
-  // cycles are reset
-  myEEPROM->systemCyclesReset();
-}
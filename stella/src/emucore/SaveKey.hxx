@@ -80,13 +80,6 @@ class SaveKey : public Controller
     */
     void update() { }
 
-    /**
-      Notification method invoked by the system right before the
-      system resets its cycle counter to zero.  It may be necessary 
-      to override this method for devices that remember cycle counts.
-    */
-    void systemCyclesReset();
-
   private:
     // The EEPROM used in the SaveKey
     MT24LC256* myEEPROM;
@@ -52,6 +52,34 @@ class Serializable
     */
     virtual bool load(Serializer& in) = 0;
 
+    /**
+      Save the same state as save(), for restore() to load back in this
+      process only (see System::snapshot()).  Objects that keep their
+      state in one trivially copyable struct copy it with
+      Serializer::putBlock(); the rest use save().
+
+      @param out  The Serializer object to use
+      @return  False on any errors, else true
+    */
+    virtual bool snapshot(Serializer& out) const { return save(out); }
+
+    /**
+      Load a state snapshot() saved, and update whatever load() would.
+
+      @param in  The Serializer object to use
+      @return  False on any errors, else true
+    */
+    virtual bool restore(Serializer& in) { return load(in); }
+
+    /**
+      The version of the state save() saves, recorded with it in
+      sectioned states (see StateManager::saveState()).  Bump it whenever
+      what save() writes changes.
+
+      @return  The version
+    */
+    virtual uint32_t stateVersion() const { return 1; }
+
     /**
       Get a descriptor for the object name (used in error checking).
 
@@ -17,15 +17,56 @@
 // $Id: Serializer.cxx 2838 2014-01-17 23:34:03Z stephena $
 //============================================================================
 
+#include <cstdio>
 #include <fstream>
 #include <stdexcept>
+#include <cstring>
+
+#ifdef _WIN32
+  #include <windows.h>
+#endif
 
 #include "Serializer.hxx"
 
+#ifdef HAVE_ZLIB
+#include <compat/zlib.h>
+
+// Inflates a gzip file into a new memory stream, or answers NULL
+static iostream* inflateFile(const string& filename)
+{
+  gzFile file = gzopen(filename.c_str(), "rb");
+  if(file == NULL)
+    return NULL;
+
+  stringstream* str = new stringstream(ios::in | ios::out | ios::binary);
+  char buffer[4096];
+  int n;
+  while((n = gzread(file, buffer, sizeof(buffer))) > 0)
+    str->write(buffer, n);
+  if(gzclose(file) != Z_OK || n < 0)
+  {
+    delete str;
+    return NULL;
+  }
+  return str;
+}
+#endif
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 Serializer::Serializer(const string& filename, bool readonly)
   : myStream(NULL),
-    myUseFilestream(true)
+    myUseFilestream(true),
+    myLevel(-1),
+    mySpan(NULL),
+    mySpanSize(0),
+    mySpanEnd(0),
+    myPosition(0),
+    myReadOnly(false),
+    myMeasuring(false),
+    myFailed(false),
+    myDelta(NULL),
+    myDeltaIndex(0),
+    myLegacy(false)
 {
   if(readonly)
   {
@@ -33,6 +74,21 @@ Serializer::Serializer(const string& filename, bool readonly)
     //if(node.isFile() && node.isReadable())
     {
       fstream* str = new fstream(filename.c_str(), ios::in | ios::binary);
+#ifdef HAVE_ZLIB
+      // A compressed file starts with the gzip magic number
+      if(str && str->is_open() && str->get() == 0x1f && str->get() == 0x8b)
+      {
+        delete str;
+        myUseFilestream = false;
+        str = NULL;
+        myStream = inflateFile(filename);
+        if(myStream)
+        {
+          myStream->exceptions( ios_base::failbit | ios_base::badbit | ios_base::eofbit );
+          reset();
+        }
+      }
+#endif
       if(str && str->is_open())
       {
         myStream = str;
@@ -70,7 +126,18 @@ Serializer::Serializer(const string& filename, bool readonly)
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 Serializer::Serializer(void)
   : myStream(NULL),
-    myUseFilestream(false)
+    myUseFilestream(false),
+    myLevel(-1),
+    mySpan(NULL),
+    mySpanSize(0),
+    mySpanEnd(0),
+    myPosition(0),
+    myReadOnly(false),
+    myMeasuring(false),
+    myFailed(false),
+    myDelta(NULL),
+    myDeltaIndex(0),
+    myLegacy(false)
 {
   myStream = new stringstream(ios::in | ios::out | ios::binary);
   
@@ -84,9 +151,68 @@ Serializer::Serializer(void)
   }
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Serializer::Serializer(const string& filename, int level)
+  : myStream(NULL),
+    myUseFilestream(false),
+    myFileName(filename),
+    myLevel(MAX(0, MIN(level, 9))),
+    mySpan(NULL),
+    mySpanSize(0),
+    mySpanEnd(0),
+    myPosition(0),
+    myReadOnly(false),
+    myMeasuring(false),
+    myFailed(false),
+    myDelta(NULL),
+    myDeltaIndex(0),
+    myLegacy(false)
+{
+  myStream = new stringstream(ios::in | ios::out | ios::binary);
+  myStream->exceptions( ios_base::failbit | ios_base::badbit | ios_base::eofbit );
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Serializer::Serializer(uint8_t* buffer, uint32_t size)
+  : myStream(NULL),
+    myUseFilestream(false),
+    myLevel(-1),
+    mySpan(buffer),
+    mySpanSize(buffer ? size : 0),
+    mySpanEnd(0),
+    myPosition(0),
+    myReadOnly(false),
+    myMeasuring(buffer == NULL),
+    myFailed(false),
+    myDelta(NULL),
+    myDeltaIndex(0),
+    myLegacy(false)
+{
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Serializer::Serializer(const uint8_t* buffer, uint32_t size)
+  : myStream(NULL),
+    myUseFilestream(false),
+    myLevel(-1),
+    mySpan(const_cast<uint8_t*>(buffer)),
+    mySpanSize(buffer ? size : 0),
+    mySpanEnd(buffer ? size : 0),
+    myPosition(0),
+    myReadOnly(true),
+    myMeasuring(false),
+    myFailed(false),
+    myDelta(NULL),
+    myDeltaIndex(0),
+    myLegacy(false)
+{
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 Serializer::~Serializer(void)
 {
+  close();
+
   if(myStream != NULL)
   {
     if(myUseFilestream)
@@ -97,15 +223,69 @@ Serializer::~Serializer(void)
   }
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool Serializer::close(void)
+{
+  if(myLevel < 0 || myStream == NULL)
+    return true;
+
+  const string data = ((stringstream*)myStream)->str();
+
+  // Write a new file beside the old one and rename it over it, so that a
+  // write that fails or is cut short leaves the old file as it was
+  const string temp = myFileName + ".tmp";
+  bool written;
+#ifdef HAVE_ZLIB
+  if(myLevel > 0)
+  {
+    char mode[] = "wb0";
+    mode[2] = '0' + myLevel;
+    gzFile file = gzopen(temp.c_str(), mode);
+    written = file != NULL && (data.empty() ||
+        gzwrite(file, data.data(), (unsigned)data.size()) == (int)data.size());
+    if(file != NULL && gzclose(file) != Z_OK)
+      written = false;
+  }
+  else
+#endif
+  {
+    ofstream file(temp.c_str(), ios::out | ios::binary | ios::trunc);
+    file.write(data.data(), data.size());
+    file.close();
+    written = !file.fail();
+  }
+  myLevel = -1;
+
+  // Windows' rename() won't replace an existing file, MoveFileEx() can.
+  // If the rename fails, the old file stays and only the new one goes
+#ifdef _WIN32
+  if(written)
+    written = MoveFileExA(temp.c_str(), myFileName.c_str(),
+        MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+  if(written)
+    written = rename(temp.c_str(), myFileName.c_str()) == 0;
+#endif
+  if(!written)
+    remove(temp.c_str());
+  return written;
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 bool Serializer::isValid(void)
 {
-  return myStream != NULL;
+  return myStream != NULL || mySpan != NULL || myMeasuring;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Serializer::reset(void)
 {
+  if(mySpan || myMeasuring)
+  {
+    myPosition = 0;
+    myFailed = false;
+    return;
+  }
   myStream->clear();
   myStream->seekg(ios_base::beg);
   myStream->seekp(ios_base::beg);
@@ -113,6 +293,8 @@ void Serializer::reset(void)
 
 uint32_t Serializer::size(void)
 {
+  if(mySpan || myMeasuring)
+    return mySpanEnd;
   if(myStream == NULL)
     return 0;
 
@@ -135,16 +317,85 @@ uint32_t Serializer::size(void)
 
 void Serializer::setPosition(uint32_t pos)
 {
+  if(mySpan || myMeasuring)
+  {
+    myPosition = pos;
+    return;
+  }
   myStream->clear();
   myStream->seekg((streampos)pos);
   myStream->seekp((streampos)pos);
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Serializer::skip(uint32_t size)
+{
+  if(!mySpan && !myMeasuring)
+  {
+    myStream->seekg(size, ios_base::cur);
+    myStream->seekp(size, ios_base::cur);
+    return;
+  }
+  if(myFailed || myMeasuring ||
+     size > mySpanEnd - MIN(myPosition, mySpanEnd))
+  {
+    myFailed = true;
+    return;
+  }
+  myPosition += size;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Serializer::read(void* data, uint32_t size)
+{
+  if(!mySpan && !myMeasuring)
+  {
+    myStream->read((char*)data, size);
+    return;
+  }
+  if(myFailed || myMeasuring ||
+     size > mySpanEnd - MIN(myPosition, mySpanEnd))
+  {
+    myFailed = true;
+    memset(data, 0, size);
+    return;
+  }
+  memcpy(data, mySpan + myPosition, size);
+  myPosition += size;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Serializer::write(const void* data, uint32_t size)
+{
+  if(myMeasuring)
+  {
+    myPosition += size;
+    if(myPosition > mySpanEnd)
+      mySpanEnd = myPosition;
+    return;
+  }
+  if(!mySpan)
+  {
+    myStream->write((const char*)data, size);
+    return;
+  }
+  if(myFailed || myReadOnly ||
+     size > mySpanSize - MIN(myPosition, mySpanSize))
+  {
+    myFailed = true;
+    return;
+  }
+  memcpy(mySpan + myPosition, data, size);
+  myPosition += size;
+  if(myPosition > mySpanEnd)
+    mySpanEnd = myPosition;
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 uint8_t Serializer::getByte(void)
 {
-  char buf;
-  myStream->read(&buf, 1);
+  uint8_t buf;
+  read(&buf, 1);
 
   return buf;
 }
@@ -152,14 +403,17 @@ uint8_t Serializer::getByte(void)
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Serializer::getByteArray(uint8_t* array, uint32_t size)
 {
-  myStream->read((char*)array, size);
+  if(myDelta && size >= kDeltaPageSize)
+    getDeltaArray(array, size);
+  else
+    read(array, size);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 uint16_t Serializer::getShort(void)
 {
   uint16_t val = 0;
-  myStream->read((char*)&val, sizeof(uint16_t));
+  read(&val, sizeof(uint16_t));
 
   return val;
 }
@@ -167,14 +421,14 @@ uint16_t Serializer::getShort(void)
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Serializer::getShortArray(uint16_t* array, uint32_t size)
 {
-  myStream->read((char*)array, sizeof(uint16_t)*size);
+  read(array, sizeof(uint16_t)*size);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 uint32_t Serializer::getInt(void)
 {
   uint32_t val = 0;
-  myStream->read((char*)&val, sizeof(uint32_t));
+  read(&val, sizeof(uint32_t));
 
   return val;
 }
@@ -182,7 +436,25 @@ uint32_t Serializer::getInt(void)
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Serializer::getIntArray(uint32_t* array, uint32_t size)
 {
-  myStream->read((char*)array, sizeof(uint32_t)*size);
+  read(array, sizeof(uint32_t)*size);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint64_t Serializer::getLong(void)
+{
+  uint64_t val = 0;
+  read(&val, sizeof(uint64_t));
+
+  return val;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint64_t Serializer::getCycles(void)
+{
+  if(!myLegacy)
+    return getLong();
+
+  return kLegacyCycleBase + (int64_t)(int32_t)getInt();
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -196,6 +468,18 @@ string Serializer::getString(void)
   // allocation or a long read that only fails at the very end. Instead,
   // reject any length that cannot possibly be satisfied by the bytes
   // left in the stream, so a bad state is refused immediately.
+  if(mySpan || myMeasuring)
+  {
+    if(myFailed || myMeasuring || len < 0 ||
+       (uint32_t)len > mySpanEnd - MIN(myPosition, mySpanEnd))
+    {
+      myFailed = true;
+      return string();
+    }
+    string str((const char*)mySpan + myPosition, len);
+    myPosition += len;
+    return str;
+  }
   stringstream* s = (stringstream*)myStream;
   streampos cur = s->tellg();
   s->seekg(0, ios::end);
@@ -220,37 +504,46 @@ bool Serializer::getBool(void)
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Serializer::putByte(uint8_t value)
 {
-  myStream->write((char*)&value, 1);
+  write(&value, 1);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Serializer::putByteArray(const uint8_t* array, uint32_t size)
 {
-  myStream->write((char*)array, size);
+  if(myDelta && size >= kDeltaPageSize)
+    putDeltaArray(array, size);
+  else
+    write(array, size);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Serializer::putShort(uint16_t value)
 {
-  myStream->write((char*)&value, sizeof(uint16_t));
+  write(&value, sizeof(uint16_t));
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Serializer::putShortArray(const uint16_t* array, uint32_t size)
 {
-  myStream->write((char*)array, sizeof(uint16_t)*size);
+  write(array, sizeof(uint16_t)*size);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Serializer::putInt(uint32_t value)
 {
-  myStream->write((char*)&value, sizeof(uint32_t));
+  write(&value, sizeof(uint32_t));
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void Serializer::putIntArray(const uint32_t* array, uint32_t size)
 {
-  myStream->write((char*)array, sizeof(uint32_t)*size);
+  write(array, sizeof(uint32_t)*size);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Serializer::putLong(uint64_t value)
+{
+  write(&value, sizeof(uint64_t));
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -258,7 +551,7 @@ void Serializer::putString(const string& str)
 {
   int len = str.length();
   putInt(len);
-  myStream->write(str.data(), len);
+  write(str.data(), len);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -266,3 +559,124 @@ void Serializer::putBool(bool b)
 {
   putByte(b ? TruePattern: FalsePattern);
 }
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Serializer::setDeltaReference(DeltaReference* ref)
+{
+  myDelta = ref;
+  myDeltaIndex = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Serializer::putDeltaArray(const uint8_t* array, uint32_t size)
+{
+  bool fresh;
+  uint8_t* ref = myDelta->block(myDeltaIndex++, size, fresh);
+  uint32_t pages = (size + kDeltaPageSize - 1) / kDeltaPageSize;
+
+  for(uint32_t group = 0; group < pages; group += 8)
+  {
+    uint32_t last = MIN(group + 8, pages);
+    uint8_t mask = 0;
+
+    for(uint32_t page = group; page < last; ++page)
+    {
+      uint32_t offset = page * kDeltaPageSize;
+      uint32_t len = MIN((uint32_t)kDeltaPageSize, size - offset);
+      if(fresh || memcmp(array + offset, ref + offset, len) != 0)
+        mask |= 1 << (page - group);
+    }
+    putByte(mask);
+
+    for(uint32_t page = group; page < last; ++page)
+    {
+      if(!(mask & (1 << (page - group))))
+        continue;
+
+      uint32_t offset = page * kDeltaPageSize;
+      uint32_t len = MIN((uint32_t)kDeltaPageSize, size - offset);
+      memcpy(ref + offset, array + offset, len);
+      write(array + offset, len);
+    }
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Serializer::getDeltaArray(uint8_t* array, uint32_t size)
+{
+  bool fresh;
+  uint8_t* ref = myDelta->block(myDeltaIndex++, size, fresh);
+  uint32_t pages = (size + kDeltaPageSize - 1) / kDeltaPageSize;
+
+  for(uint32_t group = 0; group < pages; group += 8)
+  {
+    uint32_t last = MIN(group + 8, pages);
+    uint8_t mask = getByte();
+
+    for(uint32_t page = group; page < last; ++page)
+    {
+      uint32_t offset = page * kDeltaPageSize;
+      uint32_t len = MIN((uint32_t)kDeltaPageSize, size - offset);
+
+      if(mask & (1 << (page - group)))
+      {
+        read(ref + offset, len);
+      }
+      else if(fresh)
+      {
+        // The stream depends on a page we have no copy of
+        throw runtime_error("Serializer: delta reference mismatch");
+      }
+      memcpy(array + offset, ref + offset, len);
+    }
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Serializer::DeltaReference::DeltaReference()
+  : myCount(0)
+{
+  for(int i = 0; i < kMaxBlocks; ++i)
+  {
+    myBlock[i] = NULL;
+    myBlockSize[i] = 0;
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Serializer::DeltaReference::~DeltaReference()
+{
+  clear();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void Serializer::DeltaReference::clear()
+{
+  for(int i = 0; i < kMaxBlocks; ++i)
+  {
+    delete[] myBlock[i];
+    myBlock[i] = NULL;
+    myBlockSize[i] = 0;
+  }
+  myCount = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint8_t* Serializer::DeltaReference::block(uint32_t index, uint32_t size,
+                                           bool& fresh)
+{
+  if(index >= kMaxBlocks)
+    throw runtime_error("Serializer: too many paged arrays");
+
+  fresh = myBlock[index] == NULL || myBlockSize[index] != size;
+  if(fresh)
+  {
+    delete[] myBlock[index];
+    myBlock[index] = new uint8_t[size];
+    myBlockSize[index] = size;
+  }
+  if(index >= myCount)
+    myCount = index + 1;
+
+  return myBlock[index];
+}
@@ -30,7 +30,8 @@
   stream can be either an actual file, or an in-memory structure.
 
   Bytes are written as characters, shorts as 2 characters (16-bits),
-  integers as 4 characters (32-bits), strings are written as characters
+  integers as 4 characters (32-bits), longs as 8 characters (64-bits),
+  strings are written as characters
   prepended by the length of the string, boolean values are written using
   a special character pattern.
 
@@ -53,10 +54,43 @@ class Serializer
 
       The isValid() method must immediately be called to verify the stream
       was correctly initialized.
+
+      A readonly file that close() compressed is inflated into memory as
+      it is opened (when built with HAVE_ZLIB).
     */
     Serializer(const string& filename, bool readonly = false);
     Serializer(void);
 
+    /**
+      Creates a new Serializer device for writing a file in one piece: the
+      data is streamed to memory, and close() replaces the file with it,
+      gzip-compressed at the given zlib level (1 is fastest, 9 smallest).
+      At level 0, or when built without HAVE_ZLIB, it is written as is.
+      It is written to the file name with ".tmp" appended and renamed
+      over the file once complete, so a failed write keeps the old file.
+
+      @param filename  The file to write
+      @param level     The compression level, from 0 to 9
+    */
+    Serializer(const string& filename, int level);
+
+    /**
+      Creates a new Serializer device on a caller-provided buffer, which
+      must outlive it.  Nothing is allocated or copied: a writable span
+      is written in place, a const span is read in place (and can't be
+      written).  Instead of throwing, any access past the end of the span
+      fails: reads answer zeros, writes are dropped, and failed() answers
+      true from then on.
+
+      A writable span without a buffer only measures: nothing is stored,
+      no write fails, and size() answers how many bytes were written.
+
+      @param buffer  The bytes to write or read (or 0 to measure)
+      @param size    The size of the buffer, in bytes
+    */
+    Serializer(uint8_t* buffer, uint32_t size);
+    Serializer(const uint8_t* buffer, uint32_t size);
+
     /**
       Destructor
     */
@@ -69,13 +103,41 @@ class Serializer
     */
     bool isValid(void);
 
+    /**
+      Writes out the file of a Serializer created with a compression level
+      (the destructor does it if this isn't called), and does nothing for
+      any other.
+
+      @return  False if the file couldn't be written, else true
+    */
+    bool close(void);
+
+    /**
+      Answers whether an access went past the end of a span (see above).
+      Streams throw instead, so they never answer true.
+    */
+    bool failed(void) const { return myFailed; }
+
+    /**
+      Answers whether this is a stream rather than a span.
+    */
+    bool isStream(void) const { return !mySpan && !myMeasuring; }
+
+    /**
+      For a span, the read/write location, and the bytes (0 when
+      measuring); a stream answers 0 for both.
+    */
+    uint32_t position(void) const { return isStream() ? 0 : myPosition; }
+    const uint8_t* data(void) const { return mySpan; }
+
     /**
       Resets the read/write location to the beginning of the stream.
     */
     void reset(void);
 
     /**
-      Returns the total size of the underlying stream, in bytes.
+      Returns the total size of the underlying stream, in bytes.  For a
+      writable span, that is how far it has been written.
 
       @result  The size of the stream, or 0 if it isn't valid.
     */
@@ -88,6 +150,14 @@ class Serializer
     */
     void setPosition(uint32_t pos);
 
+    /**
+      Moves the read location past the given number of bytes, as reading
+      them would (and failing as that would, for a span).
+
+      @param size  The number of bytes to skip
+    */
+    void skip(uint32_t size);
+
     /**
       Reads a byte value (unsigned 8-bit) from the current input stream.
 
@@ -134,6 +204,22 @@ class Serializer
     */
     void getIntArray(uint32_t* array, uint32_t size);
 
+    /**
+      Reads a long value (unsigned 64-bit) from the current input stream.
+
+      @result The long value which has been read from the stream.
+    */
+    uint64_t getLong(void);
+
+    /**
+      Reads a cycle count putLong() wrote.  In legacy mode (see below) it
+      reads the signed 32-bit count such states held instead, and answers
+      it offset by kLegacyCycleBase.
+
+      @result The cycle count which has been read from the stream.
+    */
+    uint64_t getCycles(void);
+
     /**
       Reads a string from the current input stream.
 
@@ -193,6 +279,13 @@ class Serializer
     */
     void putIntArray(const uint32_t* array, uint32_t size);
 
+    /**
+      Writes a long value (unsigned 64-bit) to the current output stream.
+
+      @param value The long value to write to the output stream.
+    */
+    void putLong(uint64_t value);
+
     /**
       Writes a string to the current output stream.
 
@@ -207,6 +300,91 @@ class Serializer
     */
     void putBool(bool b);
 
+    /**
+      Reads/writes a trivially copyable block exactly as it is laid out
+      in memory.  Only for snapshots (see Serializable::snapshot()),
+      which never leave the process that took them.
+
+      @param block  The block to read into, or to write
+    */
+    template<class T> void getBlock(T& block) { read(&block, sizeof(T)); }
+    template<class T> void putBlock(const T& block) { write(&block, sizeof(T)); }
+
+    /**
+      The previous snapshot an incremental stream is diffed against.  It
+      holds a copy of every paged byte array, in the order the arrays pass
+      through the Serializer, and is updated as data is streamed so that
+      after a complete save or load it describes the current state.
+    */
+    class DeltaReference
+    {
+      public:
+        DeltaReference();
+        ~DeltaReference();
+
+        /**
+          Forgets all reference data; the next incremental stream
+          written against it will be self-contained.
+        */
+        void clear();
+
+        /**
+          Answers whether any reference data is present.
+        */
+        bool isEmpty() const { return myCount == 0; }
+
+      private:
+        friend class Serializer;
+
+        // Returns the reference copy of the given array, (re)allocating
+        // it if it doesn't exist yet or changed size; 'fresh' is set in
+        // that case, since the copy then holds no usable data
+        uint8_t* block(uint32_t index, uint32_t size, bool& fresh);
+
+        enum { kMaxBlocks = 16 };
+
+        uint8_t* myBlock[kMaxBlocks];
+        uint32_t myBlockSize[kMaxBlocks];
+        uint32_t myCount;
+
+        // Copy constructor and assignment operator not supported
+        DeltaReference(const DeltaReference&);
+        DeltaReference& operator = (const DeltaReference&);
+    };
+
+    /**
+      Switches the serializer into (or out of) incremental mode.  While a
+      reference is set, byte arrays of at least kDeltaPageSize bytes are
+      compared page by page against the previous snapshot and only the
+      pages that changed are streamed, each group of 8 pages preceded by
+      a bitmask.  All other data is streamed as usual.  A stream written
+      against a reference can only be read back against a reference that
+      matches it on every page marked as unchanged.
+
+      @param ref  The reference to diff against, or NULL for normal mode
+    */
+    void setDeltaReference(DeltaReference* ref);
+
+    enum {
+      kDeltaPageSize = 64
+    };
+
+    /**
+      Switches the serializer into (or out of) legacy mode, for reading a
+      state saved before the cycle counts became 64-bit.  Those counts
+      were kept relative to the start of the frame in progress (the
+      System's counter was reset for every frame), so they could be
+      negative; getCycles() moves them to kLegacyCycleBase, which the
+      devices take as the start of that frame.  The devices whose layout
+      changed since then check legacy() to read the old one.
+
+      @param legacy  Whether the stream holds a legacy state
+    */
+    void setLegacy(bool legacy) { myLegacy = legacy; }
+    bool legacy(void) const { return myLegacy; }
+
+    static const uint64_t kLegacyCycleBase = 0x80000000u;
+
     std::string get()
     {
         stringstream *s = (stringstream*)myStream;
@@ -219,11 +397,43 @@ class Serializer
         s->str(data);
     }
 
+  private:
+    // Page-diffed byte array transfer, used in incremental mode
+    void putDeltaArray(const uint8_t* array, uint32_t size);
+    void getDeltaArray(uint8_t* array, uint32_t size);
+
+    // Raw transfer to/from the stream or span
+    void read(void* data, uint32_t size);
+    void write(const void* data, uint32_t size);
+
   private:
     // The stream to send the serialized data to.
     iostream* myStream;
     bool myUseFilestream;
 
+    // The file close() writes the stream to, and at what compression
+    // level (-1 when it has nothing to write)
+    string myFileName;
+    int myLevel;
+
+    // The span used instead of a stream (NULL when not in use), its size,
+    // how far it has been written, and the read/write location
+    uint8_t* mySpan;
+    uint32_t mySpanSize;
+    uint32_t mySpanEnd;
+    uint32_t myPosition;
+    bool myReadOnly;
+    bool myMeasuring;
+    bool myFailed;
+
+    // Reference snapshot for incremental mode (NULL when not in use),
+    // and the index of the next paged array within it
+    DeltaReference* myDelta;
+    uint32_t myDeltaIndex;
+
+    // Whether the stream holds a state with 32-bit cycle counts
+    bool myLegacy;
+
     enum {
       TruePattern  = 0xfe,
       FalsePattern = 0x01
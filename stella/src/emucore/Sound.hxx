@@ -21,10 +21,13 @@
 #define SOUND_HXX
 
 class OSystem;
+class AudioEventQueue;
+class Cartridge;
 
 #include "Serializable.hxx"
 #include "bspf.hxx"
 #include "TIASnd.hxx"
+#include "MusicStream.hxx"
 
 /**
   This class is an abstract base class for the various sound objects.
@@ -55,12 +58,13 @@ class Sound : public Serializable
     void setEnabled(bool enable);
 
     /**
-      The system cycle counter is being adjusting by the specified amount.  Any
-      members using the system cycle counter should be adjusted as needed.
+      Set the system cycle at which the TIA's current frame timing starts.
+      Register write timing restarts from this cycle whenever a fragment
+      runs out of pending writes.
 
-      @param amount The amount the cycle counter is being adjusted by
+      @param cycle The system cycle the TIA clocks are now measured from
     */
-    void adjustCycleCounter(int32_t amount);
+    void setCycleOrigin(uint64_t cycle);
 
     /**
       Sets the number of channels (mono or stereo sound).
@@ -69,6 +73,68 @@ class Sound : public Serializable
     */
     void setChannels(uint32_t channels);
 
+    /**
+      Selects how register writes reach the sound generator.  Normally
+      they are queued with their cycle delays and replayed over a fixed
+      number of samples by processFragment().  In inline mode the
+      generator instead runs up to the current cycle at every write, and
+      finishFragment() runs it up to the end of the frame, so the samples
+      follow the CPU cycle clock exactly (one every 38 cycles) and a
+      frame gives as many samples as its length in cycles spans.
+
+      Any writes still queued are applied when switching modes.
+
+      @param state  True for inline generation, false for the queue
+    */
+    void setInline(bool state);
+
+    /**
+      Hands the register writes to another thread instead of generating
+      samples here.  While a queue is set, every write is applied to the
+      registers and published to it with its cycle, the frontend marks
+      the end of every frame with markTime(), and neither
+      processFragment() nor finishFragment() is used.  Whenever events
+      could not be published (the queue was full) or the timeline jumped
+      (reset, state load), the next event is preceded by a Sync event.
+
+      @param queue  The queue to publish to, or 0 to generate samples here
+    */
+    void setEventQueue(AudioEventQueue* queue);
+
+    /**
+      Publishes that the emulation has reached the given cycle, so the
+      consumer of the event queue may generate samples up to it.
+
+      @param cycle  The system cycle the emulation is at
+    */
+    void markTime(uint64_t cycle);
+
+    /**
+      Plays the music of an ARM cart (CDF, BUS, DPC+) at the TIA's
+      sample rate.  The cart renders the levels its music fetchers give
+      into a stream, one every 38 cycles, and an AUDV write that stores
+      an AMPLITUDE fetch hands its channel over to the stream: until the
+      next write of anything else, the channel plays each sample at the
+      level rendered for it, as if the 6502 wrote AUDV every 38 cycles,
+      and the writes that merely store another fetch aren't queued.
+
+      Not for use with an event queue; the cart can only be asked from
+      the emulation thread.
+
+      @param cart  The cart to play the music of, or 0 to stop
+    */
+    void setMusicSource(Cartridge* cart);
+
+    /**
+      Saves/loads the ARM music state: which channels play the stream,
+      and the stream.  It isn't part of save(), as it only exists while
+      there is a music source, and states must load either way.
+
+      @return  The result of the save/load.  True on success.
+    */
+    bool saveMusic(Serializer& out) const;
+    bool loadMusic(Serializer& in);
+
     /**
       Start the sound system, initializing it if necessary.  This must be
       called before any calls are made to derived methods.
@@ -100,7 +166,7 @@ class Sound : public Serializable
       @param value The value to save into the register
       @param cycle The system cycle at which the register is being updated
     */
-    void set(uint16_t addr, uint8_t value, int32_t cycle);
+    void set(uint16_t addr, uint8_t value, uint64_t cycle);
 
     /**
       Sets the volume of the sound device to the specified level.  The
@@ -129,6 +195,25 @@ class Sound : public Serializable
     */
     void processFragment(int16_t* stream, uint32_t length);
 
+    /**
+      In inline mode, generates the samples between the last register
+      write and the given cycle (the end of the frame) and hands over
+      all the samples generated since the previous call.  The buffer
+      stays valid, and may be modified, until the next register write.
+
+      A fragment holds at most kInlineSamples; a frame spanning more
+      (one that never writes the TIA runs its 25000 instructions, which
+      may be 4600 samples) is handed out in parts, the register writes
+      it makes waiting in the queue until the samples before them have
+      been.  Call again with the same cycle until it answers 0.
+
+      @param cycle   The system cycle the fragment ends at
+      @param stream  Set to the start of the fragment
+      @return  The number of stereo samples in the fragment, 0 once the
+               cycle is reached
+    */
+    uint32_t finishFragment(uint64_t cycle, int16_t*& stream);
+
     /**
       Saves the current state of this device to the given Serializer.
 
@@ -145,6 +230,15 @@ class Sound : public Serializable
     */
     bool load(Serializer& in);
 
+    /**
+      The bytes save() writes beyond its fixed part: the queued register
+      writes and the samples of an unfinished inline fragment.  Everything
+      else in a state has the same size for as long as a cart is loaded
+      (see StateManager::stateSize()).
+    */
+    uint32_t pendingStateSize() const
+    { return 9 * myRegWriteQueue.size() + 4 * myInlineSamples; }
+
     /**
       Get a descriptor for this console class (used in error checking).
 
@@ -171,76 +265,120 @@ class Sound : public Serializable
     /**
       A queue class used to hold TIA sound register writes before being
       processed while creating a sound fragment.
+
+      The queue is a preallocated ring with a fixed power-of-two capacity,
+      so the audio path never allocates.  The capacity covers every write
+      a normal frame can make (a 312-line PAL frame is 23712 cycles, and
+      a store takes at least 3 of them); what happens when it is full
+      anyway is up to the owner, see Sound::set().
     */
     class RegWriteQueue
     {
       public:
-        /**
-          Create a new queue instance with the specified initial
-          capacity.  If the queue ever reaches its capacity then it will
-          automatically increase its size.
-        */
-        RegWriteQueue(uint32_t capacity = 512);
+        // Number of writes the queue holds (a power of two)
+        enum { kCapacity = 8192 };
 
         /**
-          Destroy this queue instance.
+          Create a new, empty queue instance.
         */
-        virtual ~RegWriteQueue();
+        RegWriteQueue();
 
         /**
           Clear any items stored in the queue.
         */
-        void clear();
+        void clear() { myHead = mySize = 0; }
 
         /**
           Dequeue the first object in the queue.
         */
-        void dequeue();
+        void dequeue()
+        {
+          if(mySize > 0)
+          {
+            myHead = (myHead + 1) & (kCapacity - 1);
+            --mySize;
+          }
+        }
 
         /**
           Return the total duration of all the items in the queue,
           in integer CPU cycles.
         */
-        uint64_t durationCycles();
+        uint64_t durationCycles() const;
 
         /**
-          Enqueue the specified object.
+          Enqueue the specified object.  The queue must not be full.
         */
-        void enqueue(const RegWrite& info);
+        void enqueue(const RegWrite& info)
+        {
+          myBuffer[(myHead + mySize) & (kCapacity - 1)] = info;
+          ++mySize;
+        }
 
         /**
           Return the i-th queued item counted from the front,
           for state serialization.
         */
         const RegWrite& peek(uint32_t i) const
-          { return myBuffer[(myHead + i) % myCapacity]; }
+          { return myBuffer[(myHead + i) & (kCapacity - 1)]; }
 
         /**
           Return the item at the front on the queue.
 
           @return  The item at the front of the queue.
         */
-        RegWrite& front();
+        RegWrite& front() { return myBuffer[myHead]; }
 
         /**
           Answers the number of items currently in the queue.
 
           @return  The number of items in the queue.
         */
-        uint32_t size() const;
+        uint32_t size() const { return mySize; }
 
-      private:
-        // Increase the size of the queue
-        void grow();
+        /**
+          Answers whether the queue is at its capacity.
+        */
+        bool full() const { return mySize == kCapacity; }
 
-        uint32_t myCapacity;
-        RegWrite* myBuffer;
+      private:
+        RegWrite myBuffer[kCapacity];
         uint32_t mySize;
         uint32_t myHead;
-        uint32_t myTail;
     };
 
   private:
+    // Generate the samples up to the given cycle in inline mode
+    void advanceTo(uint64_t cycle);
+
+    // Apply any queued register writes right away
+    void flushQueue();
+
+    // Apply a register write taken from the queue
+    void applyWrite(uint16_t addr, uint8_t value);
+
+    // Generate the given number of samples, starting at the given
+    // position of the fragment, playing the music stream on the channels
+    // that have been handed to it
+    void generate(int16_t* stream, uint32_t samples, uint32_t position);
+
+    // Restart the event queue's consumer from the given cycle, with a
+    // Sync event
+    void resync(uint64_t cycle);
+
+    // Publish an event to the event queue, preceded by a Sync event if
+    // earlier ones were lost
+    void publish(uint8_t type, uint64_t cycle, uint16_t addr, uint8_t value);
+
+    // Most samples an inline fragment holds; more than a frame the TIA
+    // cuts off spans (342 scanlines are 684 samples), see finishFragment()
+    // for the frames it doesn't
+    enum { kInlineSamples = 1024 };
+
+    // Flag on a queued AUDV write that hands its channel to the music
+    // stream
+    enum { kMusicWrite = 0x100 };
+
     // TIASound emulation object
     TIASound myTIASound;
 
@@ -251,7 +389,10 @@ class Sound : public Serializable
     bool myIsInitializedFlag;
 
     // Indicates the cycle when a sound register was last set
-    int32_t myLastRegisterSetCycle;
+    uint64_t myLastRegisterSetCycle;
+
+    // Indicates the system cycle the TIA's frame timing starts from
+    uint64_t myCycleOrigin;
 
     // Indicates the number of channels (mono or stereo)
     uint32_t myNumChannels;
@@ -264,6 +405,34 @@ class Sound : public Serializable
 
     // Queue of TIA register writes
     RegWriteQueue myRegWriteQueue;
+
+    // Indicates if samples are generated inline at each register write
+    bool myInlineFlag;
+
+    // Inline mode: the cycle the samples generated so far reach, and
+    // the samples of the fragment in progress
+    uint64_t myInlineCycle;
+    uint32_t myInlineSamples;
+    int16_t myInlineBuffer[2 * kInlineSamples];
+
+    // Queue the register writes are published to, if any, and whether
+    // the consumer needs a Sync event before the next one
+    AudioEventQueue* myEventQueue;
+    bool myEventsLost;
+
+    // ARM music: the cart rendering it and the stream it renders into,
+    // which channels play it, and which will once the queued writes are
+    // applied
+    Cartridge* myMusicCart;
+    MusicStream myMusicStream;
+    bool myMusicOn[2];
+    bool myMusicQueued[2];
+
+    // The levels the fragment being generated plays: the sample at
+    // position p plays level first + p * count / span
+    uint64_t myMusicFirst;
+    uint32_t myMusicCount;
+    uint32_t myMusicSpan;
 };
 
 #endif
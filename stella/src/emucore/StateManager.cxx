@@ -17,6 +17,7 @@
 // $Id: StateManager.cxx 2838 2014-01-17 23:34:03Z stephena $
 //============================================================================
 
+#include <cstring>
 #include <sstream>
 
 #include "OSystem.hxx"
@@ -27,15 +28,148 @@
 #include "Switches.hxx"
 #include "System.hxx"
 #include "Serializable.hxx"
+#include "Sound.hxx"
 
 #include "StateManager.hxx"
 
-#define STATE_HEADER "03090100state"
+// Bumped when the cycle counts became 64-bit.  States saved before then
+// still load, converted as they are read (see Serializer::setLegacy())
+#define STATE_HEADER "03090200state"
+#define LEGACY_HEADER "03090100state"
 #define MOVIE_HEADER "03030000movie"
+#define DELTA_HEADER "03090200delta"
+
+// Sectioned states (see saveState()).  All numbers are 32-bit, in host
+// byte order like the rest of the state, and offsets count from the
+// start of the header:
+//
+//   header  8  SECTION_MAGIC
+//           4  format version (kSectionedVersion)
+//           4  number of sections
+//           4  total size: header, table and sections
+//           4  flags: kChecksums if the sections have checksums
+//   table, for each section:
+//          24  name of its part, cut to 23 characters and padded with NULs
+//           4  offset
+//           4  length
+//           4  version of the part's state (see Serializable::stateVersion())
+//           4  Adler-32 checksum of the section, as zlib computes it
+//              (0 without kChecksums)
+//   sections, back to back, each holding what its part's save() writes
+//
+// The sections are those of the parts the tagged format saves one after
+// another, in the same order, so a tagged state is the header strings
+// followed by the sections.
+#define SECTION_MAGIC "STLSECT\0"
+
+namespace {
+  enum {
+    kSectionedVersion = 1,
+    kHeaderSize       = 24,
+    kNameSize         = 24,
+    kEntrySize        = kNameSize + 16,
+    kMaxSections      = 256,
+    kChecksums        = 1
+  };
+
+  struct SectionEntry
+  {
+    char name[kNameSize];
+    uint32_t offset, length, version, checksum;
+  };
+
+  // Adler-32, with the modulo deferred for as long as the sums can't
+  // overflow, and eight bytes summed at a time to shorten the chain of
+  // additions each byte otherwise waits for
+  uint32_t adler32(const uint8_t* d, uint32_t size)
+  {
+    uint32_t a = 1, b = 0;
+    while(size > 0)
+    {
+      uint32_t n = MIN(size, 5552u);
+      size -= n;
+      for(; n >= 8; n -= 8, d += 8)
+      {
+        b += 8 * a + 8 * d[0] + 7 * d[1] + 6 * d[2] + 5 * d[3] +
+                     4 * d[4] + 3 * d[5] + 2 * d[6] + d[7];
+        a += d[0] + d[1] + d[2] + d[3] + d[4] + d[5] + d[6] + d[7];
+      }
+      for(; n > 0; --n)
+      {
+        a += *d++;
+        b += a;
+      }
+      a %= 65521;
+      b %= 65521;
+    }
+    return (b << 16) | a;
+  }
+
+  void packName(char packed[kNameSize], const string& name)
+  {
+    memset(packed, 0, kNameSize);
+    strncpy(packed, name.c_str(), kNameSize - 1);
+  }
+
+  uint32_t readInt(const uint8_t* p)
+  {
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return value;
+  }
+
+  // The number of sections of the sectioned state at 'state' (0 if it
+  // isn't one), its total size, and whether it has checksums
+  uint32_t sectionCount(const uint8_t* state, uint32_t size, uint32_t& total,
+                        bool& checksums)
+  {
+    if(size < kHeaderSize || memcmp(state, SECTION_MAGIC, 8) != 0 ||
+       readInt(state + 8) != kSectionedVersion)
+      return 0;
+
+    uint32_t count = readInt(state + 12);
+    total = readInt(state + 16);
+    checksums = (readInt(state + 20) & kChecksums) != 0;
+    if(count == 0 || count > kMaxSections || total > size ||
+       total < kHeaderSize + count * kEntrySize)
+      return 0;
+
+    return count;
+  }
+
+  // Entry i of the table, if its section lies within the state
+  bool sectionEntry(const uint8_t* state, uint32_t total, uint32_t i,
+                    SectionEntry& e)
+  {
+    const uint8_t* p = state + kHeaderSize + i * kEntrySize;
+    memcpy(e.name, p, kNameSize);
+    e.offset   = readInt(p + kNameSize);
+    e.length   = readInt(p + kNameSize + 4);
+    e.version  = readInt(p + kNameSize + 8);
+    e.checksum = readInt(p + kNameSize + 12);
+
+    return e.offset <= total && e.length <= total - e.offset;
+  }
+
+  bool sectionIntact(const uint8_t* state, const SectionEntry& e,
+                     bool checksums)
+  {
+    return !checksums || adler32(state + e.offset, e.length) == e.checksum;
+  }
+}
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 StateManager::StateManager(OSystem* osystem)
-  : myOSystem(osystem)
+  : myOSystem(osystem),
+    myDeltaGeneration(0),
+    myDeltaCounter(0),
+    myStateSizeCart(0),
+    myStateSize(0),
+    mySnapshotSizeCart(0),
+    mySnapshotSize(0),
+    myGame(0),
+    myRewindFrames(0),
+    myRewindMark(0)
 {
   reset();
 }
@@ -48,6 +182,114 @@ StateManager::~StateManager()
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void StateManager::update()
 {
+  if(!myRewind.enabled() || !&myOSystem->console())
+    return;
+
+  uint32_t size = snapshotSize();
+  Serializer out(myRewind.next(size), size);
+  if(size && saveSnapshot(out))
+  {
+    myRewind.push(out.size());
+    ++myRewindFrames;
+  }
+  else
+  {
+    myRewind.clear();
+    myRewindFrames = myRewindMark = 0;
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void StateManager::setRewind(uint32_t depth, uint32_t size)
+{
+  myRewind.setup(depth, size);
+  myRewindFrames = myRewindMark = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint32_t StateManager::rewind(uint32_t frames)
+{
+  uint32_t n = 0;
+  while(n < frames && myRewind.pop())
+    ++n;
+
+  if(n == 0)
+    return 0;
+
+  myRewindFrames -= n;
+  myRewindMark = MIN(myRewindMark, myRewindFrames);
+
+  Serializer in(myRewind.newest(), myRewind.newestSize());
+  if(!loadSnapshot(in))
+  {
+    myRewind.clear();
+    myRewindFrames = myRewindMark = 0;
+    return 0;
+  }
+  return n;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void StateManager::markRewind()
+{
+  myRewindMark = myRewindFrames;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void StateManager::forgetAfterMark()
+{
+  while(myRewindFrames > myRewindMark)
+  {
+    --myRewindFrames;
+    if(!myRewind.pop())
+    {
+      // The ring no longer reaches back to the marked frame
+      myRewind.clear();
+      myRewindFrames = myRewindMark = 0;
+      return;
+    }
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void StateManager::setRollback(uint32_t slots)
+{
+  myRollback.setup(slots);
+  if(myRollback.enabled() && &myOSystem->console())
+    myRollback.reserve(snapshotSize());
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool StateManager::saveRollback(uint32_t frame)
+{
+  if(!myRollback.enabled() || !&myOSystem->console())
+    return false;
+
+  uint32_t size = snapshotSize();
+  if(size == 0)
+    return false;
+
+  uint8_t* slot = myRollback.next(frame, size);
+  Serializer out(slot, myRollback.capacity());
+  bool ok = saveSnapshot(out);
+  myRollback.push(frame, ok ? out.size() : 0);
+  return ok;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool StateManager::loadRollback(uint32_t frame)
+{
+  uint32_t size = 0;
+  const uint8_t* snapshot = myRollback.find(frame, size);
+  if(!snapshot)
+    return false;
+
+  Serializer in(snapshot, size);
+  if(!loadSnapshot(in))
+    return false;
+
+  myRollback.forgetAfter(frame);
+  return true;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -58,24 +300,39 @@ bool StateManager::loadState(Serializer& in)
     // Make sure the file can be opened for reading
     if(in.isValid())
     {
+      const uint8_t* data = in.data();
+      uint32_t at = in.position();
+      if(data && in.size() >= at + 8 &&
+         memcmp(data + at, SECTION_MAGIC, 8) == 0)
+        return loadSections(in) && !in.failed();
+
       // First test if we have a valid header and cart type
       // If so, do a complete state load using the Console
-      return in.getString() == STATE_HEADER &&
-             in.getString() == myOSystem->console().cartridge().name() &&
-             myOSystem->console().load(in);
+      string header = in.getString();
+      if(header != STATE_HEADER && header != LEGACY_HEADER)
+        return false;
+
+      in.setLegacy(header == LEGACY_HEADER);
+      bool ok = in.getString() == myOSystem->console().cartridge().name() &&
+                myOSystem->console().load(in) && !in.failed();
+      in.setLegacy(false);
+      return ok;
     }
   }
   return false;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-bool StateManager::saveState(Serializer& out)
+bool StateManager::saveState(Serializer& out, bool checksums)
 {
     if(&myOSystem->console())
     {
       // Make sure the file can be opened for writing
       if(out.isValid())
       {
+        if(!out.isStream())
+          return saveSections(out, checksums) && !out.failed();
+
         // Add header so that if the state format changes in the future,
         // we'll know right away, without having to parse the rest of the file
         out.putString(STATE_HEADER);
@@ -84,16 +341,302 @@ bool StateManager::saveState(Serializer& out)
         out.putString(myOSystem->console().cartridge().name());
 
         // Do a complete state save using the Console
-        if(myOSystem->console().save(out))
+        if(myOSystem->console().save(out) && !out.failed())
           return true;
       }
     }
   return false;
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+const uint8_t* StateManager::findSection(const uint8_t* state, uint32_t size,
+                                         const string& name, uint32_t& length,
+                                         uint32_t& version)
+{
+  uint32_t total = 0;
+  bool checksums = false;
+  uint32_t count = state ? sectionCount(state, size, total, checksums) : 0;
+
+  char packed[kNameSize];
+  packName(packed, name);
+  for(uint32_t i = 0; i < count; ++i)
+  {
+    SectionEntry e;
+    if(!sectionEntry(state, total, i, e))
+      return 0;
+    if(memcmp(e.name, packed, kNameSize) == 0)
+    {
+      if(!sectionIntact(state, e, checksums))
+        return 0;
+      length = e.length;
+      version = e.version;
+      return state + e.offset;
+    }
+  }
+  return 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint32_t StateManager::numberOfSections() const
+{
+  return myOSystem->console().numberOfStateParts() + 1;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Serializable& StateManager::section(uint32_t i) const
+{
+  Console& console = myOSystem->console();
+  if(i == 0)
+    return console.system();
+  return console.statePart(i - 1);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool StateManager::saveSection(Serializer& out, uint32_t i) const
+{
+  if(i == 0)
+    return myOSystem->console().system().saveOwnState(out);
+  return section(i).save(out);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool StateManager::loadSection(Serializer& in, uint32_t i)
+{
+  if(i == 0)
+    return myOSystem->console().system().loadOwnState(in);
+  return section(i).load(in);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool StateManager::saveSections(Serializer& out, bool checksums)
+{
+  uint32_t count = numberOfSections();
+  uint32_t start = out.position();
+  uint32_t offset = kHeaderSize + count * kEntrySize;
+
+  // Each section is saved first, then its table entry, once known
+  for(uint32_t i = 0; i < count; ++i)
+  {
+    out.setPosition(start + offset);
+    if(!saveSection(out, i) || out.failed())
+      return false;
+    uint32_t end = out.position() - start;
+
+    // Nothing to check when only measuring
+    const uint8_t* data = out.data();
+    uint32_t checksum = checksums && data ?
+        adler32(data + start + offset, end - offset) : 0;
+
+    char name[kNameSize];
+    packName(name, section(i).name());
+    out.setPosition(start + kHeaderSize + i * kEntrySize);
+    out.putByteArray((const uint8_t*)name, kNameSize);
+    out.putInt(offset);
+    out.putInt(end - offset);
+    out.putInt(section(i).stateVersion());
+    out.putInt(checksum);
+    offset = end;
+  }
+
+  out.setPosition(start);
+  out.putByteArray((const uint8_t*)SECTION_MAGIC, 8);
+  out.putInt(kSectionedVersion);
+  out.putInt(count);
+  out.putInt(offset);
+  out.putInt(checksums ? kChecksums : 0);
+  out.setPosition(start + offset);
+
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool StateManager::loadSections(Serializer& in)
+{
+  uint32_t start = in.position();
+  const uint8_t* state = in.data() + start;
+  uint32_t total = 0;
+  bool checksums = false;
+  uint32_t count = sectionCount(state, in.size() - start, total, checksums);
+  if(count == 0 || count != numberOfSections())
+    return false;
+
+  // Check every section before loading any, so that a damaged state
+  // leaves the system as it was
+  for(uint32_t i = 0; i < count; ++i)
+  {
+    SectionEntry e;
+    char name[kNameSize];
+    packName(name, section(i).name());
+    if(!sectionEntry(state, total, i, e) ||
+       memcmp(e.name, name, kNameSize) != 0 ||
+       e.version != section(i).stateVersion() ||
+       !sectionIntact(state, e, checksums))
+      return false;
+  }
+
+  for(uint32_t i = 0; i < count; ++i)
+  {
+    SectionEntry e;
+    sectionEntry(state, total, i, e);
+    in.setPosition(start + e.offset);
+    if(!loadSection(in, i) || in.position() != start + e.offset + e.length)
+      return false;
+  }
+
+  in.setPosition(start + total);
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint32_t StateManager::stateSize()
+{
+  if(!&myOSystem->console())
+    return 0;
+
+  const Sound& sound = myOSystem->sound();
+  const Cartridge* cart = &myOSystem->console().cartridge();
+  if(cart != myStateSizeCart)
+  {
+    // A span without a buffer only counts what would be written
+    Serializer measure((uint8_t*)0, 0);
+    if(!saveState(measure))
+      return 0;
+
+    myStateSize = measure.size() - sound.pendingStateSize();
+    myStateSizeCart = cart;
+  }
+  return myStateSize + sound.pendingStateSize();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool StateManager::saveSnapshot(Serializer& out)
+{
+  if(!&myOSystem->console() || !out.isValid())
+    return false;
+
+  out.putInt(myGame);
+  return myOSystem->console().snapshot(out) && !out.failed();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool StateManager::loadSnapshot(Serializer& in)
+{
+  if(!&myOSystem->console() || !in.isValid())
+    return false;
+
+  return in.getInt() == myGame &&
+         myOSystem->console().restore(in) && !in.failed();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint32_t StateManager::snapshotSize()
+{
+  if(!&myOSystem->console())
+    return 0;
+
+  const Sound& sound = myOSystem->sound();
+  const Cartridge* cart = &myOSystem->console().cartridge();
+  if(cart != mySnapshotSizeCart)
+  {
+    Serializer measure((uint8_t*)0, 0);
+    if(!saveSnapshot(measure))
+      return 0;
+
+    mySnapshotSize = measure.size() - sound.pendingStateSize();
+    mySnapshotSizeCart = cart;
+  }
+  return mySnapshotSize + sound.pendingStateSize();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool StateManager::saveStateDelta(Serializer& out)
+{
+  if(!&myOSystem->console() || !out.isValid())
+    return false;
+
+  // Record which snapshot this state is relative to, and which one it
+  // becomes; a generation of 0 means the state is self-contained
+  uint32_t base = myDelta.isEmpty() ? 0 : myDeltaGeneration;
+  uint32_t generation = ++myDeltaCounter;
+  if(generation == 0)
+    generation = ++myDeltaCounter;
+
+  bool ok = false;
+  try
+  {
+    out.putString(DELTA_HEADER);
+    out.putInt(base);
+    out.putInt(generation);
+
+    out.setDeltaReference(&myDelta);
+    ok = saveState(out, false);
+  }
+  catch(...)
+  {
+    ok = false;
+  }
+  out.setDeltaReference(NULL);
+
+  // A partially written state leaves the snapshot half updated
+  if(ok)
+    myDeltaGeneration = generation;
+  else
+    resetDelta();
+
+  return ok;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool StateManager::loadStateDelta(Serializer& in)
+{
+  if(!&myOSystem->console() || !in.isValid())
+    return false;
+
+  bool ok = false;
+  try
+  {
+    if(in.getString() != DELTA_HEADER)
+      return false;
+
+    uint32_t base = in.getInt();
+    uint32_t generation = in.getInt();
+    if(base != 0 && base != myDeltaGeneration &&
+       generation != myDeltaGeneration)
+      return false;
+
+    in.setDeltaReference(&myDelta);
+    ok = loadState(in);
+    if(ok)
+      myDeltaGeneration = generation;
+  }
+  catch(...)
+  {
+    ok = false;
+  }
+  in.setDeltaReference(NULL);
+
+  if(!ok)
+    resetDelta();
+
+  return ok;
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void StateManager::reset()
 {
+  resetDelta();
+  myStateSizeCart = mySnapshotSizeCart = 0;
+  ++myGame;
+  myRewind.clear();
+  myRewindFrames = myRewindMark = 0;
+  myRollback.clear();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void StateManager::resetDelta()
+{
+  myDelta.clear();
+  myDeltaGeneration = 0;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
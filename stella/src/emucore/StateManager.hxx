@@ -21,8 +21,12 @@
 #define STATE_MANAGER_HXX
 
 class OSystem;
+class Cartridge;
+class Serializable;
 
 #include "Serializer.hxx"
+#include "RewindBuffer.hxx"
+#include "RollbackBuffer.hxx"
 
 /**
   This class provides an interface to all things related to emulation state.
@@ -47,13 +51,76 @@ class StateManager
 
   public:
     /**
-      Updates the state of the system based on the currently active mode
+      Updates the state of the system based on the currently active mode:
+      with rewind set up, records a snapshot of the current state as the
+      newest one to rewind to.  Meant to be called once per frame.
     */
     void update();
 
+    /**
+      Sets rewind up to keep at most 'depth' frames, besides the newest,
+      in 'size' bytes (see RewindBuffer), forgetting any recorded so far.
+      A depth or size of 0 turns it off.
+    */
+    void setRewind(uint32_t depth, uint32_t size);
+
+    /**
+      Loads the state recorded the given number of frames before the
+      newest one, or the oldest one kept if that is fewer.  The frames
+      in between are forgotten.
+
+      @return  The number of frames rewound, 0 if none
+    */
+    uint32_t rewind(uint32_t frames);
+
+    /**
+      Marks the newest frame recorded for rewind as the one a state saved
+      now stands for.  Run-ahead saves a state, runs frames it throws
+      away and loads the state back; forgetAfterMark() then drops those
+      frames again.
+    */
+    void markRewind();
+
+    /**
+      Forgets the frames recorded for rewind after the one markRewind()
+      marked, since the state saved then was loaded.
+    */
+    void forgetAfterMark();
+
+    /**
+      The rewind buffer, for reporting its use.
+    */
+    const RewindBuffer& rewindBuffer() const { return myRewind; }
+
+    /**
+      Sets the rollback ring up with the given number of slots (see
+      RollbackBuffer), forgetting any frames saved to it, and allocates
+      them for the game loaded, if any.  0 slots turns it off.
+    */
+    void setRollback(uint32_t slots);
+
+    /**
+      Saves a snapshot of the current state to the rollback ring as the
+      given frame, replacing the one saved that many slots before.
+
+      @return  False if the ring is off or the snapshot failed
+    */
+    bool saveRollback(uint32_t frame);
+
+    /**
+      Restores the snapshot of the given frame from the rollback ring,
+      and forgets the frames saved after it.
+
+      @return  False if the ring doesn't hold the frame, or it couldn't
+               be restored (possibly half restored)
+    */
+    bool loadRollback(uint32_t frame);
+
     /**
       Load a state into the current system from the given Serializer.
-      No messages are printed to the screen.
+      No messages are printed to the screen.  Both sectioned states and
+      the tagged states saved before them load, including those saved
+      before the cycle counts became 64-bit.
 
       @param in  The Serializer object to use
 
@@ -65,18 +132,127 @@ class StateManager
       Save the current state from the system into the given Serializer.
       No messages are printed to the screen.
 
+      To a span, the state is sectioned: a header and a table of sections
+      with the offset, length, version and checksum of each part's state
+      (see the layout in StateManager.cxx), so that a tool can find and
+      read one part, such as the RIOT's RAM, without parsing the rest.
+      To a stream, it is saved in the tagged format instead: the parts'
+      states one after another, behind a header and the cart name.
+
+      Checksumming a large cart RAM costs several times what saving it
+      does, so states that never leave the process, such as those saved
+      for run-ahead, can go without.
+
+      @param out        The Serializer object to use
+      @param checksums  Whether the sections get checksums
+
+      @return  False on any save errors, else true
+    */
+    bool saveState(Serializer& out, bool checksums = true);
+
+    /**
+      Finds the section holding the state of the part with the given
+      name in a sectioned state, checking its checksum if it has one,
+      without loading anything.  Of two parts with the same name (the controllers, when
+      both are of one type), the first is found.
+
+      @param state    The state
+      @param size     Its size, in bytes
+      @param name     The name of the part
+      @param length   Set to the length of the section
+      @param version  Set to the version of its state
+
+      @return  The start of the section, or 0 if there is no such
+               section, or it or the state is damaged
+    */
+    static const uint8_t* findSection(const uint8_t* state, uint32_t size,
+                                      const string& name, uint32_t& length,
+                                      uint32_t& version);
+
+    /**
+      The size of the state saveState() would save now, without saving
+      it.  All but the pending sound data (see Sound::pendingStateSize())
+      is the same for as long as a cart is loaded, so that part is
+      measured once per cart, with a dry run, and cached.
+
+      @return  The size in bytes, or 0 if no state can be saved
+    */
+    uint32_t stateSize();
+
+    /**
+      Save the current state as a snapshot: the same state saveState()
+      saves, with the CPU, RIOT and TIA copied as blocks rather than
+      field by field (see System::snapshot()).  A snapshot can only be
+      loaded back by loadSnapshot() while the same game is loaded.
+
       @param out  The Serializer object to use
 
       @return  False on any save errors, else true
     */
-    bool saveState(Serializer& out);
+    bool saveSnapshot(Serializer& out);
+
+    /**
+      Load a snapshot saved by saveSnapshot().
+
+      @param in  The Serializer object to use
+
+      @return  False on any load errors, else true
+    */
+    bool loadSnapshot(Serializer& in);
 
     /**
-      Resets manager to defaults
+      The size of the snapshot saveSnapshot() would save now, worked out
+      like stateSize().
+
+      @return  The size in bytes, or 0 if no snapshot can be saved
+    */
+    uint32_t snapshotSize();
+
+    /**
+      Save the current state as an incremental state, in which the large
+      RAM-like arrays (RIOT RAM, cart/ARM RAM, etc.) only contain the
+      pages that changed since the previous incremental save or load.
+      The first incremental state after reset() is self-contained.
+      Being for run-ahead, its sections have no checksums.
+
+      @param out  The Serializer object to use
+
+      @return  False on any save errors, else true
+    */
+    bool saveStateDelta(Serializer& out);
+
+    /**
+      Load an incremental state created by saveStateDelta().  This only
+      succeeds when the state was diffed against the snapshot this
+      manager currently holds, or when it is that snapshot itself (which
+      is what run-ahead needs: save, run ahead, load the same state back).
+
+      @param in  The Serializer object to use
+
+      @return  False on any load errors, else true
+    */
+    bool loadStateDelta(Serializer& in);
+
+    /**
+      Resets manager to defaults, forgetting the incremental snapshot and
+      the frames recorded for rewind and rollback (but keeping them set
+      up)
     */
     void reset();
 
   private:
+    // Forgets the snapshot incremental states are diffed against
+    void resetDelta();
+
+    // Sectioned states: section 0 holds the system's own state, and the
+    // rest each hold one of the console's parts (see Console::statePart())
+    uint32_t numberOfSections() const;
+    Serializable& section(uint32_t i) const;
+    bool saveSection(Serializer& out, uint32_t i) const;
+    bool loadSection(Serializer& in, uint32_t i);
+    bool saveSections(Serializer& out, bool checksums);
+    bool loadSections(Serializer& in);
+
     // Copy constructor isn't supported by this class so make it private
     StateManager(const StateManager&);
 
@@ -90,6 +266,34 @@ class StateManager
 
     // The parent OSystem object
     OSystem* myOSystem;
+
+    // Snapshot the incremental states are diffed against, the generation
+    // it represents (0 if none), and the last generation handed out
+    Serializer::DeltaReference myDelta;
+    uint32_t myDeltaGeneration;
+    uint32_t myDeltaCounter;
+
+    // The cart the fixed part of a state was measured for (0 if none),
+    // and its size
+    const Cartridge* myStateSizeCart;
+    uint32_t myStateSize;
+
+    // The same for snapshots
+    const Cartridge* mySnapshotSizeCart;
+    uint32_t mySnapshotSize;
+
+    // Bumped by reset(), so snapshots of another game are refused
+    uint32_t myGame;
+
+    // The frames recorded for rewind, and saved for rollback
+    RewindBuffer myRewind;
+    RollbackBuffer myRollback;
+
+    // The frames recorded for rewind, less those rewound or forgotten
+    // (counting from 0 again whenever the ring is cleared), and that
+    // count when markRewind() was last called
+    uint32_t myRewindFrames;
+    uint32_t myRewindMark;
 };
 
 #endif
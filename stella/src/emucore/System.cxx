@@ -85,9 +85,6 @@ void System::reset(bool autodetect)
   // Provide hint to devices that autodetection is active (or not)
   mySystemInAutodetect = autodetect;
 
-  // Reset system cycle counter
-  resetCycles();
-
   // First we reset the devices attached to myself
   for(uint32_t i = 0; i < myNumberOfDevices; ++i)
     myDevices[i]->reset();
@@ -137,19 +134,6 @@ void System::attach(TIA* tia)
   attach((Device*) tia);
 }
 
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void System::resetCycles()
-{
-  // First we let all of the device attached to me know about the reset
-  for(uint32_t i = 0; i < myNumberOfDevices; ++i)
-  {
-    myDevices[i]->systemCyclesReset();
-  }
-
-  // Now, we reset cycle count to zero
-  myCycles = 0;
-}
-
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void System::setPageAccess(uint16_t page, const PageAccess& access)
 {
@@ -248,16 +232,12 @@ void System::unlockDataBus()
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 bool System::save(Serializer& out) const
 {
-   out.putString(name());
-   out.putInt(myCycles);
-   out.putByte(myDataBusState);
-
-   if(!myM6502->save(out))
+   if(!saveOwnState(out))
       return false;
 
-   // Now save the state of each device
-   for(uint32_t i = 0; i < myNumberOfDevices; ++i)
-      if(!myDevices[i]->save(out))
+   // Now save the state of the CPU and each device
+   for(uint32_t i = 0; i < numberOfParts(); ++i)
+      if(!part(i).save(out))
          return false;
 
    return true;
@@ -265,20 +245,75 @@ bool System::save(Serializer& out) const
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 bool System::load(Serializer& in)
+{
+   if(!loadOwnState(in))
+      return false;
+
+   // Now load the state of the CPU and each device
+   for(uint32_t i = 0; i < numberOfParts(); ++i)
+      if(!part(i).load(in))
+         return false;
+
+   return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool System::saveOwnState(Serializer& out) const
+{
+   out.putString(name());
+   out.putLong(myCycles);
+   out.putByte(myDataBusState);
+
+   return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool System::loadOwnState(Serializer& in)
 {
    if(in.getString() != name())
       return false;
 
-   myCycles = in.getInt();
+   myCycles = in.getCycles();
+   myDataBusState = in.getByte();
+
+   return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Serializable& System::part(uint32_t i) const
+{
+   if(i == 0)
+      return *myM6502;
+   return *myDevices[i - 1];
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool System::snapshot(Serializer& out) const
+{
+   out.putLong(myCycles);
+   out.putByte(myDataBusState);
+
+   if(!myM6502->snapshot(out))
+      return false;
+
+   for(uint32_t i = 0; i < myNumberOfDevices; ++i)
+      if(!myDevices[i]->snapshot(out))
+         return false;
+
+   return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool System::restore(Serializer& in)
+{
+   myCycles = in.getLong();
    myDataBusState = in.getByte();
 
-   // Next, load state for the CPU
-   if(!myM6502->load(in))
+   if(!myM6502->restore(in))
       return false;
 
-   // Now load the state of each device
    for(uint32_t i = 0; i < myNumberOfDevices; ++i)
-      if(!myDevices[i]->load(in))
+      if(!myDevices[i]->restore(in))
          return false;
 
    return true;
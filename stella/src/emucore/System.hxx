@@ -29,6 +29,7 @@ class NullDevice;
 #include "bspf.hxx"
 #include "Device.hxx"
 #include "NullDev.hxx"
+#include "Profiler.hxx"
 #include "Random.hxx"
 #include "Serializable.hxx"
 
@@ -64,8 +65,8 @@ class System : public Serializable
 
   public:
     /**
-      Reset the system cycle counter, the attached devices, and the
-      attached processor of the system.
+      Reset the attached devices and the attached processor of the
+      system.  The system cycle counter is monotonic and keeps running.
 
       @param autodetect  A hint to devices that the system is currently
                          in autodetect mode.  That is, the system is being
@@ -133,6 +134,15 @@ class System : public Serializable
     TIA& tia() { return *myTIA; }
     const TIA& tia() const { return *myTIA; }
 
+#ifdef STELLA_PROFILE
+    /**
+      Answer the execution profiler of the system.
+
+      @return The profiler
+    */
+    Profiler& profiler() { return myProfiler; }
+#endif
+
     /**
       Answer the random generator attached to the system.
 
@@ -172,12 +182,14 @@ class System : public Serializable
  
   public:
     /**
-      Get the number of system cycles which have passed since the last
-      time cycles were reset or the system was reset.
+      Get the number of system cycles which have passed since the system
+      was created.  The count is monotonic and 64 bits wide, so it never
+      needs to be rebased: devices can timestamp events with it across
+      frame boundaries, and only ever have to look at differences.
 
       @return The number of system cycles which have passed
     */
-    uint32_t cycles() const { return myCycles; }
+    uint64_t cycles() const { return myCycles; }
 
     /**
       Increment the system cycles by the specified number of cycles.
@@ -186,13 +198,6 @@ class System : public Serializable
     */
     void incrementCycles(uint32_t amount) { myCycles += amount; }
 
-    /**
-      Reset the system cycle count to zero.  The first thing that
-      happens is that all devices are notified of the reset by invoking 
-      their systemCyclesReset method then the system cycle count is 
-      reset to zero.
-    */
-    void resetCycles();
 
     /**
       Answers whether the system is currently in device autodetect mode.
@@ -400,6 +405,41 @@ class System : public Serializable
     */
     bool load(Serializer& in);
 
+    /**
+      Save/load only the system's own state, which save()/load() start
+      with, before that of its parts.
+
+      @return  False on any errors, else true
+    */
+    bool saveOwnState(Serializer& out) const;
+    bool loadOwnState(Serializer& in);
+
+    /**
+      The parts whose states save() saves after the system's own, one
+      after another: the CPU, then each device in the order attached.
+    */
+    uint32_t numberOfParts() const { return myNumberOfDevices + 1; }
+    Serializable& part(uint32_t i) const;
+
+    /**
+      Save the same state as save() as a snapshot: the CPU and the devices
+      that keep their state in one struct copy it whole, and the rest save
+      as usual.  Only restore() in this process can load it back; save()
+      remains the format for anything kept.
+
+      @param out  The Serializer object to use
+      @return  False on any errors, else true
+    */
+    bool snapshot(Serializer& out) const;
+
+    /**
+      Load a snapshot taken by snapshot().
+
+      @param in  The Serializer object to use
+      @return  False on any errors, else true
+    */
+    bool restore(Serializer& in);
+
     /**
       Get a descriptor for the device name (used in error checking).
 
@@ -445,8 +485,8 @@ class System : public Serializable
     // unknown/undefined behaviour
     Random* myRandom;
 
-    // Number of system cycles executed since the last reset
-    uint32_t myCycles;
+    // Number of system cycles executed since the system was created
+    uint64_t myCycles;
 
     // Null device to use for page which are not installed
     NullDevice myNullDevice; 
@@ -464,6 +504,11 @@ class System : public Serializable
     // Some parts of the codebase need to act differently in such a case
     bool mySystemInAutodetect;
 
+#ifdef STELLA_PROFILE
+    // Execution profiler, only present in profiling builds
+    Profiler myProfiler;
+#endif
+
   private:
     // Copy constructor isn't supported by this class so make it private
     System(const System&);
@@ -45,16 +45,16 @@ TIA::TIA(Console& console, Sound& sound, Settings& settings)
     myFrameYStart(34),
     myFrameHeight(210),
     myMaximumNumberOfScanlines(262),
-    myStartScanline(0),
     myColorLossEnabled(false),
-    myPartialFrameFlag(false),
     myAutoFrameEnabled(false),
-    myFrameCounter(0),
-    myPALFrameCounter(0),
+    myAudioOnlyFlag(false),
     myBitsEnabled(true),
     myCollisionsEnabled(true)
    
 {
+  // Zero the state, padding and all, so snapshots never copy garbage
+  memset(static_cast<TIAState*>(this), 0, sizeof(TIAState));
+
   // Allocate buffers for two frame buffers
   myCurrentFrameBuffer = new uint8_t[160 * 320];
   myPreviousFrameBuffer = new uint8_t[160 * 320];
@@ -85,6 +85,10 @@ TIA::~TIA()
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void TIA::reset()
 {
+  // All color clocks are measured from the current system cycle
+  myClockOriginCycle = mySystem->cycles();
+  mySound.setCycleOrigin(myClockOriginCycle);
+
   // Reset the sound device
   mySound.reset();
 
@@ -131,7 +135,7 @@ void TIA::reset()
   enableBits(true);
 
   myDumpEnabled = false;
-  myDumpDisabledCycle = 0;
+  myDumpDisabledCycle = mySystem->cycles();
   myINPT4 = myINPT5 = 0x80;
 
   myFrameCounter = myPALFrameCounter = 0;
@@ -204,7 +208,7 @@ void TIA::frameReset()
   myStopDisplayOffset = 228 * MIN(scanlines, 320u);
 
   // Reasonable values to start and stop the current frame drawing
-  myClockWhenFrameStarted = mySystem->cycles() * 3;
+  myClockWhenFrameStarted = currentClock();
   myClockStartDisplay = myClockWhenFrameStarted;
   myClockStopDisplay = myClockWhenFrameStarted + myStopDisplayOffset;
   myClockAtLastUpdate = myClockWhenFrameStarted;
@@ -221,29 +225,6 @@ void TIA::enableColorLoss(bool mode)
       ? mode : false;
 }
 
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void TIA::systemCyclesReset()
-{
-  // Get the current system cycle
-  uint32_t cycles = mySystem->cycles();
-
-  // Adjust the sound cycle indicator
-  mySound.adjustCycleCounter(-1 * cycles);
-
-  // Adjust the dump cycle
-  myDumpDisabledCycle -= cycles;
-
-  // Get the current color clock the system is using
-  uint32_t clocks = cycles * 3;
-
-  // Adjust the clocks by this amount since we're reseting the clock to zero
-  myClockWhenFrameStarted -= clocks;
-  myClockStartDisplay -= clocks;
-  myClockStopDisplay -= clocks;
-  myClockAtLastUpdate -= clocks;
-  myVSYNCFinishClock -= clocks;
-}
- 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void TIA::install(System& system)
 {
@@ -257,7 +238,7 @@ void TIA::install(System& system, Device& device)
   mySystem = &system;
 
   uint16_t shift = mySystem->pageShift();
-  mySystem->resetCycles();
+  myClockOriginCycle = mySystem->cycles();
 
   // All accesses are to the given device
   System::PageAccess access(0, 0, 0, &device, System::PA_READWRITE);
@@ -275,6 +256,7 @@ bool TIA::save(Serializer& out) const
 
     out.putString(device);
 
+    out.putLong(myClockOriginCycle);
     out.putInt(myClockWhenFrameStarted);
     out.putInt(myClockStartDisplay);
     out.putInt(myClockStopDisplay);
@@ -322,7 +304,7 @@ bool TIA::save(Serializer& out) const
     out.putByte(myCurrentGRP1);
 
     out.putBool(myDumpEnabled);
-    out.putInt(myDumpDisabledCycle);
+    out.putLong(myDumpDisabledCycle);
 
     out.putShort(myPOSP0);
     out.putShort(myPOSP1);
@@ -357,6 +339,12 @@ bool TIA::save(Serializer& out) const
     out.putInt(myFrameCounter);
     out.putInt(myPALFrameCounter);
 
+    // Where the frame in progress is, so a state saved while execution
+    // stopped inside a frame (see updatePartial()) carries on with it
+    out.putBool(myPartialFrameFlag);
+    out.putInt(myFramePointerClocks);
+    out.putInt(myStartScanline);
+
     // Save the sound sample stuff ...
     mySound.save(out);
 
@@ -371,6 +359,10 @@ bool TIA::load(Serializer& in)
     if(in.getString() != device)
       return false;
 
+    // A legacy state's clocks count from the start of the frame, which
+    // its cycle counts are moved to (see Serializer::getCycles())
+    myClockOriginCycle = in.legacy() ? Serializer::kLegacyCycleBase :
+                                       in.getLong();
     myClockWhenFrameStarted = (int32_t) in.getInt();
     myClockStartDisplay = (int32_t) in.getInt();
     myClockStopDisplay = (int32_t) in.getInt();
@@ -418,7 +410,7 @@ bool TIA::load(Serializer& in)
     myCurrentGRP1 = in.getByte();
 
     myDumpEnabled = in.getBool();
-    myDumpDisabledCycle = (int32_t) in.getInt();
+    myDumpDisabledCycle = in.getCycles();
 
     myPOSP0 = (int16_t) in.getShort();
     myPOSP1 = (int16_t) in.getShort();
@@ -453,14 +445,50 @@ bool TIA::load(Serializer& in)
     myFrameCounter = in.getInt();
     myPALFrameCounter = in.getInt();
 
+    // A legacy state is always saved between frames
+    myPartialFrameFlag = !in.legacy() && in.getBool();
+    myFramePointerClocks = in.legacy() ? 0 : in.getInt();
+    myStartScanline = in.legacy() ? 0 : in.getInt();
+    if(myFramePointerClocks > 160 * 320)
+      return false;
+    myFramePointer = myCurrentFrameBuffer + myFramePointerClocks;
+
     // Load the sound sample stuff ...
-    mySound.load(in);
+    bool soundLoaded = mySound.load(in);
 
     // Reset TIA bits to be on
     enableBits(true);
     toggleFixedColors(0);
     myAllowHMOVEBlanks = true;
 
+  return soundLoaded;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool TIA::snapshot(Serializer& out) const
+{
+  out.putBlock(static_cast<const TIAState&>(*this));
+  return mySound.snapshot(out);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool TIA::restore(Serializer& in)
+{
+  in.getBlock(static_cast<TIAState&>(*this));
+  if(myFramePointerClocks > 160 * 320)
+    return false;
+  myFramePointer = myCurrentFrameBuffer + myFramePointerClocks;
+
+  if(!mySound.restore(in))
+    return false;
+
+  // As load() does, without rebuilding the priority encoder when it is
+  // already the one for the normal colours
+  enableBits(true);
+  if(myColorPtr != myColor)
+    toggleFixedColors(0);
+  myAllowHMOVEBlanks = true;
+
   return true;
 }
 
@@ -484,6 +512,38 @@ void TIA::update()
   endFrame();
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+bool TIA::updatePartial(uint64_t cycle, uint32_t scanline)
+{
+  // The beam is on the first scanline as a frame starts, which is as far
+  // as a target of that line lets it go
+  bool started = !myPartialFrameFlag;
+  if(started)
+    startFrame();
+  myPartialFrameFlag = true;
+  if(started && scanline == 0)
+    return false;
+
+  // First cycle at which the beam is on the requested scanline; it only
+  // limits execution if it still lies ahead
+  int64_t clock = (int64_t)myClockWhenFrameStarted + 228 * (int64_t)scanline;
+  uint64_t lineCycle = myClockOriginCycle + (clock > 0 ? (clock + 2) / 3 : 0);
+  if(lineCycle > mySystem->cycles() && lineCycle < cycle)
+    cycle = lineCycle;
+
+  // As in update(); a frame split over several calls gets a fresh
+  // instruction budget for each of them
+  mySystem->m6502().execute(25000, cycle);
+
+  // The limit it stopped at may be an event (see M6502::setEventCycle())
+  if(myPartialFrameFlag &&
+     mySystem->cycles() >= mySystem->m6502().cycleLimit())
+    return false;
+
+  endFrame();
+  return true;
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 inline void TIA::startFrame()
 {
@@ -496,10 +556,14 @@ inline void TIA::startFrame()
   // so that we can adjust the frame's starting clock by this amount.  This
   // is necessary since some games position objects during VSYNC and the
   // TIA's internal counters are not reset by VSYNC.
-  uint32_t clocks = ((mySystem->cycles() * 3) - myClockWhenFrameStarted) % 228;
+  uint32_t currentClock = this->currentClock();
+  uint32_t clocks = (currentClock - myClockWhenFrameStarted) % 228;
 
-  // Ask the system to reset the cycle count so it doesn't overflow
-  mySystem->resetCycles();
+  // Move the clock origin up to the current cycle so the 32-bit color
+  // clocks never overflow; the system cycle counter itself keeps running
+  myClockOriginCycle = mySystem->cycles();
+  myVSYNCFinishClock -= currentClock;
+  mySound.setCycleOrigin(myClockOriginCycle);
 
   // Setup clocks that'll be used for drawing this frame
   myClockWhenFrameStarted = -1 * clocks;
@@ -813,6 +877,10 @@ bool TIA::driveUnusedPinsRandom(uint8_t mode)
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void TIA::updateFrame(int32_t clock)
 {
+#ifdef STELLA_PROFILE
+  Profiler::Scope profile(mySystem->profiler(), Profiler::TIAUpdate);
+#endif
+
   // See if we've already updated this portion of the screen
   if((clock < myClockStartDisplay) ||
      (myClockAtLastUpdate >= myClockStopDisplay) ||
@@ -925,7 +993,8 @@ void TIA::updateFrame(int32_t clock)
       // See if we're in the vertical blank region
       if(myVBLANK & 0x02)
       {
-        memset(myFramePointer, 0, clocksToUpdate);
+        if(!myAudioOnlyFlag)
+          memset(myFramePointer, 0, clocksToUpdate);
       }
       // Handle all other possible combinations
       else
@@ -994,7 +1063,16 @@ void TIA::updateFrame(int32_t clock)
 
         uint8_t enabledObjects = myEnabledObjects & myDisabledObjects;
         uint32_t hpos = clocksFromStartOfScanLine - HBLANK;
-        for(; myFramePointer < ending; ++myFramePointer, ++hpos)
+        if(myAudioOnlyFlag)
+        {
+          // Without drawing, the collisions are all that's left to do,
+          // and it takes two objects for there to be any
+          uint8_t objects = enabledObjects &
+              (PFBit | BLBit | P1Bit | M1Bit | P0Bit | M0Bit);
+          if(objects & (objects - 1))
+            updateCollisions(enabledObjects, hpos, hpos + clocksToUpdate);
+        }
+        else for(; myFramePointer < ending; ++myFramePointer, ++hpos)
         {
           uint8_t enabled = ((enabledObjects & PFBit) &&
                            (myPF & myPFMask[hpos])) ? PFBit : 0;
@@ -1027,7 +1105,8 @@ void TIA::updateFrame(int32_t clock)
         (clocksFromStartOfScanLine < (HBLANK + 8)))
     {
       int32_t blanks = (HBLANK + 8) - clocksFromStartOfScanLine;
-      memset(oldFramePointer, myColorPtr[HBLANKColor], blanks);
+      if(!myAudioOnlyFlag)
+        memset(oldFramePointer, myColorPtr[HBLANKColor], blanks);
 
       if((clocksToUpdate + clocksFromStartOfScanLine) >= (HBLANK + 8))
         myHMOVEBlankEnabled = false;
@@ -1047,10 +1126,39 @@ void TIA::updateFrame(int32_t clock)
   }
 }
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void TIA::updateCollisions(uint8_t enabledObjects, uint32_t hpos,
+                           uint32_t end)
+{
+  // The same object tests as in updateFrame(), without the drawing
+  for(; hpos < end; ++hpos)
+  {
+    uint8_t enabled = ((enabledObjects & PFBit) &&
+                     (myPF & myPFMask[hpos])) ? PFBit : 0;
+
+    if((enabledObjects & BLBit) && myBLMask[hpos])
+      enabled |= BLBit;
+
+    if((enabledObjects & P1Bit) && (myCurrentGRP1 & myP1Mask[hpos]))
+      enabled |= P1Bit;
+
+    if((enabledObjects & M1Bit) && myM1Mask[hpos])
+      enabled |= M1Bit;
+
+    if((enabledObjects & P0Bit) && (myCurrentGRP0 & myP0Mask[hpos]))
+      enabled |= P0Bit;
+
+    if((enabledObjects & M0Bit) && myM0Mask[hpos])
+      enabled |= M0Bit;
+
+    myCollision |= TIATables::CollisionMask[enabled];
+  }
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 inline void TIA::waitHorizontalSync()
 {
-  uint32_t cyclesToEndOfLine = 76 - ((mySystem->cycles() - 
+  uint32_t cyclesToEndOfLine = 76 - ((cyclesSinceOrigin() - 
       (myClockWhenFrameStarted / 3)) % 76);
 
   if(cyclesToEndOfLine < 76)
@@ -1107,7 +1215,7 @@ inline void TIA::waitHorizontalRSync()
   // cycle occurs before the counter warps around to zero. Therefore the positioning
   // code will hit RESPx one cycle sooner after a RSYNC than after a WSYNC.
 
-  uint32_t cyclesToEndOfLine = 76 - ((mySystem->cycles() - 
+  uint32_t cyclesToEndOfLine = 76 - ((cyclesSinceOrigin() - 
       (myClockWhenFrameStarted / 3)) % 76);
 
   mySystem->incrementCycles(cyclesToEndOfLine-1);
@@ -1187,7 +1295,7 @@ uint8_t TIA::dumpedInputPort(int resistance)
 uint8_t TIA::peek(uint16_t addr)
 {
   // Update frame to current color clock before we look at anything!
-  updateFrame(mySystem->cycles() * 3);
+  updateFrame(currentClock());
 
   // If pins are undriven, we start with the last databus value
   // Otherwise, there is some randomness injected into the mix
@@ -1289,7 +1397,7 @@ bool TIA::poke(uint16_t addr, uint8_t value)
 {
   addr = addr & 0x003f;
 
-  int32_t clock = mySystem->cycles() * 3;
+  int32_t clock = currentClock();
   int16_t delay = TIATables::PokeDelay[addr];
 
   // See if this is a poke to a PF register
@@ -29,6 +29,174 @@ class Sound;
 #include "System.hxx"
 #include "TIATables.hxx"
 
+/**
+  The state of the TIA that save() saves, besides the sound, kept in one
+  trivially copyable struct so that snapshot() and restore() can copy it
+  whole.
+*/
+struct TIAState
+{
+  // Indicates the number of 'colour clocks' offset from the base
+  // frame buffer pointer
+  // (this is used when loading state files with a 'partial' frame)
+  uint32_t myFramePointerClocks;
+
+  // System cycle from which all of the color clocks below are
+  // measured; moved up at the start of every frame
+  uint64_t myClockOriginCycle;
+
+  // Indicates color clocks when the current frame began
+  int32_t myClockWhenFrameStarted;
+
+  // Indicates color clocks when frame should begin to be drawn
+  int32_t myClockStartDisplay;
+
+  // Indicates color clocks when frame should stop being drawn
+  int32_t myClockStopDisplay;
+
+  // Indicates color clocks when the frame was last updated
+  int32_t myClockAtLastUpdate;
+
+  // Indicates how many color clocks remain until the end of 
+  // current scanline.  This value is valid during the 
+  // displayed portion of the frame.
+  int32_t myClocksToEndOfScanLine;
+
+  // Indicates the total number of scanlines generated by the last frame
+  uint32_t myScanlineCountForLastFrame;
+
+  // Indicates potentially the first scanline at which drawing occurs
+  uint32_t myStartScanline;
+
+  // Color clock when VSYNC ending causes a new frame to be started
+  int32_t myVSYNCFinishClock; 
+
+  uint8_t myVSYNC;        // Holds the VSYNC register value
+  uint8_t myVBLANK;       // Holds the VBLANK register value
+
+  uint8_t myNUSIZ0;       // Number and size of player 0 and missle 0
+  uint8_t myNUSIZ1;       // Number and size of player 1 and missle 1
+
+  uint8_t myPlayfieldPriorityAndScore;
+  uint8_t myColor[8];
+  uint8_t myCTRLPF;       // Playfield control register
+
+  bool myREFP0;         // Indicates if player 0 is being reflected
+  bool myREFP1;         // Indicates if player 1 is being reflected
+
+  uint32_t myPF;          // Playfield graphics (19-12:PF2 11-4:PF1 3-0:PF0)
+
+  uint8_t myGRP0;         // Player 0 graphics register
+  uint8_t myGRP1;         // Player 1 graphics register
+
+  uint8_t myDGRP0;        // Player 0 delayed graphics register
+  uint8_t myDGRP1;        // Player 1 delayed graphics register
+
+  bool myENAM0;         // Indicates if missle 0 is enabled
+  bool myENAM1;         // Indicates if missle 1 is enabled
+
+  bool myENABL;         // Indicates if the ball is enabled
+  bool myDENABL;        // Indicates if the vertically delayed ball is enabled
+
+  uint8_t myHMP0;         // Player 0 horizontal motion register
+  uint8_t myHMP1;         // Player 1 horizontal motion register
+  uint8_t myHMM0;         // Missle 0 horizontal motion register
+  uint8_t myHMM1;         // Missle 1 horizontal motion register
+  uint8_t myHMBL;         // Ball horizontal motion register
+
+  bool myVDELP0;        // Indicates if player 0 is being vertically delayed
+  bool myVDELP1;        // Indicates if player 1 is being vertically delayed
+  bool myVDELBL;        // Indicates if the ball is being vertically delayed
+
+  bool myRESMP0;        // Indicates if missle 0 is reset to player 0
+  bool myRESMP1;        // Indicates if missle 1 is reset to player 1
+
+  uint16_t myCollision;     // Collision register
+
+  // Determines whether specified collisions are enabled or disabled
+  // The lower 16 bits are and'ed with the collision register to mask out
+  // any collisions we don't want to be processed
+  // The upper 16 bits are used to store which objects is currently
+  // enabled or disabled
+  // This is necessary since there are 15 collision combinations which
+  // are controlled by 6 objects
+  uint32_t myCollisionEnabledMask;
+
+  // Note that these position registers contain the color clock 
+  // on which the object's serial output should begin (0 to 159)
+  int16_t myPOSP0;        // Player 0 position register
+  int16_t myPOSP1;        // Player 1 position register
+  int16_t myPOSM0;        // Missle 0 position register
+  int16_t myPOSM1;        // Missle 1 position register
+  int16_t myPOSBL;        // Ball position register
+
+  // The color clocks elapsed so far for each of the graphical objects,
+  // as denoted by 'MOTCK' line described in A. Towers TIA Hardware Notes
+  int32_t myMotionClockP0;
+  int32_t myMotionClockP1;
+  int32_t myMotionClockM0;
+  int32_t myMotionClockM1;
+  int32_t myMotionClockBL;
+
+  // Indicates 'start' signal for each of the graphical objects as
+  // described in A. Towers TIA Hardware Notes
+  int32_t myStartP0;
+  int32_t myStartP1;
+  int32_t myStartM0;
+  int32_t myStartM1;
+
+  // Index into the player mask arrays indicating whether display
+  // of the first copy should be suppressed
+  uint8_t mySuppressP0;
+  uint8_t mySuppressP1;
+
+  // Latches for 'more motion required' as described in A. Towers TIA
+  // Hardware Notes
+  bool myHMP0mmr;
+  bool myHMP1mmr;
+  bool myHMM0mmr;
+  bool myHMM1mmr;
+  bool myHMBLmmr;
+
+  // Graphics for Player 0 that should be displayed.  This will be
+  // reflected if the player is being reflected.
+  uint8_t myCurrentGRP0;
+
+  // Graphics for Player 1 that should be displayed.  This will be
+  // reflected if the player is being reflected.
+  uint8_t myCurrentGRP1;
+
+  // Indicates when the dump for paddles was last set
+  uint64_t myDumpDisabledCycle;
+
+  // Indicates if the dump is current enabled for the paddles
+  bool myDumpEnabled;
+
+  // Indicates if HMOVE blanks are currently or previously enabled,
+  // and at which horizontal position the HMOVE was initiated
+  int32_t myCurrentHMOVEPos;
+  int32_t myPreviousHMOVEPos;
+  bool myHMOVEBlankEnabled;
+
+  // Bitmap of the objects that should be considered while drawing
+  uint8_t myEnabledObjects;
+
+  // Determines whether specified bits (from TIABit) are enabled or disabled
+  // This is and'ed with the enabled objects each scanline to mask out any
+  // objects we don't want to be processed
+  uint8_t myDisabledObjects;
+
+  // Indicates whether we're done with the current frame. poke() clears this
+  // when VSYNC is strobed or the max scanlines/frame limit is hit.
+  bool myPartialFrameFlag;
+
+  // Number of total frames displayed by this TIA
+  uint32_t myFrameCounter;
+
+  // Number of PAL frames displayed by this TIA
+  uint32_t myPALFrameCounter;
+};
+
 /**
   This class is a device that emulates the Television Interface Adaptor 
   found in the Atari 2600 and 7800 consoles.  The Television Interface 
@@ -43,7 +211,7 @@ class Sound;
   @author  Bradford W. Mott
   @version $Id: TIA.hxx 2838 2014-01-17 23:34:03Z stephena $
 */
-class TIA : public Device
+class TIA : public Device, private TIAState
 {
   public:
     friend class TIADebug;
@@ -74,13 +242,6 @@ class TIA : public Device
     */
     void frameReset();
 
-    /**
-      Notification method invoked by the system right before the
-      system resets its cycle counter to zero.  It may be necessary
-      to override this method for devices that remember cycle counts.
-    */
-    void systemCyclesReset();
-
     /**
       Install TIA in the specified system.  Invoked by the system
       when the TIA is attached to it.
@@ -116,6 +277,13 @@ class TIA : public Device
     */
     bool load(Serializer& in);
 
+    /**
+      Saves/loads the state as one block, and the sound as usual (see
+      Serializable::snapshot()).
+    */
+    bool snapshot(Serializer& out) const;
+    bool restore(Serializer& in);
+
     /**
       Get a descriptor for the device name (used in error checking).
 
@@ -147,6 +315,20 @@ class TIA : public Device
     */
     void update();
 
+    /**
+      Like update(), but execution may also stop before the frame is
+      finished: once the system cycle count reaches the given cycle, or
+      once the beam reaches the given scanline of the frame.  A scanline
+      the frame has already passed when this is called doesn't stop it;
+      scanline 0 stops a frame as it starts.
+      The next call to update() or updatePartial() continues the frame.
+
+      @param cycle     The system cycle to stop at
+      @param scanline  The scanline to stop at
+      @return True if the frame was finished, false if it was stopped
+    */
+    bool updatePartial(uint64_t cycle, uint32_t scanline);
+
     /**
       Answers the current frame buffer
 
@@ -186,6 +368,15 @@ class TIA : public Device
     */
     void enableAutoFrame(bool mode) { myAutoFrameEnabled = mode; }
 
+    /**
+      Enables/disables audio-only mode, for running a ROM just for its
+      sound.  The TIA then keeps its state exactly as usual (collisions
+      included), but draws nothing, leaving the frame buffers stale.
+
+      @param mode  Whether to enable or disable audio-only mode
+    */
+    void enableAudioOnly(bool mode) { myAudioOnlyFlag = mode; }
+
     /**
       Enables/disables color-loss for PAL modes only.
 
@@ -212,7 +403,7 @@ class TIA : public Device
       @return The current color clock
     */
     uint32_t clocksThisLine() const
-      { return ((mySystem->cycles() * 3) - myClockWhenFrameStarted) % 228; }
+      { return (currentClock() - myClockWhenFrameStarted) % 228; }
 
     /**
       Answers the scanline at which the current frame began drawing.
@@ -230,7 +421,7 @@ class TIA : public Device
       @return The total number of scanlines generated
     */
     uint32_t scanlines() const
-      { return ((mySystem->cycles() * 3) - myClockWhenFrameStarted) / 228; }
+      { return (currentClock() - myClockWhenFrameStarted) / 228; }
 
     /**
       Answers whether the TIA is currently in 'partial frame' mode
@@ -331,9 +522,20 @@ class TIA : public Device
     */
     void enableCollisions(bool mode);
 
+    // System cycles elapsed since the color clock origin
+    uint32_t cyclesSinceOrigin() const
+      { return (uint32_t)(mySystem->cycles() - myClockOriginCycle); }
+
+    // Current color clock, relative to the color clock origin
+    uint32_t currentClock() const { return cyclesSinceOrigin() * 3; }
+
     // Update the current frame buffer to the specified color clock
     void updateFrame(int32_t clock);
 
+    // Collide the enabled objects over [hpos, end) of the scanline
+    void updateCollisions(uint8_t enabledObjects, uint32_t hpos,
+                          uint32_t end);
+
     // Waste cycles until the current scanline is finished
     void waitHorizontalSync();
 
@@ -388,11 +590,6 @@ class TIA : public Device
     // (the exported frame buffer is a vertical 'sliding window' of the actual buffer)
     uint32_t myFramePointerOffset;
 
-    // Indicates the number of 'colour clocks' offset from the base
-    // frame buffer pointer
-    // (this is used when loading state files with a 'partial' frame)
-    uint32_t myFramePointerClocks;
-
     // Indicated what scanline the frame should start being drawn at
     uint32_t myFrameYStart;
 
@@ -402,134 +599,13 @@ class TIA : public Device
     // Indicates offset in color clocks when display should stop
     uint32_t myStopDisplayOffset;
 
-    // Indicates color clocks when the current frame began
-    int32_t myClockWhenFrameStarted;
-
-    // Indicates color clocks when frame should begin to be drawn
-    int32_t myClockStartDisplay;
-
-    // Indicates color clocks when frame should stop being drawn
-    int32_t myClockStopDisplay;
-
-    // Indicates color clocks when the frame was last updated
-    int32_t myClockAtLastUpdate;
-
-    // Indicates how many color clocks remain until the end of 
-    // current scanline.  This value is valid during the 
-    // displayed portion of the frame.
-    int32_t myClocksToEndOfScanLine;
-
-    // Indicates the total number of scanlines generated by the last frame
-    uint32_t myScanlineCountForLastFrame;
-
     // Indicates the maximum number of scanlines to be generated for a frame
     uint32_t myMaximumNumberOfScanlines;
 
-    // Indicates potentially the first scanline at which drawing occurs
-    uint32_t myStartScanline;
-
-    // Color clock when VSYNC ending causes a new frame to be started
-    int32_t myVSYNCFinishClock; 
-
-    uint8_t myVSYNC;        // Holds the VSYNC register value
-    uint8_t myVBLANK;       // Holds the VBLANK register value
-
-    uint8_t myNUSIZ0;       // Number and size of player 0 and missle 0
-    uint8_t myNUSIZ1;       // Number and size of player 1 and missle 1
-
-    uint8_t myPlayfieldPriorityAndScore;
     uint8_t myPriorityEncoder[2][256];
-    uint8_t myColor[8];
     uint8_t myFixedColor[8];
     uint8_t* myColorPtr;
 
-    uint8_t myCTRLPF;       // Playfield control register
-
-    bool myREFP0;         // Indicates if player 0 is being reflected
-    bool myREFP1;         // Indicates if player 1 is being reflected
-
-    uint32_t myPF;          // Playfield graphics (19-12:PF2 11-4:PF1 3-0:PF0)
-
-    uint8_t myGRP0;         // Player 0 graphics register
-    uint8_t myGRP1;         // Player 1 graphics register
-    
-    uint8_t myDGRP0;        // Player 0 delayed graphics register
-    uint8_t myDGRP1;        // Player 1 delayed graphics register
-
-    bool myENAM0;         // Indicates if missle 0 is enabled
-    bool myENAM1;         // Indicates if missle 1 is enabled
-
-    bool myENABL;         // Indicates if the ball is enabled
-    bool myDENABL;        // Indicates if the vertically delayed ball is enabled
-
-    uint8_t myHMP0;         // Player 0 horizontal motion register
-    uint8_t myHMP1;         // Player 1 horizontal motion register
-    uint8_t myHMM0;         // Missle 0 horizontal motion register
-    uint8_t myHMM1;         // Missle 1 horizontal motion register
-    uint8_t myHMBL;         // Ball horizontal motion register
-
-    bool myVDELP0;        // Indicates if player 0 is being vertically delayed
-    bool myVDELP1;        // Indicates if player 1 is being vertically delayed
-    bool myVDELBL;        // Indicates if the ball is being vertically delayed
-
-    bool myRESMP0;        // Indicates if missle 0 is reset to player 0
-    bool myRESMP1;        // Indicates if missle 1 is reset to player 1
-
-    uint16_t myCollision;     // Collision register
-
-    // Determines whether specified collisions are enabled or disabled
-    // The lower 16 bits are and'ed with the collision register to mask out
-    // any collisions we don't want to be processed
-    // The upper 16 bits are used to store which objects is currently
-    // enabled or disabled
-    // This is necessary since there are 15 collision combinations which
-    // are controlled by 6 objects
-    uint32_t myCollisionEnabledMask;
-
-    // Note that these position registers contain the color clock 
-    // on which the object's serial output should begin (0 to 159)
-    int16_t myPOSP0;        // Player 0 position register
-    int16_t myPOSP1;        // Player 1 position register
-    int16_t myPOSM0;        // Missle 0 position register
-    int16_t myPOSM1;        // Missle 1 position register
-    int16_t myPOSBL;        // Ball position register
-
-    // The color clocks elapsed so far for each of the graphical objects,
-    // as denoted by 'MOTCK' line described in A. Towers TIA Hardware Notes
-    int32_t myMotionClockP0;
-    int32_t myMotionClockP1;
-    int32_t myMotionClockM0;
-    int32_t myMotionClockM1;
-    int32_t myMotionClockBL;
-
-    // Indicates 'start' signal for each of the graphical objects as
-    // described in A. Towers TIA Hardware Notes
-    int32_t myStartP0;
-    int32_t myStartP1;
-    int32_t myStartM0;
-    int32_t myStartM1;
-
-    // Index into the player mask arrays indicating whether display
-    // of the first copy should be suppressed
-    uint8_t mySuppressP0;
-    uint8_t mySuppressP1;
-
-    // Latches for 'more motion required' as described in A. Towers TIA
-    // Hardware Notes
-    bool myHMP0mmr;
-    bool myHMP1mmr;
-    bool myHMM0mmr;
-    bool myHMM1mmr;
-    bool myHMBLmmr;
-
-    // Graphics for Player 0 that should be displayed.  This will be
-    // reflected if the player is being reflected.
-    uint8_t myCurrentGRP0;
-
-    // Graphics for Player 1 that should be displayed.  This will be
-    // reflected if the player is being reflected.
-    uint8_t myCurrentGRP1;
-
     // It's VERY important that the BL, M0, M1, P0 and P1 current
     // mask pointers are always on a uint32_t boundary.  Otherwise,
     // the TIA code will fail on a good number of CPUs.
@@ -543,55 +619,29 @@ class TIA : public Device
     // Audio values; only used by TIADebug
     uint8_t myAUDV0, myAUDV1, myAUDC0, myAUDC1, myAUDF0, myAUDF1;
 
-    // Indicates when the dump for paddles was last set
-    int32_t myDumpDisabledCycle;
-
-    // Indicates if the dump is current enabled for the paddles
-    bool myDumpEnabled;
-
     // Latches for INPT4 and INPT5
     uint8_t myINPT4, myINPT5;
 
-    // Indicates if HMOVE blanks are currently or previously enabled,
-    // and at which horizontal position the HMOVE was initiated
-    int32_t myCurrentHMOVEPos;
-    int32_t myPreviousHMOVEPos;
-    bool myHMOVEBlankEnabled;
+    // Indicates if HMOVE blanks are drawn at all
     bool myAllowHMOVEBlanks;
 
     // Indicates if unused TIA pins are randomly driven high or low
     // Otherwise, they take on the value previously on the databus
     bool myTIAPinsDriven;
 
-    // Bitmap of the objects that should be considered while drawing
-    uint8_t myEnabledObjects;
-
-    // Determines whether specified bits (from TIABit) are enabled or disabled
-    // This is and'ed with the enabled objects each scanline to mask out any
-    // objects we don't want to be processed
-    uint8_t myDisabledObjects;
-
     // Indicates if color loss should be enabled or disabled.  Color loss
     // occurs on PAL (and maybe SECAM) systems when the previous frame
     // contains an odd number of scanlines.
     bool myColorLossEnabled;
 
-    // Indicates whether we're done with the current frame. poke() clears this
-    // when VSYNC is strobed or the max scanlines/frame limit is hit.
-    bool myPartialFrameFlag;
-
     // Automatic framerate correction based on number of scanlines
     bool myAutoFrameEnabled;
 
-    // Number of total frames displayed by this TIA
-    uint32_t myFrameCounter;
-
-    // Number of PAL frames displayed by this TIA
-    uint32_t myPALFrameCounter;
+    // Skip drawing into the frame buffers (see enableAudioOnly())
+    bool myAudioOnlyFlag;
 
     // The framerate currently in use by the Console
 
-
     // Whether TIA bits/collisions are currently enabled/disabled
     bool myBitsEnabled, myCollisionsEnabled;
 
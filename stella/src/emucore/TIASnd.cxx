@@ -28,6 +28,9 @@ TIASound::TIASound(int32_t outputFrequency)
     myOutputCounter(0),
     myVolumePercentage(100)
 {
+  if(!ourTablesBuilt)
+    initTables();
+
   reset();
 }
 
@@ -39,11 +42,6 @@ TIASound::~TIASound()
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 void TIASound::reset()
 {
-  // Fill the polynomials
-  polyInit(Bit4, 4, 4, 3);
-  polyInit(Bit5, 5, 5, 3);
-  polyInit(Bit9, 9, 9, 5);
-
   // Initialize instance variables
   for(int chan = 0; chan <= 1; ++chan)
   {
@@ -171,202 +169,407 @@ void TIASound::volume(uint32_t percent)
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void TIASound::process(int16_t* buffer, uint32_t samples)
+// Number of set bits in x
+static inline uint32_t popCount(uint32_t x)
 {
-  // Make temporary local copy
-  uint8_t audc0 = myAUDC[0], audc1 = myAUDC[1];
-  uint8_t p5_0 = myP5[0], p5_1 = myP5[1];
-  uint8_t div_n_cnt0 = myDivNCnt[0], div_n_cnt1 = myDivNCnt[1];
-  int16_t v0 = myVolume[0], v1 = myVolume[1];
+  x = x - ((x >> 1) & 0x55555555);
+  x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+  x = (x + (x >> 4)) & 0x0f0f0f0f;
+  return (x * 0x01010101) >> 24;
+}
 
-  // Take external volume into account
-  int16_t audv0 = (myAUDV[0] * myVolumePercentage) / 100,
-        audv1 = (myAUDV[1] * myVolumePercentage) / 100;
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Number of the 'n' steps after 'p' that are set in the 31 step sequence
+// 'seq', counted a word at a time
+static inline uint32_t countSteps31(uint32_t seq, uint32_t p, uint32_t n)
+{
+  uint32_t from = p + 1 < 31 ? p + 1 : 0, rest = n % 31;
+  uint64_t twice = seq | ((uint64_t)seq << 31);
+  uint32_t window = (uint32_t)(twice >> from) & ((1u << rest) - 1);
 
-  // Loop until the sample buffer is full
-  while(samples > 0)
+  return (n / 31) * popCount(seq) + popCount(window);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Position 'n' steps after 'p' in a sequence of 'size' steps; mostly
+// there's at most one wraparound
+static inline uint32_t stepOn(uint32_t p, uint32_t n, uint32_t size)
+{
+  p += n;
+  if(p < size)
+    return p;
+  return p < 2 * size ? p - size : p % size;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Number of steps from 'p' to the m-th step after it set in the 31 step
+// sequence whose ourNextX table is 'next'
+static inline uint32_t nthStep31(const uint8_t* next, uint32_t p, uint32_t m)
+{
+  uint32_t steps = 0;
+  while(m--)
   {
-    // Process channel 0
-    if (div_n_cnt0 > 1)
+    steps += next[p];
+    p = stepOn(p, next[p], 31);
+  }
+  return steps;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint32_t TIASound::quietClocks(int chan, uint8_t audc, uint8_t p5,
+                               int16_t v, int16_t audv) const
+{
+  // Every mode outputs either 0 or the volume
+  if(v == 0 && audv == 0)
+    return QUIET_MAX;
+
+  // The level the poly4 output must keep to leave 'v' as it is; a stale
+  // volume changes on the first step
+  int level = v == audv ? 1 : v == 0 ? 0 : -1;
+
+  switch(audc)
+  {
+    case DIV31_POLY4:
+      return level < 0 ? nthStep31(ourNextDiv31, p5, 1) - 1 :
+          nthStep31(ourNextDiv31, p5, ourRun4[myP4[chan]][level] + 1) - 1;
+
+    case POLY5_POLY4:
+      return level < 0 ? nthStep31(ourNextPoly5, p5, 1) - 1 :
+          nthStep31(ourNextPoly5, p5, ourRun4[myP4[chan]][level] + 1) - 1;
+
+    case DIV31_PURE:
+    case DIV93_PURE:
+    case DIV31_POLY5:
+      return ourNextDiv31[p5] - 1;
+
+    case POLY5_2:
+      return ourNextPoly5[p5] - 1;
+
+    case POLY5_POLY5:
+      return v == 0 ? QUIET_MAX : ourNextPoly5[p5] - 1;
+
+    case POLY5_DIV3:
+      return nthStep31(ourNextEdge5, p5, myDiv3Cnt[chan]) - 1;
+
+    default:  // no clock modifier: the output may change on every clock
+      return 0;
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+inline uint32_t TIASound::skipTicks(int chan, uint8_t audc, uint8_t& p5,
+                                    uint8_t& divNCnt, uint32_t ticks)
+{
+  if(divNCnt == 0)
+    return 0;
+
+  if(ticks < divNCnt)
+  {
+    divNCnt -= ticks;
+    return 0;
+  }
+
+  // The counter expires on tick 'divNCnt', and every 'max' ticks after
+  uint32_t max = myDivNMax[chan], after = ticks - divNCnt;
+  uint32_t clocks = 1 + after / max;
+  skipClocks(chan, audc, p5, clocks);
+  divNCnt = max - after % max;
+  return clocks;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void TIASound::skipClocks(int chan, uint8_t audc, uint8_t& p5,
+                          uint32_t clocks)
+{
+  switch(audc)
+  {
+    case SET_TO_1:
+    case POLY4:
+      myP4[chan] = stepOn(myP4[chan], clocks, POLY4_SIZE);
+      break;
+
+    case DIV31_POLY4:
+      myP4[chan] = stepOn(myP4[chan], countSteps31(ourDiv31, p5, clocks),
+                          POLY4_SIZE);
+      break;
+
+    case POLY5_POLY4:
+      myP4[chan] = stepOn(myP4[chan], countSteps31(ourPoly5, p5, clocks),
+                          POLY4_SIZE);
+      break;
+
+    case POLY9:
+      myP9[chan] = stepOn(myP9[chan], clocks, POLY9_SIZE);
+      break;
+
+    case POLY5_DIV3:
     {
-      div_n_cnt0--;
+      // Only a silent channel wraps the counter here, toggling nothing
+      uint32_t edges = countSteps31(ourEdge5, p5, clocks);
+      myDiv3Cnt[chan] = 3 - (3 - myDiv3Cnt[chan] + edges) % 3;
+      break;
     }
-    else if (div_n_cnt0 == 1)
-    {
-      int prev_bit5 = Bit5[p5_0];
-      div_n_cnt0 = myDivNMax[0];
 
-      // The P5 counter has multiple uses, so we increment it here
-      p5_0++;
-      if (p5_0 == POLY5_SIZE)
-        p5_0 = 0;
+    default:
+      break;
+  }
+
+  p5 = stepOn(p5, clocks, POLY5_SIZE);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+inline void TIASound::clockChannel(int chan, uint8_t audc, uint8_t& p5,
+                                   int16_t& v, int16_t audv)
+{
+  // The P5 counter has multiple uses, so we increment it here
+  p5++;
+  if (p5 == POLY5_SIZE)
+    p5 = 0;
+
+  // Apply the clock modifier (bits 0-1, plus the POLY5 -> DIV3 special
+  // case) and then the selected output
+  switch(audc)
+  {
+    case SET_TO_1:
+    case POLY4:
+      stepPoly4(chan, v, audv);
+      break;
+
+    case DIV31_POLY4:
+      if ((ourDiv31 >> p5) & 1)
+        stepPoly4(chan, v, audv);
+      break;
+
+    case POLY5_POLY4:
+      if ((ourPoly5 >> p5) & 1)
+        stepPoly4(chan, v, audv);
+      break;
+
+    case PURE:
+    case PURE2:
+    case DIV3_PURE:
+    case DIV3_PURE2:
+      // If the output was set turn it off, else turn it on
+      v = v ? 0 : audv;
+      break;
+
+    case DIV31_PURE:
+    case DIV93_PURE:
+    case DIV31_POLY5:
+      if ((ourDiv31 >> p5) & 1)
+        v = v ? 0 : audv;
+      break;
+
+    case POLY5_2:
+      if ((ourPoly5 >> p5) & 1)
+        v = v ? 0 : audv;
+      break;
+
+    case POLY9:
+      // Increase the poly9 counter
+      myP9[chan]++;
+      if (myP9[chan] == POLY9_SIZE)
+        myP9[chan] = 0;
+
+      v = ((ourPoly9[myP9[chan] >> 5] >> (myP9[chan] & 31)) & 1) ? audv : 0;
+      break;
+
+    case POLY5:
+      v = ((ourPoly5 >> p5) & 1) ? audv : 0;
+      break;
+
+    case POLY5_POLY5:
+      if ((ourPoly5 >> p5) & 1)
+        v = 0;
+      break;
 
-      // Check clock modifier for clock tick
-      if ((audc0 & 0x02) == 0 ||
-         ((audc0 & 0x01) == 0 && Div31[p5_0]) ||
-         ((audc0 & 0x01) == 1 && Bit5[p5_0]) ||
-         ((audc0 & 0x0f) == POLY5_DIV3 && Bit5[p5_0] != prev_bit5))
+    case POLY5_DIV3:
+      if ((ourEdge5 >> p5) & 1)
       {
-        if (audc0 & 0x04)       // Pure modified clock selected
+        myDiv3Cnt[chan]--;
+        if (!myDiv3Cnt[chan])
         {
-          if ((audc0 & 0x0f) == POLY5_DIV3) // POLY5 -> DIV3 mode
-          {
-            if ( Bit5[p5_0] != prev_bit5 )
-            {
-              myDiv3Cnt[0]--;
-              if ( !myDiv3Cnt[0] )
-              {
-                myDiv3Cnt[0] = 3;
-                v0 = v0 ? 0 : audv0;
-              }
-            }
-          }
-          else
-          {
-            // If the output was set turn it off, else turn it on
-            v0 = v0 ? 0 : audv0;
-          }
-        }
-        else if (audc0 & 0x08)  // Check for p5/p9
-        {
-          if (audc0 == POLY9)   // Check for poly9
-          {
-            // Increase the poly9 counter
-            myP9[0]++;
-            if (myP9[0] == POLY9_SIZE)
-              myP9[0] = 0;
-
-            v0 = Bit9[myP9[0]] ? audv0 : 0;
-          }
-          else if ( audc0 & 0x02 )
-          {
-            v0 = (v0 || audc0 & 0x01) ? 0 : audv0;
-          }
-          else  // Must be poly5
-          {
-            v0 = Bit5[p5_0] ? audv0 : 0;
-          }
-        }
-        else  // Poly4 is the only remaining option
-        {
-          // Increase the poly4 counter
-          myP4[0]++;
-          if (myP4[0] == POLY4_SIZE)
-            myP4[0] = 0;
-
-          v0 = Bit4[myP4[0]] ? audv0 : 0;
+          myDiv3Cnt[chan] = 3;
+          v = v ? 0 : audv;
         }
       }
-    }
+      break;
+  }
+}
 
-    // Process channel 1
-    if (div_n_cnt1 > 1)
-    {
-      div_n_cnt1--;
-    }
-    else if (div_n_cnt1 == 1)
-    {
-      int prev_bit5 = Bit5[p5_1];
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+inline void TIASound::stepPoly4(int chan, int16_t& v, int16_t audv)
+{
+  // Increase the poly4 counter
+  myP4[chan]++;
+  if (myP4[chan] == POLY4_SIZE)
+    myP4[chan] = 0;
 
-      div_n_cnt1 = myDivNMax[1];
+  v = ((ourPoly4 >> myP4[chan]) & 1) ? audv : 0;
+}
 
-      // The P5 counter has multiple uses, so we increment it here
-      p5_1++;
-      if (p5_1 == POLY5_SIZE)
-        p5_1 = 0;
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+inline void TIASound::output(int16_t*& buffer, uint32_t& samples,
+                             int16_t v0, int16_t v1)
+{
+  myOutputCounter += myOutputFrequency;
 
-      // Check clock modifier for clock tick
-      if ((audc1 & 0x02) == 0 ||
-         ((audc1 & 0x01) == 0 && Div31[p5_1]) ||
-         ((audc1 & 0x01) == 1 && Bit5[p5_1]) ||
-         ((audc1 & 0x0f) == POLY5_DIV3 && Bit5[p5_1] != prev_bit5))
+  switch(myChannelMode)
+  {
+    case Hardware2Mono:  // mono sampling with 2 hardware channels
+      while((samples > 0) && (myOutputCounter >= 31400))
       {
-        if (audc1 & 0x04)       // Pure modified clock selected
-        {
-          if ((audc1 & 0x0f) == POLY5_DIV3)   // POLY5 -> DIV3 mode
-          {
-            if ( Bit5[p5_1] != prev_bit5 )
-            {
-              myDiv3Cnt[1]--;
-              if ( ! myDiv3Cnt[1] )
-              {
-                myDiv3Cnt[1] = 3;
-                v1 = v1 ? 0 : audv1;
-              }
-            }
-          }
-          else
-          {
-            // If the output was set turn it off, else turn it on
-            v1 = v1 ? 0 : audv1;
-          }
-        }
-        else if (audc1 & 0x08)  // Check for p5/p9
-        {
-          if (audc1 == POLY9)   // Check for poly9
-          {
-            // Increase the poly9 counter
-            myP9[1]++;
-            if (myP9[1] == POLY9_SIZE)
-              myP9[1] = 0;
-
-            v1 = Bit9[myP9[1]] ? audv1 : 0;
-          }
-          else if ( audc1 & 0x02 )
-          {
-            v1 = (v1 || audc1 & 0x01) ? 0 : audv1;
-          }
-          else  // Must be poly5
-          {
-            v1 = Bit5[p5_1] ? audv1 : 0;
-          }
-        }
-        else  // Poly4 is the only remaining option
-        {
-          // Increase the poly4 counter
-          myP4[1]++;
-          if (myP4[1] == POLY4_SIZE)
-            myP4[1] = 0;
+        int16_t byte = v0 + v1;
+        *(buffer++) = byte;
+        *(buffer++) = byte;
+        myOutputCounter -= 31400;
+        samples--;
+      }
+      break;
 
-          v1 = Bit4[myP4[1]] ? audv1 : 0;
-        }
+    case Hardware2Stereo:  // stereo sampling with 2 hardware channels
+      while((samples > 0) && (myOutputCounter >= 31400))
+      {
+        *(buffer++) = v0;
+        *(buffer++) = v1;
+        myOutputCounter -= 31400;
+        samples--;
       }
-    }
+      break;
 
-    myOutputCounter += myOutputFrequency;
+    case Hardware1:  // mono/stereo sampling with only 1 hardware channel
+      while((samples > 0) && (myOutputCounter >= 31400))
+      {
+        *(buffer++) = v0 + v1;
+        myOutputCounter -= 31400;
+        samples--;
+      }
+      break;
+  }
+}
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint32_t TIASound::fill(int16_t*& buffer, uint32_t& samples, uint32_t ticks,
+                        int16_t v0, int16_t v1)
+{
+  // At the native rate every tick outputs exactly one sample, so the
+  // run is a plain fill
+  if(myOutputFrequency == 31400 && myOutputCounter < 31400)
+  {
+    uint32_t n = ticks < samples ? ticks : samples;
     switch(myChannelMode)
     {
-      case Hardware2Mono:  // mono sampling with 2 hardware channels
-        while((samples > 0) && (myOutputCounter >= 31400))
+      case Hardware2Mono:
+      {
+        int16_t byte = v0 + v1;
+        for(uint32_t i = 0; i < n; ++i)
         {
-          int16_t byte = v0 + v1;
           *(buffer++) = byte;
           *(buffer++) = byte;
-          myOutputCounter -= 31400;
-          samples--;
         }
         break;
+      }
 
-      case Hardware2Stereo:  // stereo sampling with 2 hardware channels
-        while((samples > 0) && (myOutputCounter >= 31400))
+      case Hardware2Stereo:
+        for(uint32_t i = 0; i < n; ++i)
         {
           *(buffer++) = v0;
           *(buffer++) = v1;
-          myOutputCounter -= 31400;
-          samples--;
         }
         break;
 
-      case Hardware1:  // mono/stereo sampling with only 1 hardware channel
-        while((samples > 0) && (myOutputCounter >= 31400))
-        {
-          *(buffer++) = v0 + v1;
-          myOutputCounter -= 31400;
-          samples--;
-        }
+      case Hardware1:
+      {
+        int16_t byte = v0 + v1;
+        for(uint32_t i = 0; i < n; ++i)
+          *(buffer++) = byte;
         break;
+      }
     }
+    samples -= n;
+    return n;
+  }
+
+  uint32_t n = 0;
+  for(; n < ticks && samples > 0; ++n)
+    output(buffer, samples, v0, v1);
+
+  return n;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void TIASound::process(int16_t* buffer, uint32_t samples)
+{
+  // Make temporary local copy
+  uint8_t audc0 = myAUDC[0], audc1 = myAUDC[1];
+  uint8_t p5_0 = myP5[0], p5_1 = myP5[1];
+  uint8_t div_n_cnt0 = myDivNCnt[0], div_n_cnt1 = myDivNCnt[1];
+  int16_t v0 = myVolume[0], v1 = myVolume[1];
+
+  // Take external volume into account
+  int16_t audv0 = (myAUDV[0] * myVolumePercentage) / 100,
+        audv1 = (myAUDV[1] * myVolumePercentage) / 100;
+
+  // The output of a channel can only change on the tick its divide by n
+  // counter expires (reaches 1), and the transition tables tell how many
+  // expiries ahead leave it as it is.  So until the tick that may change
+  // one of them whole runs of identical samples are written at once, and
+  // the clock logic only runs on that tick.
+  // Quiet clocks ahead of each channel.  Only the modes with a clock
+  // modifier (DIV31 or POLY5, AUDC bit 1) and silent channels have them;
+  // the others may change on every clock, and aren't worth a lookup.
+  bool ahead0 = (audc0 & 0x02) || audv0 == 0,
+       ahead1 = (audc1 & 0x02) || audv1 == 0;
+  uint32_t quiet0 = ahead0 ? quietClocks(0, audc0, p5_0, v0, audv0) : 0,
+           quiet1 = ahead1 ? quietClocks(1, audc1, p5_1, v1, audv1) : 0;
+
+  while(samples > 0)
+  {
+    uint32_t run = ~0u;
+    if(div_n_cnt0)
+      run = (div_n_cnt0 - 1) + myDivNMax[0] * quiet0;
+    if(div_n_cnt1)
+    {
+      uint32_t run1 = (div_n_cnt1 - 1) + myDivNMax[1] * quiet1;
+      if(run1 < run)
+        run = run1;
+    }
+
+    if(run > 0)
+    {
+      uint32_t ticks = fill(buffer, samples, run, v0, v1);
+      quiet0 -= skipTicks(0, audc0, p5_0, div_n_cnt0, ticks);
+      quiet1 -= skipTicks(1, audc1, p5_1, div_n_cnt1, ticks);
+      continue;
+    }
+
+    // Process channel 0
+    if (div_n_cnt0 > 1)
+      div_n_cnt0--;
+    else if (div_n_cnt0 == 1)
+    {
+      div_n_cnt0 = myDivNMax[0];
+      clockChannel(0, audc0, p5_0, v0, audv0);
+      if(quiet0)
+        quiet0--;
+      else if(ahead0)
+        quiet0 = quietClocks(0, audc0, p5_0, v0, audv0);
+    }
+
+    // Process channel 1
+    if (div_n_cnt1 > 1)
+      div_n_cnt1--;
+    else if (div_n_cnt1 == 1)
+    {
+      div_n_cnt1 = myDivNMax[1];
+      clockChannel(1, audc1, p5_1, v1, audv1);
+      if(quiet1)
+        quiet1--;
+      else if(ahead1)
+        quiet1 = quietClocks(1, audc1, p5_1, v1, audv1);
+    }
+
+    output(buffer, samples, v0, v1);
   }
 
   // Save for next round
@@ -379,7 +582,8 @@ void TIASound::process(int16_t* buffer, uint32_t samples)
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-void TIASound::polyInit(uint8_t* poly, int size, int f0, int f1)
+// Fill 'poly' with the bits of the given polynomial, one step per bit
+static void polyInit(uint32_t* poly, int size, int f0, int f1)
 {
   int mask = (1 << size) - 1, x = mask;
 
@@ -387,17 +591,74 @@ void TIASound::polyInit(uint8_t* poly, int size, int f0, int f1)
   {
     int bit0 = ( ( size - f0 ) ? ( x >> ( size - f0 ) ) : x ) & 0x01;
     int bit1 = ( ( size - f1 ) ? ( x >> ( size - f1 ) ) : x ) & 0x01;
-    poly[i] = x & 1;
+    if(i % 32 == 0)
+      poly[i / 32] = 0;
+    poly[i / 32] |= uint32_t(x & 1) << (i % 32);
     // calculate next bit
     x = ( x >> 1 ) | ( ( bit0 ^ bit1 ) << ( size - 1) );
   }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-const uint8_t TIASound::Div31[POLY5_SIZE] = {
-  0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
-};
+// Fill run[p][b] with how many steps after 'p' in a row are 'b', and
+// next[p] (if given) with how many steps it is to the next set one
+static void transitionInit(const uint32_t* poly, int size, uint8_t (*run)[2],
+                           uint8_t* next)
+{
+  for(int p = 0; p < size; ++p)
+  {
+    for(int b = 0; b <= 1; ++b)
+    {
+      int n = 0, q = p;
+      for(;;)
+      {
+        q = q + 1 < size ? q + 1 : 0;
+        if(int((poly[q / 32] >> (q % 32)) & 1) != b || n == size)
+          break;
+        ++n;
+      }
+      if(run)
+        run[p][b] = n;
+      if(next && b == 0)
+        next[p] = n + 1;
+    }
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+void TIASound::initTables()
+{
+  polyInit(&ourPoly4, 4, 4, 3);
+  polyInit(&ourPoly5, 5, 5, 3);
+  polyInit(ourPoly9, 9, 9, 5);
+
+  ourEdge5 = 0;
+  for(int p = 0; p < POLY5_SIZE; ++p)
+  {
+    int prev = p ? p - 1 : POLY5_SIZE - 1;
+    if(((ourPoly5 >> p) ^ (ourPoly5 >> prev)) & 1)
+      ourEdge5 |= 1u << p;
+  }
+
+  transitionInit(&ourPoly4, POLY4_SIZE, ourRun4, 0);
+  transitionInit(&ourPoly5, POLY5_SIZE, 0, ourNextPoly5);
+  transitionInit(&ourDiv31, POLY5_SIZE, 0, ourNextDiv31);
+  transitionInit(&ourEdge5, POLY5_SIZE, 0, ourNextEdge5);
+
+  ourTablesBuilt = true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+uint32_t TIASound::ourPoly4;
+uint32_t TIASound::ourPoly5;
+uint32_t TIASound::ourPoly9[(POLY9_SIZE + 31) / 32];
+uint32_t TIASound::ourEdge5;
+const uint32_t TIASound::ourDiv31 = (1 << 1) | (1 << 19);
+uint8_t TIASound::ourRun4[POLY4_SIZE][2];
+uint8_t TIASound::ourNextDiv31[POLY5_SIZE];
+uint8_t TIASound::ourNextPoly5[POLY5_SIZE];
+uint8_t TIASound::ourNextEdge5[POLY5_SIZE];
+bool TIASound::ourTablesBuilt = false;
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 bool TIASound::save(Serializer& out) const
@@ -434,6 +695,13 @@ bool TIASound::load(Serializer& in)
     myDivNCnt[i] = in.getByte();
     myDivNMax[i] = in.getByte();
     myDiv3Cnt[i] = in.getByte();
+
+    // Positions index the polynomial tables, and a running counter
+    // needs a period to restart with
+    if(myP4[i] >= POLY4_SIZE || myP5[i] >= POLY5_SIZE ||
+       myP9[i] >= POLY9_SIZE || myDiv3Cnt[i] < 1 || myDiv3Cnt[i] > 3 ||
+       (myDivNCnt[i] && !myDivNMax[i]))
+      return false;
   }
   myOutputCounter = (int32_t)in.getInt();
   return true;
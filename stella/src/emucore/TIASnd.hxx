@@ -100,7 +100,49 @@ class TIASound
     void volume(uint32_t percent);
 
   private:
-    void polyInit(uint8_t* poly, int size, int f0, int f1);
+    /**
+      Build the packed polynomials and their transition tables (once, for
+      all instances).
+    */
+    static void initTables();
+
+    /**
+      Clock a channel whose divide by n counter just expired: advance its
+      polynomials and update its output according to its AUDC mode.
+    */
+    void clockChannel(int chan, uint8_t audc, uint8_t& p5, int16_t& v,
+                      int16_t audv);
+    void stepPoly4(int chan, int16_t& v, int16_t audv);
+
+    /**
+      Emit the output samples due after one tick (at most 'samples').
+    */
+    void output(int16_t*& buffer, uint32_t& samples, int16_t v0, int16_t v1);
+
+    /**
+      Run up to 'ticks' ticks with constant channel outputs, emitting the
+      samples due (at most 'samples').  Answers the number of ticks run,
+      which is less than 'ticks' only if the buffer filled up.
+    */
+    uint32_t fill(int16_t*& buffer, uint32_t& samples, uint32_t ticks,
+                  int16_t v0, int16_t v1);
+
+    /**
+      The number of clocks (divide by n expiries) ahead of a channel that
+      leave its output 'v' as it is, from a few table lookups.  At most
+      QUIET_MAX; 0 if the next one may already change it.
+    */
+    uint32_t quietClocks(int chan, uint8_t audc, uint8_t p5,
+                         int16_t v, int16_t audv) const;
+
+    /**
+      Advance a channel by 'ticks' ticks, none of which may change its
+      output: counters and polynomial positions move on as the clocks in
+      them would move them.  Answers the number of clocks.
+    */
+    uint32_t skipTicks(int chan, uint8_t audc, uint8_t& p5,
+                       uint8_t& divNCnt, uint32_t ticks);
+    void skipClocks(int chan, uint8_t audc, uint8_t& p5, uint32_t clocks);
 
   public:
     /**
@@ -141,6 +183,7 @@ class TIASound
       POLY5_SIZE = 0x001f,
       POLY9_SIZE = 0x01ff,
       DIV3_MASK  = 0x0c,
+      QUIET_MAX  = 1 << 20, // quiet clocks are counted up to this
       AUDV_SHIFT = 10     // shift 2 positions for AUDV,
                           // then another 8 for 16-bit sound
     };
@@ -173,16 +216,14 @@ class TIASound
     uint32_t myVolumePercentage;
 
     /*
-      Initialize the bit patterns for the polynomials (at runtime).
-
-      The 4bit and 5bit patterns are the identical ones used in the tia chip.
-      Though the patterns could be packed with 8 bits per byte, using only a
-      single bit per byte keeps the math simple, which is important for
-      efficient processing.
+      The polynomials, packed with bit i holding step i of the sequence
+      (the 4bit and 5bit patterns are the identical ones used in the tia
+      chip).  A channel's position in a polynomial is the step it last
+      output, and clocking it moves to the next one.
     */
-    uint8_t Bit4[POLY4_SIZE];
-    uint8_t Bit5[POLY5_SIZE];
-    uint8_t Bit9[POLY9_SIZE];
+    static uint32_t ourPoly4;
+    static uint32_t ourPoly5;
+    static uint32_t ourPoly9[(POLY9_SIZE + 31) / 32];
 
     /*
       The 'Div by 31' counter is treated as another polynomial because of
@@ -190,7 +231,21 @@ class TIASound
       has a 13:18 ratio (of course, 13+18 = 31).  This could also be
       implemented by using counters.
     */
-    static const uint8_t Div31[POLY5_SIZE];
+    static const uint32_t ourDiv31;
+
+    // Steps at which the 5bit polynomial changes, as POLY5_DIV3 counts them
+    static uint32_t ourEdge5;
+
+    /*
+      Transition tables, indexed by polynomial position: ourRun4[p][b]
+      is how many of the steps after p in a row output b, and ourNextX[p]
+      how many steps it is from p to the next step set in X.
+    */
+    static uint8_t ourRun4[POLY4_SIZE][2];
+    static uint8_t ourNextDiv31[POLY5_SIZE];
+    static uint8_t ourNextPoly5[POLY5_SIZE];
+    static uint8_t ourNextEdge5[POLY5_SIZE];
+    static bool ourTablesBuilt;
 };
 
 #endif
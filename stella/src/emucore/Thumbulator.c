@@ -45,6 +45,7 @@ void thumb_init_ex(Thumbulator* self, const uint16_t* rom, uint16_t* ram,
   (void)thumb_fetch32;
   self->rom = rom;
   self->ram = ram;
+  self->ram_written = 0;
   for(i = 0; i < 16; ++i)
   {
     self->reg_sys[i] = 0;
@@ -174,6 +175,8 @@ static void thumb_write16(Thumbulator* self, uint32_t addr, uint32_t data)
   {
     case 0x40000000: /* RAM */
       addr &= THUMB_RAMADDMASK;
+      if(self->ram_written)
+        self->ram_written[addr >> THUMB_RAMPAGESHIFT] = 1;
       addr >>= 1;
 #ifdef MSB_FIRST
       self->ram[addr] = (((data & 0xFFFF) >> 8) |
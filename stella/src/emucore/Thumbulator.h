@@ -30,6 +30,10 @@ extern "C" {
 #define THUMB_ROMSIZE    (THUMB_ROMADDMASK + 1)
 #define THUMB_RAMSIZE    (THUMB_RAMADDMASK + 1)
 
+/* RAM page size of the write flags (ram_written below) */
+#define THUMB_RAMPAGESHIFT 8
+#define THUMB_RAMPAGESIZE  (1 << THUMB_RAMPAGESHIFT)
+
 /* Processor modes */
 #define THUMB_MODE_USR 0x10
 #define THUMB_MODE_FIQ 0x11
@@ -58,6 +62,14 @@ typedef struct Thumbulator
   const uint16_t* rom;   /* caller-owned ROM image (16-bit words)    */
   uint16_t*       ram;   /* caller-owned RAM (16-bit words)          */
 
+  /*
+    Optional caller-owned write flags, one byte per THUMB_RAMPAGESIZE
+    bytes of RAM: a write to the RAM sets its page's byte to 1. The carts
+    use it to tell which pages a snapshot must restore (see PagedRAM.hxx);
+    NULL (the default) turns it off.
+  */
+  uint8_t*        ram_written;
+
   uint32_t halfadd;
   uint32_t cpsr;
   uint32_t reg_sys[16];  /* system mode registers      */
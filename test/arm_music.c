@@ -0,0 +1,349 @@
+/* High-resolution ARM cart music test for the stella2014 libretro core.
+ *
+ * Builds a synthetic 29K DPC+ image (no ARM code: the music fetchers are
+ * set up from the 6502) whose kernel copies the AMPLITUDE register into
+ * AUDV0 on every visible line, for 60 frames, and then writes AUDV0 = 0
+ * and stops fetching. With "stella2014_arm_music" enabled, in both
+ * audio timings, it checks that:
+ *
+ *   1. The music plays from the stream: the audio of the music frames
+ *      differs from that of the plain register writes.
+ *   2. Writing AUDV0 = 0 hands the channel back to the register: the
+ *      last frame is flat, but for the DC blocker settling.
+ *   3. Two runs give the same audio, and savestates round-trip: running
+ *      on from a loaded state (saved mid-music) gives the same audio and
+ *      state as running on without.
+ *
+ * and that the plain 4K determinism kernel (see determinism_harness.c),
+ * which has no music fetchers, sounds exactly the same either way.
+ *
+ * Usage: arm_music <path/to/stella2014_libretro.so>
+ * Exit code 0 on success, 1 on any mismatch or failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include "libretro.h"
+
+#define FRAMES      120     /* 60 with music, 60 without */
+#define MUSIC       60
+#define SAVE_AT     30
+#define MAX_FRAME   1024    /* stereo samples in a frame, at most */
+#define SETTLED     8       /* most a silent frame may move (DC blocker) */
+
+/* DPC+: 6 x 4K banks (starting in bank 5), 4K display data (the
+ * waveforms), 1K frequency table */
+static const uint8_t dpcp_code[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,       /*       SEI CLD LDX #$FF TXS */
+    0xA9, 0x00, 0x85, 0x15,             /*       LDA #0 STA AUDC0     */
+    0x85, 0x16, 0x85, 0x1A,             /*       STA AUDC1 STA AUDV1  */
+    0xA9, 0x01, 0x8D, 0x75, 0x10,       /*       LDA #1 STA NOTE0     */
+    0xA9, 0x00, 0x8D, 0x5D, 0x10,       /*       LDA #0 STA WAVEFORM0 */
+    0xA2, 0x00,                         /*       LDX #0               */
+    0xA9, 0x02, 0x85, 0x00,             /* loop: LDA #2 STA VSYNC     */
+    0x85, 0x02, 0x85, 0x02, 0x85, 0x02, /*       STA WSYNC x3         */
+    0xA9, 0x00, 0x85, 0x00,             /*       LDA #0 STA VSYNC     */
+    0xE0, MUSIC, 0xB0, 0x17,            /*       CPX #MUSIC BCS quiet */
+    0xA0, 0xC0,                         /*       LDY #192             */
+    0xAD, 0x05, 0x10,                   /* line: LDA AMPLITUDE        */
+    0x85, 0x19, 0x85, 0x02,             /*       STA AUDV0 STA WSYNC  */
+    0x88, 0xD0, 0xF6,                   /*       DEY BNE line         */
+    0xA0, 0x43,                         /*       LDY #67              */
+    0x85, 0x02, 0x88, 0xD0, 0xFB,       /* gap:  STA WSYNC DEY BNE    */
+    0xE8, 0x4C, 0x99, 0xF0,             /*       INX JMP loop         */
+    0xA9, 0x00, 0x85, 0x19,             /* quiet:LDA #0 STA AUDV0     */
+    0xA0, 0xFF,                         /*       LDY #255             */
+    0x85, 0x02, 0x88, 0xD0, 0xFB,       /* wait: STA WSYNC DEY BNE    */
+    0x4C, 0x99, 0xF0,                   /*       JMP loop             */
+};
+
+static void build_dpcp(uint8_t rom[29 * 1024])
+{
+    uint8_t *bank5 = rom + 0x5000, *display = rom + 0x6000;
+    uint8_t *frequency = rom + 0x7000;
+    uint32_t note = 0x0C000000;     /* 1.5 waveform steps per fetch */
+    int i;
+
+    memset(rom, 0xFF, 29 * 1024);
+    memcpy(rom + 0x100, "DPC+", 4);
+    memcpy(rom + 0x200, "DPC+", 4);
+    memcpy(bank5 + 0x80, dpcp_code, sizeof(dpcp_code));
+    bank5[0xFFC] = 0x80; bank5[0xFFD] = 0xF0;
+    bank5[0xFFE] = 0x80; bank5[0xFFF] = 0xF0;
+
+    /* Waveform 0: a triangle that starts at 0, so the idle voices 1 and
+     * 2 (frequency 0) add nothing */
+    memset(display, 0, 0x1000);
+    for (i = 0; i < 32; i++)
+        display[i] = i < 16 ? i : 31 - i;
+
+    memset(frequency, 0, 0x400);
+    for (i = 0; i < 4; i++)
+        frequency[4 + i] = (note >> (8 * i)) & 0xFF;
+}
+
+/* Embedded 4K test ROM: see determinism_harness.c */
+static const uint8_t plain_code[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,
+    0xE8, 0xA9, 0x02, 0x85, 0x00, 0x85, 0x02, 0x85, 0x02, 0x85, 0x02,
+    0xA9, 0x00, 0x85, 0x00, 0xA9, 0x04, 0x85, 0x15, 0xA9, 0x0F, 0x85,
+    0x19, 0x8A, 0x85, 0x17, 0x85, 0x09, 0xA0, 0x00,
+    0x85, 0x02, 0x88, 0xD0, 0xFB, 0x4C, 0x05, 0xF0,
+};
+
+static void build_plain(uint8_t rom[4096])
+{
+    memset(rom, 0xFF, 4096);
+    memcpy(rom, plain_code, sizeof(plain_code));
+    rom[0xFFA] = 0x00; rom[0xFFB] = 0xF0;
+    rom[0xFFC] = 0x00; rom[0xFFD] = 0xF0;
+    rom[0xFFE] = 0x00; rom[0xFFF] = 0xF0;
+}
+
+static const char *g_music  = "disabled";
+static const char *g_timing = "frame";
+static int16_t g_audio[FRAMES * MAX_FRAME * 2];
+static size_t g_audio_frames;
+static size_t g_frame_end[FRAMES + 1];
+
+static bool env_cb(unsigned cmd, void *data)
+{
+    if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT)
+        return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+    if (cmd == RETRO_ENVIRONMENT_GET_VARIABLE)
+    {
+        struct retro_variable *var = (struct retro_variable*)data;
+        if (!strcmp(var->key, "stella2014_arm_music"))
+        {
+            var->value = g_music;
+            return true;
+        }
+        if (!strcmp(var->key, "stella2014_audio_timing"))
+        {
+            var->value = g_timing;
+            return true;
+        }
+    }
+    return false;
+}
+static void video_cb(const void *d, unsigned w, unsigned h, size_t p)
+{ (void)d; (void)w; (void)h; (void)p; }
+static size_t audio_batch_cb(const int16_t *data, size_t frames)
+{
+    if (g_audio_frames + frames <= FRAMES * MAX_FRAME)
+        memcpy(g_audio + 2 * g_audio_frames, data,
+               frames * 2 * sizeof(int16_t));
+    g_audio_frames += frames;
+    return frames;
+}
+static void audio_cb(int16_t l, int16_t r) { (void)l; (void)r; }
+static void input_poll_cb(void) {}
+static int16_t input_state_cb(unsigned a, unsigned b, unsigned c, unsigned d)
+{ (void)a; (void)b; (void)c; (void)d; return 0; }
+
+static struct {
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+    void (*run)(void);
+    size_t (*serialize_size)(void);
+    bool (*serialize)(void*, size_t);
+    bool (*unserialize)(const void*, size_t);
+} c;
+
+static void start(const struct retro_game_info *game, const char *music)
+{
+    g_music = music;
+    c.unload_game();
+    if (!c.load_game(game))
+    { fprintf(stderr, "load failed\n"); exit(1); }
+    g_audio_frames = 0;
+}
+
+/* Run 'frames' frames, recording where each one's audio ends */
+static void run(int first, int frames)
+{
+    int i;
+    for (i = first; i < first + frames; i++)
+    {
+        c.run();
+        g_frame_end[i + 1] = g_audio_frames;
+    }
+}
+
+static uint8_t *snapshot(size_t *size)
+{
+    uint8_t *st;
+    *size = c.serialize_size();
+    st = (uint8_t*)malloc(*size);
+    if (!st || !c.serialize(st, *size))
+    { fprintf(stderr, "serialize failed\n"); exit(1); }
+    return st;
+}
+
+static int check_timing(const struct retro_game_info *dpcp,
+                        const char *timing)
+{
+    static int16_t plain[FRAMES * MAX_FRAME * 2];
+    static int16_t ref[FRAMES * MAX_FRAME * 2];
+    size_t ref_frames, music_end, size, end_size, i;
+    int lo, hi;
+    uint8_t *st, *end;
+    int rc = 0;
+
+    g_timing = timing;
+
+    /* Plain register writes */
+    start(dpcp, "disabled");
+    run(0, FRAMES);
+    memcpy(plain, g_audio, g_audio_frames * 2 * sizeof(int16_t));
+
+    /* 1. + 2. */
+    start(dpcp, "enabled");
+    run(0, FRAMES);
+    ref_frames = g_audio_frames;
+    music_end = g_frame_end[MUSIC];
+    memcpy(ref, g_audio, ref_frames * 2 * sizeof(int16_t));
+    if (!memcmp(ref, plain, music_end * 2 * sizeof(int16_t)))
+    {
+        fprintf(stderr, "%s: music not played from the stream\n", timing);
+        rc = 1;
+    }
+    lo = hi = ref[2 * g_frame_end[FRAMES - 1]];
+    for (i = g_frame_end[FRAMES - 1]; i < ref_frames; i++)
+    {
+        if (ref[2 * i] < lo) lo = ref[2 * i];
+        if (ref[2 * i] > hi) hi = ref[2 * i];
+    }
+    if (hi - lo > SETTLED)
+    {
+        fprintf(stderr, "%s: still playing after AUDV0 = 0\n", timing);
+        rc = 1;
+    }
+    else
+        printf("%s: %u music samples from the stream, then silence"
+               " (%d..%d)\n", timing, (unsigned)music_end, lo, hi);
+
+    /* 3. again, through a state saved mid-music */
+    start(dpcp, "enabled");
+    run(0, SAVE_AT);
+    st = snapshot(&size);
+    run(SAVE_AT, FRAMES - SAVE_AT);
+    end = snapshot(&end_size);
+    if (g_audio_frames != ref_frames ||
+        memcmp(g_audio, ref, ref_frames * 2 * sizeof(int16_t)))
+    {
+        fprintf(stderr, "%s: second run differs\n", timing);
+        rc = 1;
+    }
+
+    if (!c.unserialize(st, size))
+    { fprintf(stderr, "unserialize failed\n"); exit(1); }
+    g_audio_frames = g_frame_end[SAVE_AT];
+    run(SAVE_AT, FRAMES - SAVE_AT);
+    free(st);
+    st = snapshot(&size);
+    if (g_audio_frames != ref_frames ||
+        memcmp(g_audio, ref, ref_frames * 2 * sizeof(int16_t)) ||
+        size != end_size || memcmp(st, end, size))
+    {
+        fprintf(stderr, "%s: run from a loaded state differs\n", timing);
+        rc = 1;
+    }
+    else
+        printf("%s: second run and state round trip IDENTICAL\n", timing);
+    free(st);
+    free(end);
+    return rc;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t dpcp_rom[29 * 1024];
+    static uint8_t plain_rom[4096];
+    static int16_t ref[FRAMES * MAX_FRAME * 2];
+    struct retro_game_info dpcp, plain;
+    size_t ref_frames;
+    void *so;
+    int rc = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <core.so>\n", argv[0]);
+        return 1;
+    }
+    so = dlopen(argv[1], RTLD_NOW);
+    if (!so) { fprintf(stderr, "dlopen: %s\n", dlerror()); return 1; }
+
+#define SYM(field, name) \
+    c.field = (__typeof__(c.field))dlsym(so, name); \
+    if (!c.field) { fprintf(stderr, "missing symbol " name "\n"); return 1; }
+    SYM(set_environment,        "retro_set_environment");
+    SYM(set_video_refresh,      "retro_set_video_refresh");
+    SYM(set_audio_sample,       "retro_set_audio_sample");
+    SYM(set_audio_sample_batch, "retro_set_audio_sample_batch");
+    SYM(set_input_poll,         "retro_set_input_poll");
+    SYM(set_input_state,        "retro_set_input_state");
+    SYM(init,                   "retro_init");
+    SYM(deinit,                 "retro_deinit");
+    SYM(load_game,              "retro_load_game");
+    SYM(unload_game,            "retro_unload_game");
+    SYM(run,                    "retro_run");
+    SYM(serialize_size,         "retro_serialize_size");
+    SYM(serialize,              "retro_serialize");
+    SYM(unserialize,            "retro_unserialize");
+#undef SYM
+
+    build_dpcp(dpcp_rom);
+    build_plain(plain_rom);
+    c.set_environment(env_cb);
+    c.set_video_refresh(video_cb);
+    c.set_audio_sample(audio_cb);
+    c.set_audio_sample_batch(audio_batch_cb);
+    c.set_input_poll(input_poll_cb);
+    c.set_input_state(input_state_cb);
+    c.init();
+
+    dpcp.path = "embedded.a26";
+    dpcp.data = dpcp_rom;
+    dpcp.size = sizeof(dpcp_rom);
+    dpcp.meta = NULL;
+    plain = dpcp;
+    plain.data = plain_rom;
+    plain.size = sizeof(plain_rom);
+    if (!c.load_game(&dpcp))
+    { fprintf(stderr, "load failed\n"); return 1; }
+
+    rc |= check_timing(&dpcp, "frame");
+    rc |= check_timing(&dpcp, "cycle");
+
+    /* No music fetchers: no difference */
+    g_timing = "frame";
+    start(&plain, "disabled");
+    run(0, FRAMES);
+    ref_frames = g_audio_frames;
+    memcpy(ref, g_audio, ref_frames * 2 * sizeof(int16_t));
+    start(&plain, "enabled");
+    run(0, FRAMES);
+    if (g_audio_frames != ref_frames ||
+        memcmp(g_audio, ref, ref_frames * 2 * sizeof(int16_t)))
+    { fprintf(stderr, "plain ROM sounds different\n"); rc = 1; }
+    else
+        printf("plain ROM: %u samples IDENTICAL either way\n",
+               (unsigned)ref_frames);
+
+    c.unload_game();
+    c.deinit();
+    dlclose(so);
+    if (rc == 0) printf("arm music: ALL PASS\n");
+    return rc;
+}
@@ -0,0 +1,328 @@
+/* Audio callback (threaded audio) test for the stella2014 libretro core.
+ *
+ * Runs the embedded determinism-test kernel (see determinism_harness.c)
+ * with "stella2014_audio_callback" enabled, acting as a frontend that
+ * supports RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK, and checks that:
+ *
+ *   1. The core registers the callback and retro_run() no longer calls
+ *      the audio callbacks itself.
+ *   2. Pulling the audio through the callback after every frame gives
+ *      exactly the samples of cycle-exact audio timing.
+ *   3. After the frontend stops pulling for long enough to overflow the
+ *      event queue, the callback recovers, and plays at most a bounded
+ *      backlog before it catches up with the emulation.
+ *   4. Savestates still round-trip: running on from a loaded state
+ *      gives the same state as running on without.
+ *   5. The samples the callback fills in while starved are counted: the
+ *      frames that follow play that much less, so the latency stays.
+ *
+ * The callback is called from this thread; the test covers the protocol
+ * between the emulation and the callback, not the threading.
+ *
+ * Usage: audio_callback <path/to/stella2014_libretro.so>
+ * Exit code 0 on success, 1 on any mismatch or failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include "libretro.h"
+
+#define FRAMES   120
+#define STALL    3000   /* frames run without pulling audio */
+#define STARVED  64     /* samples the callback fills in when starved */
+#define STARVE   4      /* further callbacks made while starved */
+#define MAX_LAG  (4 * 19912 / 38)
+
+/* Embedded 4K test ROM: see determinism_harness.c */
+static const uint8_t rom_code[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,
+    0xE8, 0xA9, 0x02, 0x85, 0x00, 0x85, 0x02, 0x85, 0x02, 0x85, 0x02,
+    0xA9, 0x00, 0x85, 0x00, 0xA9, 0x04, 0x85, 0x15, 0xA9, 0x0F, 0x85,
+    0x19, 0x8A, 0x85, 0x17, 0x85, 0x09, 0xA0, 0x00,
+    0x85, 0x02, 0x88, 0xD0, 0xFB, 0x4C, 0x05, 0xF0,
+};
+
+static void build_rom(uint8_t rom[4096])
+{
+    memset(rom, 0xFF, 4096);
+    memcpy(rom, rom_code, sizeof(rom_code));
+    rom[0xFFA] = 0x00; rom[0xFFB] = 0xF0;
+    rom[0xFFC] = 0x00; rom[0xFFD] = 0xF0;
+    rom[0xFFE] = 0x00; rom[0xFFF] = 0xF0;
+}
+
+static const char *g_callback = "disabled";
+static struct retro_audio_callback g_audio_callback;
+static bool g_registered;
+static bool g_in_callback;
+static unsigned g_outside;
+static int16_t g_audio[FRAMES * 2048 * 2];
+static size_t g_audio_frames;
+static size_t g_last_batch;
+
+static bool env_cb(unsigned cmd, void *data)
+{
+    if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT)
+        return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+    if (cmd == RETRO_ENVIRONMENT_GET_VARIABLE)
+    {
+        struct retro_variable *var = (struct retro_variable*)data;
+        if (!strcmp(var->key, "stella2014_audio_timing"))
+        {
+            var->value = "cycle";
+            return true;
+        }
+        if (!strcmp(var->key, "stella2014_audio_callback"))
+        {
+            var->value = g_callback;
+            return true;
+        }
+    }
+    if (cmd == RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK)
+    {
+        g_audio_callback = *(const struct retro_audio_callback*)data;
+        g_registered = true;
+        return true;
+    }
+    return false;
+}
+static void video_cb(const void *d, unsigned w, unsigned h, size_t p)
+{ (void)d; (void)w; (void)h; (void)p; }
+static size_t audio_batch_cb(const int16_t *data, size_t frames)
+{
+    if (!g_in_callback)
+        g_outside++;
+    if (g_audio_frames + frames <= FRAMES * 2048)
+        memcpy(g_audio + 2 * g_audio_frames, data,
+               frames * 2 * sizeof(int16_t));
+    g_audio_frames += frames;
+    g_last_batch = frames;
+    return frames;
+}
+static void audio_cb(int16_t l, int16_t r) { (void)l; (void)r; g_outside++; }
+static void input_poll_cb(void) {}
+static int16_t input_state_cb(unsigned a, unsigned b, unsigned c, unsigned d)
+{ (void)a; (void)b; (void)c; (void)d; return 0; }
+
+static struct {
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+    void (*run)(void);
+    size_t (*serialize_size)(void);
+    bool (*serialize)(void*, size_t);
+    bool (*unserialize)(const void*, size_t);
+} c;
+
+static struct retro_game_info g_game;
+
+static void start(const char *callback)
+{
+    g_callback = callback;
+    g_registered = false;
+    c.unload_game();
+    if (!c.load_game(&g_game))
+    { fprintf(stderr, "load failed\n"); exit(1); }
+    g_audio_frames = 0;
+    g_outside = 0;
+}
+
+/* One call of the frontend's audio thread */
+static void pull(void)
+{
+    g_in_callback = true;
+    g_audio_callback.callback();
+    g_in_callback = false;
+}
+
+static uint8_t *snapshot(size_t *size)
+{
+    uint8_t *st;
+    *size = c.serialize_size();
+    st = (uint8_t*)malloc(*size);
+    if (!st || !c.serialize(st, *size))
+    { fprintf(stderr, "serialize failed\n"); exit(1); }
+    return st;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t rom[4096];
+    static int16_t ref[FRAMES * 2048 * 2];
+    static size_t ref_end[FRAMES];
+    size_t backlog, played, expected, size, end_size;
+    uint8_t *st, *end;
+    void *so;
+    int i, calls, rc = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <core.so>\n", argv[0]);
+        return 1;
+    }
+    so = dlopen(argv[1], RTLD_NOW);
+    if (!so) { fprintf(stderr, "dlopen: %s\n", dlerror()); return 1; }
+
+#define SYM(field, name) \
+    c.field = (__typeof__(c.field))dlsym(so, name); \
+    if (!c.field) { fprintf(stderr, "missing symbol " name "\n"); return 1; }
+    SYM(set_environment,        "retro_set_environment");
+    SYM(set_video_refresh,      "retro_set_video_refresh");
+    SYM(set_audio_sample,       "retro_set_audio_sample");
+    SYM(set_audio_sample_batch, "retro_set_audio_sample_batch");
+    SYM(set_input_poll,         "retro_set_input_poll");
+    SYM(set_input_state,        "retro_set_input_state");
+    SYM(init,                   "retro_init");
+    SYM(deinit,                 "retro_deinit");
+    SYM(load_game,              "retro_load_game");
+    SYM(unload_game,            "retro_unload_game");
+    SYM(run,                    "retro_run");
+    SYM(serialize_size,         "retro_serialize_size");
+    SYM(serialize,              "retro_serialize");
+    SYM(unserialize,            "retro_unserialize");
+#undef SYM
+
+    build_rom(rom);
+    c.set_environment(env_cb);
+    c.set_video_refresh(video_cb);
+    c.set_audio_sample(audio_cb);
+    c.set_audio_sample_batch(audio_batch_cb);
+    c.set_input_poll(input_poll_cb);
+    c.set_input_state(input_state_cb);
+    c.init();
+
+    g_game.path = "embedded.a26";
+    g_game.data = rom;
+    g_game.size = sizeof(rom);
+    g_game.meta = NULL;
+    if (!c.load_game(&g_game))
+    { fprintf(stderr, "load failed\n"); return 1; }
+
+    /* Reference: cycle-exact timing, pushed by retro_run() */
+    start("disabled");
+    if (g_registered)
+    { fprintf(stderr, "callback registered while disabled\n"); rc = 1; }
+    for (i = 0; i < FRAMES; i++)
+    {
+        c.run();
+        ref_end[i] = g_audio_frames;
+    }
+    memcpy(ref, g_audio, g_audio_frames * 2 * sizeof(int16_t));
+
+    /* 1. + 2. pull each frame's audio through the callback */
+    start("enabled");
+    if (!g_registered)
+    { fprintf(stderr, "callback not registered\n"); return 1; }
+    g_audio_callback.set_state(true);
+    for (i = 0; i < FRAMES; i++)
+    {
+        c.run();
+        for (calls = 0; g_audio_frames < ref_end[i] && calls < 100; calls++)
+            pull();
+    }
+    if (g_outside)
+    {
+        fprintf(stderr, "audio sent outside the callback %u times\n",
+                g_outside);
+        rc = 1;
+    }
+    if (g_audio_frames != ref_end[FRAMES - 1] ||
+        memcmp(g_audio, ref, g_audio_frames * 2 * sizeof(int16_t)))
+    {
+        fprintf(stderr, "callback audio differs: %u samples, expected %u\n",
+                (unsigned)g_audio_frames, (unsigned)ref_end[FRAMES - 1]);
+        rc = 1;
+    }
+    else
+        printf("callback: %u samples over %d frames IDENTICAL to "
+               "cycle-exact timing\n", (unsigned)g_audio_frames, FRAMES);
+
+    /* 3. stall, overflowing the queue, then pull until starved */
+    for (i = 0; i < STALL; i++)
+        c.run();
+    g_audio_frames = 0;
+    for (calls = 0; calls < 10000; calls++)
+    {
+        pull();
+        if (g_last_batch == STARVED)
+            break;
+    }
+    backlog = g_audio_frames - g_last_batch;
+    if (calls == 10000 || backlog > MAX_LAG + 2 * 518 + 512)
+    {
+        fprintf(stderr, "after a stall of %d frames: %u samples of "
+                "backlog\n", STALL, (unsigned)backlog);
+        rc = 1;
+    }
+    else
+        printf("stall of %d frames: caught up after %u samples\n", STALL,
+               (unsigned)backlog);
+
+    /* 4. savestates */
+    st = snapshot(&size);
+    for (i = 0; i < 10; i++)
+        c.run();
+    end = snapshot(&end_size);
+    if (!c.unserialize(st, size))
+    { fprintf(stderr, "unserialize failed\n"); return 1; }
+    free(st);
+    for (i = 0; i < 10; i++)
+    {
+        c.run();
+        pull();
+    }
+    st = snapshot(&size);
+    if (size != end_size || memcmp(st, end, size))
+    { fprintf(stderr, "state after loading differs\n"); rc = 1; }
+    else
+        printf("state round trip: IDENTICAL\n");
+    free(st);
+    free(end);
+
+    /* 5. starve the callback, then run 3 frames (within MAX_LAG) */
+    for (calls = 0; calls < 100; calls++)
+    {
+        pull();
+        if (g_last_batch == STARVED)
+            break;
+    }
+    for (i = 0; i < STARVE; i++)
+        pull();
+    g_audio_frames = 0;
+    for (i = 0; i < 3; i++)
+        c.run();
+    for (calls = 0; calls < 100; calls++)
+    {
+        pull();
+        if (g_last_batch == STARVED)
+            break;
+    }
+    played   = g_audio_frames - g_last_batch;
+    expected = ref_end[FRAMES - 1] - ref_end[FRAMES - 4] -
+               (STARVE + 1) * STARVED;
+    if (played + 1 < expected || played > expected + 1)
+    {
+        fprintf(stderr, "after %d starved callbacks: %u samples for 3 "
+                "frames, expected %u\n", STARVE + 1, (unsigned)played,
+                (unsigned)expected);
+        rc = 1;
+    }
+    else
+        printf("%d starved callbacks: made up for by the next %u samples\n",
+               STARVE + 1, (unsigned)played);
+
+    c.unload_game();
+    c.deinit();
+    dlclose(so);
+    if (rc == 0) printf("audio callback: ALL PASS\n");
+    return rc;
+}
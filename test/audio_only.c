@@ -0,0 +1,242 @@
+/* Audio-only rendering test for the stella2014 libretro core.
+ *
+ * Runs a ROM whose sound depends on a collision register: every frame it
+ * positions both players, widens or copies player 0 by the frame count,
+ * and after 200 lines sets AUDV0 from the player-player collision bit.
+ * If audio-only mode skipped anything the program can observe, the
+ * sound would differ. The test checks that:
+ *
+ *   1. stella2014_render_audio(), called with buffer sizes that don't
+ *      divide into frames, returns the exact audio of retro_run().
+ *   2. Ending on the same frame leaves the same state as retro_run().
+ *   3. No video is sent while rendering.
+ *
+ * and reports how much faster than realtime the rendering runs.
+ *
+ * Usage: audio_only <path/to/stella2014_libretro.so>
+ * Exit code 0 on success, 1 on any mismatch or failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <dlfcn.h>
+#include "libretro.h"
+#include "../libretro_ext.h"
+
+#define FRAMES  300
+#define CHUNK   1234    /* stereo frames per stella2014_render_audio() */
+#define SECONDS 120     /* of audio rendered for the speed report */
+
+static const uint8_t rom_code[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,       /*       SEI CLD LDX #$FF TXS */
+    0xE8,                               /* loop: INX                  */
+    0xA9, 0x02, 0x85, 0x00,             /*       LDA #2  STA VSYNC    */
+    0x85, 0x02, 0x85, 0x02, 0x85, 0x02, /*       STA WSYNC x3         */
+    0xA9, 0x00, 0x85, 0x00,             /*       LDA #0  STA VSYNC    */
+    0xA9, 0xFF, 0x85, 0x1B, 0x85, 0x1C, /*       LDA #$FF STA GRP0/1  */
+    0x8A, 0x29, 0x07, 0x85, 0x04,       /*       TXA AND #7 STA NUSIZ0*/
+    0x85, 0x10, 0x85, 0x11,             /*       STA RESP0 STA RESP1  */
+    0xA9, 0x04, 0x85, 0x15,             /*       LDA #4  STA AUDC0    */
+    0x86, 0x17,                         /*       STX AUDF0            */
+    0x85, 0x2C,                         /*       STA CXCLR            */
+    0xA0, 0xC8,                         /*       LDY #200             */
+    0x85, 0x02, 0x88, 0xD0, 0xFB,       /* wait: STA WSYNC DEY BNE    */
+    0xA5, 0x07, 0x29, 0x80,             /*       LDA CXPPMM AND #$80  */
+    0x4A, 0x4A, 0x4A, 0x4A,             /*       LSR x4               */
+    0x85, 0x19,                         /*       STA AUDV0            */
+    0x4C, 0x05, 0xF0,                   /*       JMP loop             */
+};
+
+static void build_rom(uint8_t rom[4096])
+{
+    memset(rom, 0xFF, 4096);
+    memcpy(rom, rom_code, sizeof(rom_code));
+    rom[0xFFA] = 0x00; rom[0xFFB] = 0xF0;
+    rom[0xFFC] = 0x00; rom[0xFFD] = 0xF0;
+    rom[0xFFE] = 0x00; rom[0xFFF] = 0xF0;
+}
+
+static int16_t g_audio[FRAMES * 2048 * 2];
+static size_t g_audio_frames;
+static unsigned g_video_calls;
+
+static bool env_cb(unsigned cmd, void *data)
+{
+    if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT)
+        return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+    return false;
+}
+static void video_cb(const void *d, unsigned w, unsigned h, size_t p)
+{ (void)d; (void)w; (void)h; (void)p; g_video_calls++; }
+static size_t audio_batch_cb(const int16_t *data, size_t frames)
+{
+    memcpy(g_audio + 2 * g_audio_frames, data, frames * 2 * sizeof(int16_t));
+    g_audio_frames += frames;
+    return frames;
+}
+static void audio_cb(int16_t l, int16_t r) { (void)l; (void)r; }
+static void input_poll_cb(void) {}
+static int16_t input_state_cb(unsigned a, unsigned b, unsigned c, unsigned d)
+{ (void)a; (void)b; (void)c; (void)d; return 0; }
+
+static struct {
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+    void (*run)(void);
+    void (*get_system_av_info)(struct retro_system_av_info*);
+    size_t (*serialize_size)(void);
+    bool (*serialize)(void*, size_t);
+    size_t (*render_audio)(int16_t*, size_t);
+} c;
+
+static struct retro_game_info g_game;
+
+static void start(void)
+{
+    c.unload_game();
+    if (!c.load_game(&g_game))
+    { fprintf(stderr, "load failed\n"); exit(1); }
+}
+
+static uint8_t *snapshot(size_t *size)
+{
+    uint8_t *st;
+    *size = c.serialize_size();
+    st = (uint8_t*)malloc(*size);
+    if (!st || !c.serialize(st, *size))
+    { fprintf(stderr, "serialize failed\n"); exit(1); }
+    return st;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t rom[4096];
+    static int16_t ref[FRAMES * 2048 * 2];
+    static int16_t out[FRAMES * 2048 * 2];
+    struct retro_system_av_info av;
+    size_t ref_frames, done, n, size, ref_size, total;
+    uint8_t *st, *ref_st;
+    double rate, t;
+    void *so;
+    int i, rc = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <core.so>\n", argv[0]);
+        return 1;
+    }
+    so = dlopen(argv[1], RTLD_NOW);
+    if (!so) { fprintf(stderr, "dlopen: %s\n", dlerror()); return 1; }
+
+#define SYM(field, name) \
+    c.field = (__typeof__(c.field))dlsym(so, name); \
+    if (!c.field) { fprintf(stderr, "missing symbol " name "\n"); return 1; }
+    SYM(set_environment,        "retro_set_environment");
+    SYM(set_video_refresh,      "retro_set_video_refresh");
+    SYM(set_audio_sample,       "retro_set_audio_sample");
+    SYM(set_audio_sample_batch, "retro_set_audio_sample_batch");
+    SYM(set_input_poll,         "retro_set_input_poll");
+    SYM(set_input_state,        "retro_set_input_state");
+    SYM(init,                   "retro_init");
+    SYM(deinit,                 "retro_deinit");
+    SYM(load_game,              "retro_load_game");
+    SYM(unload_game,            "retro_unload_game");
+    SYM(run,                    "retro_run");
+    SYM(get_system_av_info,     "retro_get_system_av_info");
+    SYM(serialize_size,         "retro_serialize_size");
+    SYM(serialize,              "retro_serialize");
+    SYM(render_audio,           "stella2014_render_audio");
+#undef SYM
+
+    build_rom(rom);
+    c.set_environment(env_cb);
+    c.set_video_refresh(video_cb);
+    c.set_audio_sample(audio_cb);
+    c.set_audio_sample_batch(audio_batch_cb);
+    c.set_input_poll(input_poll_cb);
+    c.set_input_state(input_state_cb);
+    c.init();
+
+    g_game.path = "embedded.a26";
+    g_game.data = rom;
+    g_game.size = sizeof(rom);
+    g_game.meta = NULL;
+    if (c.render_audio(out, CHUNK) != 0)
+    { fprintf(stderr, "rendered audio without a game\n"); rc = 1; }
+    if (!c.load_game(&g_game))
+    { fprintf(stderr, "load failed\n"); return 1; }
+
+    /* Reference: retro_run() */
+    start();
+    g_audio_frames = 0;
+    for (i = 0; i < FRAMES; i++)
+        c.run();
+    ref_frames = g_audio_frames;
+    memcpy(ref, g_audio, ref_frames * 2 * sizeof(int16_t));
+    ref_st = snapshot(&ref_size);
+
+    /* 1. + 3. the same span, audio only */
+    start();
+    g_video_calls = 0;
+    g_audio_frames = 0;
+    for (done = 0; done < ref_frames; done += n)
+    {
+        n = ref_frames - done < CHUNK ? ref_frames - done : CHUNK;
+        if (c.render_audio(out + 2 * done, n) != n)
+        { fprintf(stderr, "short render\n"); return 1; }
+    }
+    if (g_video_calls || g_audio_frames)
+    {
+        fprintf(stderr, "%u video and %u audio callbacks while rendering\n",
+                g_video_calls, (unsigned)g_audio_frames);
+        rc = 1;
+    }
+    if (memcmp(out, ref, ref_frames * 2 * sizeof(int16_t)))
+    { fprintf(stderr, "rendered audio differs\n"); rc = 1; }
+    else
+        printf("audio only: %u samples over %d frames IDENTICAL\n",
+               (unsigned)ref_frames, FRAMES);
+
+    /* 2. the last chunk ended with frame FRAMES */
+    st = snapshot(&size);
+    if (size != ref_size || memcmp(st, ref_st, size))
+    { fprintf(stderr, "state after rendering differs\n"); rc = 1; }
+    else
+        printf("state after rendering: IDENTICAL\n");
+    free(st);
+    free(ref_st);
+
+    /* Speed */
+    c.get_system_av_info(&av);
+    rate  = av.timing.sample_rate;
+    total = (size_t)(SECONDS * rate);
+    t = now();
+    for (done = 0; done < total; done += n)
+        n = c.render_audio(out, CHUNK);
+    t = now() - t;
+    printf("rendered %d s of audio in %.3f s (%.0fx realtime)\n", SECONDS,
+           t, t > 0 ? SECONDS / t : 0.0);
+
+    c.unload_game();
+    c.deinit();
+    dlclose(so);
+    if (rc == 0) printf("audio only: ALL PASS\n");
+    return rc;
+}
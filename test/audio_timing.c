@@ -0,0 +1,309 @@
+/* Cycle-exact audio timing test for the stella2014 libretro core.
+ *
+ * Runs the embedded determinism-test kernel (see determinism_harness.c)
+ * with "stella2014_audio_timing" set to "cycle", where the samples are
+ * generated at every TIA register write instead of being replayed from
+ * the write queue when the frame ends, and checks that:
+ *
+ *   1. The frames give as many samples as the cycles they ran span, one
+ *      per 38 cycles (518 for the kernel's 259-line frames, where
+ *      per-frame timing always gives 524).
+ *   2. Running on from a state saved between frames, or in the middle
+ *      of a frame (stopped there with stella2014_run_frames()), gives
+ *      the same audio and state as running on without.
+ *   3. The same holds for a kernel that never writes the TIA, whose
+ *      frames run their full 25000 instructions and span far more
+ *      samples than one inline fragment holds.
+ *
+ * Usage: audio_timing <path/to/stella2014_libretro.so>
+ * Exit code 0 on success, 1 on any mismatch or failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include "libretro.h"
+#include "../libretro_ext.h"
+
+#define FRAMES 120
+#define SILENT_FRAMES 30
+
+/* Embedded 4K test ROM: see determinism_harness.c */
+static const uint8_t rom_code[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,
+    0xE8, 0xA9, 0x02, 0x85, 0x00, 0x85, 0x02, 0x85, 0x02, 0x85, 0x02,
+    0xA9, 0x00, 0x85, 0x00, 0xA9, 0x04, 0x85, 0x15, 0xA9, 0x0F, 0x85,
+    0x19, 0x8A, 0x85, 0x17, 0x85, 0x09, 0xA0, 0x00,
+    0x85, 0x02, 0x88, 0xD0, 0xFB, 0x4C, 0x05, 0xF0,
+};
+
+static void build_rom(uint8_t rom[4096])
+{
+    memset(rom, 0xFF, 4096);
+    memcpy(rom, rom_code, sizeof(rom_code));
+    rom[0xFFA] = 0x00; rom[0xFFB] = 0xF0;
+    rom[0xFFC] = 0x00; rom[0xFFD] = 0xF0;
+    rom[0xFFE] = 0x00; rom[0xFFF] = 0xF0;
+}
+
+/* Never writes the TIA, so the TIA never ends a frame: every one runs
+ * 25000 instructions, mostly 7-cycle INC abs,X, about 3700 samples */
+static const uint8_t silent_code[] = {
+    0xA2, 0x00,                 /* LDX #0         */
+    0xFE, 0x80, 0x00,           /* INC $0080,X    */
+    0xFE, 0x80, 0x00,           /* INC $0080,X    */
+    0x4C, 0x02, 0xF0,           /* JMP $F002      */
+};
+
+static void build_silent_rom(uint8_t rom[4096])
+{
+    build_rom(rom);
+    memcpy(rom, silent_code, sizeof(silent_code));
+}
+
+static const char *g_timing = "frame";
+static int16_t g_audio[FRAMES * 2048 * 2];
+static size_t g_audio_frames;
+static size_t g_min_batch, g_max_batch;
+
+static bool env_cb(unsigned cmd, void *data)
+{
+    if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT)
+        return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+    if (cmd == RETRO_ENVIRONMENT_GET_VARIABLE)
+    {
+        struct retro_variable *var = (struct retro_variable*)data;
+        if (!strcmp(var->key, "stella2014_audio_timing"))
+        {
+            var->value = g_timing;
+            return true;
+        }
+    }
+    return false;
+}
+static void video_cb(const void *d, unsigned w, unsigned h, size_t p)
+{ (void)d; (void)w; (void)h; (void)p; }
+static size_t audio_batch_cb(const int16_t *data, size_t frames)
+{
+    memcpy(g_audio + 2 * g_audio_frames, data, frames * 2 * sizeof(int16_t));
+    g_audio_frames += frames;
+    if (frames < g_min_batch) g_min_batch = frames;
+    if (frames > g_max_batch) g_max_batch = frames;
+    return frames;
+}
+static void audio_cb(int16_t l, int16_t r) { (void)l; (void)r; }
+static void input_poll_cb(void) {}
+static int16_t input_state_cb(unsigned a, unsigned b, unsigned c, unsigned d)
+{ (void)a; (void)b; (void)c; (void)d; return 0; }
+
+static struct {
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+    void (*run)(void);
+    size_t (*serialize_size)(void);
+    bool (*serialize)(void*, size_t);
+    bool (*unserialize)(const void*, size_t);
+    bool (*run_frames)(struct stella2014_run*);
+} c;
+
+static struct retro_game_info g_game;
+
+/* Load the game with the given audio timing and run 'frames' frames */
+static void start(const char *timing, int frames)
+{
+    int i;
+    g_timing = timing;
+    c.unload_game();
+    if (!c.load_game(&g_game))
+    { fprintf(stderr, "load failed\n"); exit(1); }
+    g_audio_frames = 0;
+    g_min_batch = ~(size_t)0;
+    g_max_batch = 0;
+    for (i = 0; i < frames; i++)
+        c.run();
+}
+
+static uint8_t *snapshot(size_t *size)
+{
+    uint8_t *st;
+    *size = c.serialize_size();
+    st = (uint8_t*)malloc(*size);
+    if (!st || !c.serialize(st, *size))
+    { fprintf(stderr, "serialize failed\n"); exit(1); }
+    return st;
+}
+
+/* Run on for 'frames' frames from a state, once straight and once after
+ * loading the state back, and compare the audio and end states */
+static int check_round_trip(const char *what, int frames)
+{
+    static int16_t before[FRAMES * 2048 * 2];
+    size_t size, frames_before, end_size;
+    uint8_t *st, *end;
+    int i, rc = 0;
+
+    st = snapshot(&size);
+    g_audio_frames = 0;
+    for (i = 0; i < frames; i++)
+        c.run();
+    frames_before = g_audio_frames;
+    memcpy(before, g_audio, frames_before * 2 * sizeof(int16_t));
+    end = snapshot(&end_size);
+
+    if (!c.unserialize(st, size))
+    { fprintf(stderr, "unserialize failed\n"); exit(1); }
+    g_audio_frames = 0;
+    for (i = 0; i < frames; i++)
+        c.run();
+    free(st);
+    st = snapshot(&size);
+
+    if (g_audio_frames != frames_before ||
+        memcmp(before, g_audio, frames_before * 2 * sizeof(int16_t)))
+    { fprintf(stderr, "%s: audio after loading differs\n", what); rc = 1; }
+    if (size != end_size || memcmp(st, end, size))
+    { fprintf(stderr, "%s: state after loading differs\n", what); rc = 1; }
+    if (rc == 0)
+        printf("%s: %u samples, round trip IDENTICAL\n", what,
+               (unsigned)frames_before);
+    free(st);
+    free(end);
+    return rc;
+}
+
+/* Run 'frames' frames and check they give one sample per 38 cycles; the
+ * clock carries the remainder of a sample over to the next frame, hence
+ * the slack of one */
+static int check_cycle_exact(const char *what, int frames)
+{
+    struct stella2014_run run;
+    uint64_t first, cycles;
+
+    start("cycle", 1);
+    memset(&run, 0, sizeof(run));
+    run.frames = 1;
+    c.run_frames(&run);
+    first = run.cycle;
+    g_audio_frames = 0;
+    g_min_batch = ~(size_t)0;
+    g_max_batch = 0;
+    run.frames = frames;
+    run.flags  = STELLA2014_RUN_AUDIO;
+    if (!c.run_frames(&run) || run.frames_run != (unsigned)frames)
+    { fprintf(stderr, "%s: batch run failed\n", what); return 1; }
+    cycles = run.cycle - first;
+    if (g_audio_frames + 1 < cycles / 38 || g_audio_frames > cycles / 38 + 1)
+    {
+        fprintf(stderr, "%s: %u samples in %llu cycles\n", what,
+                (unsigned)g_audio_frames, (unsigned long long)cycles);
+        return 1;
+    }
+    printf("%s: %u samples in %llu cycles (%u..%u per batch)\n", what,
+           (unsigned)g_audio_frames, (unsigned long long)cycles,
+           (unsigned)g_min_batch, (unsigned)g_max_batch);
+    return 0;
+}
+
+/* Stop 'cycles' cycles into the frame after the first */
+static int stop_mid_frame(uint64_t cycles)
+{
+    struct stella2014_run run;
+
+    memset(&run, 0, sizeof(run));
+    run.frames = 1;
+    c.run_frames(&run);
+    run.frames      = 0;
+    run.until_cycle = run.cycle + cycles;
+    if (!c.run_frames(&run) || !run.partial)
+    { fprintf(stderr, "could not stop mid-frame\n"); return 1; }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t rom[4096], silent[4096];
+    void *so;
+    int rc = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <core.so>\n", argv[0]);
+        return 1;
+    }
+    so = dlopen(argv[1], RTLD_NOW);
+    if (!so) { fprintf(stderr, "dlopen: %s\n", dlerror()); return 1; }
+
+#define SYM(field, name) \
+    c.field = (__typeof__(c.field))dlsym(so, name); \
+    if (!c.field) { fprintf(stderr, "missing symbol " name "\n"); return 1; }
+    SYM(set_environment,        "retro_set_environment");
+    SYM(set_video_refresh,      "retro_set_video_refresh");
+    SYM(set_audio_sample,       "retro_set_audio_sample");
+    SYM(set_audio_sample_batch, "retro_set_audio_sample_batch");
+    SYM(set_input_poll,         "retro_set_input_poll");
+    SYM(set_input_state,        "retro_set_input_state");
+    SYM(init,                   "retro_init");
+    SYM(deinit,                 "retro_deinit");
+    SYM(load_game,              "retro_load_game");
+    SYM(unload_game,            "retro_unload_game");
+    SYM(run,                    "retro_run");
+    SYM(serialize_size,         "retro_serialize_size");
+    SYM(serialize,              "retro_serialize");
+    SYM(unserialize,            "retro_unserialize");
+    SYM(run_frames,             "stella2014_run_frames");
+#undef SYM
+
+    build_rom(rom);
+    build_silent_rom(silent);
+    c.set_environment(env_cb);
+    c.set_video_refresh(video_cb);
+    c.set_audio_sample(audio_cb);
+    c.set_audio_sample_batch(audio_batch_cb);
+    c.set_input_poll(input_poll_cb);
+    c.set_input_state(input_state_cb);
+    c.init();
+
+    g_game.path = "embedded.a26";
+    g_game.data = rom;
+    g_game.size = sizeof(rom);
+    g_game.meta = NULL;
+    if (!c.load_game(&g_game))
+    { fprintf(stderr, "load failed\n"); return 1; }
+
+    /* 1. one sample per 38 cycles */
+    rc |= check_cycle_exact("cycle-exact", FRAMES);
+
+    /* 2. savestates between frames and inside a frame */
+    start("cycle", FRAMES / 2);
+    rc |= check_round_trip("frame boundary", FRAMES / 2);
+
+    start("cycle", FRAMES / 2);
+    if (stop_mid_frame(12345))
+        return 1;
+    rc |= check_round_trip("mid-frame", FRAMES / 2);
+
+    /* 3. frames longer than a fragment, and a state saved once one has
+     * filled up */
+    g_game.data = silent;
+    rc |= check_cycle_exact("no TIA writes", SILENT_FRAMES);
+
+    start("cycle", 1);
+    if (stop_mid_frame(100000))
+        return 1;
+    rc |= check_round_trip("no TIA writes, mid-frame", SILENT_FRAMES);
+
+    c.unload_game();
+    c.deinit();
+    dlclose(so);
+    if (rc == 0) printf("audio timing: ALL PASS\n");
+    return rc;
+}
@@ -0,0 +1,398 @@
+/* Batch execution test for the stella2014 libretro core.
+ *
+ * Runs the embedded determinism-test kernel (see determinism_harness.c)
+ * and verifies through the exported stella2014_run_frames() entry point
+ * that:
+ *
+ *   1. A batch of frames fed from an input buffer leaves the core in
+ *      exactly the state, and produces exactly the audio, of the same
+ *      frames run through retro_run() with the same input polled.
+ *   2. A cycle target stops the run inside a frame, at most a scanline
+ *      (a WSYNC halt) plus an instruction past the target, and finishing
+ *      that frame afterwards still matches retro_run() byte for byte.
+ *   3. A state saved there carries the partial frame: loading it and
+ *      finishing the frame gives the same result again.
+ *   4. A scanline target stops the run when the beam reaches it, the
+ *      first one included.
+ *   5. With STELLA2014_RUN_UNTIL_TIMER, a kernel polling TIMINT for its
+ *      interval timer is stopped when the timer expires: before the
+ *      kernel has stored the flag it read, but within one pass of its
+ *      polling loop of it counting the expiry, every time it sets the
+ *      timer.
+ *   6. A frame whose audio doesn't all fit in the buffer ends the run,
+ *      which reports how much of it was lost.
+ *
+ * Usage: batch_run <path/to/stella2014_libretro.so>
+ * Exit code 0 on success, 1 on any mismatch or failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include "libretro.h"
+#include "../libretro_ext.h"
+
+#define FRAMES 200
+#define TIMER_64 20
+
+/* Embedded 4K test ROM: see determinism_harness.c */
+static const uint8_t rom_code[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,
+    0xE8, 0xA9, 0x02, 0x85, 0x00, 0x85, 0x02, 0x85, 0x02, 0x85, 0x02,
+    0xA9, 0x00, 0x85, 0x00, 0xA9, 0x04, 0x85, 0x15, 0xA9, 0x0F, 0x85,
+    0x19, 0x8A, 0x85, 0x17, 0x85, 0x09, 0xA0, 0x00,
+    0x85, 0x02, 0x88, 0xD0, 0xFB, 0x4C, 0x05, 0xF0,
+};
+
+/* Sets TIM64T to 20 and polls TIMINT, keeping the last read at $80,
+ * until the timer expires; then counts the expiry at $81 and starts
+ * over */
+static const uint8_t timer_code[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,
+    0xA9, 0x00, 0x85, 0x81,             /* $F005 */
+    0xA9, 0x00, 0x85, 0x80,             /* $F009 */
+    0xA9, TIMER_64, 0x8D, 0x96, 0x02,   /* STA TIM64T */
+    0xAD, 0x85, 0x02, 0x85, 0x80,       /* $F012: LDA TIMINT, STA $80 */
+    0x10, 0xF9,                         /* BPL $F012 */
+    0xE6, 0x81, 0x4C, 0x09, 0xF0,
+};
+
+static void build_rom(uint8_t rom[4096], const uint8_t *code, size_t size)
+{
+    memset(rom, 0xFF, 4096);
+    memcpy(rom, code, size);
+    rom[0xFFA] = 0x00; rom[0xFFB] = 0xF0;
+    rom[0xFFC] = 0x00; rom[0xFFD] = 0xF0;
+    rom[0xFFE] = 0x00; rom[0xFFF] = 0xF0;
+}
+
+/* Scripted input: a different joypad bitmask on every frame */
+static int16_t script(int frame, unsigned port)
+{
+    return (int16_t)(((frame * 7 + port * 3) % 13) << 4);
+}
+
+static int g_frame;
+static int16_t g_audio[FRAMES * 1024 * 2];
+static size_t g_audio_frames;
+
+static bool env_cb(unsigned cmd, void *data)
+{
+    if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT)
+        return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+    if (cmd == RETRO_ENVIRONMENT_GET_INPUT_BITMASKS)
+        return true;
+    return false;
+}
+static void video_cb(const void *d, unsigned w, unsigned h, size_t p)
+{ (void)d; (void)w; (void)h; (void)p; }
+static size_t audio_batch_cb(const int16_t *data, size_t frames)
+{
+    memcpy(g_audio + 2 * g_audio_frames, data, frames * 2 * sizeof(int16_t));
+    g_audio_frames += frames;
+    return frames;
+}
+static void audio_cb(int16_t l, int16_t r) { (void)l; (void)r; }
+static void input_poll_cb(void) {}
+static int16_t input_state_cb(unsigned port, unsigned device,
+                              unsigned index, unsigned id)
+{
+    (void)index;
+    if (device == RETRO_DEVICE_JOYPAD && id == RETRO_DEVICE_ID_JOYPAD_MASK)
+        return script(g_frame, port);
+    return 0;
+}
+
+static struct {
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+    void (*run)(void);
+    size_t (*serialize_size)(void);
+    bool (*serialize)(void*, size_t);
+    bool (*unserialize)(const void*, size_t);
+    bool (*run_frames)(struct stella2014_run*);
+    void *(*get_memory_data)(unsigned);
+} c;
+
+static struct retro_game_info g_game;
+
+static void reload(void)
+{
+    c.unload_game();
+    if (!c.load_game(&g_game))
+    { fprintf(stderr, "load failed\n"); exit(1); }
+    g_frame = 0;
+    g_audio_frames = 0;
+}
+
+static uint8_t *snapshot(size_t *size)
+{
+    uint8_t *st;
+    *size = c.serialize_size();
+    st = (uint8_t*)malloc(*size);
+    if (!st || !c.serialize(st, *size))
+    { fprintf(stderr, "serialize failed\n"); exit(1); }
+    return st;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t rom[4096];
+    static int16_t ref_audio[FRAMES * 1024 * 2];
+    static int16_t batch_audio[FRAMES * 1024 * 2];
+    static struct stella2014_input_frame input[FRAMES];
+    struct stella2014_run run;
+    size_t ref_frames, ref_size, size, mid_size;
+    uint8_t *ref, *st, *mid;
+    uint64_t target;
+    void *so;
+    int i, p, rc = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <core.so>\n", argv[0]);
+        return 1;
+    }
+    so = dlopen(argv[1], RTLD_NOW);
+    if (!so) { fprintf(stderr, "dlopen: %s\n", dlerror()); return 1; }
+
+#define SYM(field, name) \
+    c.field = (__typeof__(c.field))dlsym(so, name); \
+    if (!c.field) { fprintf(stderr, "missing symbol " name "\n"); return 1; }
+    SYM(set_environment,        "retro_set_environment");
+    SYM(set_video_refresh,      "retro_set_video_refresh");
+    SYM(set_audio_sample,       "retro_set_audio_sample");
+    SYM(set_audio_sample_batch, "retro_set_audio_sample_batch");
+    SYM(set_input_poll,         "retro_set_input_poll");
+    SYM(set_input_state,        "retro_set_input_state");
+    SYM(init,                   "retro_init");
+    SYM(deinit,                 "retro_deinit");
+    SYM(load_game,              "retro_load_game");
+    SYM(unload_game,            "retro_unload_game");
+    SYM(run,                    "retro_run");
+    SYM(serialize_size,         "retro_serialize_size");
+    SYM(serialize,              "retro_serialize");
+    SYM(unserialize,            "retro_unserialize");
+    SYM(run_frames,             "stella2014_run_frames");
+    SYM(get_memory_data,        "retro_get_memory_data");
+#undef SYM
+
+    build_rom(rom, rom_code, sizeof(rom_code));
+    c.set_environment(env_cb);
+    c.set_video_refresh(video_cb);
+    c.set_audio_sample(audio_cb);
+    c.set_audio_sample_batch(audio_batch_cb);
+    c.set_input_poll(input_poll_cb);
+    c.set_input_state(input_state_cb);
+    c.init();
+
+    g_game.path = "embedded.a26";
+    g_game.data = rom;
+    g_game.size = sizeof(rom);
+    g_game.meta = NULL;
+    if (!c.load_game(&g_game))
+    { fprintf(stderr, "load failed\n"); return 1; }
+
+    /* Reference: FRAMES frames through retro_run() */
+    reload();
+    for (g_frame = 0; g_frame < FRAMES; g_frame++)
+        c.run();
+    ref_frames = g_audio_frames;
+    memcpy(ref_audio, g_audio, ref_frames * 2 * sizeof(int16_t));
+    ref = snapshot(&ref_size);
+
+    /* 1. the same frames as one batch, input from a buffer */
+    for (i = 0; i < FRAMES; i++)
+        for (p = 0; p < 4; p++)
+            input[i].joypad[p] = script(i, p);
+
+    reload();
+    memset(&run, 0, sizeof(run));
+    run.frames         = FRAMES;
+    run.input          = input;
+    run.audio          = batch_audio;
+    run.audio_capacity = FRAMES * 1024;
+    if (!c.run_frames(&run) || run.frames_run != FRAMES || run.partial)
+    { fprintf(stderr, "batch run failed\n"); return 1; }
+    st = snapshot(&size);
+    if (g_audio_frames != 0)
+    { fprintf(stderr, "audio callback called without RUN_AUDIO\n"); rc = 1; }
+    if (run.audio_frames != ref_frames ||
+        memcmp(batch_audio, ref_audio, ref_frames * 2 * sizeof(int16_t)))
+    { fprintf(stderr, "batch audio differs from retro_run\n"); rc = 1; }
+    if (size != ref_size || memcmp(st, ref, size))
+    { fprintf(stderr, "batch state differs from retro_run\n"); rc = 1; }
+    else
+        printf("batch of %d frames: %u audio frames, state IDENTICAL\n",
+               FRAMES, (unsigned)run.audio_frames);
+    free(st);
+
+    /* 2. stop mid-frame on a cycle target, then finish with retro_run */
+    reload();
+    memset(&run, 0, sizeof(run));
+    run.frames = FRAMES / 2;
+    run.input  = input;
+    c.run_frames(&run);
+    target = run.cycle + 12345;
+    memset(&run, 0, sizeof(run));
+    run.until_cycle = target;
+    run.flags       = STELLA2014_RUN_AUDIO;
+    if (!c.run_frames(&run) || !run.partial || run.frames_run != 0 ||
+        run.cycle < target || run.cycle > target + 76 + 7)
+    {
+        fprintf(stderr, "cycle target %llu: stopped at %llu (%u frames)\n",
+                (unsigned long long)target, (unsigned long long)run.cycle,
+                run.frames_run);
+        rc = 1;
+    }
+    mid = snapshot(&mid_size);
+    g_audio_frames = 0;
+    for (g_frame = FRAMES / 2; g_frame < FRAMES; g_frame++)
+        c.run();
+    st = snapshot(&size);
+    if (size != ref_size || memcmp(st, ref, size) ||
+        memcmp(g_audio, ref_audio + (ref_frames - g_audio_frames) * 2,
+               g_audio_frames * 2 * sizeof(int16_t)))
+    { fprintf(stderr, "split frame differs from retro_run\n"); rc = 1; }
+    else
+        printf("cycle target: stopped %u cycles past it, state IDENTICAL\n",
+               (unsigned)(run.cycle - target));
+    free(st);
+
+    /* 3. load the mid-frame state and finish the frame again */
+    if (!c.unserialize(mid, mid_size))
+    { fprintf(stderr, "unserialize failed\n"); return 1; }
+    g_audio_frames = 0;
+    for (g_frame = FRAMES / 2; g_frame < FRAMES; g_frame++)
+        c.run();
+    st = snapshot(&size);
+    if (size != ref_size || memcmp(st, ref, size) ||
+        memcmp(g_audio, ref_audio + (ref_frames - g_audio_frames) * 2,
+               g_audio_frames * 2 * sizeof(int16_t)))
+    { fprintf(stderr, "mid-frame state differs after loading\n"); rc = 1; }
+    else
+        printf("mid-frame state: %u bytes, round trip IDENTICAL\n",
+               (unsigned)mid_size);
+    free(st);
+    free(mid);
+
+    /* 4. stop on a scanline, then on the first one */
+    memset(&run, 0, sizeof(run));
+    run.frames         = 2;
+    run.until_scanline = 100;
+    run.flags          = STELLA2014_RUN_UNTIL_SCANLINE;
+    if (!c.run_frames(&run) || !run.partial || run.scanline != 100)
+    {
+        fprintf(stderr, "scanline target: stopped on line %u\n", run.scanline);
+        rc = 1;
+    }
+    else
+        printf("scanline target: stopped on line %u\n", run.scanline);
+    run.until_scanline = 0;
+    if (!c.run_frames(&run) || !run.partial || run.scanline != 0 ||
+        run.frames_run != 1)
+    {
+        fprintf(stderr, "scanline target 0: stopped on line %u after %u "
+                "frames\n", run.scanline, run.frames_run);
+        rc = 1;
+    }
+    else
+        printf("scanline target: stopped on line 0 of the next frame\n");
+
+    /* 6. (before the timer kernel replaces this one) a small buffer */
+    {
+        size_t frame_audio;
+
+        reload();
+        memset(&run, 0, sizeof(run));
+        run.frames         = 1;
+        run.audio          = batch_audio;
+        run.audio_capacity = FRAMES * 1024;
+        c.run_frames(&run);
+        frame_audio = run.audio_frames;
+
+        reload();
+        memset(&run, 0, sizeof(run));
+        run.frames         = 5;
+        run.audio          = batch_audio;
+        run.audio_capacity = 100;
+        if (!c.run_frames(&run) || run.frames_run != 1 ||
+            run.audio_frames != 100 ||
+            run.audio_dropped != frame_audio - 100)
+        {
+            fprintf(stderr, "100-frame audio buffer: %u frames run, %u audio "
+                    "frames, %u dropped of %u\n", run.frames_run,
+                    (unsigned)run.audio_frames, (unsigned)run.audio_dropped,
+                    (unsigned)frame_audio);
+            rc = 1;
+        }
+        else
+            printf("full audio buffer: run ended, %u of %u audio frames "
+                   "reported lost\n", (unsigned)run.audio_dropped,
+                   (unsigned)frame_audio);
+    }
+
+    /* 5. stop on the timer, twice */
+    build_rom(rom, timer_code, sizeof(timer_code));
+    reload();
+    {
+        const uint8_t *ram = (const uint8_t*)c.get_memory_data(
+                RETRO_MEMORY_SYSTEM_RAM);
+        uint64_t stops[2];
+        int k;
+
+        for (k = 0; k < 2 && rc == 0; k++)
+        {
+            memset(&run, 0, sizeof(run));
+            run.frames = 2;
+            run.flags  = STELLA2014_RUN_UNTIL_TIMER;
+            if (!c.run_frames(&run) || !run.partial || ram[1] != k ||
+                (ram[0] & 0x80))
+            {
+                fprintf(stderr, "timer target %d: stopped at cycle %llu "
+                        "(%d expiries, TIMINT %02x)\n", k,
+                        (unsigned long long)run.cycle, ram[1], ram[0]);
+                rc = 1;
+                break;
+            }
+            stops[k] = run.cycle;
+
+            /* One pass of the polling loop is 10 cycles, counting 5 more */
+            memset(&run, 0, sizeof(run));
+            run.frames      = 1;
+            run.until_cycle = stops[k] + 16;
+            if (!c.run_frames(&run) || ram[1] != k + 1)
+            {
+                fprintf(stderr, "timer target %d: stopped before the timer "
+                        "expired\n", k);
+                rc = 1;
+            }
+        }
+        if (rc == 0 && (stops[1] - stops[0] < 64 * TIMER_64 ||
+                        stops[1] - stops[0] > 64 * TIMER_64 + 48))
+        {
+            fprintf(stderr, "timer target: stops %llu cycles apart\n",
+                    (unsigned long long)(stops[1] - stops[0]));
+            rc = 1;
+        }
+        if (rc == 0)
+            printf("timer target: stopped at each expiry, %llu cycles "
+                   "apart\n", (unsigned long long)(stops[1] - stops[0]));
+    }
+
+    free(ref);
+    c.unload_game();
+    c.deinit();
+    dlclose(so);
+    if (rc == 0) printf("batch run: ALL PASS\n");
+    return rc;
+}
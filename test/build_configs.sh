@@ -16,7 +16,11 @@
 # cover the THUMB_SUPPORT build separately).
 #
 # Usage: test/build_configs.sh
-# Exit 0 if both configurations compile clean, non-zero otherwise.
+# A third pass compiles the opt-in profiler (STELLA_PROFILE), whose hooks
+# are likewise invisible to the default build, and a fourth the zlib state
+# files (HAVE_ZLIB), which the platform builds leave out.
+#
+# Exit 0 if all configurations compile clean, non-zero otherwise.
 
 set -e
 cd "$(dirname "$0")/.."
@@ -64,8 +68,12 @@ check_config()
 rc=0
 check_config "with THUMB_SUPPORT"    "-DTHUMB_SUPPORT" || rc=1
 check_config "without THUMB_SUPPORT"  ""               || rc=1
+# The profiler hooks (make PROFILE=1) are compiled out everywhere else
+check_config "with STELLA_PROFILE"    "-DTHUMB_SUPPORT -DSTELLA_PROFILE" || rc=1
+# Compressed state files (HAVE_ZLIB) are only built on request
+check_config "with HAVE_ZLIB"         "-DTHUMB_SUPPORT -DHAVE_ZLIB -DWANT_ZLIB" || rc=1
 
 if [ "$rc" -eq 0 ]; then
-    echo "build configs: both configurations compile clean"
+    echo "build configs: all configurations compile clean"
 fi
 exit "$rc"
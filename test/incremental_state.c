@@ -0,0 +1,203 @@
+/* Incremental (dirty-page) savestate test for the stella2014 libretro
+ * core.
+ *
+ * Uses the synthetic 32K CDF image from arm_cart_determinism.c, whose
+ * 32K of ARM RAM is exactly the case incremental states target, and
+ * verifies through the exported stella2014_*_delta entry points that:
+ *
+ *   1. The first incremental state is self-contained and a steady-state
+ *      one is much smaller than a full retro_serialize() state.
+ *   2. The run-ahead pattern (save, run ahead, load the same state back)
+ *      reproduces the post-save output exactly, repeatedly.
+ *   3. A state that was not diffed against the snapshot the core holds
+ *      is rejected instead of being applied on the wrong base.
+ *
+ * Usage: incremental_state <path/to/stella2014_libretro.so>
+ * Exit code 0 on success, 1 on any mismatch or failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include "libretro.h"
+
+/* CDF0 image: see arm_cart_determinism.c */
+static void build_cdf(uint8_t rom[32768])
+{
+    int k;
+    memset(rom, 0x00, 32768);
+    for (k = 0; k < 3; k++)
+    {
+        rom[0x40 + k*4 + 0] = 0x43; /* C */
+        rom[0x40 + k*4 + 1] = 0x44; /* D */
+        rom[0x40 + k*4 + 2] = 0x46; /* F */
+        rom[0x40 + k*4 + 3] = 0x00; /* subversion 0 -> CDF0 */
+    }
+    rom[0x808] = 0x70; rom[0x809] = 0x47;   /* BX LR */
+    rom[0x7FFC] = 0x00; rom[0x7FFD] = 0xF0;
+    rom[0x7FFE] = 0x00; rom[0x7FFF] = 0xF0;
+}
+
+/* - - - libretro plumbing (mirrors determinism_harness) - - - */
+
+static uint64_t g_hash;
+static void hash_bytes(const void *p, size_t n)
+{
+    const uint8_t *b = (const uint8_t*)p;
+    size_t i;
+    for (i = 0; i < n; i++)
+        g_hash = (g_hash ^ b[i]) * 1099511628211ull;  /* FNV-1a */
+}
+static bool env_cb(unsigned cmd, void *data)
+{
+    if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT)
+        return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+    return false;
+}
+static void video_cb(const void *data, unsigned w, unsigned h, size_t pitch)
+{
+    unsigned y;
+    if (!data) return;
+    for (y = 0; y < h; y++)
+        hash_bytes((const uint8_t*)data + y*pitch, w*2);
+}
+static size_t audio_batch_cb(const int16_t *data, size_t frames)
+{
+    hash_bytes(data, frames*2*sizeof(int16_t));
+    return frames;
+}
+static void audio_cb(int16_t l, int16_t r) { (void)l; (void)r; }
+static void input_poll_cb(void) {}
+static int16_t input_state_cb(unsigned a, unsigned b, unsigned c, unsigned d)
+{ (void)a; (void)b; (void)c; (void)d; return 0; }
+
+static struct {
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+    void (*run)(void);
+    size_t (*serialize_size)(void);
+    size_t (*serialize_delta)(void*, size_t);
+    bool (*unserialize_delta)(const void*, size_t);
+} c;
+
+static uint64_t run_frames(int n)
+{
+    int i;
+    g_hash = 1469598103934665603ull;
+    for (i = 0; i < n; i++) c.run();
+    return g_hash;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t cdf[32768];
+    struct retro_game_info gi;
+    void *so;
+    uint8_t *st, *stale;
+    size_t full, cap, first, sz, stale_sz;
+    uint64_t h1, h2;
+    int i, rc = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <core.so>\n", argv[0]);
+        return 1;
+    }
+    so = dlopen(argv[1], RTLD_NOW);
+    if (!so) { fprintf(stderr, "dlopen: %s\n", dlerror()); return 1; }
+
+#define SYM(field, name) \
+    c.field = (__typeof__(c.field))dlsym(so, name); \
+    if (!c.field) { fprintf(stderr, "missing symbol " name "\n"); return 1; }
+    SYM(set_environment,        "retro_set_environment");
+    SYM(set_video_refresh,      "retro_set_video_refresh");
+    SYM(set_audio_sample,       "retro_set_audio_sample");
+    SYM(set_audio_sample_batch, "retro_set_audio_sample_batch");
+    SYM(set_input_poll,         "retro_set_input_poll");
+    SYM(set_input_state,        "retro_set_input_state");
+    SYM(init,                   "retro_init");
+    SYM(deinit,                 "retro_deinit");
+    SYM(load_game,              "retro_load_game");
+    SYM(unload_game,            "retro_unload_game");
+    SYM(run,                    "retro_run");
+    SYM(serialize_size,         "retro_serialize_size");
+    SYM(serialize_delta,        "stella2014_serialize_delta");
+    SYM(unserialize_delta,      "stella2014_unserialize_delta");
+#undef SYM
+
+    build_cdf(cdf);
+    c.set_environment(env_cb);
+    c.set_video_refresh(video_cb);
+    c.set_audio_sample(audio_cb);
+    c.set_audio_sample_batch(audio_batch_cb);
+    c.set_input_poll(input_poll_cb);
+    c.set_input_state(input_state_cb);
+    c.init();
+
+    gi.path = "embedded.a26";
+    gi.data = cdf;
+    gi.size = sizeof(cdf);
+    gi.meta = NULL;
+    if (!c.load_game(&gi))
+    { fprintf(stderr, "CDF: load failed\n"); return 1; }
+
+    run_frames(120);
+
+    full  = c.serialize_size();
+    cap   = full + full / 256 + 64;
+    st    = (uint8_t*)malloc(cap);
+    stale = (uint8_t*)malloc(cap);
+    if (!st || !stale) return 1;
+
+    /* 1. self-contained first state, small steady-state states */
+    first = c.serialize_delta(st, cap);
+    run_frames(1);
+    stale_sz = c.serialize_delta(stale, cap);
+    run_frames(1);
+    sz = c.serialize_delta(st, cap);
+    printf("full %u bytes, first incremental %u, steady-state %u\n",
+           (unsigned)full, (unsigned)first, (unsigned)sz);
+    if (first < full || sz == 0 || sz * 4 > full)
+    { fprintf(stderr, "unexpected incremental state size\n"); rc = 1; }
+
+    /* 2. run-ahead: save, run ahead, load the same state back */
+    for (i = 0; i < 8 && rc == 0; i++)
+    {
+        sz = c.serialize_delta(st, cap);
+        h1 = run_frames(2);
+        if (!c.unserialize_delta(st, sz))
+        { fprintf(stderr, "run-ahead load %d failed\n", i); rc = 1; break; }
+        h2 = run_frames(2);
+        if (h1 != h2)
+        {
+            fprintf(stderr, "run-ahead %d: %016llx vs %016llx MISMATCH\n", i,
+                    (unsigned long long)h1, (unsigned long long)h2);
+            rc = 1;
+        }
+    }
+    if (rc == 0) printf("run-ahead round trips: DETERMINISTIC\n");
+
+    /* 3. a state diffed against an older snapshot must be refused */
+    if (c.unserialize_delta(stale, stale_sz))
+    { fprintf(stderr, "stale incremental state was accepted\n"); rc = 1; }
+    else
+        printf("stale incremental state: rejected\n");
+
+    free(st);
+    free(stale);
+    c.unload_game();
+    c.deinit();
+    dlclose(so);
+
+    if (rc == 0) printf("incremental state: ALL PASS\n");
+    return rc;
+}
@@ -0,0 +1,254 @@
+/* Legacy savestate test for the stella2014 libretro core.
+ *
+ * The files test/legacy_*.state were saved by the core as it was before
+ * the cycle counts became 64-bit (their header reads "03090100state"),
+ * each after 120 frames of a test ROM: the determinism-test kernel (see
+ * determinism_harness.c) and the synthetic CDF and BUS images (see
+ * arm_cart_determinism.c). This loads each into the core under test
+ * and verifies that:
+ *
+ *   1. The state is accepted.
+ *   2. The 60 frames that follow hash, audio and video, to what that
+ *      core produced after saving it (the post-save hashes the other
+ *      two tests print), so the old 32-bit counts were converted
+ *      without moving anything.
+ *
+ * Usage: legacy_state <path/to/stella2014_libretro.so> [--save]
+ * With --save, writes the files from the given core instead, which is
+ * how they were made (from the core before the 64-bit cycle counts).
+ * Exit code 0 on success, 1 on any mismatch or failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include "libretro.h"
+
+#define WARMUP  120
+#define FRAMES  60
+
+/* Embedded 4K test ROM: see determinism_harness.c */
+static const uint8_t rom_code[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,
+    0xE8, 0xA9, 0x02, 0x85, 0x00, 0x85, 0x02, 0x85, 0x02, 0x85, 0x02,
+    0xA9, 0x00, 0x85, 0x00, 0xA9, 0x04, 0x85, 0x15, 0xA9, 0x0F, 0x85,
+    0x19, 0x8A, 0x85, 0x17, 0x85, 0x09, 0xA0, 0x00,
+    0x85, 0x02, 0x88, 0xD0, 0xFB, 0x4C, 0x05, 0xF0,
+};
+
+static void build_4k(uint8_t *rom)
+{
+    memset(rom, 0xFF, 4096);
+    memcpy(rom, rom_code, sizeof(rom_code));
+    rom[0xFFA] = 0x00; rom[0xFFB] = 0xF0;
+    rom[0xFFC] = 0x00; rom[0xFFD] = 0xF0;
+    rom[0xFFE] = 0x00; rom[0xFFF] = 0xF0;
+}
+
+/* CDF0 and BUS1 images: see arm_cart_determinism.c */
+static void build_cdf(uint8_t *rom)
+{
+    int k;
+    memset(rom, 0x00, 32768);
+    for (k = 0; k < 3; k++)
+        memcpy(rom + 0x40 + k*4, "CDF\0", 4);
+    rom[0x808] = 0x70; rom[0x809] = 0x47;   /* BX LR */
+    rom[0x7FFC] = 0x00; rom[0x7FFD] = 0xF0;
+    rom[0x7FFE] = 0x00; rom[0x7FFF] = 0xF0;
+}
+
+static void build_bus(uint8_t *rom)
+{
+    memset(rom, 0x00, 32768);
+    memcpy(rom + 0x7f4, "BUS\0", 4);
+    memcpy(rom + 0x100, "BUS", 3);
+    memcpy(rom + 0x200, "BUS", 3);
+    rom[0x808] = 0x70; rom[0x809] = 0x47;   /* BX LR */
+    rom[0x7FFC] = 0x00; rom[0x7FFD] = 0xF0;
+    rom[0x7FFE] = 0x00; rom[0x7FFF] = 0xF0;
+}
+
+static const struct {
+    const char *label;
+    const char *file;
+    void (*build)(uint8_t*);
+    size_t rom_size;
+    uint64_t hash;
+} carts[] = {
+    { "4K",  "test/legacy_4k.state",  build_4k,  4096,
+      0xd4b33898fa1a29efull },
+    { "CDF", "test/legacy_cdf.state", build_cdf, 32768,
+      0x3d491e20cad6f423ull },
+    { "BUS", "test/legacy_bus.state", build_bus, 32768,
+      0x73d36ab8a3442973ull },
+};
+
+static uint64_t g_hash;
+static void hash_bytes(const void *p, size_t n)
+{
+    const uint8_t *b = (const uint8_t*)p;
+    size_t i;
+    for (i = 0; i < n; i++)
+        g_hash = (g_hash ^ b[i]) * 1099511628211ull;  /* FNV-1a */
+}
+
+static bool env_cb(unsigned cmd, void *data)
+{
+    if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT)
+        return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+    return false;
+}
+static void video_cb(const void *data, unsigned w, unsigned h, size_t pitch)
+{
+    unsigned y;
+    if (!data) return;
+    for (y = 0; y < h; y++)
+        hash_bytes((const uint8_t*)data + y*pitch, w*2);
+}
+static size_t audio_batch_cb(const int16_t *data, size_t frames)
+{
+    hash_bytes(data, frames*2*sizeof(int16_t));
+    return frames;
+}
+static void audio_cb(int16_t l, int16_t r) { (void)l; (void)r; }
+static void input_poll_cb(void) {}
+static int16_t input_state_cb(unsigned a, unsigned b, unsigned c, unsigned d)
+{ (void)a; (void)b; (void)c; (void)d; return 0; }
+
+static struct {
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+    void (*run)(void);
+    size_t (*serialize_size)(void);
+    bool (*serialize)(void*, size_t);
+    bool (*unserialize)(const void*, size_t);
+} c;
+
+/* Saves the state after WARMUP frames to the cart's file */
+static int save_one(int i)
+{
+    size_t size;
+    uint8_t *st;
+    FILE *f;
+    int n, rc = 1;
+
+    for (n = 0; n < WARMUP; n++) c.run();
+    size = c.serialize_size();
+    st = (uint8_t*)malloc(size);
+    f = fopen(carts[i].file, "wb");
+    if (st && f && c.serialize(st, size) && fwrite(st, 1, size, f) == size)
+    {
+        printf("%s: wrote %s (%u bytes)\n", carts[i].label, carts[i].file,
+               (unsigned)size);
+        rc = 0;
+    }
+    else
+        fprintf(stderr, "%s: couldn't write %s\n", carts[i].label,
+                carts[i].file);
+    if (f) fclose(f);
+    free(st);
+    return rc;
+}
+
+/* Loads the cart's file and checks the frames that follow it */
+static int load_one(int i)
+{
+    static uint8_t st[65536];
+    size_t size;
+    FILE *f;
+    int n;
+
+    f = fopen(carts[i].file, "rb");
+    size = f ? fread(st, 1, sizeof(st), f) : 0;
+    if (f) fclose(f);
+    if (size == 0)
+    { fprintf(stderr, "%s: can't read %s\n", carts[i].label, carts[i].file);
+      return 1; }
+    if (memcmp(st + 4, "03090100state", 13) != 0)
+    { fprintf(stderr, "%s: not a legacy state\n", carts[i].label); return 1; }
+
+    if (!c.unserialize(st, size))
+    { fprintf(stderr, "%s: legacy state refused\n", carts[i].label);
+      return 1; }
+
+    g_hash = 1469598103934665603ull;
+    for (n = 0; n < FRAMES; n++) c.run();
+    printf("%s: %u-byte legacy state loads, then %016llx  %s\n",
+           carts[i].label, (unsigned)size, (unsigned long long)g_hash,
+           g_hash == carts[i].hash ? "MATCHES" : "MISMATCH");
+    return g_hash == carts[i].hash ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t rom[32768];
+    struct retro_game_info gi;
+    void *so;
+    int save, i, rc = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <core.so> [--save]\n", argv[0]);
+        return 1;
+    }
+    save = argc >= 3 && strcmp(argv[2], "--save") == 0;
+    so = dlopen(argv[1], RTLD_NOW);
+    if (!so) { fprintf(stderr, "dlopen: %s\n", dlerror()); return 1; }
+
+#define SYM(field, name) \
+    c.field = (__typeof__(c.field))dlsym(so, name); \
+    if (!c.field) { fprintf(stderr, "missing symbol " name "\n"); return 1; }
+    SYM(set_environment,        "retro_set_environment");
+    SYM(set_video_refresh,      "retro_set_video_refresh");
+    SYM(set_audio_sample,       "retro_set_audio_sample");
+    SYM(set_audio_sample_batch, "retro_set_audio_sample_batch");
+    SYM(set_input_poll,         "retro_set_input_poll");
+    SYM(set_input_state,        "retro_set_input_state");
+    SYM(init,                   "retro_init");
+    SYM(deinit,                 "retro_deinit");
+    SYM(load_game,              "retro_load_game");
+    SYM(unload_game,            "retro_unload_game");
+    SYM(run,                    "retro_run");
+    SYM(serialize_size,         "retro_serialize_size");
+    SYM(serialize,              "retro_serialize");
+    SYM(unserialize,            "retro_unserialize");
+#undef SYM
+
+    c.set_environment(env_cb);
+    c.set_video_refresh(video_cb);
+    c.set_audio_sample(audio_cb);
+    c.set_audio_sample_batch(audio_batch_cb);
+    c.set_input_poll(input_poll_cb);
+    c.set_input_state(input_state_cb);
+    c.init();
+
+    for (i = 0; i < (int)(sizeof(carts) / sizeof(carts[0])); i++)
+    {
+        carts[i].build(rom);
+        gi.path = "embedded.a26";
+        gi.data = rom;
+        gi.size = carts[i].rom_size;
+        gi.meta = NULL;
+        if (!c.load_game(&gi))
+        { fprintf(stderr, "%s: load failed\n", carts[i].label); rc = 1;
+          continue; }
+        if (save ? save_one(i) : load_one(i))
+            rc = 1;
+        c.unload_game();
+    }
+
+    c.deinit();
+    dlclose(so);
+
+    if (rc == 0 && !save) printf("legacy states: ALL PASS\n");
+    return rc;
+}
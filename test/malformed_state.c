@@ -10,9 +10,14 @@
  * This exercises three families of malformed buffers built from a valid
  * state: every truncation length, buffers of random bytes, and valid
  * states with a handful of bytes corrupted. After each, the core is run
- * a few frames; at the end a known-good state is reloaded to confirm
- * recovery. Exit code is non-zero only on a genuine crash or a failed
- * recovery load.
+ * a few frames; then saving into buffers that are too small is checked
+ * to fail without writing past them, and a state without checksums (as
+ * saved for run-ahead) whose inline sound fragment claims more samples
+ * than the buffer holds is checked to be refused without keeping the
+ * count. At the end a known-good state is reloaded to confirm recovery.
+ * Exit code is non-zero only on a genuine crash, a short save that
+ * succeeds or overruns, a bad sample count that loads or sticks, or a
+ * failed recovery load.
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,12 +26,39 @@
 #include <dlfcn.h>
 #include "libretro.h"
 
+static int g_context = RETRO_SAVESTATE_CONTEXT_NORMAL;
+
 static bool env_cb(unsigned cmd, void *data)
 {
     if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT)
         return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+    if (cmd == RETRO_ENVIRONMENT_GET_SAVESTATE_CONTEXT)
+    {
+        *(enum retro_savestate_context*)data =
+            (enum retro_savestate_context)g_context;
+        return true;
+    }
     return false;
 }
+
+/* Offset of the inline sample count in a state: the TIA's sound saves
+ * its name, the TIASound generator (42 bytes), two cycle counts, the
+ * queued register writes (a count, then 9 bytes each), the inline flag
+ * and clock, and the count */
+static size_t inline_count_offset(const uint8_t *st, size_t size)
+{
+    static const uint8_t name[] = { 8, 0, 0, 0, 'T','I','A','S','o','u','n','d' };
+    for (size_t i = 0; i + sizeof(name) + 58 + 4 <= size; i++)
+        if (memcmp(st + i, name, sizeof(name)) == 0)
+        {
+            size_t at = i + sizeof(name) + 42 + 16;
+            uint32_t n;
+            memcpy(&n, st + at, 4);
+            at += 4 + 9 * (size_t)n + 1 + 8;
+            return at + 4 <= size ? at : 0;
+        }
+    return 0;
+}
 static void video_cb(const void *d, unsigned w, unsigned h, size_t p) {}
 static size_t audio_batch_cb(const int16_t *d, size_t f) { return f; }
 static void audio_cb(int16_t l, int16_t r) {}
@@ -115,6 +147,50 @@ int main(int argc, char **argv)
     }
     printf("bitflips:   %d/%d ok\n", ok, total);
 
+    /* 4. saving into a buffer too small must fail, never overrun it */
+    ok = total = 0;
+    for (size_t n = 0; n < sz; n += (sz/97)+1)
+    {
+        memset(bad, 0xA5, sz);
+        total++;
+        if (p_retro_serialize(bad, n))
+        { printf("short save of %u bytes succeeded\n", (unsigned)n); return 1; }
+        for (size_t i = n; i < sz; i++)
+            if (bad[i] != 0xA5)
+            { printf("short save overran %u bytes\n", (unsigned)n); return 1; }
+        ok++;
+    }
+    if (p_retro_serialize(bad, sz - 1))
+    { printf("save of %u bytes succeeded\n", (unsigned)(sz - 1)); return 1; }
+    if (!p_retro_serialize(bad, sz))
+    { printf("save of %u bytes failed\n", (unsigned)sz); return 1; }
+    printf("short save: %d/%d ok\n", ok, total);
+
+    /* 5. an inline sample count past the buffer, in a state no checksum
+     * guards, must be refused and not kept: the next state would be sized
+     * from it */
+    g_context = RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE;
+    if (!p_retro_serialize(bad, sz)) { printf("run-ahead save failed\n"); return 1; }
+    size_t at = inline_count_offset(bad, sz);
+    if (!at) { printf("inline sample count not found\n"); return 1; }
+    static const uint32_t counts[] = { 1025, 0x10000, 0xFFFFFFFFu };
+    for (int t = 0; t < 3; t++)
+    {
+        uint8_t *copy = malloc(sz);
+        memcpy(copy, bad, sz);
+        memcpy(copy + at, &counts[t], 4);
+        if (p_retro_unserialize(copy, sz))
+        { printf("inline sample count %u loaded\n", counts[t]); return 1; }
+        if (p_retro_serialize_size() != sz)
+        { printf("inline sample count %u kept\n", counts[t]); return 1; }
+        for (int i = 0; i < 3; i++) p_retro_run();
+        if (!p_retro_serialize(copy, sz))
+        { printf("save after inline sample count %u failed\n", counts[t]); return 1; }
+        free(copy);
+    }
+    g_context = RETRO_SAVESTATE_CONTEXT_NORMAL;
+    printf("sample count: refused\n");
+
     /* recovery: a good state must still load and run */
     if (!p_retro_unserialize(good, sz)) { printf("recovery load FAILED\n"); return 1; }
     for (int i = 0; i < 30; i++) p_retro_run();
@@ -0,0 +1,260 @@
+/* Profiler harness for the stella2014 libretro core.
+ *
+ * Runs a ROM (the embedded determinism-test kernel by default) for a
+ * number of frames and prints the profile collected by a core built
+ * with PROFILE=1, as CSV on stdout. With a core built without the
+ * profiler it only reports that and exits successfully, so it can be
+ * run against every build.
+ *
+ * Along the way it checks that the dump is self-consistent:
+ *
+ *   1. The 6502 cycles summed over all (bank, address) records equal
+ *      the cycles summed over all frame records.
+ *   2. In the embedded kernel the scanline loop ($F023: STA WSYNC /
+ *      DEY / BNE) is where nearly all of the time goes.
+ *   3. The binary dump's header agrees with its size and the CSVs.
+ *
+ * Usage: profile_dump <path/to/stella2014_libretro.so> [rom|-] [frames]
+ *                     [-q]
+ *   -q  only run the checks, don't print the CSVs
+ * Exit code 0 on success, 1 on any inconsistency or failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include "libretro.h"
+#include "../libretro_ext.h"
+
+/* Embedded 4K test ROM: see determinism_harness.c */
+static const uint8_t rom_code[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,
+    0xE8, 0xA9, 0x02, 0x85, 0x00, 0x85, 0x02, 0x85, 0x02, 0x85, 0x02,
+    0xA9, 0x00, 0x85, 0x00, 0xA9, 0x04, 0x85, 0x15, 0xA9, 0x0F, 0x85,
+    0x19, 0x8A, 0x85, 0x17, 0x85, 0x09, 0xA0, 0x00,
+    0x85, 0x02, 0x88, 0xD0, 0xFB, 0x4C, 0x05, 0xF0,
+};
+
+static void build_rom(uint8_t rom[4096])
+{
+    memset(rom, 0xFF, 4096);
+    memcpy(rom, rom_code, sizeof(rom_code));
+    rom[0xFFA] = 0x00; rom[0xFFB] = 0xF0;
+    rom[0xFFC] = 0x00; rom[0xFFD] = 0xF0;
+    rom[0xFFE] = 0x00; rom[0xFFF] = 0xF0;
+}
+
+static bool env_cb(unsigned cmd, void *data)
+{
+    if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT)
+        return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+    return false;
+}
+static void video_cb(const void *d, unsigned w, unsigned h, size_t p)
+{ (void)d; (void)w; (void)h; (void)p; }
+static size_t audio_batch_cb(const int16_t *d, size_t frames)
+{ (void)d; return frames; }
+static void audio_cb(int16_t l, int16_t r) { (void)l; (void)r; }
+static void input_poll_cb(void) {}
+static int16_t input_state_cb(unsigned a, unsigned b, unsigned c, unsigned d)
+{ (void)a; (void)b; (void)c; (void)d; return 0; }
+
+static struct {
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+    void (*run)(void);
+    size_t (*profile_dump)(void*, size_t, unsigned);
+    void (*profile_reset)(void);
+} c;
+
+/* Returns a NUL-terminated dump in a malloc()ed buffer, or NULL */
+static char *dump(unsigned format, size_t *size)
+{
+    char *buf;
+    *size = c.profile_dump(NULL, 0, format);
+    if (*size == 0)
+        return NULL;
+    buf = (char*)malloc(*size + 1);
+    if (!buf || c.profile_dump(buf, *size, format) != *size)
+    { free(buf); return NULL; }
+    buf[*size] = 0;
+    return buf;
+}
+
+static uint64_t le(const uint8_t *p, int bytes)
+{
+    uint64_t v = 0;
+    while (bytes--) v = (v << 8) | p[bytes];
+    return v;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t rom[4096];
+    struct retro_game_info gi;
+    void *so;
+    const char *rom_path = NULL;
+    char *pcs, *frames, *line;
+    uint8_t *bin, *file_data = NULL;
+    size_t pcs_size, frames_size, bin_size;
+    unsigned long long pc_cycles = 0, frame_cycles = 0, loop_cycles = 0;
+    unsigned pc_records = 0, frame_records = 0;
+    int nframes = 600, quiet = 0, i, rc = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <core.so> [rom|-] [frames] [-q]\n",
+                argv[0]);
+        return 1;
+    }
+    for (i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-q"))          quiet = 1;
+        else if (i == 2 && strcmp(argv[i], "-")) rom_path = argv[i];
+        else if (i == 3)                     nframes = atoi(argv[i]);
+    }
+
+    so = dlopen(argv[1], RTLD_NOW);
+    if (!so) { fprintf(stderr, "dlopen: %s\n", dlerror()); return 1; }
+
+#define SYM(field, name) \
+    c.field = (__typeof__(c.field))dlsym(so, name); \
+    if (!c.field) { fprintf(stderr, "missing symbol " name "\n"); return 1; }
+    SYM(set_environment,        "retro_set_environment");
+    SYM(set_video_refresh,      "retro_set_video_refresh");
+    SYM(set_audio_sample,       "retro_set_audio_sample");
+    SYM(set_audio_sample_batch, "retro_set_audio_sample_batch");
+    SYM(set_input_poll,         "retro_set_input_poll");
+    SYM(set_input_state,        "retro_set_input_state");
+    SYM(init,                   "retro_init");
+    SYM(deinit,                 "retro_deinit");
+    SYM(load_game,              "retro_load_game");
+    SYM(unload_game,            "retro_unload_game");
+    SYM(run,                    "retro_run");
+    SYM(profile_dump,           "stella2014_profile_dump");
+    SYM(profile_reset,          "stella2014_profile_reset");
+#undef SYM
+
+    c.set_environment(env_cb);
+    c.set_video_refresh(video_cb);
+    c.set_audio_sample(audio_cb);
+    c.set_audio_sample_batch(audio_batch_cb);
+    c.set_input_poll(input_poll_cb);
+    c.set_input_state(input_state_cb);
+    c.init();
+
+    gi.path = "embedded.a26";
+    gi.data = rom;
+    gi.size = sizeof(rom);
+    gi.meta = NULL;
+    if (rom_path)
+    {
+        FILE *f = fopen(rom_path, "rb");
+        long n;
+        if (!f) { fprintf(stderr, "cannot open %s\n", rom_path); return 1; }
+        fseek(f, 0, SEEK_END);
+        n = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        file_data = (uint8_t*)malloc(n > 0 ? n : 1);
+        if (!file_data || fread(file_data, 1, n, f) != (size_t)n)
+        { fprintf(stderr, "cannot read %s\n", rom_path); return 1; }
+        fclose(f);
+        gi.path = rom_path;
+        gi.data = file_data;
+        gi.size = n;
+    }
+    else
+        build_rom(rom);
+
+    if (!c.load_game(&gi))
+    { fprintf(stderr, "load failed\n"); return 1; }
+
+    /* Leave the startup frames out of the profile */
+    for (i = 0; i < 10; i++) c.run();
+    c.profile_reset();
+    for (i = 0; i < nframes; i++) c.run();
+
+    if (c.profile_dump(NULL, 0, STELLA2014_PROFILE_BINARY) == 0)
+    {
+        printf("profiler not built in (build with PROFILE=1): skipping\n");
+        goto done;
+    }
+
+    pcs    = dump(STELLA2014_PROFILE_INSTRUCTIONS_CSV, &pcs_size);
+    frames = dump(STELLA2014_PROFILE_FRAMES_CSV, &frames_size);
+    bin    = (uint8_t*)dump(STELLA2014_PROFILE_BINARY, &bin_size);
+    if (!pcs || !frames || !bin)
+    { fprintf(stderr, "profile dump failed\n"); return 1; }
+
+    /* 1. cycles per address add up to cycles per frame */
+    for (line = strchr(pcs, '\n'); line && line[1]; line = strchr(line + 1, '\n'))
+    {
+        unsigned bank, pc;
+        unsigned long long n, cyc;
+        if (sscanf(line + 1, "%u,%x,%llu,%llu", &bank, &pc, &n, &cyc) != 4)
+        { fprintf(stderr, "bad instruction line\n"); rc = 1; break; }
+        pc_cycles += cyc;
+        if (!rom_path && pc >= 0x1023 && pc <= 0x1026)
+            loop_cycles += cyc;
+        pc_records++;
+    }
+    for (line = strchr(frames, '\n'); line && line[1]; line = strchr(line + 1, '\n'))
+    {
+        unsigned long long f, cyc, tia, thumb, snd;
+        if (sscanf(line + 1, "%llu,%llu,%llu,%llu,%llu",
+                   &f, &cyc, &tia, &thumb, &snd) != 5)
+        { fprintf(stderr, "bad frame line\n"); rc = 1; break; }
+        frame_cycles += cyc;
+        frame_records++;
+    }
+    if (frame_records != (unsigned)(nframes < 4096 ? nframes : 4096))
+    { fprintf(stderr, "%u frame records for %d frames\n", frame_records, nframes); rc = 1; }
+    if (nframes <= 4096 && pc_cycles != frame_cycles)
+    {
+        fprintf(stderr, "cycles: %llu by address vs %llu by frame\n",
+                pc_cycles, frame_cycles);
+        rc = 1;
+    }
+
+    /* 2. the embedded kernel spends its time in the scanline loop */
+    if (!rom_path && loop_cycles * 10 < pc_cycles * 9)
+    {
+        fprintf(stderr, "scanline loop has only %llu of %llu cycles\n",
+                loop_cycles, pc_cycles);
+        rc = 1;
+    }
+
+    /* 3. binary header matches the CSVs and the dump size */
+    if (memcmp(bin, "S14P", 4) || le(bin + 4, 4) != 1 ||
+        le(bin + 8, 4) != pc_records || le(bin + 12, 4) != frame_records ||
+        bin_size != 16 + 24 * (size_t)pc_records + 40 * (size_t)frame_records)
+    { fprintf(stderr, "binary dump does not match\n"); rc = 1; }
+
+    if (!quiet)
+    {
+        fputs(pcs, stdout);
+        fputs(frames, stdout);
+    }
+    if (rc == 0)
+        printf("profile: %u addresses, %u frames, %llu cycles: CONSISTENT\n",
+               pc_records, frame_records, pc_cycles);
+
+    free(pcs);
+    free(frames);
+    free(bin);
+done:
+    c.unload_game();
+    c.deinit();
+    dlclose(so);
+    free(file_data);
+    return rc;
+}
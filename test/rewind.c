@@ -0,0 +1,366 @@
+/* In-core rewind test for the stella2014 libretro core.
+ *
+ * Runs the embedded determinism-test kernel (see determinism_harness.c)
+ * with scripted input and verifies through the exported rewind entry
+ * points that:
+ *
+ *   1. Going back N frames restores exactly the state saved N frames
+ *      ago, and running on from there draws the same frames again.
+ *   2. The ring never reaches back further than its depth, or than the
+ *      frames its size holds, and still restores exact states after it
+ *      has wrapped around many times.
+ *   3. Turned off, nothing is recorded.
+ *   4. Frames run in a batch (stella2014_run_frames()) are recorded as
+ *      retro_run() records them.
+ *   5. With run-ahead (a state saved after every frame, AHEAD frames
+ *      run and the state loaded back, the frontend answering
+ *      RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE), only the frames
+ *      really run are recorded.
+ *
+ * and reports how many frames a small ring holds.
+ *
+ * Usage: rewind <path/to/stella2014_libretro.so>
+ * Exit code 0 on success, 1 on any mismatch or failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include "libretro.h"
+#include "../libretro_ext.h"
+
+#define FRAMES  100
+#define BACK    30
+#define AHEAD   2
+#define TRAILER 28      /* audio-filter trailer: not rewound */
+
+/* Embedded 4K test ROM: see determinism_harness.c */
+static const uint8_t rom_code[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,
+    0xE8, 0xA9, 0x02, 0x85, 0x00, 0x85, 0x02, 0x85, 0x02, 0x85, 0x02,
+    0xA9, 0x00, 0x85, 0x00, 0xA9, 0x04, 0x85, 0x15, 0xA9, 0x0F, 0x85,
+    0x19, 0x8A, 0x85, 0x17, 0x85, 0x09, 0xA0, 0x00,
+    0x85, 0x02, 0x88, 0xD0, 0xFB, 0x4C, 0x05, 0xF0,
+};
+
+static void build_rom(uint8_t rom[4096])
+{
+    memset(rom, 0xFF, 4096);
+    memcpy(rom, rom_code, sizeof(rom_code));
+    rom[0xFFA] = 0x00; rom[0xFFB] = 0xF0;
+    rom[0xFFC] = 0x00; rom[0xFFD] = 0xF0;
+    rom[0xFFE] = 0x00; rom[0xFFF] = 0xF0;
+}
+
+static int g_frame;
+static uint64_t g_video;
+static int g_context = -1;      /* savestate context, -1 if not answered */
+
+static bool env_cb(unsigned cmd, void *data)
+{
+    if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT)
+        return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+    if (cmd == RETRO_ENVIRONMENT_GET_SAVESTATE_CONTEXT && g_context >= 0)
+    {
+        *(enum retro_savestate_context*)data =
+            (enum retro_savestate_context)g_context;
+        return true;
+    }
+    return false;
+}
+static void video_cb(const void *d, unsigned w, unsigned h, size_t p)
+{
+    const uint8_t *b = (const uint8_t*)d;
+    size_t i;
+
+    g_video = 1469598103934665603ull;
+    for (i = 0; d && i < h * p; i++)
+        g_video = (g_video ^ b[i]) * 1099511628211ull;
+    (void)w;
+}
+static size_t audio_batch_cb(const int16_t *d, size_t f) { (void)d; return f; }
+static void audio_cb(int16_t l, int16_t r) { (void)l; (void)r; }
+static void input_poll_cb(void) {}
+/* Scripted input: a different joypad bitmask on every frame */
+static int16_t input_state_cb(unsigned port, unsigned device, unsigned index,
+                              unsigned id)
+{
+    int16_t bits = (int16_t)(((g_frame * 7 + port * 3) % 13) << 4);
+    (void)device; (void)index;
+    if (id == RETRO_DEVICE_ID_JOYPAD_MASK)
+        return bits;
+    return (bits >> id) & 1;
+}
+
+static struct {
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+    void (*run)(void);
+    size_t (*serialize_size)(void);
+    bool (*serialize)(void*, size_t);
+    bool (*unserialize)(const void*, size_t);
+    bool (*rewind_setup)(unsigned, size_t);
+    unsigned (*rewind)(unsigned);
+    bool (*run_frames)(struct stella2014_run*);
+} c;
+
+static struct retro_game_info g_game;
+
+static void start(void)
+{
+    c.unload_game();
+    if (!c.load_game(&g_game))
+    { fprintf(stderr, "load failed\n"); exit(1); }
+    g_frame = 0;
+}
+
+static void run(int frames)
+{
+    while (frames--)
+    {
+        c.run();
+        g_frame++;
+    }
+}
+
+static uint8_t *snapshot(size_t *size)
+{
+    uint8_t *st;
+    *size = c.serialize_size();
+    st = (uint8_t*)malloc(*size);
+    if (!st || !c.serialize(st, *size))
+    { fprintf(stderr, "serialize failed\n"); exit(1); }
+    return st;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t rom[4096];
+    uint64_t video[BACK];
+    uint8_t *states[FRAMES];
+    size_t state_size[FRAMES];
+    size_t size, ref_size;
+    uint8_t *st, *ref;
+    unsigned n;
+    void *so;
+    int i, rc = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <core.so>\n", argv[0]);
+        return 1;
+    }
+    so = dlopen(argv[1], RTLD_NOW);
+    if (!so) { fprintf(stderr, "dlopen: %s\n", dlerror()); return 1; }
+
+#define SYM(field, name) \
+    c.field = (__typeof__(c.field))dlsym(so, name); \
+    if (!c.field) { fprintf(stderr, "missing symbol " name "\n"); return 1; }
+    SYM(set_environment,        "retro_set_environment");
+    SYM(set_video_refresh,      "retro_set_video_refresh");
+    SYM(set_audio_sample,       "retro_set_audio_sample");
+    SYM(set_audio_sample_batch, "retro_set_audio_sample_batch");
+    SYM(set_input_poll,         "retro_set_input_poll");
+    SYM(set_input_state,        "retro_set_input_state");
+    SYM(init,                   "retro_init");
+    SYM(deinit,                 "retro_deinit");
+    SYM(load_game,              "retro_load_game");
+    SYM(unload_game,            "retro_unload_game");
+    SYM(run,                    "retro_run");
+    SYM(serialize_size,         "retro_serialize_size");
+    SYM(serialize,              "retro_serialize");
+    SYM(unserialize,            "retro_unserialize");
+    SYM(rewind_setup,           "stella2014_rewind_setup");
+    SYM(rewind,                 "stella2014_rewind");
+    SYM(run_frames,             "stella2014_run_frames");
+#undef SYM
+
+    build_rom(rom);
+    c.set_environment(env_cb);
+    c.set_video_refresh(video_cb);
+    c.set_audio_sample(audio_cb);
+    c.set_audio_sample_batch(audio_batch_cb);
+    c.set_input_poll(input_poll_cb);
+    c.set_input_state(input_state_cb);
+    c.init();
+
+    g_game.path = "embedded.a26";
+    g_game.data = rom;
+    g_game.size = sizeof(rom);
+    g_game.meta = NULL;
+    if (!c.load_game(&g_game))
+    { fprintf(stderr, "load failed\n"); return 1; }
+
+    /* 1. */
+    if (!c.rewind_setup(FRAMES, 1 << 20))
+    { fprintf(stderr, "rewind setup failed\n"); return 1; }
+    start();
+    run(FRAMES - BACK);
+    ref = snapshot(&ref_size);
+    for (i = 0; i < BACK; i++)
+    {
+        run(1);
+        video[i] = g_video;
+    }
+    n = c.rewind(BACK);
+    g_frame -= n;
+    st = snapshot(&size);
+    if (n != BACK || size != ref_size ||
+        memcmp(st, ref, size - TRAILER))
+    {
+        fprintf(stderr, "went back %u frames, to a different state\n", n);
+        rc = 1;
+    }
+    free(st);
+    free(ref);
+    for (i = 0; i < BACK && rc == 0; i++)
+    {
+        run(1);
+        if (video[i] != g_video)
+        {
+            fprintf(stderr, "frame %d differs after rewinding\n", i);
+            rc = 1;
+        }
+    }
+    if (rc == 0)
+        printf("back %d frames: state and %d frames after IDENTICAL\n",
+               BACK, BACK);
+
+    /* 2. */
+    c.rewind_setup(10, 1 << 20);
+    start();
+    run(50);
+    n = c.rewind(1000);
+    if (n != 10)
+    { fprintf(stderr, "depth 10 went back %u frames\n", n); rc = 1; }
+
+    /* After the ring has wrapped many times */
+    c.rewind_setup(1000, 2048);
+    start();
+    for (i = 0; i < FRAMES; i++)
+    {
+        run(1);
+        states[i] = snapshot(&state_size[i]);
+    }
+    n = c.rewind(1000);
+    if (n == 0 || n >= FRAMES - 1)
+    { fprintf(stderr, "2K ring went back %u frames\n", n); rc = 1; }
+    else
+    {
+        st = snapshot(&size);
+        if (size != state_size[FRAMES - 1 - n] ||
+            memcmp(st, states[FRAMES - 1 - n], size - TRAILER))
+        { fprintf(stderr, "2K ring went back to a different state\n"); rc = 1; }
+        else
+            printf("2K ring: back %u frames (%u bytes each) IDENTICAL\n",
+                   n, 2048 / n);
+        free(st);
+    }
+    for (i = 0; i < FRAMES; i++)
+        free(states[i]);
+
+    /* 3. */
+    c.rewind_setup(0, 0);
+    start();
+    run(10);
+    if (c.rewind(1) != 0)
+    { fprintf(stderr, "rewound while off\n"); rc = 1; }
+
+    /* 4. */
+    {
+        struct stella2014_run batch;
+
+        c.rewind_setup(FRAMES, 1 << 20);
+        start();
+        run(10);
+        ref = snapshot(&ref_size);
+        memset(&batch, 0, sizeof(batch));
+        batch.frames = BACK;
+        if (!c.run_frames(&batch) || batch.frames_run != BACK)
+        { fprintf(stderr, "batch run failed\n"); return 1; }
+        n = c.rewind(BACK);
+        st = snapshot(&size);
+        if (n != BACK || size != ref_size ||
+            memcmp(st, ref, size - TRAILER))
+        {
+            fprintf(stderr, "went back %u frames of a batch, to a different "
+                    "state\n", n);
+            rc = 1;
+        }
+        else
+            printf("batch of %d frames: recorded and rewound IDENTICAL\n",
+                   BACK);
+        free(st);
+        free(ref);
+    }
+
+    /* 5. */
+    {
+        uint64_t real[BACK];
+        int frame, j;
+
+        c.rewind_setup(FRAMES, 1 << 20);
+        start();
+        ref = NULL;
+        ref_size = 0;
+        for (i = 0; i < 2 * BACK; i++)
+        {
+            run(1);
+            if (i >= BACK)
+                real[i - BACK] = g_video;
+            if (i == BACK - 1)
+                ref = snapshot(&ref_size);
+
+            g_context = RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE;
+            st = snapshot(&size);
+            frame = g_frame;
+            for (j = 0; j < AHEAD; j++)
+                c.run();
+            g_frame = frame;
+            if (!c.unserialize(st, size))
+            { fprintf(stderr, "run-ahead state refused\n"); return 1; }
+            free(st);
+            g_context = -1;
+        }
+        n = c.rewind(BACK);
+        g_frame -= n;
+        st = snapshot(&size);
+        if (n != BACK || size != ref_size ||
+            memcmp(st, ref, size - TRAILER))
+        {
+            fprintf(stderr, "went back %u frames run ahead, to a different "
+                    "state\n", n);
+            rc = 1;
+        }
+        free(st);
+        free(ref);
+        for (i = 0; i < BACK && rc == 0; i++)
+        {
+            run(1);
+            if (real[i] != g_video)
+            {
+                fprintf(stderr, "frame %d differs after rewinding run-ahead\n",
+                        i);
+                rc = 1;
+            }
+        }
+        if (rc == 0)
+            printf("run ahead %d frames: only real frames recorded, "
+                   "rewound IDENTICAL\n", AHEAD);
+    }
+
+    c.unload_game();
+    c.deinit();
+    dlclose(so);
+    if (rc == 0) printf("rewind: ALL PASS\n");
+    return rc;
+}
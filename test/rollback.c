@@ -0,0 +1,321 @@
+/* Rollback ring test for the stella2014 libretro core.
+ *
+ * Runs a two-bank F8 variant of the determinism-test kernel (see
+ * determinism_harness.c), which switches banks at the end of every
+ * frame, with scripted input, saving every frame to the rollback ring,
+ * and verifies that:
+ *
+ *   1. Restoring a frame, in the other bank or in the same one, leaves
+ *      the core in exactly the state retro_serialize() saved at that
+ *      frame, and running on from there draws the same frames.
+ *   2. Restoring a frame forgets the frames after it, and the ring only
+ *      holds as many frames as it has slots.
+ *   3. The same holds on a synthetic CDF ARM cart (see
+ *      arm_cart_determinism.c).
+ *   4. Loading a game empties the ring, saving without a game fails, and
+ *      setting it up with no slots turns it off.
+ *
+ * Usage: rollback <path/to/stella2014_libretro.so>
+ * Exit code 0 on success, 1 on any mismatch or failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include "libretro.h"
+#include "../libretro_ext.h"
+
+#define SLOTS   8
+#define FRAMES  30
+#define TRAILER 28      /* audio-filter trailer: not restored */
+
+/* The determinism-test kernel, which ends each frame by switching to the
+ * other bank (bank 0 with LDA $1FF9, bank 1 with LDA $1FF8) and jumping
+ * back; bank 1 shows Y rather than X as the background colour */
+static const uint8_t rom_code[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,
+    0xE8, 0xA9, 0x02, 0x85, 0x00, 0x85, 0x02, 0x85, 0x02, 0x85, 0x02,
+    0xA9, 0x00, 0x85, 0x00, 0xA9, 0x04, 0x85, 0x15, 0xA9, 0x0F, 0x85,
+    0x19, 0x8A, 0x85, 0x17, 0x85, 0x09, 0xA0, 0x00,
+    0x85, 0x02, 0x88, 0xD0, 0xFB, 0xAD, 0xF9, 0x1F, 0x4C, 0x05, 0xF0,
+};
+#define TXA_OFFSET 0x1C
+#define HOTSPOT_OFFSET 0x29
+
+static void build_f8(uint8_t rom[8192])
+{
+    int b;
+    memset(rom, 0xFF, 8192);
+    for (b = 0; b < 2; b++)
+    {
+        uint8_t *bank = rom + b * 4096;
+        memcpy(bank, rom_code, sizeof(rom_code));
+        bank[0xFFA] = 0x00; bank[0xFFB] = 0xF0;
+        bank[0xFFC] = 0x00; bank[0xFFD] = 0xF0;
+        bank[0xFFE] = 0x00; bank[0xFFF] = 0xF0;
+    }
+    rom[4096 + TXA_OFFSET] = 0x98;          /* TYA */
+    rom[4096 + HOTSPOT_OFFSET] = 0xF8;      /* LDA $1FF8 */
+}
+
+/* CDF0: see arm_cart_determinism.c */
+static void build_cdf(uint8_t rom[32768])
+{
+    int k;
+    memset(rom, 0x00, 32768);
+    for (k = 0; k < 3; k++)
+    {
+        rom[0x40 + k*4 + 0] = 0x43; /* C */
+        rom[0x40 + k*4 + 1] = 0x44; /* D */
+        rom[0x40 + k*4 + 2] = 0x46; /* F */
+        rom[0x40 + k*4 + 3] = 0x00; /* subversion 0 -> CDF0 */
+    }
+    rom[0x808] = 0x70; rom[0x809] = 0x47;   /* BX LR */
+    rom[0x7FFC] = 0x00; rom[0x7FFD] = 0xF0;
+    rom[0x7FFE] = 0x00; rom[0x7FFF] = 0xF0;
+}
+
+static int g_frame;
+static uint64_t g_video;
+
+static bool env_cb(unsigned cmd, void *data)
+{
+    if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT)
+        return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+    return false;
+}
+static void video_cb(const void *d, unsigned w, unsigned h, size_t p)
+{
+    const uint8_t *b = (const uint8_t*)d;
+    size_t i;
+
+    g_video = 1469598103934665603ull;
+    for (i = 0; d && i < h * p; i++)
+        g_video = (g_video ^ b[i]) * 1099511628211ull;
+    (void)w;
+}
+static size_t audio_batch_cb(const int16_t *d, size_t f) { (void)d; return f; }
+static void audio_cb(int16_t l, int16_t r) { (void)l; (void)r; }
+static void input_poll_cb(void) {}
+/* Scripted input: a different joypad bitmask on every frame */
+static int16_t input_state_cb(unsigned port, unsigned device, unsigned index,
+                              unsigned id)
+{
+    int16_t bits = (int16_t)(((g_frame * 7 + port * 3) % 13) << 4);
+    (void)device; (void)index;
+    if (id == RETRO_DEVICE_ID_JOYPAD_MASK)
+        return bits;
+    return (bits >> id) & 1;
+}
+
+static struct {
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+    void (*run)(void);
+    size_t (*serialize_size)(void);
+    bool (*serialize)(void*, size_t);
+    bool (*rollback_setup)(unsigned);
+    bool (*rollback_save)(unsigned);
+    bool (*rollback_load)(unsigned);
+} c;
+
+static struct retro_game_info g_game;
+
+static void start(void)
+{
+    c.unload_game();
+    if (!c.load_game(&g_game))
+    { fprintf(stderr, "load failed\n"); exit(1); }
+    g_frame = 0;
+}
+
+static uint8_t *serialize(size_t *size)
+{
+    uint8_t *st;
+    *size = c.serialize_size();
+    st = (uint8_t*)malloc(*size);
+    if (!st || !c.serialize(st, *size))
+    { fprintf(stderr, "serialize failed\n"); exit(1); }
+    return st;
+}
+
+/* The state retro_serialize() saved and the frame drawn at each frame */
+static uint8_t *g_ref[FRAMES];
+static size_t g_ref_size[FRAMES];
+static uint64_t g_drawn[FRAMES];
+
+/* Runs the game from frame g_frame to 'end', saving every frame to the
+ * ring first; records each frame, or checks it against the record */
+static int run_saving(const char *label, int end, int check)
+{
+    for (; g_frame < end; g_frame++)
+    {
+        if (!c.rollback_save(g_frame))
+        {
+            fprintf(stderr, "%s: saving frame %d failed\n", label, g_frame);
+            return 0;
+        }
+        if (!check)
+            g_ref[g_frame] = serialize(&g_ref_size[g_frame]);
+        c.run();
+        if (!check)
+            g_drawn[g_frame] = g_video;
+        else if (g_drawn[g_frame] != g_video)
+        {
+            fprintf(stderr, "%s: frame %d differs after rolling back\n",
+                    label, g_frame);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Rolls back to 'frame', checks the core is in the state saved there,
+ * and replays up to frame 'end' */
+static int roll_back(const char *label, int frame, int end)
+{
+    uint8_t *st;
+    size_t size;
+    int same;
+
+    if (!c.rollback_load(frame))
+    {
+        fprintf(stderr, "%s: rolling back to frame %d failed\n", label, frame);
+        return 0;
+    }
+    st = serialize(&size);
+    same = size == g_ref_size[frame] &&
+           memcmp(st, g_ref[frame], size - TRAILER) == 0;
+    free(st);
+    if (!same)
+    {
+        fprintf(stderr, "%s: frame %d rolled back to a different state\n",
+                label, frame);
+        return 0;
+    }
+    g_frame = frame;
+    return run_saving(label, end, 1);
+}
+
+/* Runs FRAMES frames, then rolls back to frame 25 (in the other bank
+ * than the last frame run), to frame 22 (in the same one), and checks
+ * what the ring still holds; clears *rc on any mismatch */
+static void check_ring(const char *label, int *rc)
+{
+    int i, ok;
+
+    start();
+    ok = run_saving(label, FRAMES, 0);
+
+    /* 2. Frame 21 has been replaced by frame 29 */
+    if (ok && c.rollback_load(FRAMES - SLOTS - 1))
+    {
+        fprintf(stderr, "%s: rolled back past the ring\n", label);
+        ok = 0;
+    }
+    ok = ok && roll_back(label, 25, 26);
+    if (ok && (c.rollback_load(27) || c.rollback_load(29)))
+    {
+        fprintf(stderr, "%s: rolled back to a frame forgotten\n", label);
+        ok = 0;
+    }
+    ok = ok && run_saving(label, FRAMES, 1);
+    ok = ok && roll_back(label, 22, FRAMES);
+
+    if (ok)
+        printf("%s: rolled back to frames 25 and 22 and %d frames after "
+               "IDENTICAL\n", label, FRAMES - 22);
+    else
+        *rc = 1;
+    for (i = 0; i < FRAMES; i++)
+    {
+        free(g_ref[i]);
+        g_ref[i] = NULL;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t f8[8192];
+    static uint8_t cdf[32768];
+    void *so;
+    int rc = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <core.so>\n", argv[0]);
+        return 1;
+    }
+    so = dlopen(argv[1], RTLD_NOW);
+    if (!so) { fprintf(stderr, "dlopen: %s\n", dlerror()); return 1; }
+
+#define SYM(field, name) \
+    c.field = (__typeof__(c.field))dlsym(so, name); \
+    if (!c.field) { fprintf(stderr, "missing symbol " name "\n"); return 1; }
+    SYM(set_environment,        "retro_set_environment");
+    SYM(set_video_refresh,      "retro_set_video_refresh");
+    SYM(set_audio_sample,       "retro_set_audio_sample");
+    SYM(set_audio_sample_batch, "retro_set_audio_sample_batch");
+    SYM(set_input_poll,         "retro_set_input_poll");
+    SYM(set_input_state,        "retro_set_input_state");
+    SYM(init,                   "retro_init");
+    SYM(deinit,                 "retro_deinit");
+    SYM(load_game,              "retro_load_game");
+    SYM(unload_game,            "retro_unload_game");
+    SYM(run,                    "retro_run");
+    SYM(serialize_size,         "retro_serialize_size");
+    SYM(serialize,              "retro_serialize");
+    SYM(rollback_setup,         "stella2014_rollback_setup");
+    SYM(rollback_save,          "stella2014_rollback_save");
+    SYM(rollback_load,          "stella2014_rollback_load");
+#undef SYM
+
+    build_f8(f8);
+    build_cdf(cdf);
+    c.set_environment(env_cb);
+    c.set_video_refresh(video_cb);
+    c.set_audio_sample(audio_cb);
+    c.set_audio_sample_batch(audio_batch_cb);
+    c.set_input_poll(input_poll_cb);
+    c.set_input_state(input_state_cb);
+    c.init();
+
+    /* 4. No game yet */
+    if (!c.rollback_setup(SLOTS))
+    { fprintf(stderr, "rollback setup failed\n"); return 1; }
+    if (c.rollback_save(0))
+    { fprintf(stderr, "saved a frame without a game\n"); rc = 1; }
+
+    /* 1. and 2. */
+    g_game.path = "embedded.a26";
+    g_game.data = f8;
+    g_game.size = sizeof(f8);
+    check_ring("rollback F8", &rc);
+
+    /* 3. */
+    g_game.data = cdf;
+    g_game.size = sizeof(cdf);
+    check_ring("rollback CDF", &rc);
+
+    /* 4. */
+    start();
+    if (c.rollback_load(22))
+    { fprintf(stderr, "rolled back to a frame of an earlier load\n"); rc = 1; }
+    if (!c.rollback_setup(0) || c.rollback_save(0))
+    { fprintf(stderr, "saved a frame with the ring off\n"); rc = 1; }
+
+    c.unload_game();
+    c.deinit();
+    dlclose(so);
+    if (rc == 0) printf("rollback: ALL PASS\n");
+    return rc;
+}
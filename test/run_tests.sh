@@ -22,9 +22,82 @@ cc -O1 -g -o test/malformed_state test/malformed_state.c \
 cc -O2 -o test/arm_cart_determinism test/arm_cart_determinism.c \
    -I libretro-common/include -ldl
 
+cc -O2 -o test/incremental_state test/incremental_state.c \
+   -I libretro-common/include -ldl
+
+cc -O2 -o test/profile_dump test/profile_dump.c \
+   -I libretro-common/include -ldl
+
+cc -O2 -o test/batch_run test/batch_run.c \
+   -I libretro-common/include -ldl
+
+cc -O2 -o test/resampler test/resampler.c \
+   -I libretro-common/include -ldl
+
+cc -O2 -o test/sound_queue test/sound_queue.c \
+   -I libretro-common/include -ldl
+
+cc -O2 -o test/audio_timing test/audio_timing.c \
+   -I libretro-common/include -ldl
+
+cc -O2 -o test/audio_callback test/audio_callback.c \
+   -I libretro-common/include -ldl
+
+cc -O2 -o test/audio_only test/audio_only.c \
+   -I libretro-common/include -ldl
+
+cc -O2 -o test/arm_music test/arm_music.c \
+   -I libretro-common/include -ldl
+
+cc -O2 -o test/rewind test/rewind.c \
+   -I libretro-common/include -ldl
+
+cc -O2 -o test/snapshot test/snapshot.c \
+   -I libretro-common/include -ldl
+
+cc -O2 -o test/rollback test/rollback.c \
+   -I libretro-common/include -ldl
+
+cc -O2 -o test/state_sections test/state_sections.c \
+   -I libretro-common/include -ldl
+
+cc -O2 -o test/legacy_state test/legacy_state.c \
+   -I libretro-common/include -ldl
+
+cc -O2 -o test/state_file test/state_file.c \
+   -I libretro-common/include -ldl
+
+cc -O2 -rdynamic -o test/state_bench test/state_bench.c \
+   -I libretro-common/include -ldl
+
+c++ -O2 -o test/tiasnd_identity test/tiasnd_identity.cxx \
+   stella/src/emucore/TIASnd.cxx stella/src/emucore/Serializer.cxx \
+   -I stella/src/emucore -I stella/src -I stella/stubs -I stella/src/common \
+   -I libretro-common/include
+
 ./test/determinism_harness "$CORE"
 ./test/malformed_state "$CORE"   # malformed-savestate robustness
 ./test/arm_cart_determinism "$CORE"  # CDF/BUS ARM-mapper determinism
+./test/incremental_state "$CORE"     # dirty-page incremental states
+./test/profile_dump "$CORE" - 600 -q # profiler (PROFILE=1 builds only)
+./test/batch_run "$CORE"             # batch run-frames API
+./test/tiasnd_identity               # run-length TIA sound generator
+./test/resampler "$CORE"             # in-core 44.1/48 kHz resampler
+./test/sound_queue "$CORE"           # sound register queue overflow
+./test/audio_timing "$CORE"          # cycle-exact inline audio
+./test/audio_callback "$CORE"        # threaded audio callback mode
+./test/audio_only "$CORE"            # audio-only rendering
+./test/arm_music "$CORE"             # high-resolution ARM cart music
+./test/rewind "$CORE"                # in-core rewind ring
+./test/snapshot "$CORE"              # in-process snapshots
+./test/rollback "$CORE"              # netplay rollback ring
+./test/state_sections "$CORE"        # sectioned state format
+./test/legacy_state "$CORE"          # states of 32-bit cycle counts
+# Built with HAVE_ZLIB=1, state files must also come out compressed
+ZLIB_ARG=
+[ "${HAVE_ZLIB:-0}" = 1 ] && ZLIB_ARG=--zlib
+./test/state_file "$CORE" $ZLIB_ARG  # compressed state files
+./test/state_bench "$CORE"           # savestate cost, no allocations
 
 if command -v valgrind >/dev/null 2>&1; then
     echo "running under valgrind..."
@@ -34,6 +107,34 @@ if command -v valgrind >/dev/null 2>&1; then
         ./test/malformed_state "$CORE" >/dev/null
     valgrind -q --leak-check=full --error-exitcode=42 \
         ./test/arm_cart_determinism "$CORE" >/dev/null
+    valgrind -q --leak-check=full --error-exitcode=42 \
+        ./test/incremental_state "$CORE" >/dev/null
+    valgrind -q --leak-check=full --error-exitcode=42 \
+        ./test/batch_run "$CORE" >/dev/null
+    valgrind -q --leak-check=full --error-exitcode=42 \
+        ./test/resampler "$CORE" >/dev/null
+    valgrind -q --leak-check=full --error-exitcode=42 \
+        ./test/sound_queue "$CORE" >/dev/null
+    valgrind -q --leak-check=full --error-exitcode=42 \
+        ./test/audio_timing "$CORE" >/dev/null
+    valgrind -q --leak-check=full --error-exitcode=42 \
+        ./test/audio_callback "$CORE" >/dev/null
+    valgrind -q --leak-check=full --error-exitcode=42 \
+        ./test/audio_only "$CORE" >/dev/null
+    valgrind -q --leak-check=full --error-exitcode=42 \
+        ./test/arm_music "$CORE" >/dev/null
+    valgrind -q --leak-check=full --error-exitcode=42 \
+        ./test/rewind "$CORE" >/dev/null
+    valgrind -q --leak-check=full --error-exitcode=42 \
+        ./test/snapshot "$CORE" >/dev/null
+    valgrind -q --leak-check=full --error-exitcode=42 \
+        ./test/rollback "$CORE" >/dev/null
+    valgrind -q --leak-check=full --error-exitcode=42 \
+        ./test/state_sections "$CORE" >/dev/null
+    valgrind -q --leak-check=full --error-exitcode=42 \
+        ./test/legacy_state "$CORE" >/dev/null
+    valgrind -q --leak-check=full --error-exitcode=42 \
+        ./test/state_file "$CORE" $ZLIB_ARG >/dev/null
     echo "valgrind: clean"
 else
     echo "valgrind not found: skipping leak check"
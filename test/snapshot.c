@@ -0,0 +1,417 @@
+/* Snapshot test for the stella2014 libretro core.
+ *
+ * Runs the embedded determinism-test kernel (see determinism_harness.c)
+ * with scripted input and verifies through the exported snapshot entry
+ * points that:
+ *
+ *   1. Restoring a snapshot leaves the core in exactly the state
+ *      retro_serialize() saved when it was taken, and running on from
+ *      there draws the same frames and reaches the same state again.
+ *   2. A snapshot only saves into a buffer of at least
+ *      stella2014_snapshot_size() bytes, and a truncated one is refused.
+ *   3. A snapshot taken before the game was loaded again is refused.
+ *   4. On a synthetic CDF ARM cart (see arm_cart_determinism.c), whose
+ *      RAM restore() only copies the pages that changed, restoring
+ *      snapshots in turn, after running on and after retro_unserialize(),
+ *      always lands on the state saved with them.
+ *   5. On a synthetic MovieCart stream, whose snapshots name the fields
+ *      in its two 4K buffers instead of holding them, restoring reads
+ *      them back to the same state and frames, as in 1.
+ *
+ * Usage: snapshot <path/to/stella2014_libretro.so>
+ * Exit code 0 on success, 1 on any mismatch or failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include "libretro.h"
+#include "../libretro_ext.h"
+
+#define FRAMES  60
+#define AHEAD   30
+#define TRAILER 28      /* audio-filter trailer: not restored */
+#define MVC_FIELD  4096
+#define MVC_FIELDS 600
+
+/* Embedded 4K test ROM: see determinism_harness.c */
+static const uint8_t rom_code[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,
+    0xE8, 0xA9, 0x02, 0x85, 0x00, 0x85, 0x02, 0x85, 0x02, 0x85, 0x02,
+    0xA9, 0x00, 0x85, 0x00, 0xA9, 0x04, 0x85, 0x15, 0xA9, 0x0F, 0x85,
+    0x19, 0x8A, 0x85, 0x17, 0x85, 0x09, 0xA0, 0x00,
+    0x85, 0x02, 0x88, 0xD0, 0xFB, 0x4C, 0x05, 0xF0,
+};
+
+static void build_rom(uint8_t rom[4096])
+{
+    memset(rom, 0xFF, 4096);
+    memcpy(rom, rom_code, sizeof(rom_code));
+    rom[0xFFA] = 0x00; rom[0xFFB] = 0xF0;
+    rom[0xFFC] = 0x00; rom[0xFFD] = 0xF0;
+    rom[0xFFE] = 0x00; rom[0xFFF] = 0xF0;
+}
+
+/* CDF0: see arm_cart_determinism.c */
+static void build_cdf(uint8_t rom[32768])
+{
+    int k;
+    memset(rom, 0x00, 32768);
+    for (k = 0; k < 3; k++)
+    {
+        rom[0x40 + k*4 + 0] = 0x43; /* C */
+        rom[0x40 + k*4 + 1] = 0x44; /* D */
+        rom[0x40 + k*4 + 2] = 0x46; /* F */
+        rom[0x40 + k*4 + 3] = 0x00; /* subversion 0 -> CDF0 */
+    }
+    rom[0x808] = 0x70; rom[0x809] = 0x47;   /* BX LR */
+    rom[0x7FFC] = 0x00; rom[0x7FFD] = 0xF0;
+    rom[0x7FFE] = 0x00; rom[0x7FFF] = 0xF0;
+}
+
+/* MovieCart stream: fields in the original format (no format byte),
+ * each with its frame number and random audio, graphics and colours, all
+ * below 16 (audio bytes index a 16-entry volume table) */
+static int write_mvc(const char *path, uint8_t *first, size_t first_size)
+{
+    static uint8_t field[MVC_FIELD];
+    uint32_t seed = 12345;
+    FILE *f = fopen(path, "wb");
+    int n, i;
+
+    if (!f)
+        return 0;
+    for (n = 0; n < MVC_FIELDS; n++)
+    {
+        for (i = 0; i < MVC_FIELD; i++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            field[i] = (uint8_t)((seed >> 16) & 0x0F);
+        }
+        memcpy(field, "MVC", 4);
+        field[4] = 0;
+        field[6] = (uint8_t)n;
+        if (n == 0)
+            memcpy(first, field, first_size);
+        if (fwrite(field, 1, MVC_FIELD, f) != MVC_FIELD)
+            break;
+    }
+    return fclose(f) == 0 && n == MVC_FIELDS;
+}
+
+static int g_frame;
+static uint64_t g_video;
+
+static bool env_cb(unsigned cmd, void *data)
+{
+    if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT)
+        return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+    return false;
+}
+static void video_cb(const void *d, unsigned w, unsigned h, size_t p)
+{
+    const uint8_t *b = (const uint8_t*)d;
+    size_t i;
+
+    g_video = 1469598103934665603ull;
+    for (i = 0; d && i < h * p; i++)
+        g_video = (g_video ^ b[i]) * 1099511628211ull;
+    (void)w;
+}
+static size_t audio_batch_cb(const int16_t *d, size_t f) { (void)d; return f; }
+static void audio_cb(int16_t l, int16_t r) { (void)l; (void)r; }
+static void input_poll_cb(void) {}
+/* Scripted input: a different joypad bitmask on every frame */
+static int16_t input_state_cb(unsigned port, unsigned device, unsigned index,
+                              unsigned id)
+{
+    int16_t bits = (int16_t)(((g_frame * 7 + port * 3) % 13) << 4);
+    (void)device; (void)index;
+    if (id == RETRO_DEVICE_ID_JOYPAD_MASK)
+        return bits;
+    return (bits >> id) & 1;
+}
+
+static struct {
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+    void (*run)(void);
+    size_t (*serialize_size)(void);
+    bool (*serialize)(void*, size_t);
+    bool (*unserialize)(const void*, size_t);
+    size_t (*snapshot_size)(void);
+    bool (*snapshot)(void*, size_t);
+    bool (*restore)(const void*, size_t);
+} c;
+
+static struct retro_game_info g_game;
+
+static void start(void)
+{
+    c.unload_game();
+    if (!c.load_game(&g_game))
+    { fprintf(stderr, "load failed\n"); exit(1); }
+    g_frame = 0;
+}
+
+static void run(int frames)
+{
+    while (frames--)
+    {
+        c.run();
+        g_frame++;
+    }
+}
+
+static uint8_t *serialize(size_t *size)
+{
+    uint8_t *st;
+    *size = c.serialize_size();
+    st = (uint8_t*)malloc(*size);
+    if (!st || !c.serialize(st, *size))
+    { fprintf(stderr, "serialize failed\n"); exit(1); }
+    return st;
+}
+
+static int same_state(const uint8_t *a, size_t a_size,
+                      const uint8_t *b, size_t b_size)
+{
+    return a_size == b_size && memcmp(a, b, a_size - TRAILER) == 0;
+}
+
+/* Restores 'snap' and checks the core is back in state 'ref' */
+static int restores_to(const uint8_t *snap, size_t snap_size,
+                       const uint8_t *ref, size_t ref_size)
+{
+    uint8_t *st;
+    size_t size;
+    int same;
+
+    if (!c.restore(snap, snap_size))
+        return 0;
+    st = serialize(&size);
+    same = same_state(st, size, ref, ref_size);
+    free(st);
+    return same;
+}
+
+/* Takes a snapshot, runs on AHEAD frames, restores it and checks that
+ * the core is back in the state it was taken in, and runs on drawing the
+ * same frames to the same state; answers the snapshot (NULL if it could
+ * not be taken), and clears *rc on any mismatch */
+static uint8_t *replay(const char *label, size_t *snap_size, int *rc)
+{
+    uint64_t video[AHEAD];
+    size_t size, ref_size, end_size;
+    uint8_t *st, *ref, *end, *snap;
+    int i, frame, ok = 1;
+
+    *snap_size = c.snapshot_size();
+    snap = (uint8_t*)malloc(*snap_size);
+    if (!snap || *snap_size == 0 || !c.snapshot(snap, *snap_size))
+    { fprintf(stderr, "%s: snapshot failed\n", label); free(snap); return NULL; }
+    ref = serialize(&ref_size);
+    frame = g_frame;
+    for (i = 0; i < AHEAD; i++)
+    {
+        run(1);
+        video[i] = g_video;
+    }
+    end = serialize(&end_size);
+
+    if (!c.restore(snap, *snap_size))
+    { fprintf(stderr, "%s: restore failed\n", label); ok = 0; }
+    g_frame = frame;
+    st = serialize(&size);
+    if (ok && !same_state(st, size, ref, ref_size))
+    { fprintf(stderr, "%s: restored a different state\n", label); ok = 0; }
+    free(st);
+    for (i = 0; i < AHEAD && ok; i++)
+    {
+        run(1);
+        if (video[i] != g_video)
+        {
+            fprintf(stderr, "%s: frame %d differs after restoring\n",
+                    label, i);
+            ok = 0;
+        }
+    }
+    if (ok)
+    {
+        st = serialize(&size);
+        if (!same_state(st, size, end, end_size))
+        { fprintf(stderr, "%s: ran on to a different state\n", label); ok = 0; }
+        free(st);
+    }
+    if (ok)
+        printf("%s (%u bytes, state %u): restored state and %d frames "
+               "after IDENTICAL\n", label, (unsigned)*snap_size,
+               (unsigned)ref_size, AHEAD);
+    else
+        *rc = 1;
+    free(ref);
+    free(end);
+    return snap;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t rom[4096];
+    static uint8_t cdf[32768];
+    static uint8_t mvc[MVC_FIELD];
+    char mvc_path[64];
+    size_t size, snap_size;
+    uint8_t *st, *snap;
+    void *so;
+    int rc = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <core.so>\n", argv[0]);
+        return 1;
+    }
+    so = dlopen(argv[1], RTLD_NOW);
+    if (!so) { fprintf(stderr, "dlopen: %s\n", dlerror()); return 1; }
+
+#define SYM(field, name) \
+    c.field = (__typeof__(c.field))dlsym(so, name); \
+    if (!c.field) { fprintf(stderr, "missing symbol " name "\n"); return 1; }
+    SYM(set_environment,        "retro_set_environment");
+    SYM(set_video_refresh,      "retro_set_video_refresh");
+    SYM(set_audio_sample,       "retro_set_audio_sample");
+    SYM(set_audio_sample_batch, "retro_set_audio_sample_batch");
+    SYM(set_input_poll,         "retro_set_input_poll");
+    SYM(set_input_state,        "retro_set_input_state");
+    SYM(init,                   "retro_init");
+    SYM(deinit,                 "retro_deinit");
+    SYM(load_game,              "retro_load_game");
+    SYM(unload_game,            "retro_unload_game");
+    SYM(run,                    "retro_run");
+    SYM(serialize_size,         "retro_serialize_size");
+    SYM(serialize,              "retro_serialize");
+    SYM(unserialize,            "retro_unserialize");
+    SYM(snapshot_size,          "stella2014_snapshot_size");
+    SYM(snapshot,               "stella2014_snapshot");
+    SYM(restore,                "stella2014_restore");
+#undef SYM
+
+    build_rom(rom);
+    c.set_environment(env_cb);
+    c.set_video_refresh(video_cb);
+    c.set_audio_sample(audio_cb);
+    c.set_audio_sample_batch(audio_batch_cb);
+    c.set_input_poll(input_poll_cb);
+    c.set_input_state(input_state_cb);
+    c.init();
+
+    g_game.path = "embedded.a26";
+    g_game.data = rom;
+    g_game.size = sizeof(rom);
+    g_game.meta = NULL;
+    if (!c.load_game(&g_game))
+    { fprintf(stderr, "load failed\n"); return 1; }
+
+    /* 1. */
+    start();
+    run(FRAMES);
+    snap = replay("snapshot", &snap_size, &rc);
+    if (!snap) return 1;
+
+    /* 2. */
+    size = c.snapshot_size();
+    st = (uint8_t*)malloc(size);
+    if (c.snapshot(st, size - 1))
+    { fprintf(stderr, "snapshot saved into a short buffer\n"); rc = 1; }
+    if (!c.snapshot(st, size))
+    { fprintf(stderr, "snapshot failed\n"); rc = 1; }
+    else if (c.restore(st, size - 1))
+    { fprintf(stderr, "restored a truncated snapshot\n"); rc = 1; }
+    else if (!c.restore(st, size))
+    { fprintf(stderr, "restore failed\n"); rc = 1; }
+    free(st);
+
+    /* 3. */
+    start();
+    run(1);
+    if (c.restore(snap, snap_size))
+    { fprintf(stderr, "restored a snapshot of an earlier load\n"); rc = 1; }
+    free(snap);
+
+    /* 4. */
+    {
+        uint8_t *snap_a, *snap_b, *ref_a, *ref_b;
+        size_t ref_a_size, ref_b_size;
+
+        build_cdf(cdf);
+        g_game.data = cdf;
+        g_game.size = sizeof(cdf);
+        start();
+        run(FRAMES);
+        snap_size = c.snapshot_size();
+        snap_a = (uint8_t*)malloc(snap_size);
+        snap_b = (uint8_t*)malloc(snap_size);
+        if (!snap_a || !snap_b || !c.snapshot(snap_a, snap_size))
+        { fprintf(stderr, "CDF snapshot failed\n"); return 1; }
+        ref_a = serialize(&ref_a_size);
+        run(AHEAD);
+        if (!c.snapshot(snap_b, snap_size))
+        { fprintf(stderr, "CDF snapshot failed\n"); return 1; }
+        ref_b = serialize(&ref_b_size);
+
+        if (!restores_to(snap_a, snap_size, ref_a, ref_a_size) ||
+            !restores_to(snap_b, snap_size, ref_b, ref_b_size) ||
+            !restores_to(snap_a, snap_size, ref_a, ref_a_size))
+        { fprintf(stderr, "CDF: restored a different state\n"); rc = 1; }
+        run(AHEAD);
+        if (rc == 0 && !restores_to(snap_a, snap_size, ref_a, ref_a_size))
+        { fprintf(stderr, "CDF: restored a different state after running "
+                  "on\n"); rc = 1; }
+        if (rc == 0 && (!c.unserialize(ref_b, ref_b_size) ||
+                        !restores_to(snap_a, snap_size, ref_a, ref_a_size)))
+        { fprintf(stderr, "CDF: restored a different state after "
+                  "retro_unserialize()\n"); rc = 1; }
+        if (rc == 0)
+            printf("snapshot CDF (%u bytes): restored in turn IDENTICAL\n",
+                   (unsigned)snap_size);
+        free(snap_a);
+        free(snap_b);
+        free(ref_a);
+        free(ref_b);
+    }
+
+    /* 5. Past the title screen (a million cart accesses) */
+    snprintf(mvc_path, sizeof(mvc_path), "/tmp/snapshot_%d.mvc", (int)getpid());
+    if (!write_mvc(mvc_path, mvc, sizeof(mvc)))
+    { fprintf(stderr, "can't write %s\n", mvc_path); return 1; }
+    g_game.path = mvc_path;
+    g_game.data = mvc;
+    g_game.size = sizeof(mvc);
+    start();
+    run(4 * FRAMES);
+    snap = replay("snapshot MVC", &snap_size, &rc);
+    if (snap && snap_size + MVC_FIELD > c.serialize_size())
+    {
+        fprintf(stderr, "MVC snapshot of %u bytes holds the field buffers\n",
+                (unsigned)snap_size);
+        rc = 1;
+    }
+    free(snap);
+    remove(mvc_path);
+    if (!snap) return 1;
+
+    c.unload_game();
+    c.deinit();
+    dlclose(so);
+    if (rc == 0) printf("snapshot: ALL PASS\n");
+    return rc;
+}
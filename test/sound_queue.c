@@ -0,0 +1,254 @@
+/* Sound register queue overflow test for the stella2014 libretro core.
+ *
+ * Runs a ROM that never strobes VSYNC and writes AUDV0/AUDV1 every 3
+ * cycles, so each frame (cut off after 342 scanlines, being detected as
+ * PAL) makes ~8600 sound register writes: more than the fixed-size
+ * register write queue holds. It checks that:
+ *
+ *   1. A state saved mid-frame with the queue full (stopped there with
+ *      stella2014_run_frames()) carries the whole queue, and running on
+ *      from it gives the same audio and state as running on without.
+ *   2. The overflowing run is reproducible from a fresh load.
+ *
+ * Usage: sound_queue <path/to/stella2014_libretro.so>
+ * Exit code 0 on success, 1 on any mismatch or failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include "libretro.h"
+#include "../libretro_ext.h"
+
+#define FRAMES     5
+#define QUEUE_SIZE 8192   /* Sound::RegWriteQueue::kCapacity */
+
+/* Embedded 4K test ROM: 6507 code at $F000.
+ *   AUDC0=4, AUDF0=0, then forever: STA AUDV0 / STA AUDV1 unrolled over
+ *   the rest of the ROM, a write every 3 cycles, with A stepped by 1 at
+ *   the top. Reset/NMI/IRQ vectors -> $F000. */
+static const uint8_t rom_code[] = {
+    0x78,             /* SEI            */
+    0xD8,             /* CLD            */
+    0xA9, 0x04,       /* LDA #$04       */
+    0x85, 0x15,       /* STA AUDC0      */
+    0xA9, 0x00,       /* LDA #$00       */
+    0x85, 0x17,       /* STA AUDF0      */
+    /* loop @ $F00A */
+    0x69, 0x01,       /* ADC #$01       */
+};
+#define LOOP      0x00A
+#define STORES    0x00C
+#define JUMP      0xFF0
+
+static void build_rom(uint8_t rom[4096])
+{
+    int i;
+    memset(rom, 0xFF, 4096);
+    memcpy(rom, rom_code, sizeof(rom_code));
+    for (i = STORES; i < JUMP; i += 2)
+    {
+        rom[i]     = 0x85;                          /* STA           */
+        rom[i + 1] = ((i - STORES) & 2) ? 0x1A : 0x19; /* AUDV1 / AUDV0 */
+    }
+    rom[JUMP] = 0x4C; rom[JUMP + 1] = LOOP; rom[JUMP + 2] = 0xF0;
+    rom[0xFFA] = 0x00; rom[0xFFB] = 0xF0;
+    rom[0xFFC] = 0x00; rom[0xFFD] = 0xF0;
+    rom[0xFFE] = 0x00; rom[0xFFF] = 0xF0;
+}
+
+static uint64_t g_hash;
+static unsigned long g_nonzero;
+
+static uint64_t fnv(uint64_t h, const void *data, size_t size)
+{
+    const uint8_t *p = (const uint8_t*)data;
+    while (size--) { h ^= *p++; h *= 0x100000001b3ull; }
+    return h;
+}
+
+static bool env_cb(unsigned cmd, void *data)
+{
+    if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT)
+        return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+    return false;
+}
+static void video_cb(const void *d, unsigned w, unsigned h, size_t p)
+{ (void)d; (void)w; (void)h; (void)p; }
+static size_t audio_batch_cb(const int16_t *data, size_t frames)
+{
+    size_t i;
+    for (i = 0; i < 2 * frames; i++)
+        if (data[i]) g_nonzero++;
+    g_hash = fnv(g_hash, data, frames * 2 * sizeof(int16_t));
+    return frames;
+}
+static void audio_cb(int16_t l, int16_t r) { (void)l; (void)r; }
+static void input_poll_cb(void) {}
+static int16_t input_state_cb(unsigned a, unsigned b, unsigned c, unsigned d)
+{ (void)a; (void)b; (void)c; (void)d; return 0; }
+
+static struct {
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+    void (*run)(void);
+    size_t (*serialize_size)(void);
+    bool (*serialize)(void*, size_t);
+    bool (*unserialize)(const void*, size_t);
+    bool (*run_frames)(struct stella2014_run*);
+} c;
+
+static struct retro_game_info g_game;
+
+/* Run FRAMES frames; answers the hash of their audio and the end state */
+static uint64_t run_on(void)
+{
+    uint64_t h;
+    size_t size;
+    uint8_t *st;
+    int i;
+
+    g_hash = 0xcbf29ce484222325ull;
+    for (i = 0; i < FRAMES; i++)
+        c.run();
+    size = c.serialize_size();
+    st = (uint8_t*)malloc(size);
+    if (!st || !c.serialize(st, size))
+    { fprintf(stderr, "serialize failed\n"); exit(1); }
+    h = fnv(g_hash, st, size);
+    free(st);
+    return h;
+}
+
+/* Load, run two frames and stop 25000 cycles into the next one */
+static void start(void)
+{
+    struct stella2014_run run;
+
+    c.unload_game();
+    if (!c.load_game(&g_game))
+    { fprintf(stderr, "load failed\n"); exit(1); }
+    c.run();
+
+    memset(&run, 0, sizeof(run));
+    run.frames = 1;
+    c.run_frames(&run);
+    run.frames      = 0;
+    run.until_cycle = run.cycle + 25000;
+    if (!c.run_frames(&run) || !run.partial)
+    { fprintf(stderr, "could not stop mid-frame\n"); exit(1); }
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t rom[4096];
+    size_t full_size, idle_size;
+    uint8_t *st;
+    uint64_t straight, loaded, again;
+    void *so;
+    int rc = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <core.so>\n", argv[0]);
+        return 1;
+    }
+    so = dlopen(argv[1], RTLD_NOW);
+    if (!so) { fprintf(stderr, "dlopen: %s\n", dlerror()); return 1; }
+
+#define SYM(field, name) \
+    c.field = (__typeof__(c.field))dlsym(so, name); \
+    if (!c.field) { fprintf(stderr, "missing symbol " name "\n"); return 1; }
+    SYM(set_environment,        "retro_set_environment");
+    SYM(set_video_refresh,      "retro_set_video_refresh");
+    SYM(set_audio_sample,       "retro_set_audio_sample");
+    SYM(set_audio_sample_batch, "retro_set_audio_sample_batch");
+    SYM(set_input_poll,         "retro_set_input_poll");
+    SYM(set_input_state,        "retro_set_input_state");
+    SYM(init,                   "retro_init");
+    SYM(deinit,                 "retro_deinit");
+    SYM(load_game,              "retro_load_game");
+    SYM(unload_game,            "retro_unload_game");
+    SYM(run,                    "retro_run");
+    SYM(serialize_size,         "retro_serialize_size");
+    SYM(serialize,              "retro_serialize");
+    SYM(unserialize,            "retro_unserialize");
+    SYM(run_frames,             "stella2014_run_frames");
+#undef SYM
+
+    build_rom(rom);
+    c.set_environment(env_cb);
+    c.set_video_refresh(video_cb);
+    c.set_audio_sample(audio_cb);
+    c.set_audio_sample_batch(audio_batch_cb);
+    c.set_input_poll(input_poll_cb);
+    c.set_input_state(input_state_cb);
+    c.init();
+
+    g_game.path = "embedded.a26";
+    g_game.data = rom;
+    g_game.size = sizeof(rom);
+    g_game.meta = NULL;
+    if (!c.load_game(&g_game))
+    { fprintf(stderr, "load failed\n"); return 1; }
+
+    /* 1. the mid-frame state holds a full queue (9 bytes per write) */
+    c.run();
+    idle_size = c.serialize_size();
+    start();
+    full_size = c.serialize_size();
+    if (full_size < idle_size + 9 * (QUEUE_SIZE - 16))
+    {
+        fprintf(stderr, "queue not full: state %u bytes, %u when idle\n",
+                (unsigned)full_size, (unsigned)idle_size);
+        rc = 1;
+    }
+    st = (uint8_t*)malloc(full_size);
+    if (!st || !c.serialize(st, full_size))
+    { fprintf(stderr, "serialize failed\n"); return 1; }
+
+    g_nonzero = 0;
+    straight = run_on();
+    if (!c.unserialize(st, full_size))
+    { fprintf(stderr, "unserialize failed\n"); return 1; }
+    loaded = run_on();
+    if (loaded != straight)
+    {
+        fprintf(stderr, "full queue: %016llx after loading, %016llx without\n",
+                (unsigned long long)loaded, (unsigned long long)straight);
+        rc = 1;
+    }
+    if (!g_nonzero)
+    { fprintf(stderr, "no audio\n"); rc = 1; }
+    free(st);
+
+    /* 2. cross-run */
+    start();
+    again = run_on();
+    if (again != straight)
+    {
+        fprintf(stderr, "cross-run: %016llx vs %016llx\n",
+                (unsigned long long)again, (unsigned long long)straight);
+        rc = 1;
+    }
+
+    if (rc == 0)
+        printf("full queue (%u bytes of state): %016llx DETERMINISTIC\n",
+               (unsigned)(full_size - idle_size),
+               (unsigned long long)straight);
+
+    c.unload_game();
+    c.deinit();
+    dlclose(so);
+    if (rc == 0) printf("sound queue: ALL PASS\n");
+    return rc;
+}
@@ -0,0 +1,348 @@
+/* Savestate cost benchmark for the stella2014 libretro core.
+ *
+ * determinism_harness checks that states round-trip; this measures what
+ * that costs. For the embedded 4K test ROM (see determinism_harness.c)
+ * and a synthetic CDF ARM cart (see arm_cart_determinism.c) it reports
+ *
+ *   - the size of a state,
+ *   - the time and heap allocations of one retro_serialize() and one
+ *     retro_unserialize(), saved as a frontend's save slot would be and
+ *     as a run-ahead frontend's would (without checksums), and
+ *   - the same for a run-ahead loop: save, run one frame, load, and
+ *     for a netplay rollback loop through the core's own ring
+ *     (stella2014_rollback_save() and stella2014_rollback_load()),
+ *
+ * and fails if any of those allocate: state operations write and read
+ * the frontend's buffer in place, and a regression that brings back a
+ * temporary buffer or string shows up here first. Times are reported,
+ * not checked, since they depend on the machine.
+ *
+ * Allocations are counted by interposing malloc() and friends (glibc
+ * only), so the test binary must be linked with -rdynamic for the core
+ * to call them.
+ *
+ * Usage: state_bench <path/to/stella2014_libretro.so> [iterations]
+ * Exit code 0 on success, 1 on any allocation or failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <dlfcn.h>
+#include "libretro.h"
+#include "../libretro_ext.h"
+
+#define WARMUP      60
+#define ITERATIONS  2000
+
+/* - - - allocation counter - - - */
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void*, size_t);
+extern void __libc_free(void*);
+
+static volatile int g_counting;
+static unsigned long g_allocs;
+
+void *malloc(size_t n)
+{
+    if (g_counting) g_allocs++;
+    return __libc_malloc(n);
+}
+void *calloc(size_t n, size_t size)
+{
+    if (g_counting) g_allocs++;
+    return __libc_calloc(n, size);
+}
+void *realloc(void *p, size_t n)
+{
+    if (g_counting) g_allocs++;
+    return __libc_realloc(p, n);
+}
+void free(void *p)
+{
+    __libc_free(p);
+}
+
+/* - - - test ROMs - - - */
+
+/* Embedded 4K test ROM: see determinism_harness.c */
+static const uint8_t rom_code[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,
+    0xE8, 0xA9, 0x02, 0x85, 0x00, 0x85, 0x02, 0x85, 0x02, 0x85, 0x02,
+    0xA9, 0x00, 0x85, 0x00, 0xA9, 0x04, 0x85, 0x15, 0xA9, 0x0F, 0x85,
+    0x19, 0x8A, 0x85, 0x17, 0x85, 0x09, 0xA0, 0x00,
+    0x85, 0x02, 0x88, 0xD0, 0xFB, 0x4C, 0x05, 0xF0,
+};
+
+static void build_4k(uint8_t rom[4096])
+{
+    memset(rom, 0xFF, 4096);
+    memcpy(rom, rom_code, sizeof(rom_code));
+    rom[0xFFA] = 0x00; rom[0xFFB] = 0xF0;
+    rom[0xFFC] = 0x00; rom[0xFFD] = 0xF0;
+    rom[0xFFE] = 0x00; rom[0xFFF] = 0xF0;
+}
+
+/* CDF0: see arm_cart_determinism.c */
+static void build_cdf(uint8_t rom[32768])
+{
+    int k;
+    memset(rom, 0x00, 32768);
+    for (k = 0; k < 3; k++)
+    {
+        rom[0x40 + k*4 + 0] = 0x43; /* C */
+        rom[0x40 + k*4 + 1] = 0x44; /* D */
+        rom[0x40 + k*4 + 2] = 0x46; /* F */
+        rom[0x40 + k*4 + 3] = 0x00; /* subversion 0 -> CDF0 */
+    }
+    rom[0x808] = 0x70; rom[0x809] = 0x47;   /* BX LR */
+    rom[0x7FFC] = 0x00; rom[0x7FFD] = 0xF0;
+    rom[0x7FFE] = 0x00; rom[0x7FFF] = 0xF0;
+}
+
+/* - - - libretro plumbing - - - */
+
+static int g_context = RETRO_SAVESTATE_CONTEXT_NORMAL;
+
+static bool env_cb(unsigned cmd, void *data)
+{
+    if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT)
+        return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+    if (cmd == RETRO_ENVIRONMENT_GET_SAVESTATE_CONTEXT)
+    {
+        *(enum retro_savestate_context*)data =
+            (enum retro_savestate_context)g_context;
+        return true;
+    }
+    return false;
+}
+static void video_cb(const void *d, unsigned w, unsigned h, size_t p)
+{ (void)d; (void)w; (void)h; (void)p; }
+static size_t audio_batch_cb(const int16_t *d, size_t f) { (void)d; return f; }
+static void audio_cb(int16_t l, int16_t r) { (void)l; (void)r; }
+static void input_poll_cb(void) {}
+static int16_t input_state_cb(unsigned a, unsigned b, unsigned c, unsigned d)
+{ (void)a; (void)b; (void)c; (void)d; return 0; }
+
+static struct {
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+    void (*run)(void);
+    size_t (*serialize_size)(void);
+    bool (*serialize)(void*, size_t);
+    bool (*unserialize)(const void*, size_t);
+    bool (*rollback_setup)(unsigned);
+    bool (*rollback_save)(unsigned);
+    bool (*rollback_load)(unsigned);
+} c;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Time and allocations of one call, averaged over 'n' */
+struct cost
+{
+    double us;
+    double allocs;
+};
+
+enum { SAVE, LOAD, LOOP, ROLLBACK };
+
+static int measure(int what, uint8_t *st, size_t size, int n,
+                   struct cost *cost)
+{
+    double t;
+    int i, ok = 1;
+
+    g_allocs = 0;
+    g_counting = 1;
+    t = now();
+    for (i = 0; i < n && ok; i++)
+    {
+        switch (what)
+        {
+            case SAVE:
+                ok = c.serialize(st, size);
+                break;
+            case LOAD:
+                ok = c.unserialize(st, size);
+                break;
+            case LOOP:
+                ok = c.serialize_size() == size && c.serialize(st, size);
+                c.run();
+                ok = ok && c.unserialize(st, size);
+                break;
+            case ROLLBACK:
+                ok = c.rollback_save(i);
+                c.run();
+                ok = ok && c.rollback_load(i);
+                break;
+        }
+    }
+    t = now() - t;
+    g_counting = 0;
+
+    cost->us = t * 1e6 / n;
+    cost->allocs = (double)g_allocs / n;
+    return ok;
+}
+
+/* Benchmarks one ROM; returns 0 if nothing allocated */
+static int bench(const char *label, const uint8_t *rom, size_t rom_size,
+                 int n)
+{
+    static const char *names[] = { "serialize", "unserialize" };
+    static const int contexts[] = {
+        RETRO_SAVESTATE_CONTEXT_NORMAL,
+        RETRO_SAVESTATE_CONTEXT_RUNAHEAD_SAME_INSTANCE
+    };
+    struct retro_game_info game;
+    struct cost cost;
+    size_t size;
+    uint8_t *st;
+    int i, k, rc = 0;
+
+    game.path = "embedded.a26";
+    game.data = rom;
+    game.size = rom_size;
+    game.meta = NULL;
+    g_allocs = 0;
+    g_counting = 1;
+    if (!c.load_game(&game))
+    { fprintf(stderr, "%s: load failed\n", label); return 1; }
+    g_counting = 0;
+    /* Loading a game always allocates: if nothing was counted, the core
+     * isn't calling the malloc() above */
+    if (g_allocs == 0)
+    {
+        fprintf(stderr, "%s: allocations not counted (link with -rdynamic)\n",
+                label);
+        return 1;
+    }
+    for (i = 0; i < WARMUP; i++)
+        c.run();
+
+    size = c.serialize_size();
+    st = (uint8_t*)malloc(size);
+    if (!st)
+    { fprintf(stderr, "%s: out of memory\n", label); return 1; }
+    printf("%s: state %u bytes\n", label, (unsigned)size);
+
+    for (k = 0; k < 2; k++)
+    {
+        g_context = contexts[k];
+        for (i = SAVE; i <= LOAD; i++)
+        {
+            if (!measure(i, st, size, n, &cost))
+            { fprintf(stderr, "%s: %s failed\n", label, names[i]); rc = 1; }
+            printf("  %-11s %-9s %8.2f us %6.2f allocs\n", names[i],
+                   k ? "run-ahead" : "normal", cost.us, cost.allocs);
+            if (cost.allocs != 0)
+                rc = 1;
+        }
+    }
+
+    /* Run-ahead loop, beside a frame alone for reference */
+    if (!measure(LOOP, st, size, n / 10, &cost))
+    { fprintf(stderr, "%s: run-ahead loop failed\n", label); rc = 1; }
+    printf("  save, run 1, load  %8.2f us %6.2f allocs\n",
+           cost.us, cost.allocs);
+    if (cost.allocs != 0)
+        rc = 1;
+    g_context = RETRO_SAVESTATE_CONTEXT_NORMAL;
+
+    /* The same through the rollback ring, allocated as it is set up */
+    if (!c.rollback_setup(8) || !measure(ROLLBACK, st, size, n / 10, &cost))
+    { fprintf(stderr, "%s: rollback loop failed\n", label); rc = 1; }
+    printf("  rollback loop      %8.2f us %6.2f allocs\n",
+           cost.us, cost.allocs);
+    if (cost.allocs != 0)
+        rc = 1;
+    c.rollback_setup(0);
+
+    {
+        double t = now();
+        for (i = 0; i < n / 10; i++)
+            c.run();
+        printf("  run 1 alone        %8.2f us\n", (now() - t) * 1e6 / (n / 10));
+    }
+
+    if (rc)
+        fprintf(stderr, "%s: state operations allocated\n", label);
+    free(st);
+    c.unload_game();
+    return rc;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t rom4k[4096];
+    static uint8_t cdf[32768];
+    void *so;
+    int n = ITERATIONS, rc = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <core.so> [iterations]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 2 && atoi(argv[2]) >= 10)
+        n = atoi(argv[2]);
+    so = dlopen(argv[1], RTLD_NOW);
+    if (!so) { fprintf(stderr, "dlopen: %s\n", dlerror()); return 1; }
+
+#define SYM(field, name) \
+    c.field = (__typeof__(c.field))dlsym(so, name); \
+    if (!c.field) { fprintf(stderr, "missing symbol " name "\n"); return 1; }
+    SYM(set_environment,        "retro_set_environment");
+    SYM(set_video_refresh,      "retro_set_video_refresh");
+    SYM(set_audio_sample,       "retro_set_audio_sample");
+    SYM(set_audio_sample_batch, "retro_set_audio_sample_batch");
+    SYM(set_input_poll,         "retro_set_input_poll");
+    SYM(set_input_state,        "retro_set_input_state");
+    SYM(init,                   "retro_init");
+    SYM(deinit,                 "retro_deinit");
+    SYM(load_game,              "retro_load_game");
+    SYM(unload_game,            "retro_unload_game");
+    SYM(run,                    "retro_run");
+    SYM(serialize_size,         "retro_serialize_size");
+    SYM(serialize,              "retro_serialize");
+    SYM(unserialize,            "retro_unserialize");
+    SYM(rollback_setup,         "stella2014_rollback_setup");
+    SYM(rollback_save,          "stella2014_rollback_save");
+    SYM(rollback_load,          "stella2014_rollback_load");
+#undef SYM
+
+    build_4k(rom4k);
+    build_cdf(cdf);
+    c.set_environment(env_cb);
+    c.set_video_refresh(video_cb);
+    c.set_audio_sample(audio_cb);
+    c.set_audio_sample_batch(audio_batch_cb);
+    c.set_input_poll(input_poll_cb);
+    c.set_input_state(input_state_cb);
+    c.init();
+
+    if (bench("4K", rom4k, sizeof(rom4k), n)) rc = 1;
+    if (bench("CDF", cdf, sizeof(cdf), n)) rc = 1;
+
+    c.deinit();
+    dlclose(so);
+    if (rc == 0) printf("state bench: NO ALLOCATIONS\n");
+    return rc;
+}
@@ -0,0 +1,295 @@
+/* State file test for the stella2014 libretro core.
+ *
+ * Runs the embedded determinism-test kernel (see determinism_harness.c)
+ * with scripted input and verifies that:
+ *
+ *   1. A state file saved at the default level is gzip-compressed (with
+ *      --zlib, for a core built with HAVE_ZLIB; otherwise it is saved
+ *      as at level 0), and loads back the state it was saved from.
+ *   2. At level 0 the file holds exactly what retro_serialize() saves,
+ *      and loads back the same.
+ *   3. A missing file or a truncated one is refused.
+ *   4. A save leaves no temporary file behind, and one that can't be
+ *      written (its temporary name being taken) fails and leaves the
+ *      old file as it was.
+ *
+ * and reports how small the file gets at each level.
+ *
+ * Usage: state_file <path/to/stella2014_libretro.so> [--zlib]
+ * Exit code 0 on success, 1 on any mismatch or failure.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include "libretro.h"
+#include "../libretro_ext.h"
+
+#define FRAMES  60
+#define AHEAD   30
+
+/* Embedded 4K test ROM: see determinism_harness.c */
+static const uint8_t rom_code[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,
+    0xE8, 0xA9, 0x02, 0x85, 0x00, 0x85, 0x02, 0x85, 0x02, 0x85, 0x02,
+    0xA9, 0x00, 0x85, 0x00, 0xA9, 0x04, 0x85, 0x15, 0xA9, 0x0F, 0x85,
+    0x19, 0x8A, 0x85, 0x17, 0x85, 0x09, 0xA0, 0x00,
+    0x85, 0x02, 0x88, 0xD0, 0xFB, 0x4C, 0x05, 0xF0,
+};
+
+static void build_rom(uint8_t rom[4096])
+{
+    memset(rom, 0xFF, 4096);
+    memcpy(rom, rom_code, sizeof(rom_code));
+    rom[0xFFA] = 0x00; rom[0xFFB] = 0xF0;
+    rom[0xFFC] = 0x00; rom[0xFFD] = 0xF0;
+    rom[0xFFE] = 0x00; rom[0xFFF] = 0xF0;
+}
+
+static int g_frame;
+static uint64_t g_video;
+
+static bool env_cb(unsigned cmd, void *data)
+{
+    if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT)
+        return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+    return false;
+}
+static void video_cb(const void *d, unsigned w, unsigned h, size_t p)
+{
+    const uint8_t *b = (const uint8_t*)d;
+    size_t i;
+
+    g_video = 1469598103934665603ull;
+    for (i = 0; d && i < h * p; i++)
+        g_video = (g_video ^ b[i]) * 1099511628211ull;
+    (void)w;
+}
+static size_t audio_batch_cb(const int16_t *d, size_t f) { (void)d; return f; }
+static void audio_cb(int16_t l, int16_t r) { (void)l; (void)r; }
+static void input_poll_cb(void) {}
+/* Scripted input: a different joypad bitmask on every frame */
+static int16_t input_state_cb(unsigned port, unsigned device, unsigned index,
+                              unsigned id)
+{
+    int16_t bits = (int16_t)(((g_frame * 7 + port * 3) % 13) << 4);
+    (void)device; (void)index;
+    if (id == RETRO_DEVICE_ID_JOYPAD_MASK)
+        return bits;
+    return (bits >> id) & 1;
+}
+
+static struct {
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+    void (*run)(void);
+    size_t (*serialize_size)(void);
+    bool (*serialize)(void*, size_t);
+    bool (*save_state_file)(const char*, int);
+    bool (*load_state_file)(const char*);
+} c;
+
+static char g_path[64];
+static int g_zlib;
+
+static uint8_t *serialize(size_t *size)
+{
+    uint8_t *st;
+    *size = c.serialize_size();
+    st = (uint8_t*)malloc(*size);
+    if (!st || !c.serialize(st, *size))
+    { fprintf(stderr, "serialize failed\n"); exit(1); }
+    return st;
+}
+
+/* Whether the core's state is still the one saved in 'ref' */
+static int unchanged(const uint8_t *ref, size_t ref_size)
+{
+    size_t size;
+    uint8_t *st = serialize(&size);
+    int same = size == ref_size && memcmp(st, ref, size) == 0;
+    free(st);
+    return same;
+}
+
+static uint8_t *read_file(size_t *size)
+{
+    FILE *f = fopen(g_path, "rb");
+    uint8_t *data;
+    long len;
+
+    if (!f) { fprintf(stderr, "can't open %s\n", g_path); exit(1); }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = (uint8_t*)malloc(len ? len : 1);
+    if (!data || fread(data, 1, len, f) != (size_t)len)
+    { fprintf(stderr, "can't read %s\n", g_path); exit(1); }
+    fclose(f);
+    *size = (size_t)len;
+    return data;
+}
+
+/* Saves a state file at 'level', moves on, and loads it back */
+static int round_trip(int level, const uint8_t *ref, size_t ref_size,
+                      size_t *file_size)
+{
+    uint8_t *file;
+    int i, ok;
+
+    if (!c.save_state_file(g_path, level))
+    { fprintf(stderr, "level %d: save failed\n", level); return 0; }
+
+    for (i = 0; i < AHEAD; i++)
+        c.run();
+    ok = c.load_state_file(g_path) && unchanged(ref, ref_size);
+    if (!ok)
+        fprintf(stderr, "level %d: loaded a different state\n", level);
+    file = read_file(file_size);
+    if (level != 0 && g_zlib &&
+        (*file_size < 2 || file[0] != 0x1f || file[1] != 0x8b))
+    { fprintf(stderr, "level %d: not compressed\n", level); ok = 0; }
+    if ((level == 0 || !g_zlib) &&
+        (*file_size != ref_size || memcmp(file, ref, ref_size) != 0))
+    { fprintf(stderr, "level %d: not the state as saved\n", level); ok = 0; }
+    free(file);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t rom[4096];
+    static const int levels[] = { -1, 0, 9 };
+    struct retro_game_info game;
+    size_t size, file_size;
+    uint8_t *st, *file;
+    unsigned i;
+    FILE *f;
+    void *so;
+    int rc = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <core.so> [--zlib]\n", argv[0]);
+        return 1;
+    }
+    g_zlib = argc >= 3 && strcmp(argv[2], "--zlib") == 0;
+    so = dlopen(argv[1], RTLD_NOW);
+    if (!so) { fprintf(stderr, "dlopen: %s\n", dlerror()); return 1; }
+
+#define SYM(field, name) \
+    c.field = (__typeof__(c.field))dlsym(so, name); \
+    if (!c.field) { fprintf(stderr, "missing symbol " name "\n"); return 1; }
+    SYM(set_environment,        "retro_set_environment");
+    SYM(set_video_refresh,      "retro_set_video_refresh");
+    SYM(set_audio_sample,       "retro_set_audio_sample");
+    SYM(set_audio_sample_batch, "retro_set_audio_sample_batch");
+    SYM(set_input_poll,         "retro_set_input_poll");
+    SYM(set_input_state,        "retro_set_input_state");
+    SYM(init,                   "retro_init");
+    SYM(deinit,                 "retro_deinit");
+    SYM(load_game,              "retro_load_game");
+    SYM(unload_game,            "retro_unload_game");
+    SYM(run,                    "retro_run");
+    SYM(serialize_size,         "retro_serialize_size");
+    SYM(serialize,              "retro_serialize");
+    SYM(save_state_file,        "stella2014_save_state_file");
+    SYM(load_state_file,        "stella2014_load_state_file");
+#undef SYM
+
+    snprintf(g_path, sizeof(g_path), "/tmp/state_file_%d.st", (int)getpid());
+    build_rom(rom);
+    c.set_environment(env_cb);
+    c.set_video_refresh(video_cb);
+    c.set_audio_sample(audio_cb);
+    c.set_audio_sample_batch(audio_batch_cb);
+    c.set_input_poll(input_poll_cb);
+    c.set_input_state(input_state_cb);
+    c.init();
+
+    game.path = "embedded.a26";
+    game.data = rom;
+    game.size = sizeof(rom);
+    game.meta = NULL;
+    if (!c.load_game(&game))
+    { fprintf(stderr, "load failed\n"); return 1; }
+    for (g_frame = 0; g_frame < FRAMES; g_frame++)
+        c.run();
+
+    /* 1. and 2. */
+    st = serialize(&size);
+    printf("state of %u bytes, as a file:", (unsigned)size);
+    for (i = 0; i < sizeof(levels) / sizeof(levels[0]); i++)
+    {
+        if (!round_trip(levels[i], st, size, &file_size))
+            rc = 1;
+        printf(" level %d %u bytes;", levels[i], (unsigned)file_size);
+    }
+    printf("\n");
+    if (rc == 0)
+        printf("loaded back at every level: IDENTICAL\n");
+
+    /* 3. */
+    if (!c.save_state_file(g_path, -1))
+    { fprintf(stderr, "save failed\n"); rc = 1; }
+    file = read_file(&file_size);
+    f = fopen(g_path, "wb");
+    if (f)
+    {
+        fwrite(file, 1, file_size / 2, f);
+        fclose(f);
+    }
+    free(file);
+    if (c.load_state_file(g_path) || !unchanged(st, size))
+    { fprintf(stderr, "truncated file loaded\n"); rc = 1; }
+    remove(g_path);
+    if (c.load_state_file(g_path))
+    { fprintf(stderr, "missing file loaded\n"); rc = 1; }
+    if (rc == 0)
+        printf("truncated and missing files: refused\n");
+    free(st);
+
+    /* 4. */
+    {
+        char temp[sizeof(g_path) + 4];
+        uint8_t *old;
+        size_t old_size;
+
+        snprintf(temp, sizeof(temp), "%s.tmp", g_path);
+        if (!c.save_state_file(g_path, -1) || access(temp, F_OK) == 0)
+        { fprintf(stderr, "save left %s behind\n", temp); rc = 1; }
+        old = read_file(&old_size);
+        c.run();
+        if (mkdir(temp, 0700) != 0)
+        { fprintf(stderr, "can't make %s\n", temp); return 1; }
+        if (c.save_state_file(g_path, -1))
+        { fprintf(stderr, "save without its temporary file succeeded\n");
+          rc = 1; }
+        file = read_file(&file_size);
+        if (file_size != old_size || memcmp(file, old, old_size) != 0)
+        { fprintf(stderr, "failed save changed the old file\n"); rc = 1; }
+        else
+            printf("failed save: old file kept\n");
+        free(file);
+        free(old);
+        rmdir(temp);
+        remove(g_path);
+    }
+
+    c.unload_game();
+    c.deinit();
+    dlclose(so);
+    if (rc == 0) printf("state files: ALL PASS\n");
+    return rc;
+}
@@ -0,0 +1,292 @@
+/* Sectioned state test for the stella2014 libretro core.
+ *
+ * Runs the embedded determinism-test kernel (see determinism_harness.c)
+ * with scripted input, saves a state, and verifies that:
+ *
+ *   1. Walking the section table as StateManager.cxx documents it finds
+ *      every part, and stella2014_state_section() finds the RIOT's
+ *      section, whose RAM matches the core's system RAM.
+ *   2. A tagged state, as saved before sections (the header strings
+ *      followed by the sections' contents), still loads, to the same
+ *      state.
+ *   3. A damaged section, or one of another version, is refused without
+ *      changing the state, and only that section stops being found.
+ *
+ * Usage: state_sections <path/to/stella2014_libretro.so>
+ * Exit code 0 on success, 1 on any mismatch or failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dlfcn.h>
+#include "libretro.h"
+#include "../libretro_ext.h"
+
+#define FRAMES  60
+
+#define HEADER_SIZE 24  /* see StateManager.cxx */
+#define ENTRY_SIZE  40
+#define NAME_SIZE   24
+
+/* Embedded 4K test ROM: see determinism_harness.c */
+static const uint8_t rom_code[] = {
+    0x78, 0xD8, 0xA2, 0xFF, 0x9A,
+    0xE8, 0xA9, 0x02, 0x85, 0x00, 0x85, 0x02, 0x85, 0x02, 0x85, 0x02,
+    0xA9, 0x00, 0x85, 0x00, 0xA9, 0x04, 0x85, 0x15, 0xA9, 0x0F, 0x85,
+    0x19, 0x8A, 0x85, 0x17, 0x85, 0x09, 0xA0, 0x00,
+    0x85, 0x02, 0x88, 0xD0, 0xFB, 0x4C, 0x05, 0xF0,
+};
+
+static void build_rom(uint8_t rom[4096])
+{
+    memset(rom, 0xFF, 4096);
+    memcpy(rom, rom_code, sizeof(rom_code));
+    rom[0xFFA] = 0x00; rom[0xFFB] = 0xF0;
+    rom[0xFFC] = 0x00; rom[0xFFD] = 0xF0;
+    rom[0xFFE] = 0x00; rom[0xFFF] = 0xF0;
+}
+
+static int g_frame;
+static uint64_t g_video;
+
+static bool env_cb(unsigned cmd, void *data)
+{
+    if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT)
+        return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_RGB565;
+    return false;
+}
+static void video_cb(const void *d, unsigned w, unsigned h, size_t p)
+{
+    const uint8_t *b = (const uint8_t*)d;
+    size_t i;
+
+    g_video = 1469598103934665603ull;
+    for (i = 0; d && i < h * p; i++)
+        g_video = (g_video ^ b[i]) * 1099511628211ull;
+    (void)w;
+}
+static size_t audio_batch_cb(const int16_t *d, size_t f) { (void)d; return f; }
+static void audio_cb(int16_t l, int16_t r) { (void)l; (void)r; }
+static void input_poll_cb(void) {}
+/* Scripted input: a different joypad bitmask on every frame */
+static int16_t input_state_cb(unsigned port, unsigned device, unsigned index,
+                              unsigned id)
+{
+    int16_t bits = (int16_t)(((g_frame * 7 + port * 3) % 13) << 4);
+    (void)device; (void)index;
+    if (id == RETRO_DEVICE_ID_JOYPAD_MASK)
+        return bits;
+    return (bits >> id) & 1;
+}
+
+static struct {
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+    void (*run)(void);
+    size_t (*serialize_size)(void);
+    bool (*serialize)(void*, size_t);
+    bool (*unserialize)(const void*, size_t);
+    void *(*get_memory_data)(unsigned);
+    const void *(*state_section)(const void*, size_t, const char*, size_t*,
+                                 unsigned*);
+} c;
+
+static uint32_t get32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, 4);
+    return p + 4;
+}
+
+static uint8_t *put_string(uint8_t *p, const char *s)
+{
+    p = put32(p, (uint32_t)strlen(s));
+    memcpy(p, s, strlen(s));
+    return p + strlen(s);
+}
+
+static uint8_t *serialize(size_t *size)
+{
+    uint8_t *st;
+    *size = c.serialize_size();
+    st = (uint8_t*)malloc(*size);
+    if (!st || !c.serialize(st, *size))
+    { fprintf(stderr, "serialize failed\n"); exit(1); }
+    return st;
+}
+
+/* Whether the core's state is still the one saved in 'ref' */
+static int unchanged(const uint8_t *ref, size_t ref_size)
+{
+    size_t size;
+    uint8_t *st = serialize(&size);
+    int same = size == ref_size && memcmp(st, ref, size) == 0;
+    free(st);
+    return same;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t rom[4096];
+    struct retro_game_info game;
+    size_t size, ram_len, legacy_size, st2_size;
+    uint8_t *st, *st2, *legacy, *p;
+    const uint8_t *ram, *riot, *tia_entry = NULL;
+    uint32_t count, total, i, off, len;
+    unsigned version;
+    char cart[NAME_SIZE] = "";
+    void *so;
+    int rc = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <core.so>\n", argv[0]);
+        return 1;
+    }
+    so = dlopen(argv[1], RTLD_NOW);
+    if (!so) { fprintf(stderr, "dlopen: %s\n", dlerror()); return 1; }
+
+#define SYM(field, name) \
+    c.field = (__typeof__(c.field))dlsym(so, name); \
+    if (!c.field) { fprintf(stderr, "missing symbol " name "\n"); return 1; }
+    SYM(set_environment,        "retro_set_environment");
+    SYM(set_video_refresh,      "retro_set_video_refresh");
+    SYM(set_audio_sample,       "retro_set_audio_sample");
+    SYM(set_audio_sample_batch, "retro_set_audio_sample_batch");
+    SYM(set_input_poll,         "retro_set_input_poll");
+    SYM(set_input_state,        "retro_set_input_state");
+    SYM(init,                   "retro_init");
+    SYM(deinit,                 "retro_deinit");
+    SYM(load_game,              "retro_load_game");
+    SYM(unload_game,            "retro_unload_game");
+    SYM(run,                    "retro_run");
+    SYM(serialize_size,         "retro_serialize_size");
+    SYM(serialize,              "retro_serialize");
+    SYM(unserialize,            "retro_unserialize");
+    SYM(get_memory_data,        "retro_get_memory_data");
+    SYM(state_section,          "stella2014_state_section");
+#undef SYM
+
+    build_rom(rom);
+    c.set_environment(env_cb);
+    c.set_video_refresh(video_cb);
+    c.set_audio_sample(audio_cb);
+    c.set_audio_sample_batch(audio_batch_cb);
+    c.set_input_poll(input_poll_cb);
+    c.set_input_state(input_state_cb);
+    c.init();
+
+    game.path = "embedded.a26";
+    game.data = rom;
+    game.size = sizeof(rom);
+    game.meta = NULL;
+    if (!c.load_game(&game))
+    { fprintf(stderr, "load failed\n"); return 1; }
+    for (g_frame = 0; g_frame < FRAMES; g_frame++)
+        c.run();
+    st = serialize(&size);
+
+    /* 1. */
+    if (size < HEADER_SIZE || memcmp(st, "STLSECT", 8) != 0)
+    { fprintf(stderr, "state is not sectioned\n"); return 1; }
+    count = get32(st + 12);
+    total = get32(st + 16);
+    printf("%u sections, %u of %u bytes:", count, total, (unsigned)size);
+    for (i = 0; i < count; i++)
+    {
+        const uint8_t *e = st + HEADER_SIZE + i * ENTRY_SIZE;
+        off = get32(e + NAME_SIZE);
+        len = get32(e + NAME_SIZE + 4);
+        printf(" %s(%u)", (const char*)e, len);
+        if (off + len > total)
+        { fprintf(stderr, "\nsection %u out of bounds\n", i); rc = 1; }
+        /* The cart comes right after the TIA */
+        if (i > 0 && strcmp((const char*)e - ENTRY_SIZE, "TIA") == 0)
+            memcpy(cart, e, NAME_SIZE);
+        if (strcmp((const char*)e, "TIA") == 0)
+            tia_entry = e;
+    }
+    printf("\n");
+
+    riot = (const uint8_t*)c.state_section(st, size, "M6532", &ram_len,
+                                           &version);
+    ram = (const uint8_t*)c.get_memory_data(RETRO_MEMORY_SYSTEM_RAM);
+    if (!riot || ram_len < 9 + 128 || version != 1 || !ram ||
+        get32(riot) != 5 || memcmp(riot + 4, "M6532", 5) != 0 ||
+        memcmp(riot + 9, ram, 128) != 0)
+    { fprintf(stderr, "RIOT section doesn't hold the RAM\n"); rc = 1; }
+    else
+        printf("RIOT RAM from its section: IDENTICAL\n");
+    if (!tia_entry || !cart[0] ||
+        c.state_section(st, size, "nonexistent", &ram_len, &version))
+    { fprintf(stderr, "section lookup failed\n"); rc = 1; }
+
+    /* 2. */
+    legacy = (uint8_t*)malloc(size + 64);
+    p = put_string(legacy, "03090200state");
+    p = put_string(p, cart);
+    for (i = 0; i < count; i++)
+    {
+        const uint8_t *e = st + HEADER_SIZE + i * ENTRY_SIZE;
+        memcpy(p, st + get32(e + NAME_SIZE), get32(e + NAME_SIZE + 4));
+        p += get32(e + NAME_SIZE + 4);
+    }
+    memcpy(p, st + total, size - total);     /* audio blocks and trailer */
+    legacy_size = (size_t)(p - legacy) + (size - total);
+
+    c.unload_game();
+    if (!c.load_game(&game))
+    { fprintf(stderr, "load failed\n"); return 1; }
+    if (!c.unserialize(legacy, legacy_size))
+    { fprintf(stderr, "tagged state refused\n"); rc = 1; }
+    else if (!unchanged(st, size))
+    { fprintf(stderr, "tagged state loaded differently\n"); rc = 1; }
+    else
+        printf("tagged state (%u bytes): loads IDENTICAL\n",
+               (unsigned)legacy_size);
+    free(legacy);
+
+    /* 3. */
+    if (tia_entry)
+    {
+        st2 = (uint8_t*)malloc(size);
+        memcpy(st2, st, size);
+        st2_size = size;
+        st2[get32(tia_entry + NAME_SIZE) + 20] ^= 0x40;
+        if (c.unserialize(st2, st2_size) || !unchanged(st, size))
+        { fprintf(stderr, "damaged section loaded\n"); rc = 1; }
+        if (c.state_section(st2, st2_size, "TIA", &ram_len, &version) ||
+            !c.state_section(st2, st2_size, "M6532", &ram_len, &version))
+        { fprintf(stderr, "damage not confined to its section\n"); rc = 1; }
+
+        memcpy(st2, st, size);
+        put32(st2 + (tia_entry - st) + NAME_SIZE + 8, 2);
+        if (c.unserialize(st2, st2_size) || !unchanged(st, size))
+        { fprintf(stderr, "section of another version loaded\n"); rc = 1; }
+        if (rc == 0)
+            printf("damaged section and version mismatch: refused\n");
+        free(st2);
+    }
+    free(st);
+
+    c.unload_game();
+    c.deinit();
+    dlclose(so);
+    if (rc == 0) printf("state sections: ALL PASS\n");
+    return rc;
+}